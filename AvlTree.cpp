@@ -1,62 +1,58 @@
 #include <algorithm>
+#include <assert.h>
+#include <climits>
+#include <cstdlib>
 
 #include "enums.h"
 #include "Limit.h"
 #include "OrderBook.h"
+#include "PriceLevelIterator.h"
 
 
-// Update the root of the AVL tree when a level is deleted
-void OrderBook::updateTreeRoot(Limit* level, OrderCategory orderCategory) {
-    auto& treeRoot = (orderCategory == OrderCategory::Limit) ? ((level->getOrderSide() == OrderSide::Bid) ? bidTree : askTree) 
-        : ((level->getOrderSide() == OrderSide::Bid) ? stopBidTree : stopAskTree);
+// Hook the replacement of a deleted level into its place: either as a child of its parent or as the new root of its AVL tree
+template <OrderSide Side, OrderCategory Category>
+void OrderBook::updateTreeRoot(Limit* level, Limit* replacement) {
+    Limit* parentLevel = level->getParentLimit();
+    if (replacement)
+        replacement->setParentLimit(parentLevel);
 
-    if (level == treeRoot) {
-        if (!treeRoot->getRightChildLimit())
-            treeRoot = treeRoot->getLeftChildLimit();
-        else {
-            // The new root is the leftmost child of the right subtree
-            treeRoot = treeRoot->getRightChildLimit();
-            while (treeRoot->getLeftChildLimit())
-                treeRoot = treeRoot->getLeftChildLimit();
-        }
-    }
+    if (!parentLevel)
+        treeRoot<Side, Category>() = replacement;
+    else if (parentLevel->getLeftChildLimit() == level)
+        parentLevel->setLeftChildLimit(replacement);
+    else
+        parentLevel->setRightChildLimit(replacement);
 }
 
 // Update the book edge (highest bid or lowest ask) when a level is deleted
-void OrderBook::updateBookEdge(Limit* level, OrderCategory orderCategory) {
-    auto& bookEdge = (orderCategory == OrderCategory::Limit) ? ((level->getOrderSide() == OrderSide::Bid) ? highestBid : lowestAsk) 
-        : ((level->getOrderSide() == OrderSide::Bid) ? lowestStopBid : highestStopAsk);
-
-    if (level == bookEdge) {
-        if (level->getOrderSide() == OrderSide::Bid && level->getLeftChildLimit())
-            bookEdge = level->getLeftChildLimit();
-        else if (level->getOrderSide() == OrderSide::Ask && level->getRightChildLimit())
-            bookEdge = level->getRightChildLimit();
-        else
-            bookEdge = level->getParentLimit();
-    }
+template <OrderSide Side, OrderCategory Category>
+void OrderBook::updateBookEdge(Limit* level) {
+    Limit*& edge = bookEdge<Side, Category>();
+    if (level == edge)
+        edge = PriceLevelIterator::nextLevel(level, isMaxEdge<Side, Category>());
 }
 
-// Get the height of a limit level in the AVL tree
+// Get the height of a limit level in the AVL tree; heights are stored in the levels and kept up to date on the insert/delete path
 int OrderBook::getLimitHeight(Limit* limit) const {
-    if (!limit) 
-        return 0;
-    int leftHeight = getLimitHeight(limit->getLeftChildLimit());
-    int rightHeight = getLimitHeight(limit->getRightChildLimit());
-    return 1 + std::max(leftHeight, rightHeight);
+    return limit ? limit->getHeight() : 0;
+}
+
+// Recompute the stored height and subtree aggregates of a limit level from its children's
+void OrderBook::updateLimitHeight(Limit* limit) {
+    limit->setHeight(1 + std::max(getLimitHeight(limit->getLeftChildLimit()), getLimitHeight(limit->getRightChildLimit())));
+    limit->updateSubtreeAggregates();
 }
 
 // Calculate the height difference between left and right subtrees
 int OrderBook::limitHeightDifference(Limit* limit) const {
     if (!limit) 
         return 0;
-    int leftHeight = getLimitHeight(limit->getLeftChildLimit());
-    int rightHeight = getLimitHeight(limit->getRightChildLimit());
-    return leftHeight - rightHeight;
+    return getLimitHeight(limit->getLeftChildLimit()) - getLimitHeight(limit->getRightChildLimit());
 }
 
 // Right rotation for AVL tree balancing
-Limit* OrderBook::rRotate(Limit* parentLimit, OrderCategory orderCategory) {
+template <OrderSide Side, OrderCategory Category>
+Limit* OrderBook::rRotate(Limit* parentLimit) {
     Limit* newParent = parentLimit->getRightChildLimit();
     parentLimit->setRightChildLimit(newParent->getLeftChildLimit());
 
@@ -67,17 +63,18 @@ Limit* OrderBook::rRotate(Limit* parentLimit, OrderCategory orderCategory) {
     newParent->setParentLimit(parentLimit->getParentLimit());
     parentLimit->setParentLimit(newParent);
 
-    if (!newParent->getParentLimit()) {
-        if (orderCategory == OrderCategory::Limit)
-            (parentLimit->getOrderSide() == OrderSide::Bid) ? setBidTree(newParent) : setAskTree(newParent);
-        else
-            (parentLimit->getOrderSide() == OrderSide::Bid) ? setStopBidTree(newParent) : setStopAskTree(newParent);
-    }
+    // Only the two rotated levels change height (and aggregates), the demoted one first as it is now a child of the other
+    updateLimitHeight(parentLimit);
+    updateLimitHeight(newParent);
+
+    if (!newParent->getParentLimit())
+        treeRoot<Side, Category>() = newParent;
     return newParent;
 }
 
 // Left rotation for AVL tree balancing
-Limit* OrderBook::lRotate(Limit* parentLimit, OrderCategory orderCategory) {
+template <OrderSide Side, OrderCategory Category>
+Limit* OrderBook::lRotate(Limit* parentLimit) {
     Limit* newParent = parentLimit->getLeftChildLimit();
     parentLimit->setLeftChildLimit(newParent->getRightChildLimit());
 
@@ -88,46 +85,273 @@ Limit* OrderBook::lRotate(Limit* parentLimit, OrderCategory orderCategory) {
     newParent->setParentLimit(parentLimit->getParentLimit());
     parentLimit->setParentLimit(newParent);
 
-    if (!newParent->getParentLimit()) {
-        if (orderCategory == OrderCategory::Limit)
-            (parentLimit->getOrderSide() == OrderSide::Bid) ? setBidTree(newParent) : setAskTree(newParent);
-        else
-            (parentLimit->getOrderSide() == OrderSide::Bid) ? setStopBidTree(newParent) : setStopAskTree(newParent);
-    }
+    updateLimitHeight(parentLimit);
+    updateLimitHeight(newParent);
+
+    if (!newParent->getParentLimit())
+        treeRoot<Side, Category>() = newParent;
     return newParent;
 }
 
 // Left-right rotation for AVL tree balancing
-Limit* OrderBook::lrRotate(Limit* parentLimit, OrderCategory orderCategory) {
-    parentLimit->setLeftChildLimit(rRotate(parentLimit->getLeftChildLimit(), orderCategory));
-    return lRotate(parentLimit, orderCategory);
+template <OrderSide Side, OrderCategory Category>
+Limit* OrderBook::lrRotate(Limit* parentLimit) {
+    parentLimit->setLeftChildLimit(rRotate<Side, Category>(parentLimit->getLeftChildLimit()));
+    return lRotate<Side, Category>(parentLimit);
 }
 
 // Right-left rotation for AVL tree balancing
-Limit* OrderBook::rlRotate(Limit* parentLimit, OrderCategory orderCategory) {
-    parentLimit->setRightChildLimit(lRotate(parentLimit->getRightChildLimit(), orderCategory));
-    return rRotate(parentLimit, orderCategory);
+template <OrderSide Side, OrderCategory Category>
+Limit* OrderBook::rlRotate(Limit* parentLimit) {
+    parentLimit->setRightChildLimit(lRotate<Side, Category>(parentLimit->getRightChildLimit()));
+    return rRotate<Side, Category>(parentLimit);
 }
 
-// Balance the AVL tree after insertion or deletion
-Limit* OrderBook::balanceTree(Limit* limit, OrderCategory orderCategory) {
+// Balance the AVL tree after insertion or deletion; the children's stored heights must already be up to date
+template <OrderSide Side, OrderCategory Category>
+Limit* OrderBook::balanceTree(Limit* limit) {
+    updateLimitHeight(limit);
     int balanceFactor = limitHeightDifference(limit);
 
     if (balanceFactor > 1) { // Left-heavy
         if (limitHeightDifference(limit->getLeftChildLimit()) >= 0)
-            return lRotate(limit, orderCategory);
+            return lRotate<Side, Category>(limit);
         else
-            return lrRotate(limit, orderCategory);
+            return lrRotate<Side, Category>(limit);
     } 
     else if (balanceFactor < -1) { // Right-heavy
         if (limitHeightDifference(limit->getRightChildLimit()) > 0)
-            return rlRotate(limit, orderCategory);
+            return rlRotate<Side, Category>(limit);
         else
-            return rRotate(limit, orderCategory);
+            return rRotate<Side, Category>(limit);
     }
     return limit;
 }
 
+// The middle level of each range is the root of its subtree: both halves differ by at most one level, their heights by at most one
+Limit* OrderBook::buildLevelTree(Limit** levels, std::size_t count, Limit* parentLevel) {
+    if (count == 0)
+        return nullptr;
+
+    std::size_t middle = count / 2;
+    Limit* root = levels[middle];
+    root->setParentLimit(parentLevel);
+    root->setLeftChildLimit(buildLevelTree(levels, middle, root));
+    root->setRightChildLimit(buildLevelTree(levels + middle + 1, count - middle - 1, root));
+    updateLimitHeight(root);
+    return root;
+}
+
+// Rebalance from a level whose subtree changed up to the root of its tree, hooking every rotated subtree into its parent
+template <OrderSide Side, OrderCategory Category>
+Limit* OrderBook::rebalanceToRoot(Limit* level) {
+    Limit* root = level;
+    while (level != nullptr) {
+        Limit* parentLevel = level->getParentLimit();
+        Limit* subtreeRoot = balanceTree<Side, Category>(level); // Rotations update the tree root themselves
+
+        if (parentLevel != nullptr && subtreeRoot != level) {
+            if (parentLevel->getLeftChildLimit() == level)
+                parentLevel->setLeftChildLimit(subtreeRoot);
+            else
+                parentLevel->setRightChildLimit(subtreeRoot);
+        }
+
+        root = subtreeRoot;
+        level = parentLevel;
+    }
+    return root;
+}
+
+/* Join two detached trees with a level priced between them, in O(|height(left) - height(right)|):
+    middle takes the place of the first subtree, along the inner edge of the taller tree, that is at most one level taller than the other tree */
+template <OrderSide Side, OrderCategory Category>
+Limit* OrderBook::joinLevels(Limit* left, Limit* middle, Limit* right) {
+    int leftHeight = getLimitHeight(left), rightHeight = getLimitHeight(right);
+    Limit* parentLevel = nullptr;
+
+    if (leftHeight > rightHeight + 1) {
+        while (getLimitHeight(left) > rightHeight + 1) {
+            parentLevel = left;
+            left = left->getRightChildLimit();
+        }
+    }
+    else if (rightHeight > leftHeight + 1) {
+        while (getLimitHeight(right) > leftHeight + 1) {
+            parentLevel = right;
+            right = right->getLeftChildLimit();
+        }
+    }
+
+    middle->setLeftChildLimit(left);
+    middle->setRightChildLimit(right);
+    middle->setParentLimit(parentLevel);
+    if (left)
+        left->setParentLimit(middle);
+    if (right)
+        right->setParentLimit(middle);
+    updateLimitHeight(middle);
+
+    if (!parentLevel)
+        return middle;
+    if (leftHeight > rightHeight)
+        parentLevel->setRightChildLimit(middle);
+    else
+        parentLevel->setLeftChildLimit(middle);
+    return rebalanceToRoot<Side, Category>(parentLevel);
+}
+
+// Split a detached tree into the levels priced at or below price and the ones above it; the joins along the search path add up to O(log(M))
+template <OrderSide Side, OrderCategory Category>
+void OrderBook::splitLevels(Limit* root, int price, Limit*& lower, Limit*& upper) {
+    if (!root) {
+        lower = upper = nullptr;
+        return;
+    }
+
+    Limit* leftChild = root->getLeftChildLimit();
+    Limit* rightChild = root->getRightChildLimit();
+    if (leftChild)
+        leftChild->setParentLimit(nullptr);
+    if (rightChild)
+        rightChild->setParentLimit(nullptr);
+
+    if (root->getLimitPrice() <= price) {
+        Limit* rightLower;
+        splitLevels<Side, Category>(rightChild, price, rightLower, upper);
+        lower = joinLevels<Side, Category>(leftChild, root, rightLower);
+    }
+    else {
+        Limit* leftUpper;
+        splitLevels<Side, Category>(leftChild, price, lower, leftUpper);
+        upper = joinLevels<Side, Category>(leftUpper, root, rightChild);
+    }
+}
+
+// Concatenate two detached trees: the lowest level of right is split off it, to join both trees in O(log(M))
+template <OrderSide Side, OrderCategory Category>
+Limit* OrderBook::concatLevels(Limit* left, Limit* right) {
+    if (!left)
+        return right;
+    if (!right)
+        return left;
+
+    Limit* lowest = right;
+    while (lowest->getLeftChildLimit())
+        lowest = lowest->getLeftChildLimit();
+    Limit* rest;
+    splitLevels<Side, Category>(right, lowest->getLimitPrice(), lowest, rest); // lowest is left alone, as a leaf
+    return joinLevels<Side, Category>(left, lowest, rest);
+}
+
+/* Every stop level crossed by the touch is detached from its stop tree with one split: the stop bids at or below the lowest ask,
+    or the stop asks at or above the highest bid. They are listed in triggeredStops from the stop edge inward, unlinked from each other */
+template <OrderSide Side>
+std::size_t OrderBook::extractTriggeredStops() {
+    const bool isBid = (Side == OrderSide::Bid);
+    Limit*& stopTree = treeRoot<Side, OrderCategory::Stop>();
+    Limit*& stopEdge = bookEdge<Side, OrderCategory::Stop>();
+    Limit* touch = bookEdge<oppositeSide(Side), OrderCategory::Limit>();
+
+    triggeredStops.clear();
+    if (!stopEdge || !touch || isBeyond<Side, OrderCategory::Stop>(touch->getLimitPrice(), stopEdge->getLimitPrice()))
+        return 0;
+
+    Limit* lower;
+    Limit* upper;
+    splitLevels<Side, OrderCategory::Stop>(stopTree, isBid ? touch->getLimitPrice() : touch->getLimitPrice() - 1, lower, upper);
+    stopTree = isBid ? upper : lower; // Set last, as rotations in the split may have pointed it at a detached subtree
+
+    Limit* triggered = isBid ? lower : upper;
+    Limit* first = triggered;
+    while (Limit* next = isBid ? first->getLeftChildLimit() : first->getRightChildLimit())
+        first = next;
+    for (Limit* level = first; level != nullptr; level = PriceLevelIterator::nextLevel(level, !isBid))
+        triggeredStops.push_back(level);
+
+    stopEdge = stopTree;
+    while (stopEdge && (isBid ? stopEdge->getLeftChildLimit() : stopEdge->getRightChildLimit()))
+        stopEdge = isBid ? stopEdge->getLeftChildLimit() : stopEdge->getRightChildLimit();
+
+    // Single levels from now on: their share changes stop at themselves, and they can go back to a tree as leaves
+    for (Limit* level : triggeredStops) {
+        level->setParentLimit(nullptr);
+        level->setLeftChildLimit(nullptr);
+        level->setRightChildLimit(nullptr);
+        updateLimitHeight(level);
+    }
+    return triggeredStops.size();
+}
+
+template <OrderSide Side>
+void OrderBook::restoreStopLevels(std::size_t first, std::size_t count) {
+    Limit*& stopTree = treeRoot<Side, OrderCategory::Stop>();
+    Limit*& stopEdge = bookEdge<Side, OrderCategory::Stop>();
+
+    for (std::size_t i = first; i < count; ++i) {
+        Limit* level = triggeredStops[i];
+        stopTree = stopTree ? insertNewLevel<Side, OrderCategory::Stop>(stopTree, level, nullptr) : level;
+        if (!stopEdge || isBeyond<Side, OrderCategory::Stop>(level->getLimitPrice(), stopEdge->getLimitPrice()))
+            stopEdge = level;
+    }
+}
+
+#ifndef NDEBUG
+// Debug-only check of one AVL tree: parent links, price ordering, stored heights and balance. Returns the number of levels
+int OrderBook::checkLevelInvariants(Limit* limit, Limit* parentLevel, long long lowerBound, long long upperBound) const {
+    if (!limit)
+        return 0;
+
+    assert(limit->getParentLimit() == parentLevel && "AVL invariant: broken parent link");
+    assert(limit->getLimitPrice() > lowerBound && limit->getLimitPrice() < upperBound && "AVL invariant: price out of order");
+
+    int leftCount = checkLevelInvariants(limit->getLeftChildLimit(), limit, lowerBound, limit->getLimitPrice());
+    int rightCount = checkLevelInvariants(limit->getRightChildLimit(), limit, limit->getLimitPrice(), upperBound);
+
+    int leftHeight = getLimitHeight(limit->getLeftChildLimit());
+    int rightHeight = getLimitHeight(limit->getRightChildLimit());
+    assert(limit->getHeight() == 1 + std::max(leftHeight, rightHeight) && "AVL invariant: stale stored height");
+    assert(std::abs(leftHeight - rightHeight) <= 1 && "AVL invariant: unbalanced level");
+
+    long long levelShares = 0;
+    int levelOrders = 0;
+    for (Order* order = limit->getHeadOrder(); order != nullptr; order = order->getNextOrder(), ++levelOrders){
+        assert(order->getParentLimit() == limit && "Level invariant: order in another level's chunk");
+        levelShares += order->getOrderShares();
+    }
+    assert(levelShares == limit->getTotalShares() && limit->sumOrderShares() == levelShares && "Level invariant: total shares differ from its orders'");
+    assert(levelOrders == limit->getNumberOfOrders() && "Level invariant: number of orders differs from its queue's");
+    Limit* left = limit->getLeftChildLimit();
+    Limit* right = limit->getRightChildLimit();
+    assert(limit->getSubtreeShares() == levelShares + (left ? left->getSubtreeShares() : 0) + (right ? right->getSubtreeShares() : 0)
+        && "Aggregate invariant: stale subtree shares");
+    assert(limit->getSubtreeNotional() == levelShares * limit->getLimitPrice() + (left ? left->getSubtreeNotional() : 0) + (right ? right->getSubtreeNotional() : 0)
+        && "Aggregate invariant: stale subtree notional");
+
+    return 1 + leftCount + rightCount;
+}
+
+// Debug-only check of the four trees, their book edges and their level maps. Runs in O(M), hence it's never called on the hot path
+void OrderBook::checkTreeInvariants() const {
+    Limit* trees[] = { bidTree, askTree, stopBidTree, stopAskTree };
+    Limit* edges[] = { highestBid, lowestAsk, lowestStopBid, highestStopAsk };
+    bool isMaxEdge[] = { true, false, false, true };
+    int levelCount = 0;
+
+    for (int i = 0; i < 4; ++i) {
+        levelCount += checkLevelInvariants(trees[i], nullptr, LLONG_MIN, LLONG_MAX);
+
+        Limit* edge = trees[i];
+        while (edge && (isMaxEdge[i] ? edge->getRightChildLimit() : edge->getLeftChildLimit()))
+            edge = isMaxEdge[i] ? edge->getRightChildLimit() : edge->getLeftChildLimit();
+        assert(edge == edges[i] && "AVL invariant: stale book edge");
+    }
+
+    assert(levelCount == (int)(limitBidMap.size() + limitAskMap.size() + stopBidMap.size() + stopAskMap.size()) && "AVL invariant: level maps and trees disagree");
+    (void)levelCount;
+}
+#endif
+
 void OrderBook::traverseAndDisplay(Limit* root, bool reverseOrder, bool isStop) const {
     // Traverse the AVL tree and print orders
     if (!root) 
@@ -173,4 +397,78 @@ void OrderBook::printLimitOrders(Limit* limit, bool isStop) const {
         current = current->getNextOrder();
     }
     std::cout << "---------------------------------" << std::endl;
-}
\ No newline at end of file
+}
+
+void OrderBook::hashLevels(Limit* root, uint64_t& hash) const {
+    // In-order traversal: levels by ascending price, orders by time priority within a level
+    if (!root)
+        return;
+
+    hashLevels(root->getLeftChildLimit(), hash);
+    for (Order* order = root->getHeadOrder(); order != nullptr; order = order->getNextOrder()){
+        int fields[3] = { order->getOrderId(), order->getLimitPrice(), order->getOrderShares() };
+        for (int field : fields)
+            for (int byte = 0; byte < 4; ++byte){ // FNV-1a
+                hash ^= (uint64_t)(((uint32_t)field >> (8 * byte)) & 0xFF);
+                hash *= 1099511628211ULL;
+            }
+    }
+    hashLevels(root->getRightChildLimit(), hash);
+}
+
+long long OrderBook::getSharesAvailable(OrderSide aggressorSide, int limitPrice) const {
+    // Walk down the opposite tree: at a reachable level, the level and its subtree on the better side are all reachable
+    bool ascending = (aggressorSide == OrderSide::Bid); // Asks are reached from the lowest price up
+    Limit* level = ascending ? askTree : bidTree;
+    long long shares = 0;
+
+    while (level != nullptr){
+        bool reachable = ascending ? level->getLimitPrice() <= limitPrice : level->getLimitPrice() >= limitPrice;
+        Limit* better = ascending ? level->getLeftChildLimit() : level->getRightChildLimit();
+        Limit* worse = ascending ? level->getRightChildLimit() : level->getLeftChildLimit();
+        if (reachable){
+            shares += level->getTotalShares() + (better ? better->getSubtreeShares() : 0);
+            level = worse;
+        }
+        else
+            level = better;
+    }
+    return shares;
+}
+
+OrderBook::ImpactEstimate OrderBook::estimateImpact(OrderSide aggressorSide, long long shares) const {
+    // Walk down the opposite tree to the level where the last share fills, adding up whole subtrees on the better side
+    bool ascending = (aggressorSide == OrderSide::Bid);
+    Limit* level = ascending ? askTree : bidTree;
+    Limit* bookEdge = ascending ? lowestAsk : highestBid;
+
+    ImpactEstimate estimate = { 0, 0, 0, 0, 0.0, 0.0 };
+    long long remaining = shares;
+    while (level != nullptr && remaining > 0){
+        Limit* better = ascending ? level->getLeftChildLimit() : level->getRightChildLimit();
+        Limit* worse = ascending ? level->getRightChildLimit() : level->getLeftChildLimit();
+        long long betterShares = better ? better->getSubtreeShares() : 0;
+
+        if (remaining <= betterShares){
+            level = better;
+            continue;
+        }
+        remaining -= betterShares;
+        estimate.notional += better ? better->getSubtreeNotional() : 0;
+
+        long long levelShares = std::min(remaining, (long long)level->getTotalShares());
+        estimate.notional += levelShares * level->getLimitPrice();
+        remaining -= levelShares;
+        if (levelShares > 0)
+            estimate.worstPrice = level->getLimitPrice(); // Later fills are always at worse prices
+        level = worse;
+    }
+
+    estimate.filledShares = shares - remaining;
+    if (estimate.filledShares > 0){
+        estimate.bestPrice = bookEdge->getLimitPrice();
+        estimate.averagePrice = (double)estimate.notional / estimate.filledShares;
+        estimate.impactCost = ascending ? estimate.averagePrice - estimate.bestPrice : estimate.bestPrice - estimate.averagePrice;
+    }
+    return estimate;
+}
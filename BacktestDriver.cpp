@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#endif
+
+#include "Backtester.h"
+#include "OrderBook.h"
+#include "ReplayFile.h"
+
+/* Example strategy: quotes quoteShares on both sides at the touch, requoting when the touch moves, and flattens its position with
+    a market order once it reaches maxPosition. Its P&L is marked at the mid price at the end of the session */
+class TouchQuoteStrategy {
+public:
+    struct Result {
+        long long position;     // Shares bought - shares sold
+        long long cash;         // Notional received - notional paid
+        long long pnl;          // cash + position * final mid price
+        uint64_t fills;
+        uint64_t tradedShares;
+
+        inline bool operator==(const Result& other) const {
+            return position == other.position && cash == other.cash && pnl == other.pnl && fills == other.fills && tradedShares == other.tradedShares;
+        }
+    };
+
+private:
+    struct Quote {
+        int orderId; // 0 if the side isn't quoted
+        int price;
+        int shares;  // Remaining
+    };
+
+    int quoteShares;
+    int maxPosition;
+    Quote quotes[2]; // By side
+    int lastMid;
+    Result result;
+
+    void requote(OrderSide orderSide, int touchPrice, StrategyOrders& orders) {
+        Quote& quote = quotes[(int)orderSide];
+        if (quote.orderId != 0 && quote.price != touchPrice) {
+            orders.cancelOrder(quote.orderId);
+            quote.orderId = 0;
+        }
+        bool positionFull = (orderSide == OrderSide::Bid) ? result.position >= maxPosition : result.position <= -maxPosition;
+        if (quote.orderId == 0 && !positionFull) {
+            quote.orderId = orders.addLimitOrder(orderSide, touchPrice, quoteShares);
+            quote.price = touchPrice;
+            quote.shares = quoteShares;
+        }
+    }
+
+public:
+    explicit TouchQuoteStrategy(int _quoteShares = 10, int _maxPosition = 200) : quoteShares(_quoteShares), maxPosition(_maxPosition), lastMid(0) {
+        quotes[0].orderId = quotes[1].orderId = 0;
+        result.position = result.cash = result.pnl = 0;
+        result.fills = result.tradedShares = 0;
+    }
+
+    void onBookUpdate(const OrderBook& book, StrategyOrders& orders) {
+        if (!book.getHighestBid() || !book.getLowestAsk())
+            return;
+        int bestBid = book.getHighestBid()->getLimitPrice(), bestAsk = book.getLowestAsk()->getLimitPrice();
+        lastMid = bestBid + (bestAsk - bestBid) / 2;
+
+        if (result.position >= maxPosition || result.position <= -maxPosition)
+            orders.addMarketOrder((result.position > 0) ? OrderSide::Ask : OrderSide::Bid, (int)std::abs(result.position));
+        requote(OrderSide::Bid, bestBid, orders);
+        requote(OrderSide::Ask, bestAsk, orders);
+    }
+
+    void onFill(int orderId, OrderSide orderSide, int price, int shares, StrategyOrders&) {
+        long long signedShares = (orderSide == OrderSide::Bid) ? shares : -shares;
+        result.position += signedShares;
+        result.cash -= signedShares * price;
+        ++result.fills;
+        result.tradedShares += shares;
+
+        Quote& quote = quotes[(int)orderSide];
+        if (orderId == quote.orderId && (quote.shares -= shares) == 0)
+            quote.orderId = 0;
+    }
+
+    void onCancel(int, int, StrategyOrders&) {} // Only its own requotes & the rest of its market orders
+
+    void onSessionEnd(const OrderBook&) { result.pnl = result.cash + result.position * lastMid; }
+
+    inline Result getResult() const { return result; }
+};
+
+// Writes sessions to replay in parallel, and backtests TouchQuoteStrategy over a directory of sessions
+class BacktestDriver {
+public:
+    typedef Backtester<TouchQuoteStrategy> QuoteBacktester;
+
+    // Everything but the duration & thread
+    static bool sameResult(const QuoteBacktester::SessionResult& a, const QuoteBacktester::SessionResult& b) {
+        return a.completed == b.completed && a.messages == b.messages && a.strategyOrders == b.strategyOrders && a.strategyFills == b.strategyFills
+               && a.bookChecksum == b.bookChecksum && a.strategy == b.strategy;
+    }
+
+    // num_sessions clustered sessions of different seeds, from num_messages / 2 to 5 * num_messages / 4 messages long
+    static int write_sessions(const std::string& directory, int num_sessions, int num_messages) {
+        try {
+#if defined(__unix__) || defined(__APPLE__)
+            mkdir(directory.c_str(), 0755); // Fails harmlessly if it exists
+#endif
+            uint64_t written = 0;
+            for (int session = 0; session < num_sessions; ++session) {
+                int messages = num_messages / 2 + num_messages / 4 * (session % 4);
+                char name[32];
+                std::snprintf(name, sizeof(name), "/session_%05d.lob", session);
+                ReplayFile::write(directory + name, OrderBookBenchmark::generate_clustered_commands(messages, 1000 + session));
+                written += messages;
+            }
+            std::cout << "Wrote " << num_sessions << " sessions (" << written << " messages) to " << directory << "\n";
+            return 0;
+        }
+        catch (const std::exception& error) {
+            std::cerr << error.what() << "\n";
+            return 1;
+        }
+    }
+
+    /* With num_threads, backtests the sessions once and prints every session's result. Without (0), backtests them from 1 thread up to
+        one per core: every run must give the same results as the single-threaded one */
+    static int run_backtest(const std::string& directory, int num_threads) {
+        try {
+            std::vector<std::string> paths = listSessionFiles(directory);
+            if (paths.empty()) {
+                std::cerr << "No session in " << directory << "\n";
+                return 1;
+            }
+
+            std::vector<unsigned> threadCounts;
+            unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+            if (num_threads > 0)
+                threadCounts.push_back((unsigned)num_threads);
+            else {
+                for (unsigned threads = 1; threads < cores; threads *= 2)
+                    threadCounts.push_back(threads);
+                threadCounts.push_back(cores);
+            }
+
+            std::vector<QuoteBacktester::SessionResult> reference;
+            double referenceSeconds = 0;
+            for (unsigned threads : threadCounts) {
+                QuoteBacktester backtester(threads);
+                auto start = std::chrono::high_resolution_clock::now();
+                std::vector<QuoteBacktester::SessionResult> results = backtester.run(paths, TouchQuoteStrategy());
+                double seconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count() / 1e9;
+
+                uint64_t messages = 0, fills = 0, failed = 0, steals = 0;
+                long long pnl = 0;
+                for (const QuoteBacktester::SessionResult& result : results) {
+                    messages += result.messages;
+                    fills += result.strategyFills;
+                    failed += !result.completed;
+                    pnl += result.strategy.pnl;
+                }
+                for (std::size_t worker = 0; worker < backtester.getPool().getThreadCount(); ++worker)
+                    steals += backtester.getPool().getWorkerStats(worker).steals;
+
+                bool sameResults = true;
+                if (reference.empty()) {
+                    reference = results;
+                    referenceSeconds = seconds;
+                }
+                for (std::size_t i = 0; i < results.size(); ++i)
+                    sameResults = sameResults && sameResult(results[i], reference[i]);
+
+                std::cout << "Threads: " << threads << " | " << results.size() << " sessions, " << messages << " messages in " << (long long)(seconds * 1000)
+                          << "ms (" << results.size() / seconds << " sessions/s, " << messages / seconds << " messages/s, x" << referenceSeconds / seconds
+                          << ") | " << steals << " steals | Strategy: " << fills << " fills, P&L " << pnl << " | " << failed << " failed, "
+                          << (sameResults ? "same" : "DIFFERENT") << " results\n";
+
+                if (num_threads > 0)
+                    for (const QuoteBacktester::SessionResult& result : results) {
+                        std::cout << "  " << result.path << ": ";
+                        if (!result.completed)
+                            std::cout << "failed (" << result.error << ")\n";
+                        else
+                            std::cout << result.messages << " messages, " << result.strategyOrders << " strategy orders, " << result.strategyFills
+                                      << " fills, position " << result.strategy.position << ", P&L " << result.strategy.pnl
+                                      << " | Checksum: 0x" << std::hex << result.bookChecksum << std::dec << "\n";
+                    }
+            }
+            return 0;
+        }
+        catch (const std::exception& error) {
+            std::cerr << error.what() << "\n";
+            return 1;
+        }
+    }
+};
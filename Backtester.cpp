@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+#include "Backtester.h"
+#include "Clock.h"
+#include "ReplayFile.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+int StrategyOrders::addLimitOrder(OrderSide orderSide, int limitPrice, int shares, TimeInForce tif) {
+    CommandType type = (tif == TimeInForce::IOC) ? CommandType::AddLimitIOC : (tif == TimeInForce::FOK) ? CommandType::AddLimitFOK : CommandType::AddLimit;
+    pending.push_back(makeCommand(type, orderSide, nextOrderId, limitPrice, shares));
+    ++submittedOrders;
+    return nextOrderId--;
+}
+
+int StrategyOrders::addStopOrder(OrderSide orderSide, int stopPrice, int shares) {
+    pending.push_back(makeCommand(CommandType::AddStop, orderSide, nextOrderId, stopPrice, shares));
+    ++submittedOrders;
+    return nextOrderId--;
+}
+
+int StrategyOrders::addMarketOrder(OrderSide orderSide, int shares) {
+    int widestPrice = (orderSide == OrderSide::Bid) ? std::numeric_limits<int>::max() : std::numeric_limits<int>::min();
+    return addLimitOrder(orderSide, widestPrice, shares, TimeInForce::IOC);
+}
+
+void StrategyOrders::cancelOrder(int orderId, OrderCategory orderCategory) {
+    pending.push_back(makeCommand((orderCategory == OrderCategory::Limit) ? CommandType::CancelLimit : CommandType::CancelStop, OrderSide::Bid, orderId, 0, 0));
+    ++submittedOrders;
+}
+
+void StrategyOrders::modifyOrder(int orderId, int newShares, int newPrice, OrderCategory orderCategory) {
+    pending.push_back(makeCommand((orderCategory == OrderCategory::Limit) ? CommandType::ModifyLimit : CommandType::ModifyStop, OrderSide::Bid, orderId, newPrice, newShares));
+    ++submittedOrders;
+}
+
+template <typename Strategy>
+class Backtester<Strategy>::SessionListener {
+private:
+    Strategy& strategy;
+    StrategyOrders& orders;
+    uint64_t& strategyFills;
+
+public:
+    SessionListener(Strategy& _strategy, StrategyOrders& _orders, uint64_t& _strategyFills) : strategy(_strategy), orders(_orders), strategyFills(_strategyFills) {}
+
+    inline void onAck(int, OrderSide, int, int) {}
+    inline void onFill(int aggressorOrderId, int restingOrderId, OrderSide aggressorSide, int price, int shares, int) {
+        // Both sides of a trade may be the strategy's, e.g: its market order reaching its own quote
+        if (StrategyOrders::isStrategyOrder(aggressorOrderId)) {
+            ++strategyFills;
+            strategy.onFill(aggressorOrderId, aggressorSide, price, shares, orders);
+        }
+        if (StrategyOrders::isStrategyOrder(restingOrderId)) {
+            ++strategyFills;
+            strategy.onFill(restingOrderId, (aggressorSide == OrderSide::Bid) ? OrderSide::Ask : OrderSide::Bid, price, shares, orders);
+        }
+    }
+    inline void onCancel(int orderId, OrderSide, int, int shares) {
+        if (StrategyOrders::isStrategyOrder(orderId))
+            strategy.onCancel(orderId, shares, orders);
+    }
+    inline void onBatchBegin() {}
+    inline void onBatchEnd() {}
+};
+
+template <typename Strategy>
+Backtester<Strategy>::Backtester(std::size_t numberOfThreads, std::size_t _batchSize) : pool(numberOfThreads), batchSize(std::max<std::size_t>(_batchSize, 1)) {}
+
+template <typename Strategy>
+void Backtester<Strategy>::runSession(const std::string& path, const Strategy& prototype, SessionResult& result) const {
+    ReplayFile file(path);
+    OrderBook book(file.getMessageCount() / 4, 4096);
+    ReplayClock clock; // Same timestamps whatever the thread running the session
+    book.setClock(&clock);
+
+    Strategy strategy(prototype);
+    StrategyOrders orders;
+    std::vector<OrderCommand> strategyCommands;
+    SessionListener listener(strategy, orders, result.strategyFills);
+
+    const OrderCommand* commands = file.getCommands();
+    std::size_t count = file.getMessageCount();
+    for (std::size_t first = 0; first < count; first += batchSize) {
+        book.processBatch(commands + first, std::min(batchSize, count - first), listener);
+        strategy.onBookUpdate(book, orders);
+        // Orders submitted from onFill & onCancel while these are matched wait for the next batch
+        if (orders.hasPending()) {
+            orders.takePending(strategyCommands);
+            book.processBatch(strategyCommands.data(), strategyCommands.size(), listener);
+        }
+    }
+    strategy.onSessionEnd(book);
+
+    result.messages = count;
+    result.strategyOrders = orders.getSubmittedOrders();
+    result.bookChecksum = book.getChecksum();
+    result.strategy = strategy.getResult();
+    result.completed = true;
+}
+
+template <typename Strategy>
+std::vector<typename Backtester<Strategy>::SessionResult> Backtester<Strategy>::run(const std::vector<std::string>& paths, const Strategy& prototype) {
+    std::vector<SessionResult> results(paths.size());
+
+    /* Longest sessions first (by file size), dealt round-robin over the threads' initial ranges (see WorkStealingPool::run): every thread
+        starts with its share of long & short sessions, and the short ones, at the back of the ranges, are left to be stolen at the end */
+    std::vector<std::pair<long long, std::size_t>> sizes; // (-size, path index)
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+        std::ifstream in(paths[i].c_str(), std::ios::binary | std::ios::ate);
+        sizes.push_back(std::make_pair(in ? -(long long)in.tellg() : 0LL, i));
+    }
+    std::sort(sizes.begin(), sizes.end());
+    std::size_t numberOfThreads = pool.getThreadCount();
+    std::vector<std::size_t> schedule;
+    schedule.reserve(paths.size());
+    for (std::size_t thread = 0; thread < numberOfThreads; ++thread)
+        for (std::size_t i = thread; i < sizes.size(); i += numberOfThreads)
+            schedule.push_back(sizes[i].second);
+
+    pool.run(schedule.size(), [&](std::size_t task, std::size_t worker) {
+        std::size_t index = schedule[task];
+        SessionResult& result = results[index];
+        result.path = paths[index];
+        result.completed = false;
+        result.messages = result.strategyOrders = result.strategyFills = result.bookChecksum = 0;
+        result.strategy = StrategyResult();
+        result.worker = worker;
+
+        auto start = std::chrono::steady_clock::now();
+        try {
+            runSession(paths[index], prototype, result);
+        }
+        catch (const std::exception& error) {
+            result.completed = false;
+            result.error = error.what();
+        }
+        result.durationNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    });
+    return results;
+}
+
+std::vector<std::string> listSessionFiles(const std::string& directory) {
+    std::vector<std::string> paths;
+#if defined(__unix__) || defined(__APPLE__)
+    DIR* dir = opendir(directory.c_str());
+    if (!dir)
+        throw std::runtime_error("Cannot open directory " + directory);
+    while (dirent* entry = readdir(dir)) {
+        std::string path = directory + "/" + entry->d_name;
+        struct stat fileStat;
+        if (stat(path.c_str(), &fileStat) == 0 && S_ISREG(fileStat.st_mode))
+            paths.push_back(path);
+    }
+    closedir(dir);
+#else
+    throw std::runtime_error("Listing " + directory + " isn't supported on this platform");
+#endif
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
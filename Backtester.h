@@ -0,0 +1,99 @@
+#ifndef BACKTESTER_H
+#define BACKTESTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "enums.h"
+#include "OrderBook.h"
+#include "OrderCommand.h"
+#include "WorkStealingPool.h"
+
+/* Orders a strategy submits during a backtest session, matched right after the callback submitting them returns.
+    Strategy orders get negative ids (-1, -2...), hence they never collide with the session's (positive) ids and their reports are told apart */
+class StrategyOrders {
+private:
+    std::vector<OrderCommand> pending;
+    int nextOrderId;
+    uint64_t submittedOrders;
+
+public:
+    StrategyOrders() : nextOrderId(-1), submittedOrders(0) {}
+
+    static inline bool isStrategyOrder(int orderId) { return orderId < 0; }
+
+    // Return the id of the new order
+    int addLimitOrder(OrderSide orderSide, int limitPrice, int shares, TimeInForce tif = TimeInForce::GTC);
+    int addStopOrder(OrderSide orderSide, int stopPrice, int shares);
+    int addMarketOrder(OrderSide orderSide, int shares); // An IOC limit order at the widest price: unlike a market order, it has an id, hence its fills are reported to the strategy
+    void cancelOrder(int orderId, OrderCategory orderCategory = OrderCategory::Limit);
+    void modifyOrder(int orderId, int newShares, int newPrice, OrderCategory orderCategory = OrderCategory::Limit);
+
+    // Backtester only: moves the pending orders to commands (cleared first)
+    inline void takePending(std::vector<OrderCommand>& commands) {
+        commands.clear();
+        commands.swap(pending);
+    }
+    inline bool hasPending() const { return !pending.empty(); }
+    inline uint64_t getSubmittedOrders() const { return submittedOrders; }
+};
+
+// Outcome of one session; everything but durationNs & worker only depends on the session file and the strategy
+template <typename StrategyResult>
+struct BacktestResult {
+    std::string path;
+    bool completed;           // false if the session file couldn't be replayed, see error
+    std::string error;
+    uint64_t messages;        // Replayed messages
+    uint64_t strategyOrders;  // Orders, cancels & modifications submitted by the strategy
+    uint64_t strategyFills;   // Fills of the strategy's orders
+    uint64_t bookChecksum;    // OrderBook::getChecksum at the end of the session
+    StrategyResult strategy;
+    uint64_t durationNs;
+    std::size_t worker;       // Thread that ran the session
+};
+
+/* Replays many recorded sessions (see ReplayFile.h) in parallel, each one against a strategy: every session gets its own OrderBook,
+    ReplayClock and copy of the strategy, and runs from start to end on a single thread of a WorkStealingPool. The sessions are dealt
+    to the threads longest first and idle threads steal the sessions left to the others. Each session writes its own slot of the results,
+    indexed like the paths, hence there's no lock (nor shared state) on the hot path and the results don't depend on the number of threads.
+    The session's messages are matched in batches of batchSize (see OrderBook::processBatch), each batch followed by the strategy's turn.
+    A session is a single book: instrumentIds are ignored.
+
+    Strategy is a template parameter, like the book's listeners (see ExecutionEvents.h), and implements:
+        Strategy(const Strategy&): one copy of the prototype per session
+        onBookUpdate(const OrderBook& book, StrategyOrders& orders): after every batch of the session's messages
+        onFill(orderId, side, price, shares, StrategyOrders& orders): one of its orders traded; side is its order's side
+        onCancel(orderId, shares, StrategyOrders& orders): one of its orders left the book without trading shares (IOC, cancel...)
+        onSessionEnd(const OrderBook& book)
+        Result getResult() const, Result being a copyable type
+    Orders submitted from a callback are matched after it returns (after the strategy's orders being matched for onFill & onCancel) */
+template <typename Strategy>
+class Backtester {
+public:
+    typedef typename Strategy::Result StrategyResult;
+    typedef BacktestResult<StrategyResult> SessionResult;
+
+private:
+    class SessionListener; // Routes the reports of the strategy's orders to the strategy
+
+    WorkStealingPool pool;
+    std::size_t batchSize;
+
+    void runSession(const std::string& path, const Strategy& prototype, SessionResult& result) const;
+
+public:
+    explicit Backtester(std::size_t numberOfThreads, std::size_t batchSize = 64);
+
+    // One result per path, in the order of paths. Sessions that fail (e.g: invalid files) are reported as not completed
+    std::vector<SessionResult> run(const std::vector<std::string>& paths, const Strategy& prototype);
+
+    inline const WorkStealingPool& getPool() const { return pool; }
+};
+
+// Paths of the regular files of a directory, sorted by name. Throws std::runtime_error if the directory can't be read
+std::vector<std::string> listSessionFiles(const std::string& directory);
+
+#endif
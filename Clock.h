@@ -0,0 +1,58 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <chrono>
+#include <cstdint>
+
+#include "CycleCounter.h"
+
+/* Nanosecond clocks stamping the orders of a book (see OrderBook::setClock):
+    TscClock (the default) reads the CPU's time-stamp counter, ReplayClock returns times set by the caller for deterministic runs */
+class Clock {
+public:
+    virtual ~Clock() {}
+    virtual uint64_t now() = 0; // Nanoseconds
+};
+
+// Nanoseconds since the epoch from the TSC: the TSC frequency is calibrated against the steady clock at construction
+class TscClock : public Clock {
+private:
+    uint64_t baseCycles;
+    uint64_t baseNanoseconds; // System time at baseCycles
+    double nanosecondsPerCycle;
+
+public:
+    explicit TscClock(int calibrationMs = 10) : nanosecondsPerCycle(1.0 / cyclesPerNanosecond(calibrationMs)) {
+        baseNanoseconds = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        baseCycles = readCycles();
+    }
+
+    inline uint64_t now() override { return baseNanoseconds + (uint64_t)((readCycles() - baseCycles) * nanosecondsPerCycle); }
+    inline double getNanosecondsPerCycle() const { return nanosecondsPerCycle; }
+};
+
+// Deterministic clock: returns the time it was set to, then advances by step nanoseconds at every read (0 for a fixed time)
+class ReplayClock : public Clock {
+private:
+    uint64_t time;
+    uint64_t step;
+
+public:
+    explicit ReplayClock(uint64_t startTime = 0, uint64_t _step = 1) : time(startTime), step(_step) {}
+
+    inline uint64_t now() override {
+        uint64_t current = time;
+        time += step;
+        return current;
+    }
+    inline void setTime(uint64_t newTime) { time = newTime; } // e.g: the capture time of the next replayed message
+    inline void advance(uint64_t nanoseconds) { time += nanoseconds; }
+};
+
+// Shared by the books that weren't given a clock; calibrated once, on first use
+inline Clock& defaultClock() {
+    static TscClock clock;
+    return clock;
+}
+
+#endif
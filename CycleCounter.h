@@ -0,0 +1,63 @@
+#ifndef CYCLECOUNTER_H
+#define CYCLECOUNTER_H
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define LOB_HAS_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define LOB_HAS_TSC 1
+#endif
+
+/* Cycle-accurate timing of short code sections with the CPU's time-stamp counter (TSC).
+    readCyclesStart() and readCyclesEnd() are fenced so that the timed section can't move around them.
+    Without a TSC (non-x86 CPUs), both fall back to the steady clock in nanoseconds and cyclesPerNanosecond() is 1. */
+
+// Unfenced read, for timestamps rather than for timing a code section
+inline uint64_t readCycles() {
+#if defined(LOB_HAS_TSC)
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline uint64_t readCyclesStart() {
+#if defined(LOB_HAS_TSC)
+    _mm_lfence(); // Previous instructions complete before the counter is read
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline uint64_t readCyclesEnd() {
+#if defined(LOB_HAS_TSC)
+    unsigned int auxiliary;
+    uint64_t cycles = __rdtscp(&auxiliary); // Waits for the timed instructions to complete
+    _mm_lfence(); // Following instructions start after the counter is read
+    return cycles;
+#else
+    return readCyclesStart();
+#endif
+}
+
+// Measures the TSC frequency against the steady clock over calibrationMs milliseconds (busy wait)
+inline double cyclesPerNanosecond(int calibrationMs = 50) {
+#if defined(LOB_HAS_TSC)
+    auto start = std::chrono::steady_clock::now();
+    uint64_t startCycles = readCyclesStart();
+    while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(calibrationMs)) {}
+    uint64_t endCycles = readCyclesEnd();
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    return (double)(endCycles - startCycles) / elapsed;
+#else
+    (void)calibrationMs;
+    return 1.0;
+#endif
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef EXECUTIONEVENTS_H
+#define EXECUTIONEVENTS_H
+
+#include <cstdint>
+#include <thread>
+
+#include "enums.h"
+#include "SpscQueue.h"
+
+/* Execution reports of the matching code. OrderBook's order methods take the listener as a template parameter,
+    hence calls to a listener are resolved (and inlined) at compile time, and NullEventListener compiles to nothing.
+    A listener implements:
+        onAck(orderId, side, price, shares): an order (or its remaining shares) now rests in the book, or was amended
+        onFill(aggressorOrderId, restingOrderId, aggressorSide, price, shares, restingRemainingShares): a trade
+        onCancel(orderId, side, price, shares): an order left the book without trading its remaining shares
+        onBatchBegin() & onBatchEnd(): called around OrderBook::processBatch, e.g: to publish a batch's events at once
+    Market orders have no id, their aggressorOrderId is 0.
+    Rejects aren't reported by the book: a gateway sends them for the commands it refuses, with the command's fields. */
+
+enum class EventType : uint8_t {
+    Ack,
+    Fill,
+    Cancel,
+    Reject   // A refused command: orderId, side, price & shares as received
+};
+
+struct ExecutionEvent { // Fixed-size record, 24 bytes
+    EventType type;
+    OrderSide side;          // Aggressor side for fills, order side otherwise
+    int orderId;             // Aggressor for fills
+    int restingOrderId;      // Fills only
+    int price;
+    int shares;              // Traded, resting or cancelled shares
+    int remainingShares;     // Fills: shares left in the resting order; rejects: the refused command's CommandType
+};
+
+struct NullEventListener {
+    inline void onAck(int, OrderSide, int, int) {}
+    inline void onFill(int, int, OrderSide, int, int, int) {}
+    inline void onCancel(int, OrderSide, int, int) {}
+    inline void onBatchBegin() {}
+    inline void onBatchEnd() {}
+};
+
+// Ring of events: the matching thread pushes, one consumer thread pops (see SpscQueue.h)
+typedef SpscQueue<ExecutionEvent> EventRingBuffer;
+
+// What RingBufferListener does with an event when the ring is full
+enum class FullRingPolicy : uint8_t {
+    Wait, // Publish the pending events & wait for the consumer to make room: no event is lost, the matcher is slowed down to the consumer's pace
+    Drop  // Drop the event & count it (see getDroppedEvents): the matcher never waits, for consumers that can do without some events
+};
+
+// Default listener: writes every event to a ring buffer, waiting for the consumer when it falls behind (see FullRingPolicy)
+// Events of a batch are published to the consumer once, at the end of the batch, or when the ring fills up. With FullRingPolicy::Wait,
+// the consumer must run on another thread, or empty the ring often enough (e.g: between batches smaller than the ring)
+class RingBufferListener {
+private:
+    EventRingBuffer& ring;
+    FullRingPolicy policy;
+    uint64_t droppedEvents;
+    uint64_t fullRingWaits;
+    bool inBatch;
+
+    inline void push(EventType type, OrderSide side, int orderId, int restingOrderId, int price, int shares, int remainingShares) {
+        ExecutionEvent event = { type, side, orderId, restingOrderId, price, shares, remainingShares };
+        if (ring.tryPush(event, !inBatch))
+            return;
+        if (policy == FullRingPolicy::Drop) {
+            ++droppedEvents;
+            return;
+        }
+        ++fullRingWaits;
+        ring.publish(); // The consumer may be waiting for the events of this batch
+        while (!ring.tryPush(event, !inBatch))
+            std::this_thread::yield();
+    }
+
+public:
+    explicit RingBufferListener(EventRingBuffer& _ring, FullRingPolicy _policy = FullRingPolicy::Wait)
+        : ring(_ring), policy(_policy), droppedEvents(0), fullRingWaits(0), inBatch(false) {}
+
+    inline void onAck(int orderId, OrderSide side, int price, int shares) { push(EventType::Ack, side, orderId, 0, price, shares, 0); }
+    inline void onFill(int aggressorOrderId, int restingOrderId, OrderSide aggressorSide, int price, int shares, int restingRemainingShares) {
+        push(EventType::Fill, aggressorSide, aggressorOrderId, restingOrderId, price, shares, restingRemainingShares);
+    }
+    inline void onCancel(int orderId, OrderSide side, int price, int shares) { push(EventType::Cancel, side, orderId, 0, price, shares, 0); }
+    inline void onBatchBegin() { inBatch = true; }
+    inline void onBatchEnd() { inBatch = false; ring.publish(); }
+
+    inline uint64_t getDroppedEvents() const { return droppedEvents; } // FullRingPolicy::Drop only
+    inline uint64_t getFullRingWaits() const { return fullRingWaits; } // Events that waited for room, FullRingPolicy::Wait only
+};
+
+#endif
@@ -0,0 +1,520 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Gateway.h"
+
+namespace {
+    const uint64_t listenToken = 0; // epoll data of the listening socket & of the eventfd; connections have ids from 2 on
+    const uint64_t wakeToken = 1;
+
+    bool isAdd(CommandType type) {
+        return type == CommandType::AddLimit || type == CommandType::AddStop || type == CommandType::AddLimitIOC || type == CommandType::AddLimitFOK;
+    }
+
+    // Records are checked before they reach the book: the book trusts its callers (e.g: positive shares)
+    bool isValidCommand(const OrderCommand& command) {
+        bool validSide = command.side == OrderSide::Bid || command.side == OrderSide::Ask;
+        switch (command.type) {
+            case CommandType::AddLimit:
+            case CommandType::AddStop:
+            case CommandType::AddLimitIOC:
+            case CommandType::AddLimitFOK: return validSide && command.orderId != 0 && command.shares > 0;
+            case CommandType::Market: return validSide && command.shares > 0;
+            case CommandType::CancelLimit:
+            case CommandType::CancelStop: return true;
+            case CommandType::ModifyLimit:
+            case CommandType::ModifyStop: return command.shares > 0;
+            default: return false; // Checkpoints are journal records, not orders
+        }
+    }
+}
+
+// Reports of the matching thread, to the connections owning their orders
+class Gateway::ReportListener {
+private:
+    Gateway& gateway;
+
+    static inline ExecutionEvent makeEvent(EventType type, OrderSide side, int orderId, int restingOrderId, int price, int shares, int remainingShares) {
+        ExecutionEvent event;
+        std::memset(&event, 0, sizeof(event)); // Padding included, as the record is sent as is
+        event.type = type;
+        event.side = side;
+        event.orderId = orderId;
+        event.restingOrderId = restingOrderId;
+        event.price = price;
+        event.shares = shares;
+        event.remainingShares = remainingShares;
+        return event;
+    }
+
+    inline uint32_t ownerOf(int orderId) const {
+        if (orderId == 0) // Market order
+            return currentConnection;
+        auto it = gateway.orderOwners.find(orderId);
+        return (it == gateway.orderOwners.end()) ? currentConnection : it->second;
+    }
+
+public:
+    uint32_t currentConnection; // Sender of the commands being matched
+    bool reported;              // Since the network thread was last woken up
+    std::vector<int> aggressorIds; // Of the fills since the last batch: e.g: a triggered stop that fills completely leaves the book without any cancel
+
+    explicit ReportListener(Gateway& _gateway) : gateway(_gateway), currentConnection(0), reported(false) {}
+
+    inline void onAck(int orderId, OrderSide side, int price, int shares) {
+        gateway.pushReport(ownerOf(orderId), makeEvent(EventType::Ack, side, orderId, 0, price, shares, 0));
+        reported = true;
+    }
+
+    inline void onFill(int aggressorOrderId, int restingOrderId, OrderSide aggressorSide, int price, int shares, int restingRemainingShares) {
+        ExecutionEvent event = makeEvent(EventType::Fill, aggressorSide, aggressorOrderId, restingOrderId, price, shares, restingRemainingShares);
+        uint32_t aggressorOwner = ownerOf(aggressorOrderId);
+        gateway.pushReport(aggressorOwner, event);
+        if (aggressorOrderId != 0)
+            aggressorIds.push_back(aggressorOrderId);
+
+        auto resting = gateway.orderOwners.find(restingOrderId);
+        if (resting != gateway.orderOwners.end()) {
+            if (resting->second != aggressorOwner)
+                gateway.pushReport(resting->second, event);
+            if (restingRemainingShares == 0) // The resting order left the book
+                gateway.orderOwners.erase(resting);
+        }
+        reported = true;
+    }
+
+    inline void onCancel(int orderId, OrderSide side, int price, int shares) {
+        gateway.pushReport(ownerOf(orderId), makeEvent(EventType::Cancel, side, orderId, 0, price, shares, 0));
+        if (orderId != 0)
+            gateway.orderOwners.erase(orderId);
+        reported = true;
+    }
+
+    // Sent to the sender of the command being matched
+    inline void onReject(const OrderCommand& command) {
+        gateway.pushReport(currentConnection, makeEvent(EventType::Reject, command.side, command.orderId, 0, command.price, command.shares, (int)command.type));
+        reported = true;
+    }
+
+    inline void onBatchBegin() {}
+    inline void onBatchEnd() {}
+};
+
+Gateway::Gateway(uint16_t _port, std::size_t queueCapacity, std::size_t orderCapacity)
+    : inbound(queueCapacity), outbound(queueCapacity), book(orderCapacity, 4096), listenFd(-1), epollFd(-1), wakeFd(-1), port(_port),
+      running(false), nextConnectionId(2), acceptedConnections(0), openConnections(0), receivedCommands(0), refusedCommands(0), sentReports(0), droppedReports(0) {
+    listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    epollFd = ::epoll_create1(0);
+    wakeFd = ::eventfd(0, EFD_NONBLOCK);
+    if (listenFd < 0 || epollFd < 0 || wakeFd < 0) {
+        std::string error = std::strerror(errno);
+        closeSockets();
+        throw std::runtime_error("Cannot set up the gateway: " + error);
+    }
+
+    int reuse = 1;
+    ::setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(_port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addressLength = sizeof(address);
+
+    epoll_event listenEvent, wakeEvent;
+    listenEvent.events = wakeEvent.events = EPOLLIN;
+    listenEvent.data.u64 = listenToken;
+    wakeEvent.data.u64 = wakeToken;
+    if (::bind(listenFd, (sockaddr*)&address, sizeof(address)) < 0 || ::listen(listenFd, SOMAXCONN) < 0
+        || ::getsockname(listenFd, (sockaddr*)&address, &addressLength) < 0
+        || ::epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &listenEvent) < 0 || ::epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &wakeEvent) < 0) {
+        std::string error = std::strerror(errno);
+        closeSockets();
+        throw std::runtime_error("Cannot listen on port " + std::to_string(_port) + ": " + error);
+    }
+    port = ntohs(address.sin_port);
+}
+
+Gateway::~Gateway() {
+    stop();
+    closeSockets();
+}
+
+void Gateway::closeSockets() {
+    for (auto& entry : connections)
+        ::close(entry.second->fd);
+    connections.clear();
+    for (int fd : { listenFd, epollFd, wakeFd })
+        if (fd >= 0)
+            ::close(fd);
+    listenFd = epollFd = wakeFd = -1;
+}
+
+void Gateway::start() {
+    if (running.exchange(true))
+        return;
+    matchingThread = std::thread(&Gateway::runMatching, this);
+    networkThread = std::thread(&Gateway::runNetwork, this);
+}
+
+void Gateway::stop() {
+    if (!running.exchange(false))
+        return;
+    uint64_t wake = 1;
+    if (::write(wakeFd, &wake, sizeof(wake)) < 0) {} // The network thread also sees running within its epoll timeout
+    if (networkThread.joinable())
+        networkThread.join();
+    if (matchingThread.joinable())
+        matchingThread.join(); // Once the commands queued are matched; their reports, and the backlog, are dropped
+}
+
+Gateway::Stats Gateway::getStats() const {
+    Stats stats;
+    stats.connections = (std::size_t)openConnections.load(std::memory_order_relaxed);
+    stats.acceptedConnections = acceptedConnections.load(std::memory_order_relaxed);
+    stats.receivedCommands = receivedCommands.load(std::memory_order_relaxed);
+    stats.refusedCommands = refusedCommands.load(std::memory_order_relaxed);
+    stats.sentReports = sentReports.load(std::memory_order_relaxed);
+    stats.droppedReports = droppedReports.load(std::memory_order_relaxed);
+    return stats;
+}
+
+
+// Network thread
+void Gateway::runNetwork() {
+    const int maxEvents = 64;
+    epoll_event events[maxEvents];
+
+    while (running.load(std::memory_order_acquire)) {
+        int count = ::epoll_wait(epollFd, events, maxEvents, backlog.empty() ? 100 : 1); // The backlog is retried every millisecond
+        for (int i = 0; i < count; ++i) {
+            uint64_t token = events[i].data.u64;
+            if (token == listenToken)
+                acceptConnections();
+            else if (token == wakeToken) {
+                uint64_t wakes;
+                if (::read(wakeFd, &wakes, sizeof(wakes)) < 0) {} // Reset the eventfd, the reports are drained below
+                deliverReports();
+            }
+            else {
+                auto it = connections.find((uint32_t)token);
+                if (it == connections.end())
+                    continue;
+                Connection& connection = *it->second;
+                if ((events[i].events & EPOLLOUT) && !sendPending(connection))
+                    continue;
+                if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !connection.readingPaused)
+                    receive(connection);
+            }
+        }
+        flushBacklog();
+        inbound.publish(); // Once per round of events, for the records of every connection
+    }
+}
+
+void Gateway::acceptConnections() {
+    while (true) {
+        int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK);
+        if (fd < 0)
+            return; // EAGAIN: no more pending connections (or a connection aborted before being accepted)
+
+        int noDelay = 1; // Reports are small & latency-sensitive
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        std::unique_ptr<Connection> connection(new Connection());
+        connection->fd = fd;
+        connection->id = nextConnectionId++;
+        connection->receiveBuffer.reset(new char[receiveBufferSize]);
+        connection->receivedBytes = 0;
+        connection->sentBytes = 0;
+        connection->waitingWritable = false;
+        connection->readingPaused = false;
+
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = connection->id;
+        if (::epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            ::close(fd);
+            continue;
+        }
+        connections.emplace(connection->id, std::move(connection));
+        acceptedConnections.fetch_add(1, std::memory_order_relaxed);
+        openConnections.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool Gateway::receive(Connection& connection) {
+    char* buffer = connection.receiveBuffer.get();
+    while (true) {
+        ssize_t bytes = ::recv(connection.fd, buffer + connection.receivedBytes, receiveBufferSize - connection.receivedBytes, 0);
+        if (bytes == 0 || (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            closeConnection(connection);
+            return false;
+        }
+        if (bytes < 0) {
+            if (errno == EINTR)
+                continue;
+            return true;
+        }
+        connection.receivedBytes += (std::size_t)bytes;
+
+        // Whole records are used in place from the buffer, a partial record is moved to its start for the next read
+        const OrderCommand* commands = reinterpret_cast<const OrderCommand*>(buffer);
+        std::size_t count = connection.receivedBytes / sizeof(OrderCommand);
+        for (std::size_t i = 0; i < count; ++i) {
+            InboundCommand queued = { connection.id, commands[i], !isValidCommand(commands[i]) };
+            pushCommand(queued);
+        }
+        receivedCommands.fetch_add(count, std::memory_order_relaxed);
+
+        std::size_t usedBytes = count * sizeof(OrderCommand);
+        std::memmove(buffer, buffer + usedBytes, connection.receivedBytes - usedBytes);
+        connection.receivedBytes -= usedBytes;
+
+        if (!backlog.empty()) { // The matching thread is behind: the rest stays in the socket until the backlog is queued
+            connection.readingPaused = true;
+            pausedConnections.push_back(connection.id);
+            updateEvents(connection);
+            return true;
+        }
+    }
+}
+
+bool Gateway::sendPending(Connection& connection) {
+    while (connection.sentBytes < connection.sendBuffer.size()) {
+        ssize_t bytes = ::send(connection.fd, connection.sendBuffer.data() + connection.sentBytes,
+                               connection.sendBuffer.size() - connection.sentBytes, MSG_NOSIGNAL);
+        if (bytes > 0)
+            connection.sentBytes += (std::size_t)bytes;
+        else if (bytes < 0 && errno == EINTR)
+            continue;
+        else if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!connection.waitingWritable) { // The rest is sent once the socket has room
+                connection.waitingWritable = true;
+                updateEvents(connection);
+            }
+            return true;
+        }
+        else {
+            closeConnection(connection);
+            return false;
+        }
+    }
+
+    connection.sendBuffer.clear();
+    connection.sentBytes = 0;
+    if (connection.waitingWritable) {
+        connection.waitingWritable = false;
+        updateEvents(connection);
+    }
+    return true;
+}
+
+void Gateway::updateEvents(Connection& connection) {
+    epoll_event event;
+    event.events = (connection.readingPaused ? 0u : (uint32_t)EPOLLIN) | (connection.waitingWritable ? (uint32_t)EPOLLOUT : 0u);
+    event.data.u64 = connection.id;
+    ::epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+}
+
+void Gateway::pushCommand(const InboundCommand& command) {
+    // Never waits for the matching thread, which may itself be waiting for the reports this thread delivers
+    if (backlog.empty() && inbound.tryPush(command, false))
+        return;
+    backlog.push_back(command);
+}
+
+void Gateway::flushBacklog() {
+    while (!backlog.empty() && inbound.tryPush(backlog.front(), false))
+        backlog.pop_front();
+    if (!backlog.empty())
+        return;
+    for (uint32_t connectionId : pausedConnections) { // Data left in their sockets is reported by the next epoll_wait
+        auto it = connections.find(connectionId);
+        if (it != connections.end()) {
+            it->second->readingPaused = false;
+            updateEvents(*it->second);
+        }
+    }
+    pausedConnections.clear();
+}
+
+void Gateway::closeConnection(Connection& connection) {
+    // A checkpoint, which clients can't send (see isValidCommand), follows its last command: the matching thread then cancels its resting orders
+    InboundCommand disconnect = { connection.id, makeCommand(CommandType::Checkpoint, OrderSide::Bid, 0, 0, 0), false };
+    pushCommand(disconnect);
+    ::epoll_ctl(epollFd, EPOLL_CTL_DEL, connection.fd, nullptr);
+    ::close(connection.fd);
+    openConnections.fetch_sub(1, std::memory_order_relaxed);
+    connections.erase(connection.id);
+}
+
+void Gateway::deliverReports() {
+    // Reports are appended to their connections' send buffers, then every connection that got some is flushed once
+    std::vector<uint32_t> flushed;
+    uint64_t sent = 0, dropped = 0;
+    outbound.drain([&](const OutboundReport& report) {
+        auto it = connections.find(report.connectionId);
+        if (it == connections.end()) {
+            ++dropped;
+            return;
+        }
+        std::vector<char>& buffer = it->second->sendBuffer;
+        if (buffer.empty())
+            flushed.push_back(report.connectionId);
+        const char* bytes = reinterpret_cast<const char*>(&report.event);
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(ExecutionEvent));
+        ++sent;
+    });
+    sentReports.fetch_add(sent, std::memory_order_relaxed);
+    if (dropped)
+        droppedReports.fetch_add(dropped, std::memory_order_relaxed);
+
+    for (uint32_t connectionId : flushed) {
+        auto it = connections.find(connectionId);
+        if (it != connections.end() && !it->second->waitingWritable)
+            sendPending(*it->second);
+    }
+}
+
+
+// Matching thread
+void Gateway::pushReport(uint32_t connectionId, const ExecutionEvent& event) {
+    OutboundReport report = { connectionId, event };
+    if (outbound.tryPush(report, false))
+        return;
+    outbound.publish();
+    uint64_t wake = 1;
+    if (::write(wakeFd, &wake, sizeof(wake)) < 0) {}
+    while (!outbound.tryPush(report, false)) { // The network thread is behind: wait for room, unless it's stopped
+        if (!running.load(std::memory_order_acquire)) {
+            droppedReports.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        std::this_thread::yield();
+    }
+}
+
+void Gateway::matchRun(const InboundCommand* commands, std::size_t count, OrderCommand* scratch, ReportListener& listener) {
+    // Commands of one connection: ownership is checked and recorded, then they're matched as one batch
+    uint32_t connectionId = commands[0].connectionId;
+    std::size_t accepted = 0;
+    uint64_t refused = 0;
+    bool disconnected = false;
+    listener.currentConnection = connectionId;
+    auto matchAccepted = [&]() {
+        book.processBatch(scratch, accepted, listener);
+        // Added orders that didn't rest (filled, IOC or FOK), and triggered stops that filled completely, have no owner anymore
+        for (std::size_t i = 0; i < accepted; ++i)
+            if (isAdd(scratch[i].type) && !book.getOrderIndex().contains(scratch[i].orderId))
+                orderOwners.erase(scratch[i].orderId);
+        for (int orderId : listener.aggressorIds)
+            if (!book.getOrderIndex().contains(orderId))
+                orderOwners.erase(orderId);
+        listener.aggressorIds.clear();
+        accepted = 0;
+    };
+    // The commands accepted before a refused one are matched first, so that the client gets its reports in order
+    auto refuse = [&](const OrderCommand& command) {
+        if (accepted > 0)
+            matchAccepted();
+        listener.onReject(command);
+        ++refused;
+    };
+
+    for (std::size_t i = 0; i < count; ++i) {
+        const OrderCommand& command = commands[i].command;
+        if (commands[i].malformed) {
+            refuse(command);
+            continue;
+        }
+        if (command.type == CommandType::Checkpoint) { // The connection was closed, after this run's other commands (see closeConnection)
+            disconnected = true;
+            continue;
+        }
+        if (isAdd(command.type)) {
+            if (!orderOwners.emplace(command.orderId, connectionId).second) { // The id of a live order
+                refuse(command);
+                continue;
+            }
+        }
+        else if (command.type != CommandType::Market) {
+            auto owner = orderOwners.find(command.orderId);
+            if (owner != orderOwners.end() && owner->second != connectionId) { // Another client's order
+                refuse(command);
+                continue;
+            }
+            // A limit command for a stop order, or the other way around. The order may have been added earlier in this run: those commands are matched first
+            const Order* order = book.getOrderIndex().find(command.orderId);
+            if (!order && owner != orderOwners.end())
+                for (std::size_t j = 0; j < accepted; ++j)
+                    if (isAdd(scratch[j].type) && scratch[j].orderId == command.orderId) {
+                        matchAccepted();
+                        order = book.getOrderIndex().find(command.orderId);
+                        break;
+                    }
+            bool isStopCommand = (command.type == CommandType::CancelStop || command.type == CommandType::ModifyStop);
+            if (order && (order->getOrderType() == OrderType::StopOrder) != isStopCommand) {
+                refuse(command);
+                continue;
+            }
+        }
+        scratch[accepted++] = command;
+    }
+    if (refused)
+        refusedCommands.fetch_add(refused, std::memory_order_relaxed);
+    matchAccepted();
+
+    // The orders of a closed connection are cancelled in one pass over the book; their cancels forget their owners
+    if (disconnected)
+        book.cancelOrdersIf([&](const Order& order) {
+            auto owner = orderOwners.find(order.getOrderId());
+            return owner != orderOwners.end() && owner->second == connectionId;
+        }, listener);
+}
+
+void Gateway::runMatching() {
+    const std::size_t maxBatch = 256;
+    InboundCommand popped[maxBatch];
+    OrderCommand scratch[maxBatch];
+    ReportListener listener(*this);
+    unsigned idlePolls = 0;
+
+    while (true) {
+        std::size_t count = inbound.tryPopBatch(popped, maxBatch);
+        if (count == 0) {
+            if (!running.load(std::memory_order_acquire) && inbound.size() == 0)
+                break;
+            if (++idlePolls > 64) // Spin a little, then let the other threads run
+                std::this_thread::yield();
+            continue;
+        }
+        idlePolls = 0;
+
+        // Consecutive commands of the same connection are matched as one batch
+        for (std::size_t first = 0; first < count; ) {
+            std::size_t last = first + 1;
+            while (last < count && popped[last].connectionId == popped[first].connectionId)
+                ++last;
+            matchRun(popped + first, last - first, scratch, listener);
+            first = last;
+        }
+
+        if (listener.reported) {
+            outbound.publish();
+            uint64_t wake = 1;
+            if (::write(wakeFd, &wake, sizeof(wake)) < 0) {}
+            listener.reported = false;
+        }
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef GATEWAY_H
+#define GATEWAY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "ExecutionEvents.h"
+#include "OrderBook.h"
+#include "OrderCommand.h"
+#include "SpscQueue.h"
+
+/* Binary order-entry gateway in front of one OrderBook, over TCP (Linux, epoll).
+    Protocol, fixed-width and little-endian, with no framing besides the record sizes:
+        client -> gateway: 16-byte OrderCommand records (see OrderCommand.h); instrumentId is ignored, Checkpoint commands are refused
+        gateway -> client: 24-byte ExecutionEvent records (see ExecutionEvents.h) about the client's own orders: acks, fills & cancels,
+            and a reject for every refused command. A fill is sent to both the aggressor's and the resting order's clients; reports of
+            market orders (order id 0) go to their sender. A client gets its reports in the order of its commands
+    Order ids are chosen by the clients from one id space shared by all of them: an add with the id of a live order, whichever client
+    added it, is rejected, and the id is free again once that order leaves the book. An order is cancelled or modified
+    only by the client that added it, with the commands of its type (CancelLimit & ModifyLimit for limit orders, CancelStop & ModifyStop for stop
+    orders): other cancels & modifications are rejected. Cancels & modifications of unknown orders are ignored, like in the book.
+    The orders of a closed connection are cancelled with one mass cancel (see OrderBook::cancelOrdersIf) once the commands it sent
+    before closing are matched; their reports are dropped.
+    When the matching thread is behind, the commands that don't fit in its queue wait in order in the network thread, whose connections aren't
+    read until they're queued: clients are slowed down by TCP flow control, and the network thread never stops delivering reports.
+
+    Two threads: the network thread runs the epoll loop, reads the records in place from each connection's receive buffer and hands
+    them over to the matching thread through a lock-free queue; the matching thread matches them in batches (see OrderBook::processBatch)
+    and hands the reports back through another queue, waking the network thread with an eventfd. The book is only touched by the matching thread */
+class Gateway {
+public:
+    struct Stats {
+        std::size_t connections;         // Open now
+        uint64_t acceptedConnections;
+        uint64_t receivedCommands;
+        uint64_t refusedCommands;        // Malformed, ids of live orders (of any client), or cancels & modifications of other clients' orders or of the wrong order type
+        uint64_t sentReports;
+        uint64_t droppedReports;         // Of closed connections
+    };
+
+private:
+    static const std::size_t receiveBufferSize = 64 * 1024; // A multiple of the record size
+
+    struct InboundCommand {
+        uint32_t connectionId;
+        OrderCommand command;
+        bool malformed; // Refused by the network thread, only rejected by the matching thread
+    };
+
+    struct OutboundReport {
+        uint32_t connectionId;
+        ExecutionEvent event;
+    };
+
+    struct Connection {
+        int fd;
+        uint32_t id;
+        std::unique_ptr<char[]> receiveBuffer; // Records are decoded in place: the buffer is aligned for OrderCommand & holds whole records from its start
+        std::size_t receivedBytes;
+        std::vector<char> sendBuffer;          // Reports not yet taken by the socket, from sentBytes on
+        std::size_t sentBytes;
+        bool waitingWritable;                  // EPOLLOUT is armed until sendBuffer is drained
+        bool readingPaused;                    // EPOLLIN is disarmed while commands wait in the backlog
+    };
+
+    // Routes reports to the connections owning the orders (matching thread)
+    class ReportListener;
+
+    SpscQueue<InboundCommand> inbound;   // Network thread -> matching thread
+    SpscQueue<OutboundReport> outbound;  // Matching thread -> network thread
+    OrderBook book;                      // Matching thread only
+
+    int listenFd;
+    int epollFd;
+    int wakeFd;      // eventfd: reports are waiting in outbound
+    uint16_t port;
+    std::atomic<bool> running;
+    std::thread networkThread;
+    std::thread matchingThread;
+
+    // Network thread only
+    std::unordered_map<uint32_t, std::unique_ptr<Connection>> connections;
+    uint32_t nextConnectionId;
+    std::deque<InboundCommand> backlog;     // Received while inbound was full, queued before any newer command; at most a receive buffer per connection
+    std::vector<uint32_t> pausedConnections; // Read again once the backlog is queued
+
+    // Matching thread only: owner connection of every live order id (ids are global, see above)
+    std::unordered_map<int, uint32_t> orderOwners;
+
+    std::atomic<uint64_t> acceptedConnections, openConnections, receivedCommands, refusedCommands, sentReports, droppedReports;
+
+    void closeSockets();
+    void runNetwork();
+    void runMatching();
+    void acceptConnections();
+    bool receive(Connection& connection); // false once the connection is closed
+    bool sendPending(Connection& connection); // ...
+    void closeConnection(Connection& connection);
+    void pushCommand(const InboundCommand& command); // Network thread, into the backlog if the matching thread is behind
+    void flushBacklog(); // Queues the backlog, then reads the paused connections again once it's empty
+    void updateEvents(Connection& connection); // Arms EPOLLIN unless reading is paused, and EPOLLOUT while waiting for room to send
+    void deliverReports();
+    void pushReport(uint32_t connectionId, const ExecutionEvent& event); // Matching thread, waits for room if the network thread is behind
+    void matchRun(const InboundCommand* commands, std::size_t count, OrderCommand* scratch, ReportListener& listener);
+
+public:
+    // Listens on 127.0.0.1:port (port 0 picks a free port, see getPort). Throws std::runtime_error if the socket can't be set up
+    explicit Gateway(uint16_t port, std::size_t queueCapacity = 1 << 16, std::size_t orderCapacity = 1 << 20);
+    ~Gateway(); // Stops the threads and closes the connections
+    Gateway(const Gateway&) = delete;
+    Gateway& operator=(const Gateway&) = delete;
+
+    void start();
+    void stop();
+
+    inline uint16_t getPort() const { return port; }
+    Stats getStats() const;
+};
+
+#endif
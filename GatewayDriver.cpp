@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Clock.h"
+#include "ExecutionEvents.h"
+#include "Gateway.h"
+#include "LatencyHistogram.h"
+#include "OrderCommand.h"
+
+/* Runs a Gateway as a process, and a load generator measuring its round-trip latency over loopback TCP.
+    The load generator opens its connections, then sends commands at a fixed total rate (open loop: commands are sent when they're due,
+    not when the previous one is answered), spread round-robin over the connections: 70% limit orders near the touch (some of them cross)
+    and 30% cancellations of the connection's own previous orders. The round trip of a limit order is measured from its hand-off to its
+    socket until its connection receives its first report (ack, fill or cancel); cancellations of filled orders get no report */
+class GatewayDriver {
+public:
+    struct LoadResult {
+        uint64_t sentCommands;
+        uint64_t measuredOrders;   // Limit orders whose first report came back
+        uint64_t unansweredOrders; // ... that got no report within the drain timeout
+        uint64_t receivedReports;
+        double sendSeconds;        // Time taken to send every command, 1 / offered rate per command at best
+        LatencyHistogram roundTripNs;
+    };
+
+private:
+    struct ClientConnection {
+        int fd;
+        std::vector<char> sendBuffer;
+        std::size_t sentBytes;
+        char receiveBuffer[64 * 1024];
+        std::size_t receivedBytes;
+        std::vector<int> liveOrderIds; // Candidates for cancellation
+    };
+
+    static std::atomic<bool>& stopRequested() {
+        static std::atomic<bool> requested(false);
+        return requested;
+    }
+
+    static void onStopSignal(int) { stopRequested().store(true); }
+
+    static int connectTo(uint16_t port) {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            throw std::runtime_error(std::string("Cannot create a socket: ") + std::strerror(errno));
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(fd, (sockaddr*)&address, sizeof(address)) < 0) {
+            std::string error = std::strerror(errno);
+            ::close(fd);
+            throw std::runtime_error("Cannot connect to port " + std::to_string(port) + ": " + error);
+        }
+        int noDelay = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        return fd;
+    }
+
+    static void flush(ClientConnection& connection) {
+        while (connection.sentBytes < connection.sendBuffer.size()) {
+            ssize_t bytes = ::send(connection.fd, connection.sendBuffer.data() + connection.sentBytes,
+                                   connection.sendBuffer.size() - connection.sentBytes, MSG_NOSIGNAL);
+            if (bytes <= 0) {
+                if (bytes < 0 && errno == EINTR)
+                    continue;
+                if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    return; // Sent with the next flush
+                throw std::runtime_error("Gateway connection lost");
+            }
+            connection.sentBytes += (std::size_t)bytes;
+        }
+        connection.sendBuffer.clear();
+        connection.sentBytes = 0;
+    }
+
+public:
+    /* numCommands commands at messagesPerSecond over numConnections connections to the gateway at port. Limit orders get ids from
+        firstOrderId on, which must not be live in the gateway's book (e.g: from a previous run) */
+    static LoadResult run_load(uint16_t port, int numConnections, int messagesPerSecond, int numCommands, int firstOrderId = 1) {
+        const int referencePrice = 10000;
+        const uint64_t drainTimeoutNs = 2000000000ULL;
+        Clock& clock = defaultClock();
+        std::mt19937 gen(17);
+        std::uniform_int_distribution<int> offset_dist(-2, 20); // Ticks behind the reference price, negative ones cross
+        std::uniform_int_distribution<int> shares_dist(1, 100);
+        std::uniform_real_distribution<double> action_dist(0.0, 1.0);
+
+        LoadResult result;
+        result.sentCommands = result.measuredOrders = result.unansweredOrders = result.receivedReports = 0;
+        std::vector<std::unique_ptr<ClientConnection>> connections;
+        std::vector<uint64_t> sendTimes(numCommands, 0); // By order id - firstOrderId, 0 once answered (or for cancels)
+        int epollFd = ::epoll_create1(0);
+
+        try {
+            for (int i = 0; i < numConnections; ++i) {
+                std::unique_ptr<ClientConnection> connection(new ClientConnection());
+                connection->fd = connectTo(port);
+                connection->sentBytes = connection->receivedBytes = 0;
+                epoll_event event;
+                event.events = EPOLLIN;
+                event.data.u64 = (uint64_t)i;
+                ::epoll_ctl(epollFd, EPOLL_CTL_ADD, connection->fd, &event);
+                connections.push_back(std::move(connection));
+            }
+
+            uint64_t start = clock.now(), lastSend = start;
+            uint64_t pendingOrders = 0;
+            int sent = 0;
+            epoll_event events[64];
+            while (sent < numCommands || (pendingOrders > 0 && clock.now() - lastSend < drainTimeoutNs)) {
+                // Commands due by now are written to their connections' buffers, then every connection is flushed
+                uint64_t now = clock.now();
+                long long due = std::min((long long)numCommands, (long long)((now - start) * 1e-9 * messagesPerSecond) + 1);
+                for (; sent < due; ++sent) {
+                    ClientConnection& connection = *connections[sent % numConnections];
+                    OrderCommand command;
+                    if (action_dist(gen) < 0.3 && !connection.liveOrderIds.empty()) {
+                        std::size_t index = gen() % connection.liveOrderIds.size();
+                        command = makeCommand(CommandType::CancelLimit, OrderSide::Bid, connection.liveOrderIds[index], 0, 0);
+                        connection.liveOrderIds[index] = connection.liveOrderIds.back();
+                        connection.liveOrderIds.pop_back();
+                    }
+                    else {
+                        OrderSide side = (gen() & 1) ? OrderSide::Bid : OrderSide::Ask;
+                        int offset = offset_dist(gen);
+                        int orderId = firstOrderId + sent;
+                        command = makeCommand(CommandType::AddLimit, side, orderId, (side == OrderSide::Bid) ? referencePrice - offset : referencePrice + offset, shares_dist(gen));
+                        connection.liveOrderIds.push_back(orderId);
+                        sendTimes[sent] = now;
+                        ++pendingOrders;
+                    }
+                    const char* bytes = reinterpret_cast<const char*>(&command);
+                    connection.sendBuffer.insert(connection.sendBuffer.end(), bytes, bytes + sizeof(command));
+                }
+                for (std::unique_ptr<ClientConnection>& connection : connections)
+                    if (!connection->sendBuffer.empty())
+                        flush(*connection);
+                if (sent == numCommands && result.sentCommands == 0) { // The drain timeout starts now
+                    result.sentCommands = (uint64_t)sent;
+                    result.sendSeconds = (clock.now() - start) * 1e-9;
+                    lastSend = clock.now();
+                }
+
+                // Reports: the first one about a connection's own limit order ends its round trip
+                int count = ::epoll_wait(epollFd, events, 64, (sent < numCommands) ? 1 : 10);
+                for (int i = 0; i < count; ++i) {
+                    int connectionIndex = (int)events[i].data.u64;
+                    ClientConnection& connection = *connections[connectionIndex];
+                    ssize_t bytes = ::recv(connection.fd, connection.receiveBuffer + connection.receivedBytes, sizeof(connection.receiveBuffer) - connection.receivedBytes, 0);
+                    if (bytes == 0)
+                        throw std::runtime_error("Gateway connection closed");
+                    if (bytes < 0)
+                        continue;
+                    connection.receivedBytes += (std::size_t)bytes;
+
+                    uint64_t received = clock.now();
+                    std::size_t reports = connection.receivedBytes / sizeof(ExecutionEvent);
+                    const ExecutionEvent* records = reinterpret_cast<const ExecutionEvent*>(connection.receiveBuffer);
+                    for (std::size_t j = 0; j < reports; ++j) {
+                        long long index = (long long)records[j].orderId - firstOrderId;
+                        if (index >= 0 && index < numCommands && index % numConnections == connectionIndex && sendTimes[index] != 0) {
+                            result.roundTripNs.record(received - sendTimes[index]);
+                            sendTimes[index] = 0;
+                            --pendingOrders;
+                            ++result.measuredOrders;
+                        }
+                    }
+                    result.receivedReports += reports;
+                    std::size_t usedBytes = reports * sizeof(ExecutionEvent);
+                    std::memmove(connection.receiveBuffer, connection.receiveBuffer + usedBytes, connection.receivedBytes - usedBytes);
+                    connection.receivedBytes -= usedBytes;
+                }
+            }
+            result.unansweredOrders = pendingOrders;
+        }
+        catch (...) {
+            for (std::unique_ptr<ClientConnection>& connection : connections)
+                ::close(connection->fd);
+            ::close(epollFd);
+            throw;
+        }
+
+        for (std::unique_ptr<ClientConnection>& connection : connections)
+            ::close(connection->fd);
+        ::close(epollFd);
+        return result;
+    }
+
+    static void print_load(int numConnections, int messagesPerSecond, const LoadResult& result) {
+        std::cout << "Gateway: " << numConnections << " connections, " << messagesPerSecond << " msg/s offered ("
+                  << (uint64_t)(result.sendSeconds > 0 ? result.sentCommands / result.sendSeconds : 0.0) << " sent) | "
+                  << result.measuredOrders << " orders, round trip (us) p50 " << result.roundTripNs.valueAtPercentile(50.0) / 1000.0
+                  << ", p99 " << result.roundTripNs.valueAtPercentile(99.0) / 1000.0 << ", p99.9 " << result.roundTripNs.valueAtPercentile(99.9) / 1000.0
+                  << ", max " << result.roundTripNs.getMax() / 1000.0 << " | " << result.unansweredOrders << " unanswered\n";
+    }
+
+    /* Round-trip latency at 1, 16 & 128 connections and 10k, 50k & 200k messages/s, about a second per run, against the gateway
+        at port; port 0 starts a gateway in this process, on a free port */
+    static int run_load_sweep(uint16_t port) {
+        try {
+            std::unique_ptr<Gateway> gateway;
+            if (port == 0) {
+                gateway.reset(new Gateway(0));
+                gateway->start();
+                port = gateway->getPort();
+            }
+
+            const int connectionCounts[] = { 1, 16, 128 };
+            const int rates[] = { 10000, 50000, 200000 };
+            int firstOrderId = 1;
+            for (int numConnections : connectionCounts)
+                for (int rate : rates) {
+                    LoadResult result = run_load(port, numConnections, rate, rate, firstOrderId);
+                    firstOrderId += rate; // Orders of the previous runs may still rest in the book
+                    print_load(numConnections, rate, result);
+                }
+
+            if (gateway) {
+                Gateway::Stats stats = gateway->getStats();
+                std::cout << "  Gateway: " << stats.acceptedConnections << " connections, " << stats.receivedCommands << " commands ("
+                          << stats.refusedCommands << " refused), " << stats.sentReports << " reports sent, " << stats.droppedReports << " dropped\n";
+            }
+            return 0;
+        }
+        catch (const std::exception& error) {
+            std::cerr << error.what() << "\n";
+            return 1;
+        }
+    }
+
+    static int run_load_once(uint16_t port, int numConnections, int messagesPerSecond, int numCommands) {
+        try {
+            print_load(numConnections, messagesPerSecond, run_load(port, numConnections, messagesPerSecond, numCommands));
+            return 0;
+        }
+        catch (const std::exception& error) {
+            std::cerr << error.what() << "\n";
+            return 1;
+        }
+    }
+
+    // Serves until SIGINT or SIGTERM
+    static int run_gateway(uint16_t port) {
+        try {
+            Gateway gateway(port);
+            std::signal(SIGINT, onStopSignal);
+            std::signal(SIGTERM, onStopSignal);
+            gateway.start();
+            std::cout << "Gateway listening on 127.0.0.1:" << gateway.getPort() << std::endl;
+
+            while (!stopRequested().load())
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            gateway.stop();
+
+            Gateway::Stats stats = gateway.getStats();
+            std::cout << "Gateway stopped: " << stats.acceptedConnections << " connections, " << stats.receivedCommands << " commands ("
+                      << stats.refusedCommands << " refused), " << stats.sentReports << " reports sent, " << stats.droppedReports << " dropped\n";
+            return 0;
+        }
+        catch (const std::exception& error) {
+            std::cerr << error.what() << "\n";
+            return 1;
+        }
+    }
+};
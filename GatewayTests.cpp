@@ -0,0 +1,197 @@
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "ExecutionEvents.h"
+#include "Gateway.h"
+#include "OrderCommand.h"
+
+// Gateway tests of tests.cpp, over loopback TCP (see TEST_CHECK in OrderBookTests.cpp)
+class GatewayTests {
+private:
+    // Blocking client socket; sends & receives give up after timeoutSeconds
+    static int connectTo(uint16_t port, int timeoutSeconds = 5) {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        timeval timeout = { timeoutSeconds, 0 };
+        int noDelay = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        if (::connect(fd, (sockaddr*)&address, sizeof(address)) < 0) {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    static bool sendAll(int fd, const void* data, std::size_t size) {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t sent = ::send(fd, bytes, size, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR)
+                continue;
+            if (sent <= 0)
+                return false; // Timed out or closed
+            bytes += sent;
+            size -= (std::size_t)sent;
+        }
+        return true;
+    }
+
+    // Receives count reports into events; false if they don't all come before the socket's timeout
+    static bool receiveEvents(int fd, std::size_t count, std::vector<ExecutionEvent>& events) {
+        events.resize(count);
+        char* bytes = reinterpret_cast<char*>(events.data());
+        std::size_t size = count * sizeof(ExecutionEvent), received = 0;
+        while (received < size) {
+            ssize_t bytesRead = ::recv(fd, bytes + received, size - received, 0);
+            if (bytesRead < 0 && errno == EINTR)
+                continue;
+            if (bytesRead <= 0)
+                return false;
+            received += (std::size_t)bytesRead;
+        }
+        return true;
+    }
+
+public:
+    static bool test_gateway_flood_is_not_stalled() {
+        /* A client floods the gateway with adds while reading their acks. With queues much smaller than the flood, the network thread
+            holds commands back & stops reading until the matching thread catches up, instead of waiting on it: every ack must come back */
+        const int num_orders = 200000;
+        Gateway gateway(0, 1024);
+        gateway.start();
+        int fd = connectTo(gateway.getPort());
+        TEST_CHECK(fd >= 0);
+
+        std::vector<ExecutionEvent> acks;
+        bool received = false;
+        std::thread reader([&]() { received = receiveEvents(fd, num_orders, acks); });
+        std::vector<OrderCommand> commands;
+        for (int orderId = 1; orderId <= num_orders; ++orderId)
+            commands.push_back(makeCommand(CommandType::AddLimit, OrderSide::Bid, orderId, 1 + orderId % 1000, 10));
+        bool sent = sendAll(fd, commands.data(), commands.size() * sizeof(OrderCommand));
+        reader.join();
+        ::close(fd);
+        gateway.stop();
+
+        TEST_CHECK(sent);
+        TEST_CHECK(received);
+        for (int i = 0; i < num_orders; ++i)
+            TEST_CHECK(acks[i].type == EventType::Ack && acks[i].orderId == i + 1);
+        return true;
+    }
+
+    static bool test_gateway_refuses_the_other_order_type() {
+        // Limit cancels & modifications of a client's own stop order are rejected: the stop stays in the book until its CancelStop
+        Gateway gateway(0);
+        gateway.start();
+        int fd = connectTo(gateway.getPort());
+        TEST_CHECK(fd >= 0);
+        const OrderCommand commands[] = {
+            makeCommand(CommandType::AddStop, OrderSide::Bid, 2, 150, 5),
+            makeCommand(CommandType::CancelLimit, OrderSide::Bid, 2, 0, 0),
+            makeCommand(CommandType::ModifyLimit, OrderSide::Bid, 2, 140, 3),
+            makeCommand(CommandType::CancelStop, OrderSide::Bid, 2, 0, 0)
+        };
+        std::vector<ExecutionEvent> events;
+        bool exchanged = sendAll(fd, commands, sizeof(commands)) && receiveEvents(fd, 4, events);
+        ::close(fd);
+        Gateway::Stats stats = gateway.getStats();
+        gateway.stop();
+
+        TEST_CHECK(exchanged);
+        TEST_CHECK(events[0].type == EventType::Ack && events[0].orderId == 2);
+        TEST_CHECK(events[1].type == EventType::Reject && events[1].orderId == 2 && events[1].remainingShares == (int)CommandType::CancelLimit);
+        TEST_CHECK(events[2].type == EventType::Reject && events[2].orderId == 2 && events[2].remainingShares == (int)CommandType::ModifyLimit);
+        TEST_CHECK(events[3].type == EventType::Cancel && events[3].orderId == 2 && events[3].price == 150 && events[3].shares == 5);
+        TEST_CHECK(stats.refusedCommands == 2);
+        return true;
+    }
+
+    static bool test_gateway_rejects_refused_commands() {
+        // Every refused command gets a reject, in order with the sender's other reports, and leaves the other clients' orders alone
+        Gateway gateway(0);
+        gateway.start();
+        int owner = connectTo(gateway.getPort()), other = connectTo(gateway.getPort());
+        TEST_CHECK(owner >= 0 && other >= 0);
+        OrderCommand add = makeCommand(CommandType::AddLimit, OrderSide::Bid, 5, 100, 10);
+        std::vector<ExecutionEvent> ownerEvents, otherEvents;
+        bool added = sendAll(owner, &add, sizeof(add)) && receiveEvents(owner, 1, ownerEvents);
+
+        const OrderCommand commands[] = {
+            makeCommand(CommandType::AddLimit, OrderSide::Bid, 6, 90, 1),
+            makeCommand(CommandType::CancelLimit, OrderSide::Bid, 5, 0, 0),   // Another client's order
+            makeCommand(CommandType::AddLimit, OrderSide::Bid, 5, 95, 2),     // The id of a live order
+            makeCommand(CommandType::Checkpoint, OrderSide::Bid, 0, 0, 0),    // Malformed, refused by the network thread
+            makeCommand(CommandType::AddLimit, OrderSide::Ask, 7, 110, -3),
+            makeCommand(CommandType::CancelLimit, OrderSide::Bid, 6, 0, 0)
+        };
+        bool exchanged = sendAll(other, commands, sizeof(commands)) && receiveEvents(other, 6, otherEvents);
+        OrderCommand cancel = makeCommand(CommandType::CancelLimit, OrderSide::Bid, 5, 0, 0);
+        bool cancelled = sendAll(owner, &cancel, sizeof(cancel)) && receiveEvents(owner, 1, ownerEvents);
+        ::close(owner);
+        ::close(other);
+        Gateway::Stats stats = gateway.getStats();
+        gateway.stop();
+
+        TEST_CHECK(added && exchanged && cancelled);
+        TEST_CHECK(otherEvents[0].type == EventType::Ack && otherEvents[0].orderId == 6);
+        TEST_CHECK(otherEvents[1].type == EventType::Reject && otherEvents[1].orderId == 5 && otherEvents[1].remainingShares == (int)CommandType::CancelLimit);
+        TEST_CHECK(otherEvents[2].type == EventType::Reject && otherEvents[2].orderId == 5 && otherEvents[2].price == 95 && otherEvents[2].shares == 2);
+        TEST_CHECK(otherEvents[3].type == EventType::Reject && otherEvents[3].remainingShares == (int)CommandType::Checkpoint);
+        TEST_CHECK(otherEvents[4].type == EventType::Reject && otherEvents[4].orderId == 7 && otherEvents[4].shares == -3);
+        TEST_CHECK(otherEvents[5].type == EventType::Cancel && otherEvents[5].orderId == 6);
+        TEST_CHECK(ownerEvents[0].type == EventType::Cancel && ownerEvents[0].orderId == 5 && ownerEvents[0].shares == 10);
+        TEST_CHECK(stats.refusedCommands == 4);
+        return true;
+    }
+
+    static bool test_gateway_frees_the_ids_of_filled_stops() {
+        // A stop that fills completely once triggered leaves the book without a cancel: its id must be free again right away
+        Gateway gateway(0);
+        gateway.start();
+        int seller = connectTo(gateway.getPort()), stopper = connectTo(gateway.getPort());
+        TEST_CHECK(seller >= 0 && stopper >= 0);
+        const OrderCommand asks[] = {
+            makeCommand(CommandType::AddLimit, OrderSide::Ask, 1, 100, 5),
+            makeCommand(CommandType::AddLimit, OrderSide::Ask, 3, 101, 10)
+        };
+        OrderCommand stop = makeCommand(CommandType::AddStop, OrderSide::Bid, 2, 101, 5);
+        OrderCommand market = makeCommand(CommandType::Market, OrderSide::Bid, 0, 0, 5);
+        OrderCommand reuse = makeCommand(CommandType::AddLimit, OrderSide::Bid, 2, 90, 1);
+        std::vector<ExecutionEvent> sellerEvents, stopperEvents, reuseEvents;
+        bool exchanged = sendAll(seller, asks, sizeof(asks)) && receiveEvents(seller, 2, sellerEvents)
+            && sendAll(stopper, &stop, sizeof(stop)) && receiveEvents(stopper, 1, stopperEvents)
+            && sendAll(seller, &market, sizeof(market)) && receiveEvents(seller, 2, sellerEvents) // The market's fill, then the stop's
+            && receiveEvents(stopper, 1, stopperEvents)
+            && sendAll(stopper, &reuse, sizeof(reuse)) && receiveEvents(stopper, 1, reuseEvents);
+        ::close(seller);
+        ::close(stopper);
+        Gateway::Stats stats = gateway.getStats();
+        gateway.stop();
+
+        TEST_CHECK(exchanged);
+        TEST_CHECK(sellerEvents[1].type == EventType::Fill && sellerEvents[1].orderId == 2 && sellerEvents[1].restingOrderId == 3);
+        TEST_CHECK(stopperEvents[0].type == EventType::Fill && stopperEvents[0].orderId == 2 && stopperEvents[0].shares == 5);
+        TEST_CHECK(reuseEvents[0].type == EventType::Ack && reuseEvents[0].orderId == 2 && reuseEvents[0].price == 90);
+        TEST_CHECK(stats.refusedCommands == 0);
+        return true;
+    }
+};
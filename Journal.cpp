@@ -0,0 +1,147 @@
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include "Journal.h"
+#include "ReplayFile.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+Journal::Journal(const std::string& path, FlushPolicy _policy, std::size_t _maxGroupRecords, uint32_t maxGroupDelayMicros, std::size_t queueCapacity) :
+    queue(queueCapacity), file(nullptr), policy(_policy), maxGroupRecords(_maxGroupRecords > 0 ? _maxGroupRecords : 1),
+    maxGroupDelayNs((uint64_t)maxGroupDelayMicros * 1000), appendedRecords(0), writtenRecords(0), durableRecords(0), commits(0),
+    error(0), running(true), writeBuffer(1024)
+{
+    file = std::fopen(path.c_str(), "wb");
+    if (!file)
+        throw std::runtime_error("Cannot create " + path);
+
+    ReplayHeader header;
+    std::memcpy(header.magic, "LOBR", 4);
+    header.version = ReplayFile::currentVersion;
+    header.recordSize = sizeof(OrderCommand);
+    header.messageCount = ReplayFile::openEnded;
+    if (std::fwrite(&header, sizeof(header), 1, file) != 1 || std::fflush(file) != 0) {
+        std::fclose(file);
+        throw std::runtime_error("Cannot write " + path);
+    }
+    writer = std::thread(&Journal::run, this);
+}
+
+Journal::~Journal() {
+    running.store(false, std::memory_order_release);
+    writer.join();
+    std::fclose(file);
+}
+
+bool Journal::append(const OrderCommand* commands, std::size_t count) {
+    // The queue is published once per call (or when full), as for MatchingEngine::submit
+    for (std::size_t i = 0; i < count; ++i)
+        if (!queue.tryPush(commands[i], false)) {
+            queue.publish();
+            while (!queue.tryPush(commands[i], false))
+                std::this_thread::yield();
+        }
+    queue.publish();
+    appendedRecords += count;
+    return getError() == 0;
+}
+
+bool Journal::appendCheckpoint(uint64_t bookChecksum) {
+    OrderCommand checkpoint = makeCheckpoint(bookChecksum);
+    return append(&checkpoint, 1);
+}
+
+bool Journal::flush() {
+    while (durableRecords.load(std::memory_order_acquire) < appendedRecords) {
+        if (getError() != 0)
+            return false;
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+void Journal::fail(int errorNumber) {
+    int none = 0;
+    error.compare_exchange_strong(none, errorNumber != 0 ? errorNumber : EIO, std::memory_order_release);
+}
+
+bool Journal::commit() {
+    if (std::fflush(file) != 0) {
+        fail(errno);
+        return false;
+    }
+    if (policy != FlushPolicy::None) {
+#if defined(__linux__)
+        int synced = fdatasync(fileno(file)); // File size included, the records can be read back after a crash
+#elif defined(__unix__) || defined(__APPLE__)
+        int synced = fsync(fileno(file));
+#else
+        int synced = 0;
+#endif
+        if (synced != 0) {
+            fail(errno);
+            return false;
+        }
+    }
+    durableRecords.store(writtenRecords.load(std::memory_order_relaxed), std::memory_order_release);
+    commits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void Journal::run() {
+    uint64_t groupRecords = 0; // Written since the last commit
+    std::chrono::steady_clock::time_point groupStart;
+    unsigned idlePolls = 0;
+
+    while (true) {
+        bool stopping = !running.load(std::memory_order_acquire); // Read before popping: every record appended before stopping is in the queue
+        std::size_t count = queue.tryPopBatch(&writeBuffer[0], writeBuffer.size());
+
+        // Once a write or sync failed, the records are only popped, so that the matching thread doesn't wait for room
+        bool failed = getError() != 0;
+        if (count > 0 && !failed) {
+            if (groupRecords == 0)
+                groupStart = std::chrono::steady_clock::now();
+            if (policy == FlushPolicy::EachRecord)
+                for (std::size_t i = 0; i < count; ++i) {
+                    if (std::fwrite(&writeBuffer[i], sizeof(OrderCommand), 1, file) != 1) {
+                        fail(errno);
+                        break;
+                    }
+                    writtenRecords.fetch_add(1, std::memory_order_relaxed);
+                    if (!commit())
+                        break;
+                }
+            else if (std::fwrite(&writeBuffer[0], sizeof(OrderCommand), count, file) != count)
+                fail(errno);
+            else {
+                writtenRecords.fetch_add(count, std::memory_order_relaxed);
+                groupRecords += count;
+            }
+        }
+
+        // A group ends once the queue runs dry, so that the records appended during a sync are committed together by the next one
+        if (getError() != 0)
+            groupRecords = 0;
+        if (groupRecords > 0 && (count == 0 || groupRecords >= maxGroupRecords
+                || (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - groupStart).count() >= maxGroupDelayNs)) {
+            commit();
+            groupRecords = 0;
+        }
+
+        if (count > 0) {
+            idlePolls = 0;
+            continue;
+        }
+        if (stopping)
+            break;
+        if (++idlePolls > 64) // Spin a little, then let the other threads run, then sleep while the book is idle
+            std::this_thread::yield();
+        if (idlePolls > 4096)
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "OrderCommand.h"
+#include "SpscQueue.h"
+
+// When journaled commands are made durable
+enum class FlushPolicy : uint8_t {
+    None,        // Written to the OS, which flushes them to disk in its own time: they survive a crash of the process, not of the machine
+    GroupCommit, // Synced once per group: the records written while the previous sync was in progress, or maxGroupRecords, or maxGroupDelay worth
+    EachRecord   // Every record is synced on its own, e.g: to measure what group commit saves
+};
+
+/* Write-ahead journal of the commands submitted to a book (see OrderBook::setJournal): the matching thread pushes them to a lock-free
+    queue, a writer thread appends them to a session file (see ReplayFile.h) and syncs it according to the flush policy.
+    The file is written with an open-ended message count, so that it can be replayed as is: a record torn by a crash is ignored.
+    The matching thread never waits for the disk, only for room in the queue; results should be published once getDurableRecords() covers their command.
+    After a failed write or sync, nothing more is written nor made durable: getError() has the error, append & flush return false */
+class Journal {
+private:
+    SpscQueue<OrderCommand> queue;
+    std::FILE* file;
+    FlushPolicy policy;
+    std::size_t maxGroupRecords;
+    uint64_t maxGroupDelayNs;
+
+    uint64_t appendedRecords;               // Matching thread only
+    std::atomic<uint64_t> writtenRecords;   // Handed to the OS
+    std::atomic<uint64_t> durableRecords;   // Synced (written, with FlushPolicy::None)
+    std::atomic<uint64_t> commits;
+    std::atomic<int> error;                 // errno of the first failed write or sync, 0 if none
+    std::atomic<bool> running;
+    std::vector<OrderCommand> writeBuffer;  // Writer thread only
+    std::thread writer;
+
+    void run(); // Writer thread
+    bool commit(); // false if the flush or sync failed
+    void fail(int errorNumber); // Records the first error
+
+public:
+    // Throws std::runtime_error if path can't be created
+    explicit Journal(const std::string& path, FlushPolicy _policy = FlushPolicy::GroupCommit, std::size_t _maxGroupRecords = 4096,
+                     uint32_t maxGroupDelayMicros = 200, std::size_t queueCapacity = 1 << 16);
+    ~Journal(); // Writes & commits every appended record, then closes the file
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    bool append(const OrderCommand* commands, std::size_t count); // Waits for room in the queue if the writer is behind; false once the journal failed
+    bool appendCheckpoint(uint64_t bookChecksum); // The book's checksum at this point of the journal, checked by the recovery
+    bool flush(); // Waits until every appended record is durable; false if the journal failed before, records from the failed one on aren't
+
+    // Getters
+    inline FlushPolicy getPolicy() const { return policy; }
+    inline uint64_t getAppendedRecords() const { return appendedRecords; }
+    inline uint64_t getDurableRecords() const { return durableRecords.load(std::memory_order_acquire); }
+    inline uint64_t getCommits() const { return commits.load(std::memory_order_relaxed); }
+    inline int getError() const { return error.load(std::memory_order_acquire); } // errno of the failed write or sync, 0 if none
+};
+
+#endif
@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <iostream>
+#include <ostream>
+#include <random>
+#include "CycleCounter.h"
+#include "LatencyHistogram.h"
+#include "OrderBook.h"
+
+/* Per-operation latency of the book: every call is timed with the cycle counter and recorded into the histogram of its operation,
+    then one CSV row per (profile, operation) is written: profile,operation,count,mean_ns,p50_ns,p99_ns,p999_ns,max_ns
+    Operations:
+        add_passive: limit order resting without trading     add_aggressive: limit order crossing the spread
+        cancel: limit or stop order cancellation              modify: new shares (and price for limit orders) of a resting order
+        market_sweep: market order triggering no stop         stop_trigger: market order that also executed stop orders
+        add_stop: stop order resting away from the touch
+    The touch profile is run again with tracing, breaking limit & market orders down into matching and the work after it (trace_* rows) */
+class LatencyBenchmark {
+private:
+    enum Operation { AddPassive, AddAggressive, Cancel, Modify, MarketSweep, StopTrigger, AddStop, OperationCount };
+
+    struct Profile {
+        const char* name;
+        double operationShares[OperationCount - 1]; // Share of each operation, stop triggers being a kind of market order
+        int passiveSpread;              // Passive orders rest up to passiveSpread ticks behind the touch
+        int minShares, maxShares;       // Limit & stop orders
+        int minSweep, maxSweep;         // Market orders
+        int preloadLevels, ordersPerLevel; // Resting book before the measurement (per side)
+    };
+
+    static const int referencePrice = 1000000;
+    static const int stopIdBase = 1 << 30; // Stop order ids, so that their fills are recognized by the listener
+
+    // Flags market orders that executed stop orders: a stop order's fills have its own id as the aggressor id
+    struct StopTriggerListener : NullEventListener {
+        bool stopFilled;
+        StopTriggerListener() : stopFilled(false) {}
+        inline void onFill(int aggressorOrderId, int, OrderSide, int, int, int) { if (aggressorOrderId >= stopIdBase) stopFilled = true; }
+    };
+
+    static const char* operationName(int operation) {
+        static const char* names[OperationCount] = { "add_passive", "add_aggressive", "cancel", "modify", "market_sweep", "stop_trigger", "add_stop" };
+        return names[operation];
+    }
+
+    static int bestBidOf(const OrderBook& book) {
+        if (book.getHighestBid()) return book.getHighestBid()->getLimitPrice();
+        return book.getLowestAsk() ? book.getLowestAsk()->getLimitPrice() - 1 : referencePrice - 1;
+    }
+
+    static int bestAskOf(const OrderBook& book) {
+        if (book.getLowestAsk()) return book.getLowestAsk()->getLimitPrice();
+        return book.getHighestBid() ? book.getHighestBid()->getLimitPrice() + 1 : referencePrice + 1;
+    }
+
+public:
+    /* With a tracer, only the breakdown of limit & market orders (from their traces) is written, as tracing adds to the operations' latency.
+        With a profiler, only its counters are written (see run_counter_benchmark) */
+    static void run_profile(const Profile& profile, int num_operations, double cyclesPerNs, std::ostream& out, OrderTracer* tracer = nullptr,
+                            OperationProfiler* profiler = nullptr) {
+        OrderBook book(profile.preloadLevels * profile.ordersPerLevel * 2 + num_operations, profile.preloadLevels * 2 + 1024);
+        int nextOrderId = 1, nextStopId = stopIdBase;
+
+        for (int level = 1; level <= profile.preloadLevels; ++level)
+            for (int i = 0; i < profile.ordersPerLevel; ++i) {
+                book.addLimitOrder(nextOrderId++, OrderSide::Bid, referencePrice - level, profile.minShares);
+                book.addLimitOrder(nextOrderId++, OrderSide::Ask, referencePrice + level, profile.minShares);
+            }
+
+        book.setTracer(tracer); // After the preloading
+        book.setProfiler(profiler);
+        std::mt19937 gen(42);
+        std::discrete_distribution<> operation_dist(profile.operationShares, profile.operationShares + OperationCount - 1);
+        std::uniform_int_distribution<> offset_dist(0, profile.passiveSpread);
+        std::uniform_int_distribution<> shares_dist(profile.minShares, profile.maxShares);
+        std::uniform_int_distribution<> sweep_dist(profile.minSweep, profile.maxSweep);
+        std::uniform_int_distribution<> cross_dist(0, 2);
+        std::uniform_int_distribution<> stop_dist(1, 10);
+        std::bernoulli_distribution side_dist(0.5);
+
+        LatencyHistogram histograms[OperationCount];
+        StopTriggerListener listener;
+
+        for (int i = 0; i < num_operations; ++i) {
+            int operation = operation_dist(gen);
+            OrderSide side = side_dist(gen) ? OrderSide::Bid : OrderSide::Ask;
+            int bestBid = bestBidOf(book), bestAsk = bestAskOf(book);
+            uint64_t start = 0, end = 0;
+
+            if ((operation == Cancel || operation == Modify) && book.getOrderIndex().empty())
+                operation = AddPassive;
+            if (operation == AddAggressive && (side == OrderSide::Bid ? book.getLowestAsk() : book.getHighestBid()) == nullptr)
+                operation = AddPassive;
+
+            switch (operation) {
+            case AddPassive: {
+                int price = (side == OrderSide::Bid) ? bestBid - offset_dist(gen) : bestAsk + offset_dist(gen);
+                int shares = shares_dist(gen);
+                start = readCyclesStart();
+                book.addLimitOrder(nextOrderId++, side, price, shares, listener);
+                end = readCyclesEnd();
+                break;
+            }
+            case AddAggressive: {
+                int price = (side == OrderSide::Bid) ? bestAsk + cross_dist(gen) : bestBid - cross_dist(gen);
+                int shares = shares_dist(gen);
+                start = readCyclesStart();
+                book.addLimitOrder(nextOrderId++, side, price, shares, listener);
+                end = readCyclesEnd();
+                break;
+            }
+            case Cancel: {
+                Order* order = book.getOrderIndex().sampleOrder(gen);
+                int orderId = order->getOrderId();
+                bool isStop = order->getOrderType() == OrderType::StopOrder;
+                start = readCyclesStart();
+                if (isStop)
+                    book.cancelStopOrder(orderId, listener);
+                else
+                    book.cancelLimitOrder(orderId, listener);
+                end = readCyclesEnd();
+                break;
+            }
+            case Modify: {
+                Order* order = book.getOrderIndex().sampleOrder(gen);
+                int orderId = order->getOrderId(), shares = shares_dist(gen);
+                if (order->getOrderType() == OrderType::StopOrder) { // Same stop price, the stop can't trigger
+                    int stopPrice = order->getLimitPrice();
+                    start = readCyclesStart();
+                    book.modifyStopOrder(orderId, shares, stopPrice, listener);
+                    end = readCyclesEnd();
+                }
+                else { // The new price stays on the order's side of the spread, modifications never trade
+                    int price = (order->getOrderSide() == OrderSide::Bid) ? std::min(order->getLimitPrice() + cross_dist(gen) - 1, bestAsk - 1)
+                                                                          : std::max(order->getLimitPrice() - cross_dist(gen) + 1, bestBid + 1);
+                    start = readCyclesStart();
+                    book.modifyLimitOrder(orderId, shares, price, listener);
+                    end = readCyclesEnd();
+                }
+                break;
+            }
+            case MarketSweep: {
+                int shares = sweep_dist(gen);
+                listener.stopFilled = false;
+                start = readCyclesStart();
+                book.addMarketOrder(side, shares, listener);
+                end = readCyclesEnd();
+                if (listener.stopFilled)
+                    operation = StopTrigger;
+                break;
+            }
+            default: { // AddStop: stop bids above the best ask, stop asks below the best bid
+                int distance = stop_dist(gen);
+                int price = (side == OrderSide::Bid) ? bestAsk + distance : bestBid - distance;
+                int shares = shares_dist(gen);
+                operation = AddStop;
+                start = readCyclesStart();
+                book.addStopOrder(nextStopId++, side, price, shares, listener);
+                end = readCyclesEnd();
+                break;
+            }
+            }
+            histograms[operation].record(end - start);
+        }
+
+#ifndef NDEBUG
+        book.checkTreeInvariants();
+#endif
+
+        if (tracer) {
+            write_trace_rows(out, profile.name, *tracer);
+            return;
+        }
+        if (profiler)
+            return;
+        for (int operation = 0; operation < OperationCount; ++operation)
+            write_row(out, profile.name, operationName(operation), histograms[operation], cyclesPerNs);
+    }
+
+    // Where the time goes inside addLimitOrder & addMarketOrder: matching, then resting & acking (limit) or executing triggered stops (market)
+    static void write_trace_rows(std::ostream& out, const char* profile, const OrderTracer& tracer) {
+        LatencyHistogram limitMatch, limitAck, marketMatch, marketStops;
+        for (std::size_t i = 0; i < tracer.size(); ++i) {
+            const OrderTrace& trace = tracer.at(i);
+            bool isLimit = trace.orderType == OrderType::LimitOrder;
+            (isLimit ? limitMatch : marketMatch).record(trace.matchedTime - trace.ingressTime);
+            (isLimit ? limitAck : marketStops).record(trace.ackTime - trace.matchedTime);
+        }
+        write_row(out, profile, "trace_limit_match", limitMatch, 1.0); // Traces are in nanoseconds
+        write_row(out, profile, "trace_limit_rest_ack", limitAck, 1.0);
+        write_row(out, profile, "trace_market_match", marketMatch, 1.0);
+        write_row(out, profile, "trace_market_stops", marketStops, 1.0);
+    }
+
+    static void write_row(std::ostream& out, const char* profile, const char* operation, const LatencyHistogram& histogram, double cyclesPerNs) {
+        out << profile << ',' << operation << ',' << histogram.getCount() << ','
+            << (uint64_t)(histogram.getMean() / cyclesPerNs) << ','
+            << (uint64_t)(histogram.valueAtPercentile(50.0) / cyclesPerNs) << ','
+            << (uint64_t)(histogram.valueAtPercentile(99.0) / cyclesPerNs) << ','
+            << (uint64_t)(histogram.valueAtPercentile(99.9) / cyclesPerNs) << ','
+            << (uint64_t)(histogram.getMax() / cyclesPerNs) << '\n';
+    }
+
+    static const int profileCount = 4;
+    static const Profile* profiles() {
+        //                                                 add_passive add_aggressive cancel modify market add_stop
+        static const Profile workloads[profileCount] = {
+            { "touch",        { 0.45, 0.05, 0.30, 0.10, 0.05, 0.05 },    20,   1,  100,   1,  200,     0,  0 },
+            { "cancel_heavy", { 0.25, 0.02, 0.60, 0.08, 0.02, 0.03 },    20,   1,  100,   1,  200,     0,  0 },
+            { "sweep_heavy",  { 0.60, 0.00, 0.13, 0.05, 0.15, 0.07 },    20, 200, 1500, 500, 5000,     0,  0 },
+            { "deep",         { 0.45, 0.05, 0.30, 0.10, 0.05, 0.05 }, 10000,   1,  100,   1,  200, 10000, 50 },
+        };
+        return workloads;
+    }
+
+    static void run_latency_benchmark(std::ostream& out, int num_operations = 1000000) {
+        double cyclesPerNs = cyclesPerNanosecond();
+        out << "profile,operation,count,mean_ns,p50_ns,p99_ns,p999_ns,max_ns\n";
+
+        // Cost of the timing itself, included in every measurement
+        LatencyHistogram overhead;
+        for (int i = 0; i < 100000; ++i) {
+            uint64_t start = readCyclesStart();
+            overhead.record(readCyclesEnd() - start);
+        }
+        write_row(out, "calibration", "timer_overhead", overhead, cyclesPerNs);
+
+        for (int profile = 0; profile < profileCount; ++profile)
+            run_profile(profiles()[profile], num_operations, cyclesPerNs, out);
+
+        // Per-order traces of the touch profile
+        OrderTracer tracer(num_operations);
+        run_profile(profiles()[0], num_operations, cyclesPerNs, out, &tracer);
+    }
+
+    /* Performance counters of every operation of the four profiles, grouped by operation & level change (see OperationProfiler::report),
+        each profile with its own counters. Hardware counters if the PMU is available, otherwise software counters or the cycle counter */
+    static void run_counter_benchmark(std::ostream& out, int num_operations = 1000000) {
+        for (int profile = 0; profile < profileCount; ++profile) {
+            OperationProfiler profiler;
+            profiler.calibrate();
+            run_profile(profiles()[profile], num_operations, 1.0, out, nullptr, &profiler);
+            profiler.report(out, profiles()[profile].name, profile == 0);
+        }
+    }
+};
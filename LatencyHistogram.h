@@ -0,0 +1,91 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <cstdint>
+#include <vector>
+
+/* HDR-style histogram of latencies (in cycles or nanoseconds): values below 32 have their own bucket,
+    then every power of two is split into 32 linear sub-buckets, hence any recorded value is known within ~3%.
+    Recording is O(1) and never allocates; all buckets are allocated at construction (~16KB). */
+class LatencyHistogram {
+private:
+    static const int subBucketBits = 5;
+    static const int subBucketCount = 1 << subBucketBits;
+
+    std::vector<uint64_t> counts;
+    uint64_t totalCount;
+    uint64_t maxValue;
+    double sum;
+
+    static inline int highestBitIndex(uint64_t value) {
+        int index = 0;
+        while (value >>= 1)
+            ++index;
+        return index;
+    }
+
+    static inline int bucketOf(uint64_t value) {
+        if (value < (uint64_t)subBucketCount)
+            return (int)value;
+        int magnitude = highestBitIndex(value); // >= subBucketBits
+        int shift = magnitude - subBucketBits;
+        return subBucketCount + shift * subBucketCount + (int)((value >> shift) - subBucketCount);
+    }
+
+    static inline uint64_t highestValueOf(int bucket) { // Highest value recorded in bucket
+        if (bucket < subBucketCount)
+            return (uint64_t)bucket;
+        int shift = (bucket - subBucketCount) / subBucketCount;
+        uint64_t subBucket = (uint64_t)((bucket - subBucketCount) % subBucketCount) + subBucketCount;
+        return ((subBucket + 1) << shift) - 1;
+    }
+
+public:
+    LatencyHistogram() : counts(subBucketCount * (64 - subBucketBits + 1), 0), totalCount(0), maxValue(0), sum(0) {}
+
+    inline void record(uint64_t value) {
+        ++counts[bucketOf(value)];
+        ++totalCount;
+        sum += (double)value;
+        if (value > maxValue)
+            maxValue = value;
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < counts.size(); ++i)
+            counts[i] += other.counts[i];
+        totalCount += other.totalCount;
+        sum += other.sum;
+        if (other.maxValue > maxValue)
+            maxValue = other.maxValue;
+    }
+
+    void reset() {
+        counts.assign(counts.size(), 0);
+        totalCount = maxValue = 0;
+        sum = 0;
+    }
+
+    // Smallest bucket bound such that at least percentile% of the recorded values are at or below it
+    uint64_t valueAtPercentile(double percentile) const {
+        if (totalCount == 0)
+            return 0;
+        uint64_t threshold = (uint64_t)(percentile / 100.0 * totalCount + 0.5);
+        if (threshold == 0)
+            threshold = 1;
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket < counts.size(); ++bucket) {
+            seen += counts[bucket];
+            if (seen >= threshold)
+                return highestValueOf((int)bucket) < maxValue ? highestValueOf((int)bucket) : maxValue;
+        }
+        return maxValue;
+    }
+
+    // Getters
+    inline uint64_t getCount() const { return totalCount; }
+    inline uint64_t getMax() const { return maxValue; }
+    inline double getMean() const { return totalCount ? sum / totalCount : 0.0; }
+};
+
+#endif
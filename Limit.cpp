@@ -2,25 +2,18 @@
 
 #include "Limit.h"
 #include "Order.h"
+#include "OrderIndex.h"
 
-Limit::Limit(int _limitPrice, OrderSide _orderSide) : 
-    limitPrice(_limitPrice), orderSide(_orderSide), 
+Limit::Limit(int _limitPrice, OrderSide _orderSide, OrderCategory _orderCategory) : 
+    limitPrice(_limitPrice), orderSide(_orderSide), orderCategory(_orderCategory), 
     numberOfOrders(0), totalShares(0),  // number of orders and total shares initialized to 0
-    headOrder(nullptr), tailOrder(nullptr),
-    parentLimit(nullptr), leftChildLimit(nullptr), rightChildLimit(nullptr) 
+    headChunk(nullptr), tailChunk(nullptr), tombstones(0),
+    parentLimit(nullptr), leftChildLimit(nullptr), rightChildLimit(nullptr), height(1),
+    subtreeShares(0), subtreeNotional(0)
 {}
 
-Limit::~Limit() {   // Destroy all orders of this limit
-    Order* current = headOrder;
-    while (current) {
-        Order* next = current->getNextOrder();
-        delete current;
-        current = next;
-    }
-}
-
 void Limit::showLimit() const {
-    Order* current = headOrder;
+    Order* current = getHeadOrder();
     std::cout << "Following are the IDs of Orders part of this limit level" << std::endl;
     while (current) {
         std::cout << "Order ID: " << current->getOrderId() << std::endl;
@@ -28,49 +21,125 @@ void Limit::showLimit() const {
     }
 }
 
-void Limit::addOrder(Order* order) {
-    if (!order)
-        throw std::invalid_argument("Order cannot be null");
-
-    if (!headOrder)
-        headOrder = tailOrder = order;
-    else {
-        tailOrder->setNextOrder(order);
-        order->setPreviousOrder(tailOrder);
-        order->setNextOrder(nullptr);
-        tailOrder = order;
+void Limit::addShares(int shares) {
+    totalShares += shares;
+    long long notional = (long long)shares * limitPrice;
+    for (Limit* level = this; level != nullptr; level = level->parentLimit) {
+        level->subtreeShares += shares;
+        level->subtreeNotional += notional;
+    }
+}
+
+void Limit::updateSubtreeAggregates() {
+    subtreeShares = totalShares;
+    subtreeNotional = (long long)totalShares * limitPrice;
+    if (leftChildLimit) {
+        subtreeShares += leftChildLimit->subtreeShares;
+        subtreeNotional += leftChildLimit->subtreeNotional;
     }
-    
+    if (rightChildLimit) {
+        subtreeShares += rightChildLimit->subtreeShares;
+        subtreeNotional += rightChildLimit->subtreeNotional;
+    }
+}
+
+Order* Limit::addOrder(const Order& order, ObjectPool<OrderChunk>& chunkPool) {
+    // The order is copied to the tail of the queue; a new chunk is linked once the tail chunk is full
+    if (!tailChunk || tailChunk->end == OrderChunk::capacity) {
+        OrderChunk* newChunk = chunkPool.create();
+        newChunk->level = this;
+        newChunk->index = chunkPool.indexOf(newChunk);
+        if (tailChunk)
+            tailChunk->nextChunk = newChunk;
+        else
+            headChunk = newChunk;
+        tailChunk = newChunk;
+    }
+
+    Order* slot = tailChunk->orders + tailChunk->end++;
+    *slot = order;
+
     ++numberOfOrders;
-    totalShares += order->getOrderShares();
-    order->setParentLimit(this);
+    addShares(order.orderShares);
+    return slot;
 }
 
-void Limit::removeOrder(Order* order) {
-    // Update the Limit level's DLL and both number of orders and total shares after an order is removed (e.g: fully executed, etc.)
-    if (!order || !headOrder)
+void Limit::removeOrder(Order* order, ObjectPool<OrderChunk>& chunkPool) {
+    // Update both number of orders and total shares after an order is removed (e.g: fully executed, cancelled, etc.), then its queue
+    --numberOfOrders;
+    addShares(-order->orderShares); // if the order is fully executed, then it removes 0 shares
+    order->orderShares = 0;
+
+    if (numberOfOrders == 0) { // Only tombstones are left
+        releaseChunks(chunkPool);
         return;
+    }
 
-    if (order == headOrder) {
-        headOrder = order->getNextOrder();
-        if (headOrder) 
-            headOrder->setPreviousOrder(nullptr);
-    } 
-    else if (order == tailOrder) {
-        tailOrder = order->getPreviousOrder();
-        if (tailOrder) 
-            tailOrder->setNextOrder(nullptr);
-    } 
-    else {
-        Order* prev = order->getPreviousOrder();
-        Order* next = order->getNextOrder();
-        if (prev) 
-            prev->setNextOrder(next);
-        if (next) 
-            next->setPreviousOrder(prev);
+    if (order != getHeadOrder()) { // Left in place, skipped by getNextOrder
+        ++tombstones;
+        return;
     }
 
-    --numberOfOrders;
-    totalShares -= order->getOrderShares(); // if the order is fully executed, then the right side equals 0
-    delete order;
+    // The head moves to the next live order, over the tombstones behind it; consumed chunks go back to the pool
+    OrderChunk* chunk = headChunk;
+    ++chunk->begin;
+    while (true) {
+        for (; chunk->begin < chunk->end; ++chunk->begin, --tombstones)
+            if (chunk->orders[chunk->begin].orderShares != 0)
+                return;
+        headChunk = chunk->nextChunk; // There's a live order further: the tail chunk isn't consumed
+        chunkPool.destroy(chunk);
+        chunk = headChunk;
+    }
+}
+
+void Limit::releaseChunks(ObjectPool<OrderChunk>& chunkPool) {
+    while (headChunk) {
+        OrderChunk* nextChunk = headChunk->nextChunk;
+        chunkPool.destroy(headChunk);
+        headChunk = nextChunk;
+    }
+    tailChunk = nullptr;
+    tombstones = 0;
+}
+
+void Limit::compact(ObjectPool<OrderChunk>& chunkPool, OrderIndex& orderIndex) {
+    // The live orders are moved forward in time priority order, from the head slot (a live head stays in place); the chunks left empty are released
+    OrderChunk* writeChunk = headChunk;
+    int writeSlot = headChunk->begin;
+    for (OrderChunk* readChunk = headChunk; readChunk != nullptr; readChunk = readChunk->nextChunk)
+        for (int readSlot = readChunk->begin; readSlot < readChunk->end; ++readSlot) {
+            Order& order = readChunk->orders[readSlot];
+            if (order.orderShares == 0)
+                continue;
+            if (writeSlot == OrderChunk::capacity) { // Every chunk but the tail is full: the write position never passes the read position
+                writeChunk = writeChunk->nextChunk;
+                writeSlot = 0;
+            }
+            Order* slot = writeChunk->orders + writeSlot++;
+            if (slot != &order) {
+                *slot = order;
+                orderIndex.relocate(slot->idNumber, slot);
+            }
+        }
+
+    writeChunk->end = (uint16_t)writeSlot;
+    OrderChunk* emptyChunk = writeChunk->nextChunk;
+    writeChunk->nextChunk = nullptr;
+    tailChunk = writeChunk;
+    while (emptyChunk) {
+        OrderChunk* nextChunk = emptyChunk->nextChunk;
+        chunkPool.destroy(emptyChunk);
+        emptyChunk = nextChunk;
+    }
+    tombstones = 0;
+}
+
+long long Limit::sumOrderShares() const {
+    // Tombstones hold 0 shares, hence the slots of a chunk are summed in one branch-free loop
+    long long shares = 0;
+    for (const OrderChunk* chunk = headChunk; chunk != nullptr; chunk = chunk->nextChunk)
+        for (int slot = chunk->begin; slot < chunk->end; ++slot)
+            shares += chunk->orders[slot].orderShares;
+    return shares;
 }
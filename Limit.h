@@ -2,8 +2,10 @@
 #define LIMIT_H
 
 #include "enums.h"
+#include "ObjectPool.h"
+#include "Order.h"
 
-class Order;
+class OrderIndex;
 
 class Limit {   // a limit is a set of orders of the same limit price
 private:
@@ -11,42 +13,99 @@ private:
 
     int limitPrice; // Price level for this limit
     OrderSide orderSide; // Bid or Ask side
+    OrderCategory orderCategory; // Limit or stop level
     int numberOfOrders; // number of orders in the limit
     int totalShares; // total number of shares in the limit (sum of shares of all orders)
     
-    Order* headOrder;   // head of the linked list of orders of the limit; The first order to be executed within the limit orders of the limit
-    Order* tailOrder;
+    /* Queue of the level's orders in time priority: chunks of contiguous orders, from headChunk (its begin slot is the first order
+        to be executed) to tailChunk (new orders are appended to it). A level without orders has no chunk */
+    OrderChunk* headChunk;
+    OrderChunk* tailChunk;
+    int tombstones; // Cancelled orders still in the queue, behind its head
     
     Limit* parentLimit;
     Limit* leftChildLimit;
     Limit* rightChildLimit;
+    int height; // height of the subtree rooted at this level in its AVL tree (a leaf has height 1)
+
+    // Aggregates of the subtree rooted at this level: kept up to date on share changes (up to the root) and on rotations
+    long long subtreeShares;
+    long long subtreeNotional; // Sum of price * shares
+
+    void releaseChunks(ObjectPool<OrderChunk>& chunkPool); // Once the level has no order left: its chunks go back to the pool
 
 public:
-    Limit(int _limitPrice, OrderSide _orderSide);
-    ~Limit();
+    Limit(int _limitPrice, OrderSide _orderSide, OrderCategory _orderCategory = OrderCategory::Limit);
 
     void showLimit() const;
 
     // Getters
     inline int getLimitPrice() const { return limitPrice; }
     inline OrderSide getOrderSide() const { return orderSide; }
+    inline OrderCategory getOrderCategory() const { return orderCategory; }
     inline int getNumberOfOrders() const { return numberOfOrders; }
     inline int getTotalShares() const { return totalShares; }
-    inline Order* getHeadOrder() const { return headOrder; }
-    inline Order* getTailOrder() const { return tailOrder; }
+    inline Order* getHeadOrder() const { return headChunk ? headChunk->orders + headChunk->begin : nullptr; }
+    inline int getTombstones() const { return tombstones; }
     inline Limit* getParentLimit() const { return parentLimit; }
     inline Limit* getLeftChildLimit() const { return leftChildLimit; }
     inline Limit* getRightChildLimit() const { return rightChildLimit; }
+    inline int getHeight() const { return height; }
+    inline long long getSubtreeShares() const { return subtreeShares; }
+    inline long long getSubtreeNotional() const { return subtreeNotional; }
 
     // Setters
     inline void setParentLimit(Limit* parent) { parentLimit = parent; }
     inline void setLeftChildLimit(Limit* leftChild) { leftChildLimit = leftChild; }
     inline void setRightChildLimit(Limit* rightChild) { rightChildLimit = rightChild; }
-    inline void setHeadOrder(Order* newHeadOrder) { headOrder = newHeadOrder; }
-    inline void setTailOrder(Order* newTailOrder) { tailOrder = newTailOrder; }
+    inline void setHeight(int newHeight) { height = newHeight; }
     
-    void addOrder(Order* order);   // Add an order to this limit level
-    void removeOrder(Order* order); // Remove an order from this limit level
+    void addShares(int shares); // Change the level's total shares (negative to remove), and its ancestors' subtree aggregates: O(depth)
+    void updateSubtreeAggregates(); // Recompute the aggregates from the children's, e.g: after a rotation
+
+    // Orders are copied into the level's queue: addOrder returns the slot of the copy, the order's address from then on (and its handle's, see Order::getHandle)
+    Order* addOrder(const Order& order, ObjectPool<OrderChunk>& chunkPool);
+    void removeOrder(Order* order, ObjectPool<OrderChunk>& chunkPool); // The order becomes a tombstone, or the head moves past it: O(1) amortized
+
+    // Cancellations in the middle of the queue leave tombstones, which are squeezed out once they outnumber the orders: O(1) amortized per cancellation
+    inline bool needsCompaction() const { return tombstones > numberOfOrders && tombstones >= OrderChunk::capacity; }
+    void compact(ObjectPool<OrderChunk>& chunkPool, OrderIndex& orderIndex); // Moves the orders to the front of the queue, and updates their index entries
+    long long sumOrderShares() const; // Total shares recomputed from the queue, e.g: to check totalShares
+
+    /* Bulk removal (see OrderBook's mass cancels): shouldRemove(Order&) is called on every order of the queue, in time priority, and the ones
+        it returns true for are removed in one pass, then the queue is compacted. Returns the number of removed orders. O(N) for the level's N orders;
+        the subtree aggregates of the level & its ancestors are left stale, to be recomputed by the caller (e.g: when it rebuilds the tree) */
+    template <typename Predicate>
+    int removeOrdersIf(Predicate&& shouldRemove, ObjectPool<OrderChunk>& chunkPool, OrderIndex& orderIndex);
 };
 
+template <typename Predicate>
+int Limit::removeOrdersIf(Predicate&& shouldRemove, ObjectPool<OrderChunk>& chunkPool, OrderIndex& orderIndex) {
+    int removedOrders = 0;
+    for (OrderChunk* chunk = headChunk; chunk != nullptr; chunk = chunk->nextChunk)
+        for (int slot = chunk->begin; slot < chunk->end; ++slot) {
+            Order& order = chunk->orders[slot];
+            if (order.orderShares == 0 || !shouldRemove(order))
+                continue;
+            totalShares -= order.orderShares;
+            order.orderShares = 0;
+            ++removedOrders;
+        }
+
+    if (removedOrders == 0)
+        return 0;
+    numberOfOrders -= removedOrders;
+    tombstones += removedOrders;
+    if (numberOfOrders == 0)
+        releaseChunks(chunkPool);
+    else // The head may be a tombstone now: the live orders are moved to the front
+        compact(chunkPool, orderIndex);
+    return removedOrders;
+}
+
+// The order's price, side & type are its level's
+inline int Order::getLimitPrice() const { return getParentLimit()->getLimitPrice(); }
+inline OrderSide Order::getOrderSide() const { return getParentLimit()->getOrderSide(); }
+inline OrderType Order::getOrderType() const { return (getParentLimit()->getOrderCategory() == OrderCategory::Limit) ? OrderType::LimitOrder : OrderType::StopOrder; }
+
 #endif
\ No newline at end of file
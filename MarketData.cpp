@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "MarketData.h"
+#include "OrderBook.h"
+
+namespace {
+    // Prices may be negative: zigzag encoding maps small magnitudes of either sign to small varints (0, -1, 1, -2... -> 0, 1, 2, 3...)
+    inline uint32_t zigzag(int value) { uint32_t bits = (uint32_t)value; return (bits << 1) ^ (0u - (bits >> 31)); }
+    inline int unzigzag(uint64_t value) { uint32_t bits = (uint32_t)value; return (int)((bits >> 1) ^ (0u - (bits & 1))); }
+
+    uint64_t readVarint(const uint8_t*& in, const uint8_t* end) {
+        uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            if (in == end)
+                throw std::runtime_error("Truncated market data message");
+            uint8_t byte = *in++;
+            value |= (uint64_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+        throw std::runtime_error("Corrupt market data message: varint too long");
+    }
+}
+
+MarketDataEncoder::MarketDataEncoder(uint64_t _refreshInterval)
+    : sequence(0), refreshInterval(_refreshInterval), sinceRefresh(0), refreshes(0), entries(0) {}
+
+uint8_t* MarketDataEncoder::writeVarint(uint8_t* out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+void MarketDataEncoder::writeMessage(MarketDataMessageType type) {
+    // Written in place after room for the longest encoding is made (the type byte, 3 varints of 10 bytes, 3 varints of 5 bytes per entry)
+    std::size_t start = buffer.size();
+    buffer.resize(start + 31 + 15 * (messageLevels[0].size() + messageLevels[1].size()));
+    uint8_t* out = buffer.data() + start;
+    *out++ = (uint8_t)type;
+    out = writeVarint(out, sequence);
+    out = writeVarint(out, messageLevels[0].size());
+    out = writeVarint(out, messageLevels[1].size());
+
+    // Bids from the highest price down, asks from the lowest up: the distance from the previous entry is always positive
+    for (int side = 0; side < 2; ++side) {
+        int previousPrice = 0;
+        for (std::size_t i = 0; i < messageLevels[side].size(); ++i) {
+            const DepthLevel& level = messageLevels[side][i];
+            if (i == 0)
+                out = writeVarint(out, zigzag(level.price));
+            else
+                out = writeVarint(out, (uint64_t)(uint32_t)(side == 0 ? previousPrice - level.price : level.price - previousPrice));
+            previousPrice = level.price;
+            out = writeVarint(out, (uint64_t)(uint32_t)level.totalShares);
+            if (level.totalShares != 0)
+                out = writeVarint(out, (uint64_t)(uint32_t)level.numberOfOrders);
+        }
+    }
+    buffer.resize(out - buffer.data());
+}
+
+bool MarketDataEncoder::encodeChanges(const OrderBook& book) {
+    if (!hasChanges())
+        return false;
+
+    // The changed prices are sorted best first, without duplicates; levels deleted by the event aren't in the book anymore: 0 shares
+    for (int side = 0; side < 2; ++side) {
+        std::vector<int>& changed = changedLevels[side];
+        messageLevels[side].clear();
+        if (changed.empty())
+            continue;
+        if (changed.size() > 1) { // Most events change one level per side
+            if (side == 0)
+                std::sort(changed.begin(), changed.end(), [](int price, int otherPrice) { return price > otherPrice; });
+            else
+                std::sort(changed.begin(), changed.end());
+            changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+        }
+
+        OrderSide orderSide = (side == 0) ? OrderSide::Bid : OrderSide::Ask;
+        for (int price : changed) {
+            const Limit* level = book.findLevel(orderSide, price);
+            DepthLevel entry = { price, level ? level->getTotalShares() : 0, level ? level->getNumberOfOrders() : 0 };
+            messageLevels[side].push_back(entry);
+        }
+        entries += changed.size();
+        changed.clear();
+    }
+
+    ++sequence;
+    writeMessage(MarketDataMessageType::Incremental);
+    if (refreshInterval && ++sinceRefresh >= refreshInterval)
+        encodeRefresh(book);
+    return true;
+}
+
+void MarketDataEncoder::encodeRefresh(const OrderBook& book) {
+    for (int side = 0; side < 2; ++side) {
+        messageLevels[side].clear();
+        for (PriceLevelIterator it = book.getLevelIterator(side == 0 ? OrderSide::Bid : OrderSide::Ask); it != PriceLevelIterator(); ++it) {
+            DepthLevel entry = { it->getLimitPrice(), it->getTotalShares(), it->getNumberOfOrders() };
+            messageLevels[side].push_back(entry);
+        }
+    }
+    writeMessage(MarketDataMessageType::Refresh);
+    sinceRefresh = 0;
+    ++refreshes;
+}
+
+
+MarketDataDecoder::MarketDataDecoder() : sequence(0), synchronized(false), appliedMessages(0) {}
+
+const uint8_t* MarketDataDecoder::apply(const uint8_t* message, const uint8_t* end) {
+    const uint8_t* in = message;
+    if (in == end)
+        throw std::runtime_error("Truncated market data message");
+    MarketDataMessageType type = (MarketDataMessageType)*in++;
+    if (type != MarketDataMessageType::Incremental && type != MarketDataMessageType::Refresh)
+        throw std::runtime_error("Corrupt market data message: unknown type");
+    uint64_t messageSequence = readVarint(in, end);
+    uint64_t sideEntries[2];
+    sideEntries[0] = readVarint(in, end);
+    sideEntries[1] = readVarint(in, end);
+
+    /* A refresh replaces the levels; an incremental message is applied only if it's the next one. A gap drops the levels until the next
+        refresh, whose sequence may be behind the last message applied: the refresh is the state of the book at its sequence */
+    bool isRefresh = (type == MarketDataMessageType::Refresh);
+    if (!isRefresh && synchronized && messageSequence != sequence + 1) {
+        synchronized = false;
+        levels[0].clear();
+        levels[1].clear();
+    }
+    bool applied = isRefresh || synchronized;
+    if (isRefresh) {
+        levels[0].clear();
+        levels[1].clear();
+        synchronized = true;
+    }
+
+    for (int side = 0; side < 2; ++side) {
+        int price = 0;
+        for (uint64_t i = 0; i < sideEntries[side]; ++i) {
+            uint64_t encodedPrice = readVarint(in, end);
+            if (i == 0)
+                price = unzigzag(encodedPrice);
+            else if (encodedPrice == 0)
+                throw std::runtime_error("Corrupt market data message: entries out of price order");
+            else
+                price = (side == 0) ? price - (int)encodedPrice : price + (int)encodedPrice;
+
+            int shares = (int)readVarint(in, end);
+            int orders = shares ? (int)readVarint(in, end) : 0;
+            if (!applied)
+                continue;
+            if (shares == 0)
+                levels[side].erase(price);
+            else {
+                DepthLevel level = { price, shares, orders };
+                levels[side][price] = level;
+            }
+        }
+    }
+
+    if (applied) {
+        sequence = messageSequence;
+        ++appliedMessages;
+    }
+    return in;
+}
+
+void MarketDataDecoder::applyAll(const uint8_t* messages, std::size_t size) {
+    const uint8_t* end = messages + size;
+    while (messages != end)
+        messages = apply(messages, end);
+}
+
+std::size_t MarketDataDecoder::getDepth(OrderSide orderSide, std::size_t maxLevels, DepthLevel* depth) const {
+    std::size_t count = 0;
+    if (orderSide == OrderSide::Bid)
+        for (auto it = levels[0].rbegin(); it != levels[0].rend() && count < maxLevels; ++it)
+            depth[count++] = it->second;
+    else
+        for (auto it = levels[1].begin(); it != levels[1].end() && count < maxLevels; ++it)
+            depth[count++] = it->second;
+    return count;
+}
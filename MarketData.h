@@ -0,0 +1,98 @@
+#ifndef MARKETDATA_H
+#define MARKETDATA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "enums.h"
+#include "PriceLevelIterator.h"
+
+class OrderBook;
+
+enum class MarketDataMessageType : uint8_t {
+    Incremental, // The levels changed by one matching event
+    Refresh      // Every level of the book
+};
+
+/* Incremental L2 (price level) market data of a book (see OrderBook::setMarketData), as a stream of self-delimited binary messages.
+    The book marks the limit levels that each order method changes, and at the end of each matching event (each command of processBatch,
+    see OrderBook::publishMarketData) their new states are coalesced into one incremental message: a sweep of 20 levels is one message of
+    20 entries, whatever its number of fills. A full refresh follows every refreshInterval incremental messages, or is written on demand,
+    for late joiners.
+
+    Message, its integers as LEB128 varints (7 bits per byte, low bits first):
+        type (1 byte), sequence, number of bid entries, number of ask entries, then the bid entries from the highest price down and the ask
+        entries from the lowest price up. An entry is a price, the level's total shares and its number of orders: the first price of a side is
+        zigzag-encoded, the next ones are their distance from the previous entry (>= 1). 0 shares delete the level, its number of orders is left out
+    Incremental messages are numbered from 1; a refresh carries the sequence of the last incremental message it includes, so a late joiner
+    applies a refresh, then the incremental messages that follow it (see MarketDataDecoder) */
+class MarketDataEncoder {
+private:
+    std::vector<int> changedLevels[2]; // Prices of the bids & asks changed by the current event, with duplicates
+    std::vector<DepthLevel> messageLevels[2]; // Entries of the message being written, best price first
+    std::vector<uint8_t> buffer;       // Messages not yet taken by the consumer
+    uint64_t sequence;                 // Of the last incremental message
+    uint64_t refreshInterval;          // 0: refreshes on demand only
+    uint64_t sinceRefresh;             // Incremental messages since the last refresh
+    uint64_t refreshes;
+    uint64_t entries;                  // Of the incremental messages
+
+    static uint8_t* writeVarint(uint8_t* out, uint64_t value); // Returns the end of the varint written at out
+    void writeMessage(MarketDataMessageType type); // Of messageLevels
+
+public:
+    explicit MarketDataEncoder(uint64_t refreshInterval = 0);
+
+    // Called by the book when the level at price changes; a fill after a fill at the same price is only marked once
+    inline void markLevel(OrderSide side, int price) {
+        std::vector<int>& changed = changedLevels[side == OrderSide::Ask];
+        if (changed.empty() || changed.back() != price)
+            changed.push_back(price);
+    }
+    inline bool hasChanges() const { return !changedLevels[0].empty() || !changedLevels[1].empty(); }
+
+    /* One incremental message with the current state of every marked level of book, then a refresh if one is due. O(C log(C)) for the C
+        marked levels, which are then cleared. Returns false (nothing written) if no level was marked */
+    bool encodeChanges(const OrderBook& book);
+    void encodeRefresh(const OrderBook& book); // Every limit level of book, in O(M)
+
+    // Messages are appended to the buffer until the consumer clears it
+    inline const std::vector<uint8_t>& getBuffer() const { return buffer; }
+    inline void clear() { buffer.clear(); }
+
+    // Getters
+    inline uint64_t getSequence() const { return sequence; } // Number of incremental messages
+    inline uint64_t getRefreshes() const { return refreshes; }
+    inline uint64_t getEntries() const { return entries; }
+};
+
+/* Rebuilds the L2 book of a market data stream (see MarketDataEncoder). Until its first refresh, a decoder isn't synchronized and skips the
+    incremental messages; it also drops its levels & waits for the next refresh when a sequence number is missing */
+class MarketDataDecoder {
+private:
+    std::map<int, DepthLevel> levels[2]; // Bids & asks by price
+    uint64_t sequence;                   // Of the last message applied
+    bool synchronized;
+    uint64_t appliedMessages;
+
+public:
+    MarketDataDecoder();
+
+    // Decodes the message starting at message, in a stream ending at end, and applies it; returns the end of the message.
+    // Throws std::runtime_error if the message is truncated or malformed
+    const uint8_t* apply(const uint8_t* message, const uint8_t* end);
+    void applyAll(const uint8_t* messages, std::size_t size); // A whole stream of messages
+
+    // Writes the best maxLevels levels of a side into depth, best first, like OrderBook::getDepth; returns the number of levels written
+    std::size_t getDepth(OrderSide orderSide, std::size_t maxLevels, DepthLevel* levels) const;
+
+    // Getters
+    inline bool isSynchronized() const { return synchronized; }
+    inline uint64_t getSequence() const { return sequence; }
+    inline uint64_t getAppliedMessages() const { return appliedMessages; }
+    inline std::size_t getLevelCount(OrderSide orderSide) const { return levels[orderSide == OrderSide::Ask].size(); }
+};
+
+#endif
@@ -0,0 +1,175 @@
+#include <stdexcept>
+
+#include "CycleCounter.h"
+#include "MatchingEngine.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#endif
+
+MatchingEngine::MatchingEngine(std::size_t numberOfShards, std::size_t queueCapacity, bool _pinThreads)
+    : shardOfInstrument(maxInstruments), running(false), pinThreads(_pinThreads), cyclesPerNs(cyclesPerNanosecond()) {
+    if (numberOfShards == 0)
+        throw std::invalid_argument("An engine needs at least one shard");
+    for (std::size_t i = 0; i < numberOfShards; ++i)
+        shards.emplace_back(new Shard(queueCapacity));
+    touchedShards.assign(numberOfShards, 0);
+    for (std::size_t instrumentId = 0; instrumentId < maxInstruments; ++instrumentId)
+        shardOfInstrument[instrumentId] = (uint16_t)(instrumentId % numberOfShards);
+}
+
+MatchingEngine::~MatchingEngine() {
+    stop();
+}
+
+void MatchingEngine::assignInstrument(uint16_t instrumentId, std::size_t shardIndex) {
+    if (running.load() || shardIndex >= shards.size())
+        throw std::logic_error("Instruments are assigned to existing shards, before the engine starts");
+    shardOfInstrument[instrumentId] = (uint16_t)shardIndex;
+}
+
+void MatchingEngine::start() {
+    if (running.exchange(true))
+        return;
+    unsigned cores = std::thread::hardware_concurrency();
+    for (std::size_t i = 0; i < shards.size(); ++i) {
+        shards[i]->worker = std::thread(&MatchingEngine::runWorker, this, i);
+#if defined(__linux__)
+        if (pinThreads && cores > 0) { // Shard i on core i (modulo the number of cores)
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+            CPU_SET(i % cores, &cpuSet);
+            pthread_setaffinity_np(shards[i]->worker.native_handle(), sizeof(cpu_set_t), &cpuSet);
+        }
+#else
+        (void)cores;
+#endif
+    }
+}
+
+void MatchingEngine::stop() {
+    if (!running.load())
+        return;
+    waitUntilIdle();
+    running.store(false, std::memory_order_release);
+    for (std::size_t i = 0; i < shards.size(); ++i)
+        if (shards[i]->worker.joinable())
+            shards[i]->worker.join();
+}
+
+void MatchingEngine::submit(const OrderCommand* commands, std::size_t count) {
+    // Queues are published once per call (or when full), rather than once per command
+    for (std::size_t i = 0; i < count; ++i) {
+        std::size_t shardIndex = shardOfInstrument[commands[i].instrumentId];
+        Shard& shard = *shards[shardIndex];
+        QueuedCommand queued = { commands[i], readCyclesStart() };
+        if (!shard.queue.tryPush(queued, false)) {
+            shard.queue.publish();
+            while (!shard.queue.tryPush(queued, false))
+                std::this_thread::yield();
+        }
+        ++shard.submittedMessages;
+        touchedShards[shardIndex] = 1;
+    }
+    for (std::size_t i = 0; i < shards.size(); ++i)
+        if (touchedShards[i]){
+            shards[i]->queue.publish();
+            touchedShards[i] = 0;
+        }
+}
+
+void MatchingEngine::waitUntilIdle() const {
+    for (std::size_t i = 0; i < shards.size(); ++i)
+        while (shards[i]->processedMessages.load(std::memory_order_acquire) != shards[i]->submittedMessages)
+            std::this_thread::yield();
+}
+
+void MatchingEngine::runWorker(std::size_t shardIndex) {
+    const std::size_t maxBatch = 256;
+    Shard& shard = *shards[shardIndex];
+    QueuedCommand popped[maxBatch];
+    OrderCommand commands[maxBatch];
+    uint64_t processed = 0;
+    unsigned idlePolls = 0;
+
+    while (true) {
+        std::size_t count = shard.queue.tryPopBatch(popped, maxBatch);
+        if (count == 0) {
+            if (!running.load(std::memory_order_acquire) && shard.queue.size() == 0)
+                break;
+            if (++idlePolls > 64) // Spin a little, then let the other threads run
+                std::this_thread::yield();
+            continue;
+        }
+        idlePolls = 0;
+
+        std::size_t depth = count + shard.queue.size();
+        if (depth > shard.maxQueueDepth.load(std::memory_order_relaxed))
+            shard.maxQueueDepth.store(depth, std::memory_order_relaxed);
+
+        for (std::size_t i = 0; i < count; ++i)
+            commands[i] = popped[i].command;
+
+        // Consecutive commands of the same instrument are matched as one batch
+        for (std::size_t first = 0; first < count; ) {
+            uint16_t instrumentId = commands[first].instrumentId;
+            std::size_t last = first + 1;
+            while (last < count && commands[last].instrumentId == instrumentId)
+                ++last;
+
+            std::unique_ptr<OrderBook>& book = shard.books[instrumentId];
+            if (!book)
+                book.reset(new OrderBook());
+            book->processBatch(commands + first, last - first);
+            first = last;
+        }
+
+        uint64_t now = readCyclesEnd();
+        for (std::size_t i = 0; i < count; ++i)
+            shard.latency.record(now - popped[i].submissionCycles);
+        processed += count;
+        shard.processedMessages.store(processed, std::memory_order_release);
+    }
+}
+
+MatchingEngine::ShardStats MatchingEngine::getShardStats(std::size_t shardIndex) const {
+    const Shard& shard = *shards[shardIndex];
+    ShardStats stats;
+    stats.instruments = shard.books.size();
+    stats.processedMessages = shard.processedMessages.load(std::memory_order_acquire);
+    stats.queueDepth = shard.queue.size();
+    stats.maxQueueDepth = shard.maxQueueDepth.load(std::memory_order_relaxed);
+    stats.meanLatencyNs = shard.latency.getMean() / cyclesPerNs;
+    stats.p50LatencyNs = shard.latency.valueAtPercentile(50.0) / cyclesPerNs;
+    stats.p99LatencyNs = shard.latency.valueAtPercentile(99.0) / cyclesPerNs;
+    stats.p999LatencyNs = shard.latency.valueAtPercentile(99.9) / cyclesPerNs;
+    stats.maxLatencyNs = shard.latency.getMax() / cyclesPerNs;
+    return stats;
+}
+
+const OrderBook* MatchingEngine::findBook(uint16_t instrumentId) const {
+    const Shard& shard = *shards[shardOfInstrument[instrumentId]];
+    auto it = shard.books.find(instrumentId);
+    return (it == shard.books.end()) ? nullptr : it->second.get();
+}
+
+uint64_t MatchingEngine::getChecksum(uint16_t instrumentId) const {
+    const OrderBook* book = findBook(instrumentId);
+    return book ? book->getChecksum() : 0;
+}
+
+uint64_t MatchingEngine::getChecksum() const {
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a over (instrument, book checksum), by instrument
+    for (std::size_t instrumentId = 0; instrumentId < maxInstruments; ++instrumentId) {
+        const OrderBook* book = findBook((uint16_t)instrumentId);
+        if (!book)
+            continue;
+        uint64_t words[2] = { instrumentId, book->getChecksum() };
+        for (uint64_t word : words)
+            for (int byte = 0; byte < 8; ++byte) {
+                hash ^= (word >> (8 * byte)) & 0xFF;
+                hash *= 1099511628211ULL;
+            }
+    }
+    return hash;
+}
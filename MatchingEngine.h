@@ -0,0 +1,87 @@
+#ifndef MATCHINGENGINE_H
+#define MATCHINGENGINE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "LatencyHistogram.h"
+#include "OrderBook.h"
+#include "OrderCommand.h"
+#include "SpscQueue.h"
+
+/* Multi-instrument engine: one OrderBook per instrument (OrderCommand::instrumentId), instruments spread over shards.
+    Each shard is a worker thread, pinned to a core where supported, fed by its own SPSC queue: a book is only ever touched by its shard's thread.
+    Commands are submitted from a single producer thread; each shard matches the commands it pops in batches (see OrderBook::processBatch).
+    Books are created by their worker on their instrument's first command, hence allocated by the thread (and near the core) using them. */
+class MatchingEngine {
+public:
+    static const std::size_t maxInstruments = 1 << 16;
+
+    struct ShardStats {
+        std::size_t instruments;
+        uint64_t processedMessages;
+        std::size_t queueDepth;     // Messages waiting now
+        std::size_t maxQueueDepth;  // Max messages waiting when the worker popped
+        // Latency from submission to the end of matching, in nanoseconds
+        double meanLatencyNs;
+        double p50LatencyNs, p99LatencyNs, p999LatencyNs, maxLatencyNs;
+    };
+
+private:
+    struct QueuedCommand {
+        OrderCommand command;
+        uint64_t submissionCycles;
+    };
+
+    struct Shard {
+        SpscQueue<QueuedCommand> queue;
+        std::thread worker;
+        std::unordered_map<uint16_t, std::unique_ptr<OrderBook>> books; // Worker thread only
+        LatencyHistogram latency;                                        // Worker thread only, read once idle
+        std::atomic<uint64_t> processedMessages;                         // Written by the worker
+        std::atomic<std::size_t> maxQueueDepth;                          // ...
+        uint64_t submittedMessages;                                      // Producer thread only
+
+        explicit Shard(std::size_t queueCapacity) : queue(queueCapacity), processedMessages(0), maxQueueDepth(0), submittedMessages(0) {}
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::vector<uint16_t> shardOfInstrument;
+    std::vector<char> touchedShards; // Producer thread only: shards to publish at the end of submit()
+    std::atomic<bool> running;
+    bool pinThreads;
+    double cyclesPerNs;
+
+    void runWorker(std::size_t shardIndex);
+    const OrderBook* findBook(uint16_t instrumentId) const;
+
+public:
+    explicit MatchingEngine(std::size_t numberOfShards, std::size_t queueCapacity = 1 << 16, bool pinThreads = true);
+    ~MatchingEngine(); // Stops the workers
+    MatchingEngine(const MatchingEngine&) = delete;
+    MatchingEngine& operator=(const MatchingEngine&) = delete;
+
+    // Instruments are spread round-robin by default; assignments must be done before start()
+    void assignInstrument(uint16_t instrumentId, std::size_t shardIndex);
+    void start();
+    void stop(); // Returns once every submitted command was matched
+
+    // Producer thread only. Waits (yielding) while a shard's queue is full
+    void submit(const OrderCommand* commands, std::size_t count);
+    inline void submit(const OrderCommand& command) { submit(&command, 1); }
+    void waitUntilIdle() const; // Returns once every submitted command was matched
+
+    // Getters; books & latencies are only read while the engine is idle (after waitUntilIdle or stop)
+    inline std::size_t getShardCount() const { return shards.size(); }
+    inline std::size_t getShardOf(uint16_t instrumentId) const { return shardOfInstrument[instrumentId]; }
+    ShardStats getShardStats(std::size_t shardIndex) const;
+    uint64_t getChecksum(uint16_t instrumentId) const; // OrderBook::getChecksum of the instrument's book, 0 if it has none
+    uint64_t getChecksum() const; // Combined checksum of every book, independent of the number of shards
+};
+
+#endif
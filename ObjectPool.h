@@ -0,0 +1,183 @@
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+/* Slab allocator for the objects of an order book (order queue chunks & limit levels): objects are placement-constructed into
+    fixed-size slabs, and freed slots are chained in an intrusive free list, hence no malloc/free on the hot path once warm.
+    Slabs hold a power of two number of slots, so a slot can also be addressed by a 32-bit index (slab, offset), see indexOf & at.
+    Objects still alive when the pool is destroyed are released without running their destructors. */
+template <typename T>
+class ObjectPool {
+private:
+    union Slot {
+        Slot* nextFree; // Only meaningful while the slot is in the free list
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    struct Slab {
+        Slot* slots;
+        void* memory;  // As allocated: slots are aligned up from it for over-aligned types
+        std::size_t bytes;
+        bool isMapped; // Allocated with mmap (huge pages) rather than operator new
+    };
+
+    std::vector<Slab> slabs;
+    std::vector<std::pair<const Slot*, uint32_t>> slabsByAddress; // (first slot, slab index), sorted by address, see indexOf
+    Slot* freeList;       // Freed slots, reused first
+    std::size_t nextUnused; // Index of the first never used slot of the last slab
+    std::size_t slotsPerSlab;
+    unsigned slabShift;   // log2(slotsPerSlab)
+    bool useHugePages;
+
+    std::size_t liveObjects;
+    std::size_t highWaterMark;
+    std::size_t createdObjects; // Since construction: created - live were destroyed
+
+    void addSlab(bool prefault) {
+        std::size_t bytes = slotsPerSlab * sizeof(Slot);
+        Slab slab = { nullptr, nullptr, bytes, false };
+#if defined(__linux__)
+        if (useHugePages) {
+            const std::size_t hugePageSize = 2 * 1024 * 1024;
+            slab.bytes = (bytes + hugePageSize - 1) / hugePageSize * hugePageSize;
+            void* memory = mmap(nullptr, slab.bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (memory == MAP_FAILED) { // No reserved huge pages: fall back to transparent huge pages
+                memory = mmap(nullptr, slab.bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (memory != MAP_FAILED)
+                    madvise(memory, slab.bytes, MADV_HUGEPAGE);
+            }
+            if (memory == MAP_FAILED)
+                throw std::bad_alloc();
+            slab.slots = static_cast<Slot*>(memory); // Page aligned
+            slab.memory = memory;
+            slab.isMapped = true;
+        }
+#endif
+        if (!slab.slots) {
+            // operator new only guarantees the alignment of fundamental types, over-aligned slots are aligned up within a larger block
+            std::size_t padding = (alignof(Slot) > alignof(std::max_align_t)) ? alignof(Slot) : 0;
+            slab.bytes = bytes + padding;
+            slab.memory = ::operator new(slab.bytes);
+            std::size_t address = reinterpret_cast<std::size_t>(slab.memory);
+            slab.slots = reinterpret_cast<Slot*>(padding ? (address + padding - 1) / padding * padding : address);
+        }
+        if (prefault) // Touch every page now rather than on the first orders
+            std::memset(static_cast<void*>(slab.slots), 0, bytes);
+
+        std::pair<const Slot*, uint32_t> entry(slab.slots, (uint32_t)slabs.size());
+        slabsByAddress.insert(std::upper_bound(slabsByAddress.begin(), slabsByAddress.end(), entry), entry);
+        slabs.push_back(slab);
+        nextUnused = 0;
+    }
+
+    Slot* takeSlot() {
+        if (freeList) {
+            Slot* slot = freeList;
+            freeList = slot->nextFree;
+            return slot;
+        }
+        if (slabs.empty() || nextUnused == slotsPerSlab)
+            addSlab(false);
+        return &slabs.back().slots[nextUnused++];
+    }
+
+public:
+    // Preallocates enough slabs for capacity objects; with useHugePages, slabs are backed by 2MB pages when the system allows it
+    explicit ObjectPool(std::size_t capacity = 0, bool _useHugePages = false) :
+        freeList(nullptr), nextUnused(0), slotsPerSlab(1024), slabShift(10), useHugePages(_useHugePages),
+        liveObjects(0), highWaterMark(0), createdObjects(0)
+    {
+        // Huge page slabs are at least one huge page large
+        std::size_t minSlabBytes = useHugePages ? 2 * 1024 * 1024 : 64 * 1024;
+        while (slotsPerSlab * sizeof(Slot) < minSlabBytes) {
+            slotsPerSlab <<= 1;
+            ++slabShift;
+        }
+
+        // Preallocated slabs are chained in the free list in address order, the last one is left for the bump pointer
+        std::size_t slabCount = (capacity + slotsPerSlab - 1) / slotsPerSlab;
+        for (std::size_t i = 0; i < slabCount; ++i)
+            addSlab(true);
+        for (std::size_t i = slabCount; i-- > 1; )
+            for (std::size_t j = slotsPerSlab; j-- > 0; ) {
+                Slot* slot = &slabs[i - 1].slots[j];
+                slot->nextFree = freeList;
+                freeList = slot;
+            }
+    }
+
+    ~ObjectPool() {
+        for (Slab& slab : slabs) {
+#if defined(__linux__)
+            if (slab.isMapped) {
+                munmap(slab.memory, slab.bytes);
+                continue;
+            }
+#endif
+            ::operator delete(slab.memory);
+        }
+    }
+
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    template <typename... Args>
+    T* create(Args&&... args) {
+        Slot* slot = takeSlot();
+        T* object = new (slot->storage) T(std::forward<Args>(args)...);
+        if (++liveObjects > highWaterMark)
+            highWaterMark = liveObjects;
+        ++createdObjects;
+        return object;
+    }
+
+    void destroy(T* object) {
+        if (!object)
+            return;
+        object->~T();
+        Slot* slot = reinterpret_cast<Slot*>(object);
+        slot->nextFree = freeList;
+        freeList = slot;
+        --liveObjects;
+    }
+
+    // 32-bit index of an object of the pool (slab << slabShift | offset), found with a binary search over the slabs
+    uint32_t indexOf(const T* object) const {
+        const Slot* slot = reinterpret_cast<const Slot*>(object);
+        auto slab = std::upper_bound(slabsByAddress.begin(), slabsByAddress.end(), std::make_pair(slot, UINT32_MAX)) - 1;
+        return slab->second << slabShift | (uint32_t)(slot - slab->first);
+    }
+
+    // Object at an index returned by indexOf
+    inline T* at(uint32_t index) const {
+        return reinterpret_cast<T*>(slabs[index >> slabShift].slots[index & (slotsPerSlab - 1)].storage);
+    }
+
+    // Getters
+    inline std::size_t getLiveObjects() const { return liveObjects; }
+    inline std::size_t getHighWaterMark() const { return highWaterMark; }
+    inline std::size_t getCreatedObjects() const { return createdObjects; }
+    inline std::size_t getDestroyedObjects() const { return createdObjects - liveObjects; }
+    inline std::size_t getCapacity() const { return slabs.size() * slotsPerSlab; }
+    inline std::size_t getReservedBytes() const {
+        std::size_t bytes = 0;
+        for (const Slab& slab : slabs)
+            bytes += slab.bytes;
+        return bytes;
+    }
+    inline std::size_t getSlotsPerSlab() const { return slotsPerSlab; }
+    inline unsigned getSlabShift() const { return slabShift; }
+};
+
+#endif
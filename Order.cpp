@@ -6,90 +6,49 @@
 #include "Limit.h"
 
 
-Order::Order(int _idNumber, OrderSide _orderSide, int _orderShares, int _limitPrice, OrderType _orderType, TimeInForce _tif): 
-    idNumber(_idNumber), orderSide(_orderSide), orderShares(_orderShares), limitPrice(_limitPrice),
-    orderType(_orderType), tif(_tif), submissionTime(std::time(nullptr)),
-    parentLimit(nullptr), previousOrder(nullptr), nextOrder(nullptr)
+Order::Order(int _idNumber, int _orderShares, TimeInForce _tif): 
+    idNumber(_idNumber), orderShares(_orderShares), timeAndTIF((uint64_t)_tif << tifShift)
 {}
 
 void Order::displayOrder() const {
     std::cout << "Following are the information of Order " << idNumber << std::endl;
-    std::cout << "  Order Side: " << (orderSide == OrderSide::Bid ? "Bid" : "Ask") << std::endl;
+    std::cout << "  Order Side: " << (getOrderSide() == OrderSide::Bid ? "Bid" : "Ask") << std::endl;
     std::cout << "  Number of shares: " << orderShares << std::endl;
-    if (orderType == OrderType::LimitOrder)
-        std::cout << "  Limit price: " << limitPrice << std::endl;
-    std::cout << "  Order Type: " << (orderType == OrderType::LimitOrder ? "Limit Order" 
-        : orderType == OrderType::MarketOrder ? "Market Order" : "Stop Order") << std::endl;
+    if (getOrderType() == OrderType::LimitOrder)
+        std::cout << "  Limit price: " << getLimitPrice() << std::endl;
+    std::cout << "  Order Type: " << (getOrderType() == OrderType::LimitOrder ? "Limit Order" 
+        : getOrderType() == OrderType::MarketOrder ? "Market Order" : "Stop Order") << std::endl;
 }
 
-void Order::amendOrder(int newShares, int newLimitPrice) {
-    /* Note: After calling this method, 
-        1° Add limit level to limit/stop map
-        2° Add the modified order to its limit/stop DLL in the limit/stop map
-        3° Add the new number of shares to the limit level, if it's a limit level
+void Order::amendOrder(int newShares, uint64_t amendTime) {
+    /* Note: Orders are stored in their level's queue, hence an order that loses its time priority (new price or more shares) is a copy of the original,
+        amended then added to the back of its new level (see OrderBook::amendRestingOrder):
+        1° Copy the order, amend the copy (its new price is its new level's), then add it to its limit/stop level, and point the order index to the slot it's copied into
+        2° Remove the original from its level (delete the level if it's left empty)
     */
     if (newShares <= 0)
         throw std::invalid_argument("Order shares must be positive");
 
-    submissionTime = std::time(nullptr);
+    setSubmissionTime(amendTime);
     orderShares = newShares;
-
-    if (limitPrice != newLimitPrice) {
-        limitPrice = newLimitPrice;
-            
-        parentLimit->numberOfOrders -= 1;
-        parentLimit->totalShares -= orderShares;
-        
-        parentLimit = nullptr;
-        previousOrder = nextOrder = nullptr;
-    }
-
-    // TO DO: Update Head & Tail orders
 }
 
-void Order::cancelOrder() {
-    /* Note: After cancelling an order, 
-        1° Delete its limit/stop level if it's empty
-        2° Remove order from its map
-        3° Finally delete order
-    */
-    if (!parentLimit) 
-        return;
-
-    if (previousOrder)
-        previousOrder->setNextOrder(nextOrder);
-    else
-        parentLimit->setHeadOrder(nextOrder);
-
-    if (nextOrder)
-        nextOrder->setPreviousOrder(previousOrder);
-    else
-        parentLimit->setTailOrder(previousOrder);
-
-    parentLimit->numberOfOrders -= 1;
-    parentLimit->totalShares -= orderShares;
-    orderShares = 0;
+void Order::reduceShares(int newShares) {
+    // A size decrease keeps the order's slot in its level's queue, hence its time priority and submission time
+    assert(newShares > 0 && newShares <= orderShares && "Invalid reduced shares");
+    getParentLimit()->addShares(newShares - orderShares);
+    orderShares = newShares;
 }
 
 void Order::executeOrder(int tradedShares) {
     /* Note: After an order is fully executed:
-        1° Delete limit level if no order is left
-        2° Delete order from orders map
-        3° Delete order
+        1° Delete order from orders map
+        2° Remove it from its limit level (Limit::removeOrder), which turns it into a tombstone
+        3° Delete limit level if no order is left
     */
     assert(tradedShares > 0 && tradedShares <= orderShares && "Invalid traded shares");
 
-    if (tradedShares == orderShares) { // Full execution
-        //parentLimit->numberOfOrders -= 1; No need to do it here as it will be decremented when the order is removed
-
-        if (parentLimit->getHeadOrder() == this) {
-            parentLimit->setHeadOrder(nextOrder);
-            if (!nextOrder) 
-                parentLimit->setTailOrder(nullptr);
-        }
-        previousOrder = nextOrder = nullptr;
-    }
-
+    // The order stays in its level's queue even when fully executed, Limit::removeOrder then moves the level's head past it
     orderShares -= tradedShares;
-    parentLimit->totalShares -= tradedShares;
+    getParentLimit()->addShares(-tradedShares);
 }
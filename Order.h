@@ -1,54 +1,103 @@
 #ifndef ORDER_H
 #define ORDER_H
 
+#include <cstdint>
+
 #include "enums.h"
 
 
 class Limit;
+struct OrderChunk;
 
+/* A resting order: 16 bytes, stored by value in its level's queue (see OrderChunk), hence it's addressed through the book's order index,
+    by its 32-bit handle (chunk index & slot, see getHandle). Its price, side and type are its level's (found through its chunk), its TIF is
+    packed in the top bits of its submission time. A cancelled order is left in its chunk as a tombstone (0 shares) until its level's head
+    moves past it or the level is compacted */
 class Order {
 private:
     friend class Limit; // Limit class is a friend of Order class, thus it can access the private attributes of Order class
 
+    static const unsigned tifShift = 62;
+    static const uint64_t timeMask = (1ULL << tifShift) - 1; // Nanoseconds since the epoch fit in 62 bits until 2116
+
     // Following are the primary attributes of an order
     int idNumber; // Unique identifier for the order
-    OrderSide orderSide; // Bid or Ask side of the order
-    int orderShares; // Number of shares in the order
-    int limitPrice; // Price level for limit orders
-    OrderType orderType; // Type of order (Limit, Market, Stop)
-    TimeInForce tif; // Time-in-force for the order (GTC, DAY, IOC, FOK)
-    std::time_t submissionTime; // Timestamp when the order was submitted
-
-    Limit* parentLimit;    // The limit level to which this order belongs
-    Order* previousOrder;  // Previous order in the doubly linked list
-    Order* nextOrder;      // Next order in the doubly linked list
-    //      nextOrder  -> Order ->  previousOrder   ; next is next to be executed   &   previous is previously executed
+    int orderShares; // Number of shares in the order, 0 for a tombstone
+    uint64_t timeAndTIF; // Nanoseconds, from the book's clock (see Clock.h), when the order was submitted or last amended | time-in-force << tifShift
+
+    inline OrderChunk* getChunk() const; // The chunk where this order is stored, found from its address
 
 public:
-    Order(int _idNumber, OrderSide _orderSide, int _orderShares, int _limitPrice, OrderType _type = OrderType::LimitOrder, TimeInForce _tif = TimeInForce::GTC);
+    static const unsigned slotBits = 5; // Handles are chunk index << slotBits | slot
+
+    Order() = default; // Chunk slots are left uninitialized until an order is copied in
+    Order(int _idNumber, int _orderShares, TimeInForce _tif = TimeInForce::GTC);
 
-    // Getters
+    // Getters; but for the id, shares, TIF & submission time, only valid for an order stored in a level
     inline int getOrderId() const { return idNumber; }
-    inline OrderSide getOrderSide() const { return orderSide; }
     inline int getOrderShares() const { return orderShares; }
-    inline int getLimitPrice() const { return limitPrice; }
-    inline Limit* getParentLimit() const { return parentLimit; }
-    inline Order* getNextOrder() const { return nextOrder; }
-    inline Order* getPreviousOrder() const { return previousOrder; }
-    inline OrderType getOrderType() const { return orderType; }
-    inline TimeInForce getTIF() const { return tif; }
-    inline std::time_t getSubmissionTime() const { return submissionTime; }
+    inline Limit* getParentLimit() const; // The limit level to which this order belongs
+    inline int getLimitPrice() const; // Limit or stop price, its level's
+    inline OrderSide getOrderSide() const;
+    inline OrderType getOrderType() const; // LimitOrder or StopOrder, from its level's category
+    inline TimeInForce getTIF() const { return (TimeInForce)(timeAndTIF >> tifShift); }
+    inline uint64_t getSubmissionTime() const { return timeAndTIF & timeMask; }
+    inline Order* getNextOrder() const; // Next live order of its level in time priority (tombstones are skipped), nullptr at the tail
+    inline uint32_t getHandle() const; // 32-bit address of the order in its book (see OrderIndex), valid until it's moved
 
     // Setters
-    inline void setPreviousOrder(Order* newPreviousOrder) { previousOrder = newPreviousOrder; }
-    inline void setNextOrder(Order* newNextOrder) { nextOrder = newNextOrder; }
-    inline void setParentLimit(Limit* newParentLimit) { parentLimit = newParentLimit; }
+    inline void setSubmissionTime(uint64_t newSubmissionTime) { timeAndTIF = (timeAndTIF & ~timeMask) | (newSubmissionTime & timeMask); }
 
     void displayOrder() const; // Show order details
 
-    void amendOrder(int newShares, int newLimitPrice); // Modify order
-    void cancelOrder(); // Cancel order
+    void amendOrder(int newShares, uint64_t amendTime); // Modify a copy of the order, before it's requeued (it loses its time priority)
+    void reduceShares(int newShares); // Modify the resting order in place, keeping its time priority: 0 < newShares <= its shares
     void executeOrder(int tradedShares); // Execute order
 };
 
-#endif
\ No newline at end of file
+static_assert(sizeof(Order) == 16, "Order must stay 16 bytes, four orders per cache line");
+
+/* Fixed-size block of a level's queue: orders are appended at end and consumed from begin, in time priority.
+    Only the head chunk of a level has begin > 0; chunks are allocated from the book's pool (see Limit::addOrder), and every order of a chunk
+    belongs to its level. Chunks are aligned on their size, hence an order finds its chunk by masking its address, without a pointer of its own */
+struct alignas(512) OrderChunk {
+    static const int capacity = 30;
+
+    OrderChunk* nextChunk; // Towards the level's tail
+    Limit* level;
+    uint32_t index;        // Index of the chunk in its pool (see ObjectPool::at), the high bits of its orders' handles
+    uint16_t begin;        // First slot still in use: a live order (in the head chunk) or a tombstone
+    uint16_t end;          // First free slot
+    Order orders[capacity];
+
+    OrderChunk() : nextChunk(nullptr), level(nullptr), index(0), begin(0), end(0) {}
+};
+
+static_assert(sizeof(OrderChunk) == 512, "OrderChunk must stay 512 bytes, chunks are found by masking order addresses");
+static_assert(OrderChunk::capacity <= (1 << Order::slotBits), "A chunk's slots must fit in the slot bits of a handle");
+
+inline OrderChunk* Order::getChunk() const {
+    return reinterpret_cast<OrderChunk*>(reinterpret_cast<uintptr_t>(this) & ~(uintptr_t)(sizeof(OrderChunk) - 1));
+}
+
+inline Limit* Order::getParentLimit() const { return getChunk()->level; }
+
+inline uint32_t Order::getHandle() const {
+    OrderChunk* chunk = getChunk();
+    return chunk->index << slotBits | (uint32_t)(this - chunk->orders);
+}
+
+inline Order* Order::getNextOrder() const {
+    const Order* order = this + 1;
+    for (OrderChunk* current = getChunk(); ; ) {
+        for (const Order* chunkEnd = current->orders + current->end; order < chunkEnd; ++order)
+            if (order->orderShares != 0)
+                return const_cast<Order*>(order);
+        current = current->nextChunk;
+        if (!current)
+            return nullptr;
+        order = current->orders + current->begin;
+    }
+}
+
+#endif
@@ -1,394 +1,727 @@
 #include <iostream>
 #include <assert.h>
 #include <algorithm> 
+#include <climits>
+#include <stdexcept>
+#include <vector>
 
 #include "Order.h"
 #include "Limit.h"
 #include "OrderBook.h"
+#include "Journal.h"
+#include "MarketData.h"
+#include "SnapshotFile.h"
+#include "TopOfBook.h"
 
 
-OrderBook::OrderBook():
+OrderBook::OrderBook(std::size_t orderCapacity, std::size_t levelCapacity, bool useHugePages):
     bidTree(nullptr), highestBid(nullptr), askTree(nullptr), lowestAsk(nullptr), 
-    stopBidTree(nullptr), lowestStopBid(nullptr), stopAskTree(nullptr), highestStopAsk(nullptr)
+    stopBidTree(nullptr), lowestStopBid(nullptr), stopAskTree(nullptr), highestStopAsk(nullptr),
+    chunkPool(orderCapacity / OrderChunk::capacity + levelCapacity, useHugePages), limitPool(levelCapacity, useHugePages), orderIndex(chunkPool, orderCapacity),
+    clock(&defaultClock()), tracer(nullptr), profiler(nullptr), journal(nullptr), topOfBook(nullptr), marketData(nullptr)
 {}
 
 OrderBook::~OrderBook(){
-    for (auto& pair : limitBidMap) // pair.first = limitBidPrice && pair.second = limitBid
-        delete pair.second;     // ~Limit will delete its Orders
-
-    for (auto& pair : limitAskMap) // pair.first = limitAskPrice && pair.second = limitAsk
-        delete pair.second;     // ...
-
-    for (auto& pair : stopMap) // pair.first = stopPrice && pair.second = stopLevel
-        delete pair.second; // ...
-
-    // OrderMap now contains dangling pointers (Orders are owned by Limits)
-    // No need to delete Orders manually here!
-    orderMap.clear();  // Optional: Clear dangling pointers
+    // Order chunks and levels live in the book's pools, which release their slabs once destroyed
 }
 
-// Auxiliary methods used in other methods
-void OrderBook::stopOrderToLimitOrder(Order* order, OrderSide orderSide){
-    // Turn a stop limit order into a limit order: Execute the stop order if possible, then make a limit order from the remaining shares
-
-    auto& bookEdge = (orderSide == OrderSide::Bid) ? lowestStopBid : highestStopAsk;
-
-    int tradedShares = std::min(order->getOrderShares(), bookEdge->getTotalShares());
-    order->executeOrder(tradedShares);
+OrderBook::MemoryStats OrderBook::getMemoryStats() const {
+    MemoryStats stats;
+    stats.liveOrders = orderIndex.size();
+    stats.liveLevels = limitPool.getLiveObjects();
+    stats.liveChunks = chunkPool.getLiveObjects();
+    stats.orderHighWaterMark = chunkPool.getHighWaterMark() * OrderChunk::capacity;
+    stats.levelHighWaterMark = limitPool.getHighWaterMark();
+
+    // Pools' slabs and order index, plus an estimate of the level maps' nodes (key, value & next pointer) and bucket arrays
+    std::size_t nodeBytes = sizeof(void*) + sizeof(std::pair<const int, void*>);
+    stats.reservedBytes = chunkPool.getReservedBytes() + limitPool.getReservedBytes()
+        + orderIndex.getReservedBytes()
+        + (limitBidMap.size() + limitAskMap.size() + stopBidMap.size() + stopAskMap.size()) * nodeBytes
+        + (limitBidMap.bucket_count() + limitAskMap.bucket_count() + stopBidMap.bucket_count() + stopAskMap.bucket_count()) * sizeof(void*)
+        + triggeredStops.capacity() * sizeof(Limit*);
+    stats.bytesPerRestingOrder = stats.liveOrders ? (double)stats.reservedBytes / stats.liveOrders : 0.0;
+    return stats;
+}
 
-    if (tradedShares == bookEdge->getTotalShares()) // All shares from the current book edge were traded, hence delete the book edge limit
-        deleteLevel(bookEdge, OrderCategory::Stop);
+void OrderBook::loadSnapshot(const SnapshotFile& snapshot){
+    if (!orderIndex.empty() || bidTree || askTree || stopBidTree || stopAskTree)
+        throw std::logic_error("Snapshots are loaded into an empty book");
+
+    orderIndex.reserve(snapshot.getOrderCount());
+    const SnapshotLevel* levelRecord = snapshot.getLevels();
+    const SnapshotOrder* orderRecord = snapshot.getOrders();
+    const SnapshotOrder* lastOrderRecord = orderRecord + snapshot.getOrderCount();
+    const std::size_t prefetchDistance = 16; // Order index slots are loaded this many orders ahead of their insertion
+    std::vector<Limit*> levels;
+
+    for (int tree = 0; tree < 4; ++tree){
+        OrderSide orderSide = (tree % 2 == 0) ? OrderSide::Bid : OrderSide::Ask;
+        OrderCategory orderCategory = (tree < 2) ? OrderCategory::Limit : OrderCategory::Stop;
+        auto& levelMap = (tree < 2) ? ((orderSide == OrderSide::Bid) ? limitBidMap : limitAskMap)
+            : ((orderSide == OrderSide::Bid) ? stopBidMap : stopAskMap);
+
+        levels.clear();
+        levels.reserve(snapshot.getLevelCount(tree));
+        levelMap.reserve(snapshot.getLevelCount(tree));
+        for (std::size_t i = 0; i < snapshot.getLevelCount(tree); ++i, ++levelRecord){
+            Limit* level = limitPool.create(levelRecord->price, orderSide, orderCategory);
+            for (uint32_t j = 0; j < levelRecord->numberOfOrders; ++j, ++orderRecord){
+                if (orderRecord + prefetchDistance < lastOrderRecord)
+                    orderIndex.prefetch(orderRecord[prefetchDistance].orderId);
+                if (orderRecord->shares <= 0)
+                    throw std::runtime_error("Corrupt snapshot: order shares must be positive");
+
+                Order* order = level->addOrder(Order(orderRecord->orderId, orderRecord->shares, (TimeInForce)orderRecord->tif),
+                    chunkPool); // No parent yet: only the level's own counters change
+                order->setSubmissionTime(orderRecord->submissionTime);
+                if (!orderIndex.insert(orderRecord->orderId, order))
+                    throw std::runtime_error("Corrupt snapshot: duplicate order id");
+            }
+            levelMap.emplace(levelRecord->price, level);
+            levels.push_back(level);
+        }
 
-    if (order->getOrderShares() != 0){
-        auto& limitMap = (orderSide == OrderSide::Bid) ? limitBidMap : limitAskMap;
+        Limit* root = buildLevelTree(levels.data(), levels.size(), nullptr);
+        Limit* lowestLevel = levels.empty() ? nullptr : levels.front();
+        Limit* highestLevel = levels.empty() ? nullptr : levels.back();
+        switch (tree){
+            case 0: bidTree = root; highestBid = highestLevel; break;
+            case 1: askTree = root; lowestAsk = lowestLevel; break;
+            case 2: stopBidTree = root; lowestStopBid = lowestLevel; break;
+            default: stopAskTree = root; highestStopAsk = highestLevel; break;
+        }
+    }
+}
 
-        if (limitMap.find(order->getLimitPrice()) == limitMap.end())
-            addLimit(order->getLimitPrice(), orderSide);
+PriceLevelIterator OrderBook::getLevelIterator(OrderSide orderSide, OrderCategory orderCategory) const {
+    if (orderCategory == OrderCategory::Limit)
+        return (orderSide == OrderSide::Bid) ? PriceLevelIterator(highestBid, true) : PriceLevelIterator(lowestAsk, false);
+    return (orderSide == OrderSide::Bid) ? PriceLevelIterator(lowestStopBid, false) : PriceLevelIterator(highestStopAsk, true);
+}
 
-        limitMap[order->getLimitPrice()]->addOrder(order);
+std::size_t OrderBook::getDepth(OrderSide orderSide, std::size_t maxLevels, DepthLevel* levels) const {
+    std::size_t count = 0;
+    for (PriceLevelIterator it = getLevelIterator(orderSide); count < maxLevels && it != PriceLevelIterator(); ++it, ++count){
+        levels[count].price = it->getLimitPrice();
+        levels[count].totalShares = it->getTotalShares();
+        levels[count].numberOfOrders = it->getNumberOfOrders();
     }
-    else
-        delete order;
+    return count;
 }
 
-// Execute orders method
-void OrderBook::executeStopOrders(OrderSide orderSide){
-    /* We go through Stop orders and execute those that were triggered if there are enough shares in the order book
-        If a stop order is partially executed, then we make a limit order from the remaining shares */
-    if (orderSide == OrderSide::Bid){
-        while (lowestStopBid != nullptr && lowestAsk != nullptr && lowestStopBid->getLimitPrice() <= lowestAsk->getLimitPrice()){
-            Order* headOrder = lowestStopBid->getHeadOrder();
-
-            int tradedShares = std::min(headOrder->getOrderShares(), lowestAsk->getTotalShares());
-            headOrder->executeOrder(tradedShares);
-
-            while (tradedShares > 0 && lowestAsk->getHeadOrder() != nullptr){
-                Order* askHeadOrder = lowestAsk->getHeadOrder();
-                int _tradedShares = std::min(askHeadOrder->getOrderShares(), tradedShares);
-                askHeadOrder->executeOrder(_tradedShares);
-                tradedShares -= _tradedShares;
-                
-                if (askHeadOrder->getOrderShares() == 0){
-                    orderMap.erase(askHeadOrder->getOrderId());
-                    askHeadOrder->cancelOrder();
-                    delete askHeadOrder;
-                }
-            }
+void OrderBook::getTopOfBook(TopOfBookSnapshot& snapshot) const {
+    snapshot.bidLevels = (uint32_t)getDepth(OrderSide::Bid, TopOfBookSnapshot::maxLevels, snapshot.bids);
+    snapshot.askLevels = (uint32_t)getDepth(OrderSide::Ask, TopOfBookSnapshot::maxLevels, snapshot.asks);
+    // Unused levels are zeroed, hence equal tops are equal snapshots
+    std::fill(snapshot.bids + snapshot.bidLevels, snapshot.bids + TopOfBookSnapshot::maxLevels, DepthLevel());
+    std::fill(snapshot.asks + snapshot.askLevels, snapshot.asks + TopOfBookSnapshot::maxLevels, DepthLevel());
+}
 
-            if (!lowestAsk->getHeadOrder()){
-                updateBookEdge(lowestAsk, OrderCategory::Limit);
-                deleteLevel(lowestAsk, OrderCategory::Limit);
-            }
+void OrderBook::publishTopOfBook(){
+    if (!topOfBook)
+        return;
+    TopOfBookSnapshot snapshot;
+    getTopOfBook(snapshot);
+    topOfBook->publish(snapshot);
+}
 
-           if (tradedShares == headOrder->getOrderShares()){
-                orderMap.erase(headOrder->getOrderId());
-                headOrder->cancelOrder(); // We cancel headOrder in order to update both head and tail orders of lowestStopBid
-                delete headOrder;
+void OrderBook::publishMarketData(){
+    if (marketData)
+        marketData->encodeChanges(*this);
+}
 
-                if (!lowestStopBid->getHeadOrder()){
-                    updateBookEdge(lowestStopBid, OrderCategory::Stop);
-                    deleteLevel(lowestStopBid, OrderCategory::Stop);
-                }
-            }
-            else    
-                stopOrderToLimitOrder(headOrder, orderSide);
-        }
-    }
-    else{ // orderSide == OrderSide::Ask
-        while (highestStopAsk != nullptr && highestBid != nullptr && highestStopAsk->getLimitPrice() >= highestBid->getLimitPrice()){
-            Order* headOrder = highestStopAsk->getHeadOrder();
-
-            int tradedShares = std::min(headOrder->getOrderShares(), highestBid->getTotalShares());
-            headOrder->executeOrder(tradedShares);
-            
-            while (tradedShares > 0 && highestBid->getHeadOrder() != nullptr){
-                Order* askHeadOrder = highestBid->getHeadOrder();
-                int _tradedShares = std::min(askHeadOrder->getOrderShares(), tradedShares);
-                askHeadOrder->executeOrder(_tradedShares);
-                tradedShares -= _tradedShares;
-                
-                if (askHeadOrder->getOrderShares() == 0){
-                    orderMap.erase(askHeadOrder->getOrderId());
-                    askHeadOrder->cancelOrder();
-                    delete askHeadOrder;
-                }
-            }
+const Limit* OrderBook::findLevel(OrderSide orderSide, int price, OrderCategory orderCategory) const {
+    const std::unordered_map<int, Limit*>& levels = (orderCategory == OrderCategory::Limit) ? ((orderSide == OrderSide::Bid) ? limitBidMap : limitAskMap)
+        : ((orderSide == OrderSide::Bid) ? stopBidMap : stopAskMap);
+    auto it = levels.find(price);
+    return (it == levels.end()) ? nullptr : it->second;
+}
 
-            if (highestBid->getHeadOrder() == nullptr){
-                updateBookEdge(highestBid, OrderCategory::Limit);
-                deleteLevel(highestBid, OrderCategory::Limit);
-            }
+template <OrderSide Side, OrderCategory Category>
+inline void OrderBook::markLevelChanged(int price){
+    if (Category == OrderCategory::Limit && marketData) // Stop orders aren't market data
+        marketData->markLevel(Side, price);
+}
 
-           if (tradedShares == headOrder->getOrderShares()){
-                orderMap.erase(headOrder->getOrderId());
-                headOrder->cancelOrder(); // We cancel headOrder in order to update both head and tail orders of lowestStopBid
-                delete headOrder;
+// Auxiliary methods used in other methods
+template <OrderSide Side, typename Listener>
+void OrderBook::stopOrderToLimitOrder(Order* order, Listener& listener){
+    // Turn a triggered stop order into a limit order at its stop price, made of its remaining shares; it leaves its (detached) stop level
+    // The copy's price & type are its new level's: the stop price is read before the order leaves its level
+    int remainingShares = order->getOrderShares();
+    int price = order->getLimitPrice();
+    Order limitOrder = *order;
+    order->getParentLimit()->removeOrder(order, chunkPool); // The head of its stop level moves to the next stop
+
+    limitOrder.amendOrder(remainingShares, clock->now()); // A new limit order, at the back of its level
+
+    Limit* level = findOrAddLevel<Side, OrderCategory::Limit>(price);
+    orderIndex.relocate(limitOrder.getOrderId(), level->addOrder(limitOrder, chunkPool));
+    markLevelChanged<Side, OrderCategory::Limit>(price);
+    listener.onAck(limitOrder.getOrderId(), Side, price, remainingShares);
+}
 
-                if (lowestStopBid->getHeadOrder() == nullptr){
-                    updateBookEdge(highestStopAsk, OrderCategory::Stop);
-                    deleteLevel(highestStopAsk, OrderCategory::Stop);
+// Execute orders method
+template <OrderSide Side, typename Listener>
+void OrderBook::executeStopOrders(Listener& listener){
+    /* The stop cascade, in rounds: every stop crossed by the touch is extracted at once (one split of its stop tree, see extractTriggeredStops),
+        then executed from the stop edge inward, in time priority within a level. Their trades move the touch, which may cross more stops: next round.
+        If the other side of the book is emptied, the stops left are put back and wait for the next trades */
+    Limit*& touch = bookEdge<oppositeSide(Side), OrderCategory::Limit>();
+    auto& stopMap = levelMap<Side, OrderCategory::Stop>();
+
+    while (std::size_t count = extractTriggeredStops<Side>()){
+        for (std::size_t i = 0; i < count; ++i){
+            Limit* stopLevel = triggeredStops[i];
+            while (Order* stopOrder = stopLevel->getHeadOrder()){
+                if (touch == nullptr){
+                    restoreStopLevels<Side>(i, count);
+                    return;
                 }
+                executeTriggeredStop<Side>(stopOrder, listener);
             }
-            else    
-                stopOrderToLimitOrder(headOrder, orderSide);
+            stopMap.erase(stopLevel->getLimitPrice());
+            limitPool.destroy(stopLevel);
         }
     }
 }
 
+template <OrderSide Side, typename Listener>
+void OrderBook::executeTriggeredStop(Order* stopOrder, Listener& listener){
+    // A triggered stop trades against the touch level only; if it empties it, the stop's remaining shares are made a limit order
+    ProfiledOperation profiled(*this, BookOperation::StopTrigger);
+    Limit* touchLevel = bookEdge<oppositeSide(Side), OrderCategory::Limit>();
+
+    int tradedShares = std::min(stopOrder->getOrderShares(), touchLevel->getTotalShares());
+    stopOrder->executeOrder(tradedShares);
+    markLevelChanged<oppositeSide(Side), OrderCategory::Limit>(touchLevel->getLimitPrice());
+
+    while (tradedShares > 0){
+        Order* headOrder = touchLevel->getHeadOrder();
+        int _tradedShares = std::min(headOrder->getOrderShares(), tradedShares);
+        headOrder->executeOrder(_tradedShares);
+        tradedShares -= _tradedShares;
+        listener.onFill(stopOrder->getOrderId(), headOrder->getOrderId(), Side, touchLevel->getLimitPrice(), _tradedShares, headOrder->getOrderShares());
+
+        if (headOrder->getOrderShares() == 0){
+            orderIndex.erase(headOrder->getOrderId());
+            touchLevel->removeOrder(headOrder, chunkPool);
+        }
+    }
 
-// Limit tree's methods
-void OrderBook::addLimit(int limitPrice, OrderSide orderSide){
-    // Add a new limit level to its limit map and limit tree, then check if it can its book's new edge
-    auto& limitMap = (orderSide == OrderSide::Bid) ? limitBidMap : limitAskMap;
-    auto& tree = (orderSide == OrderSide::Bid) ? bidTree : askTree;
-    auto& bookEdge = (orderSide == OrderSide::Bid) ? highestBid : lowestAsk;
-
-    Limit* newLimit = new Limit(limitPrice, orderSide);
-    limitMap.emplace(limitPrice, newLimit);
+    if (touchLevel->getHeadOrder() == nullptr)
+        deleteLevel<oppositeSide(Side), OrderCategory::Limit>(touchLevel);
 
-    if (!tree) // This limit's tree is empty
-        tree = bookEdge = newLimit;
-    else{
-        // Update tree's root if needed
-        Limit* unused = insertNewLevel(tree, newLimit, nullptr, OrderCategory::Limit);
-        // Update book's edge if needed
-        if (orderSide == OrderSide::Bid){
-            if (highestBid->getLimitPrice() < limitPrice)
-                highestBid = newLimit;
-        }
-        else{ // OrderSide::Limit
-            if (lowestAsk->getLimitPrice() > limitPrice)
-                lowestAsk = newLimit;
-        }
+    if (stopOrder->getOrderShares() == 0){
+        orderIndex.erase(stopOrder->getOrderId());
+        stopOrder->getParentLimit()->removeOrder(stopOrder, chunkPool); // The head of its stop level moves to the next stop
     }
+    else
+        stopOrderToLimitOrder<Side>(stopOrder, listener);
 }
 
 
-// Stop tree's methods
-void OrderBook::addStopLevel(int stopPrice, OrderSide orderSide){
-    auto& stopTree = (orderSide == OrderSide::Bid) ? stopBidTree : stopAskTree;
-    auto& bookEdge = (orderSide == OrderSide::Bid) ? lowestStopBid : highestStopAsk;
+// Limit & Stop trees' methods
+template <OrderSide Side, OrderCategory Category>
+Limit* OrderBook::addLevel(int price){
+    // Add a new level to its level map and tree, then check if it's its book's new edge
+    Limit*& tree = treeRoot<Side, Category>();
+    Limit*& edge = bookEdge<Side, Category>();
 
-    Limit* newStop = new Limit(stopPrice, orderSide);
-    stopMap.emplace(stopPrice, newStop);
+    Limit* newLevel = limitPool.create(price, Side, Category);
+    levelMap<Side, Category>().emplace(price, newLevel);
 
-    if (stopTree == nullptr) // There is no stop level in this tree yet 
-        stopTree = bookEdge = newStop;
+    if (!tree) // This level's tree is empty
+        tree = edge = newLevel;
     else{
         // Update tree's root if needed
-        Limit* unused = insertNewLevel(stopTree, newStop, nullptr, OrderCategory::Stop);
+        tree = insertNewLevel<Side, Category>(tree, newLevel, nullptr);
         // Update book's edge if needed
-        if (orderSide == OrderSide::Bid){ // Then update the book edge
-            if (stopPrice < lowestStopBid->getLimitPrice())
-                lowestStopBid = newStop;
-        }
-        else{
-            if (stopPrice > highestStopAsk->getLimitPrice())
-                highestStopAsk = newStop;
-        }
+        if (isBeyond<Side, Category>(price, edge->getLimitPrice()))
+            edge = newLevel;
     }
+    return newLevel;
+}
+
+template <OrderSide Side, OrderCategory Category>
+Limit* OrderBook::findOrAddLevel(int price){
+    auto& levels = levelMap<Side, Category>();
+    auto it = levels.find(price);
+    return (it != levels.end()) ? it->second : addLevel<Side, Category>(price);
 }
 
 // Limit and Stop trees' shared methods
-Limit* OrderBook::insertNewLevel(Limit* root, Limit* newLevel, Limit* parentLevel, OrderCategory orderCategory){
+template <OrderSide Side, OrderCategory Category>
+Limit* OrderBook::insertNewLevel(Limit* root, Limit* newLevel, Limit* parentLevel){
     /* Inserts a new limit/stop level in the Bid/Ask limit/stop AVL tree.
-    Returns the root of the tree where newLevel (stop or a limit) is inserted. */
+    Returns the root of the subtree where newLevel (stop or a limit) is inserted; only the levels on the insert path are rebalanced. */
 
-    if (!root){ // First stop level to insert in this stop tree
+    if (!root){ // newLevel becomes a leaf of its tree
         newLevel->setParentLimit(parentLevel); 
         return newLevel;
     }
     else if (newLevel->getLimitPrice() < root->getLimitPrice()){ // then move to the left subtree
-        root->setLeftChildLimit(insertNewLevel(root->getLeftChildLimit(), newLevel, root, orderCategory));
-        root = balanceTree(root, orderCategory);
+        root->setLeftChildLimit(insertNewLevel<Side, Category>(root->getLeftChildLimit(), newLevel, root));
+        root = balanceTree<Side, Category>(root);
     }
     else if (newLevel->getLimitPrice() > root->getLimitPrice()){ // then move to the right subtree
-        root->setRightChildLimit(insertNewLevel(root->getRightChildLimit(), newLevel, root, orderCategory));
-        root = balanceTree(root, orderCategory);
+        root->setRightChildLimit(insertNewLevel<Side, Category>(root->getRightChildLimit(), newLevel, root));
+        root = balanceTree<Side, Category>(root);
     }
     return root;
 }
 
-void OrderBook::deleteLevel(Limit* level, OrderCategory orderCategory){
+template <OrderSide Side, OrderCategory Category>
+void OrderBook::deleteLevel(Limit* level){
     /* When deleting a stop/limit level we do the following (all if needed):
-            Update book edge  ->  Update tree root  ->  Rebalance AVL tree -&- Update parent/children of connected nodes */
+            Update book edge  ->  Unlink the level from its tree  ->  Rebalance the AVL tree from the lowest modified level up to the root */
 
-    updateBookEdge(level, orderCategory);
-    updateTreeRoot(level, orderCategory);
+    updateBookEdge<Side, Category>(level);
 
-    Limit* parentLimit = level->getParentLimit();
-    int levelPrice = level->getLimitPrice();
-
-    (orderCategory == OrderCategory::Stop) ? stopMap.erase(levelPrice) 
-        : (level->getOrderSide() == OrderSide::Bid) ? limitBidMap.erase(levelPrice) : limitAskMap.erase(levelPrice);
-    delete level;
-
-    while (parentLimit != nullptr){
-        parentLimit = balanceTree(parentLimit, OrderCategory::Stop);
-        
-        if (parentLimit->getParentLimit() != nullptr){
+    Limit* leftChild = level->getLeftChildLimit();
+    Limit* rightChild = level->getRightChildLimit();
+    Limit* rebalanceFrom; // lowest level whose subtree changed
 
-            if (parentLimit->getParentLimit()->getLimitPrice() > levelPrice)
-                parentLimit->getParentLimit()->setLeftChildLimit(parentLimit);
-            else
-                parentLimit->getParentLimit()->setRightChildLimit(parentLimit);
+    if (!leftChild || !rightChild){ // The level is replaced by its only child (if any)
+        rebalanceFrom = level->getParentLimit();
+        updateTreeRoot<Side, Category>(level, leftChild ? leftChild : rightChild);
+    }
+    else{ // The level is replaced by its in-order successor, i.e. the leftmost level of its right subtree
+        Limit* successor = rightChild;
+        while (successor->getLeftChildLimit())
+            successor = successor->getLeftChildLimit();
+
+        if (successor != rightChild){
+            rebalanceFrom = successor->getParentLimit();
+            rebalanceFrom->setLeftChildLimit(successor->getRightChildLimit());
+            if (successor->getRightChildLimit())
+                successor->getRightChildLimit()->setParentLimit(rebalanceFrom);
+
+            successor->setRightChildLimit(rightChild);
+            rightChild->setParentLimit(successor);
         }
+        else
+            rebalanceFrom = successor;
 
-        parentLimit = parentLimit->getParentLimit();
+        successor->setLeftChildLimit(leftChild);
+        leftChild->setParentLimit(successor);
+        updateTreeRoot<Side, Category>(level, successor);
     }
-}
 
+    levelMap<Side, Category>().erase(level->getLimitPrice());
+    limitPool.destroy(level);
 
-// Limit order methods
-void OrderBook::addLimitOrder(int orderId, OrderSide orderSide, int limitPrice, int shares){
-    // Trade the biggest possible number of shares, then make a limit order from the remaining shares
-    if (orderSide == OrderSide::Bid){
-        while (shares != 0 && lowestAsk != nullptr && limitPrice >= lowestAsk->getLimitPrice())
-            executeMarketOrder(orderSide, shares);
-    }   
-    else{ // orderSide == OrderSide::Ask
-        while (shares != 0 && highestBid != nullptr && limitPrice <= highestBid->getLimitPrice())
-            executeMarketOrder(orderSide, shares);
-    }
-
-    if (shares != 0){ // some or all shares are left
-        Order* newOrder = new Order(orderId, orderSide, shares, limitPrice);
-        orderMap.emplace(orderId, newOrder);
+    rebalanceToRoot<Side, Category>(rebalanceFrom);
+}
 
-        auto& limitMap = (orderSide == OrderSide::Bid) ? limitBidMap : limitAskMap;
+template <OrderSide Side, OrderCategory Category>
+void OrderBook::removeRestingOrder(Order* order){
+    // A cancelled or modified order leaves its level, which is deleted once empty, or compacted once its tombstones outnumber its orders
+    Limit* level = order->getParentLimit();
+    markLevelChanged<Side, Category>(level->getLimitPrice());
+    level->removeOrder(order, chunkPool);
+
+    if (level->getNumberOfOrders() == 0)
+        deleteLevel<Side, Category>(level);
+    else if (level->needsCompaction())
+        level->compact(chunkPool, orderIndex);
+}
 
-        if (limitMap.find(limitPrice) == limitMap.end())
-            addLimit(limitPrice, orderSide);
-        
-        limitMap[limitPrice]->addOrder(newOrder);
+template <OrderSide Side, OrderCategory Category, typename Listener>
+void OrderBook::amendRestingOrder(Order* order, int newShares, int newPrice, Listener& listener){
+    /* A size decrease at the same price is done in place: the order keeps its slot, hence its time priority, and no level changes.
+        Otherwise the order loses its priority and is queued at the back of the level at its new price: its own level for a size increase,
+        which stays in its tree even if the order was alone in it; its former level is deleted only if the order leaves it empty */
+    int orderId = order->getOrderId();
+    Limit* level = order->getParentLimit();
+    if (newPrice == order->getLimitPrice() && newShares > 0 && newShares <= order->getOrderShares())
+        order->reduceShares(newShares);
+    else{
+        Order amendedOrder = *order;
+        amendedOrder.amendOrder(newShares, clock->now());
+        if (newPrice == level->getLimitPrice()){
+            level->removeOrder(order, chunkPool);
+            orderIndex.relocate(orderId, level->addOrder(amendedOrder, chunkPool));
+            if (level->needsCompaction())
+                level->compact(chunkPool, orderIndex);
+        }
+        else{
+            orderIndex.relocate(orderId, findOrAddLevel<Side, Category>(newPrice)->addOrder(amendedOrder, chunkPool));
+            removeRestingOrder<Side, Category>(order);
+        }
     }
-    else // all shares were traded, hence we check if some stop orders can be executed now that the order book was updated
-        executeStopOrders(orderSide);
+    markLevelChanged<Side, Category>(newPrice);
+    listener.onAck(orderId, Side, newPrice, newShares);
 }
 
-void OrderBook::cancelLimitOrder(int orderId){
-    // Cancel order, Delete limit level if empty, then Delete order from orderMap and deallocate memory 
-    auto it = orderMap.find(orderId);
-    if (it == orderMap.end()) return;  // Order not found
 
-    Order* order = it->second;
-    
-    order->cancelOrder();
-    
-    if (order->getParentLimit()->getNumberOfOrders() == 0)
-        deleteLevel(order->getParentLimit(), OrderCategory::Limit);
-    
-    orderMap.erase(orderId);
-    //delete order;
+// Limit order methods
+template <typename Listener>
+void OrderBook::addLimitOrder(int orderId, OrderSide orderSide, int limitPrice, int shares, Listener&& listener){
+    addLimitOrder(orderId, orderSide, limitPrice, shares, TimeInForce::GTC, listener);
 }
 
-void OrderBook::modifyLimitOrder(int orderId, int newShares, int newLimitPrice){
-    Order* order = orderMap[orderId];
-    assert(order != nullptr && "Error: This order Id doesn't exist");
+template <typename Listener>
+void OrderBook::addLimitOrder(int orderId, OrderSide orderSide, int limitPrice, int shares, TimeInForce tif, Listener&& listener){
+    ProfiledOperation profiled(*this, BookOperation::AddLimit);
+    if (orderSide == OrderSide::Bid)
+        submitLimitOrder<OrderSide::Bid>(orderId, limitPrice, shares, tif, listener);
+    else
+        submitLimitOrder<OrderSide::Ask>(orderId, limitPrice, shares, tif, listener);
+}
 
-    order->cancelOrder();
+template <OrderSide Side, typename Listener>
+void OrderBook::submitLimitOrder(int orderId, int limitPrice, int shares, TimeInForce tif, Listener& listener){
+    // Trade the biggest possible number of shares, then make a limit order from the remaining shares (GTC & DAY) or cancel them (IOC)
+    if (orderIndex.contains(orderId)){ // The id of a live order
+        listener.onCancel(orderId, Side, limitPrice, shares);
+        return;
+    }
+    uint64_t submissionTime = clock->now();
+    OrderTrace* trace = tracer ? tracer->beginTrace(orderId, OrderType::LimitOrder, submissionTime) : nullptr;
+
+    if (tif == TimeInForce::FOK && getSharesAvailable(Side, limitPrice) < shares){ // Killed without trading, in O(log(M))
+        listener.onCancel(orderId, Side, limitPrice, shares);
+        if (trace)
+            trace->matchedTime = trace->ackTime = clock->now();
+        return;
+    }
 
-    Limit* parentLimit = order->getParentLimit();
-    if (parentLimit->getNumberOfOrders() == 0)
-        deleteLevel(parentLimit, OrderCategory::Limit);
+    int submittedShares = shares;
+    matchOrder<Side>(shares, limitPrice, orderId, listener);
+    if (trace)
+        trace->matchedTime = clock->now();
+
+    bool rests = shares != 0 && (tif == TimeInForce::GTC || tif == TimeInForce::DAY);
+    if (rests){ // some or all shares are left
+        Limit* level = findOrAddLevel<Side, OrderCategory::Limit>(limitPrice);
+        Order* newOrder = level->addOrder(Order(orderId, shares, tif), chunkPool);
+        newOrder->setSubmissionTime(submissionTime);
+        orderIndex.insert(orderId, newOrder);
+        markLevelChanged<Side, OrderCategory::Limit>(limitPrice);
+        listener.onAck(orderId, Side, limitPrice, shares);
+    }
+    else if (shares != 0) // IOC: the remaining shares are cancelled
+        listener.onCancel(orderId, Side, limitPrice, shares);
+
+    // The trades moved the touch, hence we check if some stop orders can be executed now, after the order rested (the stops it triggers are on its side)
+    if (shares != submittedShares || !rests)
+        executeStopOrders<Side>(listener);
 
-    order->amendOrder(newShares, newLimitPrice);
+    if (trace)
+        trace->ackTime = clock->now();
+}
 
-    OrderSide orderSide = order->getOrderSide();
-    auto& limitMap = (orderSide == OrderSide::Bid) ? limitBidMap : limitAskMap;
+template <typename Listener>
+void OrderBook::cancelLimitOrder(int orderId, Listener&& listener){
+    ProfiledOperation profiled(*this, BookOperation::Cancel);
+    // Delete order from orderIndex, then remove it from its level (Delete limit level if empty)
+    Order* order = orderIndex.find(orderId);
+    if (!order || order->getOrderType() != OrderType::LimitOrder) return;  // Order not found, or not a limit order
+
+    listener.onCancel(orderId, order->getOrderSide(), order->getLimitPrice(), order->getOrderShares());
+    orderIndex.erase(orderId);
+    if (order->getOrderSide() == OrderSide::Bid)
+        removeRestingOrder<OrderSide::Bid, OrderCategory::Limit>(order);
+    else
+        removeRestingOrder<OrderSide::Ask, OrderCategory::Limit>(order);
+}
 
-    if (limitMap.find(newLimitPrice) == limitMap.end()) // New limit price
-        addLimit(newLimitPrice, orderSide);
+template <typename Listener>
+void OrderBook::modifyLimitOrder(int orderId, int newShares, int newLimitPrice, Listener&& listener){
+    ProfiledOperation profiled(*this, BookOperation::Modify);
+    Order* order = orderIndex.find(orderId);
+    assert(order != nullptr && "Error: This order Id doesn't exist");
+    if (order->getOrderType() != OrderType::LimitOrder) // A stop order's id
+        return;
 
-    limitMap[newLimitPrice]->addOrder(order);
+    if (order->getOrderSide() == OrderSide::Bid)
+        amendRestingOrder<OrderSide::Bid, OrderCategory::Limit>(order, newShares, newLimitPrice, listener);
+    else
+        amendRestingOrder<OrderSide::Ask, OrderCategory::Limit>(order, newShares, newLimitPrice, listener);
 }
 
 
 // Stop order methods
-void OrderBook::addStopOrder(int orderId, OrderSide orderSide, int stopPrice, int shares){    
-    // First, we execute the stop order if possible, and then we make a new stop order from the remaining shares
-    if (orderSide == OrderSide::Bid && lowestAsk != nullptr && stopPrice <= lowestAsk->getLimitPrice()) // the last condition triggers the stop order
-        executeMarketOrder(orderSide, shares);
-    else if (orderSide == OrderSide::Ask && highestBid != nullptr && stopPrice >= highestBid->getLimitPrice()) // ...
-        executeMarketOrder(orderSide, shares);
-
-    if (shares != 0){ // The remaining shares are turned into a stop order
-        Order* newOrder = new Order(orderId, orderSide, shares, stopPrice);
-        assert(newOrder != nullptr && "Error: This order Id doesn't exist");
-        orderMap.emplace(orderId, newOrder);
+template <typename Listener>
+void OrderBook::addStopOrder(int orderId, OrderSide orderSide, int stopPrice, int shares, Listener&& listener){
+    ProfiledOperation profiled(*this, BookOperation::AddStop);
+    if (orderSide == OrderSide::Bid)
+        submitStopOrder<OrderSide::Bid>(orderId, stopPrice, shares, listener);
+    else
+        submitStopOrder<OrderSide::Ask>(orderId, stopPrice, shares, listener);
+}
 
-        if (stopMap.find(stopPrice) == stopMap.end())
-            addStopLevel(stopPrice, orderSide);
+template <OrderSide Side, typename Listener>
+void OrderBook::submitStopOrder(int orderId, int stopPrice, int shares, Listener& listener){
+    // First, we execute the stop order if possible (the touch is at or beyond its stop price), and then we make a new stop order from the remaining shares
+    if (orderIndex.contains(orderId)){ // The id of a live order
+        listener.onCancel(orderId, Side, stopPrice, shares);
+        return;
+    }
+    Limit* touch = bookEdge<oppositeSide(Side), OrderCategory::Limit>();
+    bool triggered = touch != nullptr && !isBeyond<Side, OrderCategory::Stop>(touch->getLimitPrice(), stopPrice);
+    if (triggered)
+        matchOrder<Side>(shares, (Side == OrderSide::Bid) ? INT_MAX : INT_MIN, orderId, listener);
 
-        stopMap[stopPrice]->addOrder(newOrder);
+    if (shares != 0){ // The remaining shares are turned into a stop order
+        Order* newOrder = findOrAddLevel<Side, OrderCategory::Stop>(stopPrice)->addOrder(Order(orderId, shares), chunkPool);
+        newOrder->setSubmissionTime(clock->now());
+        orderIndex.insert(orderId, newOrder);
+        listener.onAck(orderId, Side, stopPrice, shares);
     }
+
+    if (triggered) // Its trades moved the touch, like a market order's
+        executeStopOrders<Side>(listener);
 }
 
-void OrderBook::cancelStopOrder(int orderId){
-    // Cancel order, Delete limit level if empty, then Delete order from orderMap and deallocate memory 
-    Order* order = orderMap[orderId];
-    
-    order->cancelOrder();
-    
-    if (order->getParentLimit()->getNumberOfOrders() == 0)
-        deleteLevel(order->getParentLimit(), OrderCategory::Stop);
-    
-    orderMap.erase(orderId);
-    //delete order;
+template <typename Listener>
+void OrderBook::cancelStopOrder(int orderId, Listener&& listener){
+    ProfiledOperation profiled(*this, BookOperation::Cancel);
+    // Delete order from orderIndex, then remove it from its level (Delete stop level if empty)
+    Order* order = orderIndex.find(orderId);
+    if (!order || order->getOrderType() != OrderType::StopOrder) return;  // Order not found, or not a stop order
+
+    listener.onCancel(orderId, order->getOrderSide(), order->getLimitPrice(), order->getOrderShares());
+    orderIndex.erase(orderId);
+    if (order->getOrderSide() == OrderSide::Bid)
+        removeRestingOrder<OrderSide::Bid, OrderCategory::Stop>(order);
+    else
+        removeRestingOrder<OrderSide::Ask, OrderCategory::Stop>(order);
 }
 
-void OrderBook::modifyStopOrder(int orderId, int newShares, int newstopPrice){
-    Order* order = orderMap[orderId];
+template <typename Listener>
+void OrderBook::modifyStopOrder(int orderId, int newShares, int newstopPrice, Listener&& listener){
+    ProfiledOperation profiled(*this, BookOperation::Modify);
+    Order* order = orderIndex.find(orderId);
 
     assert(order != nullptr && "Error: This order Id doesn't exist");
+    if (order->getOrderType() != OrderType::StopOrder) // A limit order's id
+        return;
+
+    if (order->getOrderSide() == OrderSide::Bid)
+        amendRestingOrder<OrderSide::Bid, OrderCategory::Stop>(order, newShares, newstopPrice, listener);
+    else
+        amendRestingOrder<OrderSide::Ask, OrderCategory::Stop>(order, newShares, newstopPrice, listener);
+}
 
-    Limit* parentLimit = order->getParentLimit();
-    OrderSide orderSide = order->getOrderSide();
 
-    order->cancelOrder();
-    if (parentLimit->getNumberOfOrders() == 0)
-        deleteLevel(parentLimit, OrderCategory::Stop);
+// Mass cancels
+template <OrderSide Side, OrderCategory Category, typename Predicate, typename Listener>
+std::size_t OrderBook::cancelTreeOrders(int minPrice, int maxPrice, Predicate& shouldCancel, Listener& listener){
+    /* The tree is split into lower | range | upper, the range's orders are cancelled level by level without touching the tree,
+        then the range's emptied levels are released and the ones left are rebuilt into a balanced subtree, which is joined back */
+    Limit*& root = treeRoot<Side, Category>();
+    if (!root || minPrice > maxPrice)
+        return 0;
+
+    Limit* lower = nullptr;
+    Limit* rest = root;
+    Limit* range;
+    Limit* upper;
+    if (minPrice != INT_MIN)
+        splitLevels<Side, Category>(root, minPrice - 1, lower, rest);
+    splitLevels<Side, Category>(rest, maxPrice, range, upper);
+
+    /* The range's levels are walked from the edge outward, the order of the cancel reports. The walk climbs back through levels already
+        visited, hence the emptied levels are released after it */
+    const bool descending = isMaxEdge<Side, Category>();
+    Limit* first = range;
+    while (first && (descending ? first->getRightChildLimit() : first->getLeftChildLimit()))
+        first = descending ? first->getRightChildLimit() : first->getLeftChildLimit();
+
+    std::vector<Limit*> keptLevels, emptiedLevels;
+    std::vector<OrderCommand> journaledCancels; // The cancels of the orders, which replay to the same book (mass cancels aren't commands)
+    const CommandType cancelType = (Category == OrderCategory::Limit) ? CommandType::CancelLimit : CommandType::CancelStop;
+    std::size_t cancelledOrders = 0;
+    for (Limit* level = first; level != nullptr; level = PriceLevelIterator::nextLevel(level, descending)){
+        int price = level->getLimitPrice();
+        int removedOrders = level->removeOrdersIf([&](Order& order){
+            if (!shouldCancel((const Order&)order))
+                return false;
+            listener.onCancel(order.getOrderId(), Side, price, order.getOrderShares());
+            if (journal)
+                journaledCancels.push_back(makeCommand(cancelType, Side, order.getOrderId(), 0, 0));
+            orderIndex.erase(order.getOrderId());
+            return true;
+        }, chunkPool, orderIndex);
+        if (removedOrders){
+            markLevelChanged<Side, Category>(price);
+            cancelledOrders += removedOrders;
+        }
+        (level->getNumberOfOrders() ? keptLevels : emptiedLevels).push_back(level);
+    }
+    for (Limit* level : emptiedLevels){
+        levelMap<Side, Category>().erase(level->getLimitPrice());
+        limitPool.destroy(level);
+    }
+    if (!journaledCancels.empty())
+        journal->append(journaledCancels.data(), journaledCancels.size());
+
+    // Rebuilt by ascending price, which also recomputes the subtree aggregates of the range's levels
+    if (descending)
+        std::reverse(keptLevels.begin(), keptLevels.end());
+    range = buildLevelTree(keptLevels.data(), keptLevels.size(), nullptr);
+    root = concatLevels<Side, Category>(concatLevels<Side, Category>(lower, range), upper); // Set last, as rotations in the splits & joins may have pointed it at a detached subtree
+
+    Limit*& edge = bookEdge<Side, Category>();
+    edge = root;
+    while (edge && (descending ? edge->getRightChildLimit() : edge->getLeftChildLimit()))
+        edge = descending ? edge->getRightChildLimit() : edge->getLeftChildLimit();
+    return cancelledOrders;
+}
+
+template <typename Listener>
+std::size_t OrderBook::cancelAllOrders(OrderSide orderSide, Listener&& listener){
+    ProfiledOperation profiled(*this, BookOperation::MassCancel);
+    auto anyOrder = [](const Order&){ return true; };
+    if (orderSide == OrderSide::Bid)
+        return cancelTreeOrders<OrderSide::Bid, OrderCategory::Limit>(INT_MIN, INT_MAX, anyOrder, listener)
+             + cancelTreeOrders<OrderSide::Bid, OrderCategory::Stop>(INT_MIN, INT_MAX, anyOrder, listener);
+    return cancelTreeOrders<OrderSide::Ask, OrderCategory::Limit>(INT_MIN, INT_MAX, anyOrder, listener)
+         + cancelTreeOrders<OrderSide::Ask, OrderCategory::Stop>(INT_MIN, INT_MAX, anyOrder, listener);
+}
 
-    order->amendOrder(newShares, newstopPrice);
+template <typename Listener>
+std::size_t OrderBook::cancelOrdersInRange(OrderSide orderSide, int minPrice, int maxPrice, Listener&& listener){
+    ProfiledOperation profiled(*this, BookOperation::MassCancel);
+    auto anyOrder = [](const Order&){ return true; };
+    if (orderSide == OrderSide::Bid)
+        return cancelTreeOrders<OrderSide::Bid, OrderCategory::Limit>(minPrice, maxPrice, anyOrder, listener);
+    return cancelTreeOrders<OrderSide::Ask, OrderCategory::Limit>(minPrice, maxPrice, anyOrder, listener);
+}
 
-    if (stopMap.find(newstopPrice) == stopMap.end()) // New Stop price
-        addStopLevel(newstopPrice, orderSide);
+template <typename Listener>
+std::size_t OrderBook::expireDayOrders(Listener&& listener){
+    ProfiledOperation profiled(*this, BookOperation::MassCancel);
+    auto isDayOrder = [](const Order& order){ return order.getTIF() == TimeInForce::DAY; };
+    return cancelTreeOrders<OrderSide::Bid, OrderCategory::Limit>(INT_MIN, INT_MAX, isDayOrder, listener)
+         + cancelTreeOrders<OrderSide::Ask, OrderCategory::Limit>(INT_MIN, INT_MAX, isDayOrder, listener);
+}
 
-    stopMap[newstopPrice]->addOrder(order);
+template <typename Predicate, typename Listener>
+std::size_t OrderBook::cancelOrdersIf(Predicate&& shouldCancel, Listener&& listener){
+    ProfiledOperation profiled(*this, BookOperation::MassCancel);
+    return cancelTreeOrders<OrderSide::Bid, OrderCategory::Limit>(INT_MIN, INT_MAX, shouldCancel, listener)
+         + cancelTreeOrders<OrderSide::Ask, OrderCategory::Limit>(INT_MIN, INT_MAX, shouldCancel, listener)
+         + cancelTreeOrders<OrderSide::Bid, OrderCategory::Stop>(INT_MIN, INT_MAX, shouldCancel, listener)
+         + cancelTreeOrders<OrderSide::Ask, OrderCategory::Stop>(INT_MIN, INT_MAX, shouldCancel, listener);
 }
 
 
-void OrderBook::executeMarketOrder(OrderSide orderSide, int& shares){
-    // The max possible number of shares is traded. At the end, shares takes as a value the number of remaining shares
-    auto& bookEdge = (orderSide == OrderSide::Bid) ? lowestAsk : highestBid;
+template <typename Listener>
+void OrderBook::executeMarketOrder(OrderSide orderSide, int& shares, int aggressorOrderId, Listener&& listener){
+    // The max possible number of shares is traded, at any price. At the end, shares takes as a value the number of remaining shares
+    if (orderSide == OrderSide::Bid)
+        matchOrder<OrderSide::Bid>(shares, INT_MAX, aggressorOrderId, listener);
+    else
+        matchOrder<OrderSide::Ask>(shares, INT_MIN, aggressorOrderId, listener);
+}
 
-    while (shares > 0 && bookEdge != nullptr){
-        Order* headOrder = bookEdge->getHeadOrder(); // The first order to be executed from the bookEdge level
+template <OrderSide Side, typename Listener>
+void OrderBook::matchOrder(int& shares, int limitPrice, int aggressorOrderId, Listener& listener){
+    const OrderSide OtherSide = oppositeSide(Side);
+    Limit*& edge = bookEdge<OtherSide, OrderCategory::Limit>();
+
+    // The opposite edge is reached while it isn't beyond limitPrice, e.g. a bid reaches the asks priced at or below its limit
+    while (shares > 0 && edge != nullptr && !isBeyond<OtherSide, OrderCategory::Limit>(limitPrice, edge->getLimitPrice())){
+        Order* headOrder = edge->getHeadOrder(); // The first order to be executed from the edge level
         int tradedShares = std::min(headOrder->getOrderShares(), shares);
         
         headOrder->executeOrder(tradedShares); // Head Order is executed
-        shares -= tradedShares; // The remaining number of shares from the market order
+        shares -= tradedShares; // The remaining number of shares from the aggressive order
+        markLevelChanged<OtherSide, OrderCategory::Limit>(edge->getLimitPrice());
+        listener.onFill(aggressorOrderId, headOrder->getOrderId(), Side, edge->getLimitPrice(), tradedShares, headOrder->getOrderShares());
 
         if (headOrder->getOrderShares() == 0){ // headOrder was completely executed
-            orderMap.erase(headOrder->getOrderId());
-            headOrder->cancelOrder(); // We cancel headOrder in order to update both head and tail orders of bookEdge
-            delete headOrder; // Handled in ~Limit()
-
-            if (bookEdge->getNumberOfOrders() == 0){
-                // This limit level has no more orders left, hence we move to the next book edge, and the current is deleted 
-                Limit* prevBookEdge = bookEdge;
-                updateBookEdge(bookEdge, OrderCategory::Limit);
-                deleteLevel(prevBookEdge, OrderCategory::Limit);
-            }
+            orderIndex.erase(headOrder->getOrderId());
+            edge->removeOrder(headOrder, chunkPool); // The head of edge moves to its next order
+
+            // This limit level has no more orders left, hence it's deleted and the next level becomes the book edge
+            if (edge->getNumberOfOrders() == 0)
+                deleteLevel<OtherSide, OrderCategory::Limit>(edge);
         }
     }
 }
 
-void OrderBook::addMarketOrder(OrderSide orderSide, int shares){
+template <typename Listener>
+void OrderBook::addMarketOrder(OrderSide orderSide, int shares, Listener&& listener){
+    ProfiledOperation profiled(*this, BookOperation::Market);
+    if (orderSide == OrderSide::Bid)
+        submitMarketOrder<OrderSide::Bid>(shares, listener);
+    else
+        submitMarketOrder<OrderSide::Ask>(shares, listener);
+}
+
+template <OrderSide Side, typename Listener>
+void OrderBook::submitMarketOrder(int shares, Listener& listener){
+    OrderTrace* trace = tracer ? tracer->beginTrace(0, OrderType::MarketOrder, clock->now()) : nullptr;
+
     // First, execute the market order
-    executeMarketOrder(orderSide, shares);
+    matchOrder<Side>(shares, (Side == OrderSide::Bid) ? INT_MAX : INT_MIN, 0, listener);
+    if (shares != 0) // The book side was emptied, the remaining shares are dropped
+        listener.onCancel(0, Side, 0, shares);
+    if (trace)
+        trace->matchedTime = clock->now();
+
     // Then check if any stop orders were triggered after the order book was updated
-    executeStopOrders(orderSide);
+    executeStopOrders<Side>(listener);
+    if (trace)
+        trace->ackTime = clock->now();
+}
+
+template <typename Listener>
+void OrderBook::processBatch(const OrderCommand* commands, std::size_t count, Listener&& listener){
+    /* Commands are matched one after the other, exactly as if they were submitted one by one. What's done once per batch:
+        1° The order index is grown once for all the new orders of the batch
+        2° The index slots of upcoming cancellations & modifications are prefetched a few commands ahead of their lookup
+        3° The listener publishes the events of the batch at once (onBatchBegin & onBatchEnd)
+        4° The top of the book is published once, at the end of the batch (see setTopOfBook)
+        5° Market data is still published after each command, a matching event (see setMarketData)
+       Stop orders are still checked after each aggressive command, as a triggered stop trades against the book the next command sees */
+    const std::size_t prefetchDistance = 8;
+
+    if (journal) // Journaled before they're matched
+        journal->append(commands, count);
+
+    std::size_t newOrders = 0;
+    for (std::size_t i = 0; i < count; ++i)
+        newOrders += (commands[i].type == CommandType::AddLimit || commands[i].type == CommandType::AddStop);  // IOC & FOK orders never rest
+    orderIndex.growFor(newOrders);
+
+    listener.onBatchBegin();
+    for (std::size_t i = 0; i < count; ++i){
+        if (i + prefetchDistance < count){
+            CommandType aheadType = commands[i + prefetchDistance].type;
+            if (aheadType == CommandType::CancelLimit || aheadType == CommandType::ModifyLimit || aheadType == CommandType::CancelStop || aheadType == CommandType::ModifyStop)
+                orderIndex.prefetch(commands[i + prefetchDistance].orderId);
+        }
+
+        const OrderCommand& command = commands[i];
+        switch (command.type){
+            case CommandType::AddLimit: addLimitOrder(command.orderId, command.side, command.price, command.shares, listener); break;
+            case CommandType::CancelLimit: cancelLimitOrder(command.orderId, listener); break;
+            case CommandType::ModifyLimit:
+                if (orderIndex.contains(command.orderId))
+                    modifyLimitOrder(command.orderId, command.shares, command.price, listener);
+                break;
+            case CommandType::AddStop: addStopOrder(command.orderId, command.side, command.price, command.shares, listener); break;
+            case CommandType::CancelStop: cancelStopOrder(command.orderId, listener); break;
+            case CommandType::ModifyStop:
+                if (orderIndex.contains(command.orderId))
+                    modifyStopOrder(command.orderId, command.shares, command.price, listener);
+                break;
+            case CommandType::Market: addMarketOrder(command.side, command.shares, listener); break;
+            case CommandType::AddLimitIOC: addLimitOrder(command.orderId, command.side, command.price, command.shares, TimeInForce::IOC, listener); break;
+            case CommandType::AddLimitFOK: addLimitOrder(command.orderId, command.side, command.price, command.shares, TimeInForce::FOK, listener); break;
+            case CommandType::Checkpoint: break;
+        }
+        if (marketData)
+            publishMarketData();
+    }
+    listener.onBatchEnd();
+    publishTopOfBook(); // Once per batch: readers see the book between batches, never in the middle of one
 }
 
 // In OrderBook.cpp
@@ -409,3 +742,13 @@ void OrderBook::displayAllOrders(bool includeStopOrders) const {
         traverseAndDisplay(stopAskTree, true, true); // Reverse in-order for stop asks
     }
 }
+
+uint64_t OrderBook::getChecksum() const {
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a offset basis
+    Limit* trees[4] = { bidTree, askTree, stopBidTree, stopAskTree };
+    for (Limit* tree : trees){
+        hashLevels(tree, hash);
+        hash = (hash ^ 0xFF) * 1099511628211ULL; // Tree separator, so that an order can't move between trees unnoticed
+    }
+    return hash;
+}
@@ -1,14 +1,51 @@
 #ifndef ORDERBOOK_H
 #define ORDERBOOK_H
 
+#include <cstddef>
+#include <cstdint>
 #include <unordered_map>
+#include <vector>
 
 #include "enums.h"
+#include "Clock.h"
+#include "ExecutionEvents.h"
+#include "Limit.h"
+#include "Order.h"
+#include "ObjectPool.h"
+#include "OrderCommand.h"
+#include "OrderIndex.h"
+#include "OrderTracer.h"
+#include "PerfCounters.h"
+#include "PriceLevelIterator.h"
 
-class Limit;
-class Order;
+class Journal;
+class MarketDataEncoder;
+class SnapshotFile;
+class TopOfBook;
+struct TopOfBookSnapshot;
 
 class OrderBook {
+public:
+    struct MemoryStats {
+        std::size_t liveOrders;
+        std::size_t liveLevels; // Limit & stop levels
+        std::size_t liveChunks; // Chunks of the levels' order queues
+        std::size_t orderHighWaterMark; // Max number of order slots (orders & tombstones) allocated at once
+        std::size_t levelHighWaterMark;
+        std::size_t reservedBytes; // Pools' slabs and (estimated) maps' memory
+        double bytesPerRestingOrder;
+    };
+
+    // Pre-trade estimate of an order sweeping the opposite side (see estimateImpact)
+    struct ImpactEstimate {
+        long long filledShares;   // Less than the requested shares if the opposite side is too thin
+        long long notional;       // Sum of price * shares over the fills
+        int bestPrice;            // Price of the first fill, 0 if nothing fills
+        int worstPrice;           // Price of the last fill, ...
+        double averagePrice;      // notional / filledShares
+        double impactCost;        // How much worse than bestPrice the average price is, per share (>= 0)
+    };
+
 private:
     // Limit Orders
     Limit* bidTree; // Bid == Buy
@@ -25,40 +62,120 @@ private:
     Limit* stopAskTree;
     Limit* highestStopAsk; // triggered at a higher limit price from the Bid side, hence 1st to be executed
 
-    std::unordered_map<int, Order*> orderMap;
+    // Every order queue chunk and level of the book is allocated from these pools
+    ObjectPool<OrderChunk> chunkPool;
+    ObjectPool<Limit> limitPool;
+
+    OrderIndex orderIndex; // Resolves its handles through chunkPool, hence declared after it
     std::unordered_map<int, Limit*> limitBidMap;
     std::unordered_map<int, Limit*> limitAskMap;
-    std::unordered_map<int, Limit*> stopMap;
+    std::unordered_map<int, Limit*> stopBidMap; // Stop bids & stop asks may rest at the same price, on separate levels
+    std::unordered_map<int, Limit*> stopAskMap;
+    std::vector<Limit*> triggeredStops; // Stop levels of the current cascade round, in execution order (see executeStopOrders)
+
+    Clock* clock;         // Stamps orders in nanoseconds
+    OrderTracer* tracer;  // nullptr unless tracing
+    OperationProfiler* profiler; // nullptr unless profiling
+    Journal* journal;     // nullptr unless journaling
+    TopOfBook* topOfBook; // nullptr unless publishing the top of the book
+    MarketDataEncoder* marketData; // nullptr unless publishing market data
+
+    // Counts the operation of its scope with the book's profiler, if any (see setProfiler); levels are counted through the level pool
+    class ProfiledOperation {
+    private:
+        OrderBook& book;
+        BookOperation operation;
+        OperationProfiler::Sample sample;
+
+    public:
+        inline ProfiledOperation(OrderBook& _book, BookOperation _operation) : book(_book), operation(_operation) {
+            if (book.profiler)
+                book.profiler->begin(sample, book.limitPool.getCreatedObjects(), book.limitPool.getDestroyedObjects());
+        }
+        inline ~ProfiledOperation() {
+            if (book.profiler)
+                book.profiler->end(sample, operation, book.limitPool.getCreatedObjects(), book.limitPool.getDestroyedObjects());
+        }
+    };
+
+    /* The matching and level-maintenance methods are templated on the side & category of the tree they work on: the tree, its edge
+        and its level map are picked, and the prices compared, at compile time. The order methods dispatch on the side once */
+    template <OrderSide Side, OrderCategory Category> inline Limit*& treeRoot() {
+        return (Category == OrderCategory::Limit) ? ((Side == OrderSide::Bid) ? bidTree : askTree) : ((Side == OrderSide::Bid) ? stopBidTree : stopAskTree);
+    }
+    template <OrderSide Side, OrderCategory Category> inline Limit*& bookEdge() {
+        return (Category == OrderCategory::Limit) ? ((Side == OrderSide::Bid) ? highestBid : lowestAsk) : ((Side == OrderSide::Bid) ? lowestStopBid : highestStopAsk);
+    }
+    template <OrderSide Side, OrderCategory Category> inline std::unordered_map<int, Limit*>& levelMap() {
+        return (Category == OrderCategory::Limit) ? ((Side == OrderSide::Bid) ? limitBidMap : limitAskMap) : ((Side == OrderSide::Bid) ? stopBidMap : stopAskMap);
+    }
+    // The highest bid and the highest stop ask are the rightmost levels of their trees, the lowest ask and the lowest stop bid the leftmost ones
+    template <OrderSide Side, OrderCategory Category> static constexpr bool isMaxEdge() { return (Side == OrderSide::Bid) == (Category == OrderCategory::Limit); }
+    // Whether price is closer to the edge of its tree than otherPrice
+    template <OrderSide Side, OrderCategory Category> static inline bool isBeyond(int price, int otherPrice) {
+        return isMaxEdge<Side, Category>() ? price > otherPrice : price < otherPrice;
+    }
+    static constexpr OrderSide oppositeSide(OrderSide orderSide) { return (orderSide == OrderSide::Bid) ? OrderSide::Ask : OrderSide::Bid; }
 
     // Limit & Stop trees' methods
-    void addLimit(int limitPrice, OrderSide orderSide); // Add a new limit level
-    void addStopLevel(int stopPrice, OrderSide orderSide); // Add a new stop price
+    template <OrderSide Side, OrderCategory Category> Limit* addLevel(int price); // Add a new limit/stop level
+    template <OrderSide Side, OrderCategory Category> Limit* findOrAddLevel(int price); // The level at price, added if it's new
+    template <OrderSide Side, OrderCategory Category> Limit* insertNewLevel(Limit* root, Limit* newLevel, Limit* parentLevel);
+    template <OrderSide Side, OrderCategory Category> void deleteLevel(Limit* level);
+    // Cancelled & modified orders (matched orders leave from their level's head)
+    template <OrderSide Side, OrderCategory Category> void removeRestingOrder(Order* order);
+    // The shares or orders of the level at price changed, or it was added or deleted: marked for the market data, if any (limit levels only)
+    template <OrderSide Side, OrderCategory Category> void markLevelChanged(int price);
 
-    // Limit and Stop trees' shared methods
-    Limit* insertNewLevel(Limit* root, Limit* newLevel, Limit* parentLevel, OrderCategory  orderCategory);
-    void deleteLevel(Limit* level, OrderCategory  orderCategory);
+    // Order methods, for one side (see the public order methods)
+    template <OrderSide Side, typename Listener> void submitLimitOrder(int orderId, int limitPrice, int shares, TimeInForce tif, Listener& listener);
+    template <OrderSide Side, typename Listener> void submitStopOrder(int orderId, int stopPrice, int shares, Listener& listener);
+    template <OrderSide Side, typename Listener> void submitMarketOrder(int shares, Listener& listener);
+    template <OrderSide Side, OrderCategory Category, typename Listener> void amendRestingOrder(Order* order, int newShares, int newPrice, Listener& listener);
 
     // Auxiliary methods
-    void stopOrderToLimitOrder(Order* Order, OrderSide orderSide); 
-    void executeStopOrders(OrderSide orderSide); // Used for limit & stop orders
+    template <OrderSide Side, typename Listener> void stopOrderToLimitOrder(Order* order, Listener& listener);
+    template <OrderSide Side, typename Listener> void executeStopOrders(Listener& listener); // Used for limit & stop orders
+    template <OrderSide Side, typename Listener> void executeTriggeredStop(Order* stopOrder, Listener& listener);
+    template <OrderSide Side> std::size_t extractTriggeredStops(); // Detach the stop levels crossed by the touch into triggeredStops
+    template <OrderSide Side> void restoreStopLevels(std::size_t first, std::size_t count); // Put triggeredStops[first, count) back in their stop tree
+    // Trade up to shares against the opposite side, at limitPrice or better; shares becomes the number of remaining shares
+    template <OrderSide Side, typename Listener> void matchOrder(int& shares, int limitPrice, int aggressorOrderId, Listener& listener);
+    // Mass cancel of one tree's orders priced in [minPrice, maxPrice] (see cancelOrdersIf); returns the number of cancelled orders
+    template <OrderSide Side, OrderCategory Category, typename Predicate, typename Listener>
+    std::size_t cancelTreeOrders(int minPrice, int maxPrice, Predicate& shouldCancel, Listener& listener);
 
     // AVL Tree methods; Note: OrderBook is an AVL Tree
     int limitHeightDifference(Limit* limit) const;
-    Limit* balanceTree(Limit* parentLimit, OrderCategory  orderCategory);
+    void updateLimitHeight(Limit* limit);
+    template <OrderSide Side, OrderCategory Category> Limit* balanceTree(Limit* parentLimit);
     // Rotations happen at the node where the unbalance happens
-    Limit* rRotate(Limit* parentLimit, OrderCategory  orderCategory); // for a "right"-right-heavy tree
-    Limit* lRotate(Limit* parentLimit, OrderCategory  orderCategory);
-    Limit* lrRotate(Limit* parentLimit, OrderCategory  orderCategory);
-    Limit* rlRotate(Limit* parentLimit, OrderCategory  orderCategory);
+    template <OrderSide Side, OrderCategory Category> Limit* rRotate(Limit* parentLimit); // for a "right"-right-heavy tree
+    template <OrderSide Side, OrderCategory Category> Limit* lRotate(Limit* parentLimit);
+    template <OrderSide Side, OrderCategory Category> Limit* lrRotate(Limit* parentLimit);
+    template <OrderSide Side, OrderCategory Category> Limit* rlRotate(Limit* parentLimit);
+
+    template <OrderSide Side, OrderCategory Category> Limit* rebalanceToRoot(Limit* level); // Rebalance level and its ancestors, returns the root
+    // Split & join of detached subtrees (their roots have no parent), in O(log(M))
+    template <OrderSide Side, OrderCategory Category> Limit* joinLevels(Limit* left, Limit* middle, Limit* right); // left's prices < middle's < right's
+    template <OrderSide Side, OrderCategory Category> void splitLevels(Limit* root, int price, Limit*& lower, Limit*& upper); // lower: prices <= price
+    template <OrderSide Side, OrderCategory Category> Limit* concatLevels(Limit* left, Limit* right); // left's prices < right's
+    Limit* buildLevelTree(Limit** levels, std::size_t count, Limit* parentLevel); // Balanced tree of levels sorted by price, in O(count)
 
-    void updateTreeRoot(Limit* level, OrderCategory  orderCategory);
-    void updateBookEdge(Limit* level, OrderCategory  orderCategory);
+    template <OrderSide Side, OrderCategory Category> void updateTreeRoot(Limit* level, Limit* replacement);
+    template <OrderSide Side, OrderCategory Category> void updateBookEdge(Limit* level);
+
+#ifndef NDEBUG
+    int checkLevelInvariants(Limit* limit, Limit* parentLevel, long long lowerBound, long long upperBound) const;
+#endif
 
     void traverseAndDisplay(Limit* root, bool isBid, bool isStop) const;
     void printLimitOrders(Limit* limit, bool isStop) const;
+    void hashLevels(Limit* root, uint64_t& hash) const;
 
 public:
-    OrderBook();
+    // Pools are preallocated for orderCapacity orders (in full chunks) & levelCapacity levels, and grow past them if needed
+    explicit OrderBook(std::size_t orderCapacity = 0, std::size_t levelCapacity = 0, bool useHugePages = false);
     ~OrderBook();
 
     // Getters
@@ -70,31 +187,108 @@ public:
     inline Limit* getStopAskTree() const { return stopAskTree; }
     inline Limit* getLowestStopBid() const { return lowestStopBid; }
     inline Limit* getHighestStopAsk() const { return highestStopAsk; }
-    inline std::unordered_map<int, Order*> getOrderMap() const { return orderMap; }
+    inline const OrderIndex& getOrderIndex() const { return orderIndex; }
+
+    // Levels of a side from its best price outward: bids & stop asks by descending price, asks & stop bids by ascending price
+    // Iterate while != PriceLevelIterator()
+    PriceLevelIterator getLevelIterator(OrderSide orderSide, OrderCategory orderCategory = OrderCategory::Limit) const;
+    // Writes the best maxLevels limit levels of a side into levels, best first; returns the number of levels written. O(N + log(M)), no allocation
+    std::size_t getDepth(OrderSide orderSide, std::size_t maxLevels, DepthLevel* levels) const;
+    void getTopOfBook(TopOfBookSnapshot& snapshot) const; // The best TopOfBookSnapshot::maxLevels levels of each side; sequence is left unchanged
+    void publishTopOfBook(); // Publishes the top of the book to the TopOfBook set, if any; done by processBatch, call it after the other order methods
+    // Encodes the levels changed since the last call as one market data message, if any; done by processBatch after each command, call it after each other order method
+    void publishMarketData();
+    const Limit* findLevel(OrderSide orderSide, int price, OrderCategory orderCategory = OrderCategory::Limit) const; // nullptr if there's no level at price
 
     // Setters
     inline void setBidTree(Limit* newBidTree) { bidTree = newBidTree; }
     inline void setAskTree(Limit* newAskTree) { askTree = newAskTree; }
     inline void setStopBidTree(Limit* newStopBidTree) { stopBidTree = newStopBidTree; }
     inline void setStopAskTree(Limit* newStopAskTree) { stopAskTree = newStopAskTree; }
+    inline void setClock(Clock* newClock) { clock = newClock ? newClock : &defaultClock(); } // nullptr for the default TSC clock
+    inline void setTracer(OrderTracer* newTracer) { tracer = newTracer; } // Traces limit & market orders until set back to nullptr
+    // Counts every order method & triggered stop with the profiler's counters until set back to nullptr; only from the profiler's thread
+    inline void setProfiler(OperationProfiler* newProfiler) { profiler = newProfiler; }
+    inline void setJournal(Journal* newJournal) { journal = newJournal; } // Commands of processBatch & the cancels of mass cancels are journaled until set back to nullptr
+    // The top of the book is published for other threads at the end of every processBatch until set back to nullptr (see TopOfBook.h)
+    inline void setTopOfBook(TopOfBook* newTopOfBook) { topOfBook = newTopOfBook; }
+    // Changed limit levels are encoded as incremental L2 messages until set back to nullptr (see MarketData.h); after loadSnapshot, write a refresh
+    inline void setMarketData(MarketDataEncoder* newMarketData) { marketData = newMarketData; }
+
+    /* Order methods: acks, fills & cancels are reported to listener, whose type is a template parameter (see ExecutionEvents.h).
+        Without a listener, NullEventListener is used and reporting compiles to nothing.
+        Cancellations & modifications of an order of the other category (e.g: cancelLimitOrder of a stop order's id) are ignored.
+        An add with the id of a live order is cancelled (onCancel) before it trades or rests: the live order keeps its id.
+        The templates are defined in OrderBook.cpp, which is compiled with its callers (see main.cpp) */
 
     // Limit order methods
-    void addLimitOrder(int orderId, OrderSide orderSide, int limitPrice, int shares); // Note: For any order type, OrderSide is needed only when adding an order
-    void cancelLimitOrder(int orderId);
-    void modifyLimitOrder(int orderId, int newShares, int newLimitPrice);
+    template <typename Listener = NullEventListener>
+    void addLimitOrder(int orderId, OrderSide orderSide, int limitPrice, int shares, Listener&& listener = Listener()); // Note: For any order type, OrderSide is needed only when adding an order
+    // IOC: the shares that can't trade right away are cancelled rather than rested. FOK: the order trades all its shares right away, or is cancelled
+    // GTC & DAY orders rest, DAY orders until expireDayOrders is called at the end of the trading day
+    template <typename Listener = NullEventListener>
+    void addLimitOrder(int orderId, OrderSide orderSide, int limitPrice, int shares, TimeInForce tif, Listener&& listener = Listener());
+    template <typename Listener = NullEventListener>
+    void cancelLimitOrder(int orderId, Listener&& listener = Listener());
+    // A size decrease at the same price keeps the order's time priority, in O(1) besides its level's ancestors' aggregates; a new price or a size
+    // increase requeues it at the back of its new level. The same applies to stop orders
+    template <typename Listener = NullEventListener>
+    void modifyLimitOrder(int orderId, int newShares, int newLimitPrice, Listener&& listener = Listener());
 
     // Stop order methods
-    void addStopOrder(int orderId, OrderSide orderSide, int stopPrice, int shares); // Once stopPrice is reached the order is executed with the market price
-    void cancelStopOrder(int orderId);
-    void modifyStopOrder(int orderId, int newShares, int newstopPrice);
+    template <typename Listener = NullEventListener>
+    void addStopOrder(int orderId, OrderSide orderSide, int stopPrice, int shares, Listener&& listener = Listener()); // Once stopPrice is reached the order is executed with the market price
+    template <typename Listener = NullEventListener>
+    void cancelStopOrder(int orderId, Listener&& listener = Listener());
+    template <typename Listener = NullEventListener>
+    void modifyStopOrder(int orderId, int newShares, int newstopPrice, Listener&& listener = Listener());
 
     // Market orders are executed immediately after adding them, hence it's not possible to cancel or modify them
     // We assume a market order is filled completely or partially, and then removed
-    void executeMarketOrder(OrderSide orderSide, int& shares);
-    void addMarketOrder(OrderSide orderSide, int shares);
+    template <typename Listener = NullEventListener>
+    void executeMarketOrder(OrderSide orderSide, int& shares, int aggressorOrderId = 0, Listener&& listener = Listener());
+    template <typename Listener = NullEventListener>
+    void addMarketOrder(OrderSide orderSide, int shares, Listener&& listener = Listener());
+
+    /* Mass cancels, e.g: at the end of a session or when a client disconnects. Every matching order is cancelled and reported to listener
+        (level by level from the book edge outward, in time priority within a level), then each tree is pruned once: the price range is split
+        off, its emptied levels are released and the levels left are rebuilt into a balanced subtree, joined back in O(log(M)). O(N + K + log(M))
+        per tree, for the N orders of the K levels in range, rather than a deletion & rebalance per emptied level. Like cancellations, mass cancels
+        trigger no stop; they aren't commands of processBatch, hence each cancelled order is journaled as its own cancel (CancelLimit or CancelStop),
+        which the recovery replays to the same book. They return the number of cancelled orders */
+    template <typename Listener = NullEventListener>
+    std::size_t cancelAllOrders(OrderSide orderSide, Listener&& listener = Listener()); // Limit & stop orders of a side
+    template <typename Listener = NullEventListener>
+    std::size_t cancelOrdersInRange(OrderSide orderSide, int minPrice, int maxPrice, Listener&& listener = Listener()); // Limit orders priced in [minPrice, maxPrice]
+    template <typename Listener = NullEventListener>
+    std::size_t expireDayOrders(Listener&& listener = Listener()); // DAY limit orders of both sides
+    // Orders of both sides & categories for which shouldCancel(const Order&) is true, e.g: the orders of a session or an owner, by their ids
+    template <typename Predicate, typename Listener = NullEventListener>
+    std::size_t cancelOrdersIf(Predicate&& shouldCancel, Listener&& listener = Listener());
+
+    // Batched submission: commands are matched in sequence, with the same results as their one by one submission
+    // Modifications of unknown orders are ignored, like cancellations
+    template <typename Listener = NullEventListener>
+    void processBatch(const OrderCommand* commands, std::size_t count, Listener&& listener = Listener());
 
     // AVL Tree methods
-    int getLimitHeight(Limit* limit) const;
+    int getLimitHeight(Limit* limit) const; // O(1), the height is stored in the level
+#ifndef NDEBUG
+    void checkTreeInvariants() const; // Debug builds only: asserts that the four trees are valid AVL trees in O(M)
+#endif
+
+    /* Pre-trade queries, answered in O(log(M)) with the levels' subtree aggregates, without changing the book.
+        aggressorSide is the side of the hypothetical order: a Bid trades against the asks, from the lowest one up */
+    long long getSharesAvailable(OrderSide aggressorSide, int limitPrice) const; // Shares an order could trade at limitPrice or better
+    ImpactEstimate estimateImpact(OrderSide aggressorSide, long long shares) const; // Fills of a market order for shares
+
+    /* Warm restart: the book (which must be empty) is filled with a snapshot (see SnapshotFile::write), each tree being built
+        bottom-up from its sorted levels in O(M) rather than one insertion & rotation at a time. Throws std::runtime_error on
+        duplicate order ids or non-positive shares, the book must then be discarded. Size the book's pools from the snapshot's counts */
+    void loadSnapshot(const SnapshotFile& snapshot);
+
+    MemoryStats getMemoryStats() const;
+    uint64_t getChecksum() const; // Hash of every resting order (id, price, shares) in price-time priority: equal books have equal checksums
 
     void displayAllOrders(bool includeStopOrders = false) const;
 };
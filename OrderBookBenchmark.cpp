@@ -1,7 +1,19 @@
+#include <algorithm>
+#include <atomic>
+#include <climits>
 #include <iostream>
 #include <chrono>
+#include <cstdio>
+#include <string>
 #include <random>
+#include <vector>
+#include <thread>
+#include "ExecutionEvents.h"
+#include "MatchingEngine.h"
 #include "OrderBook.h"
+#include "PriceLadderBook.h"
+#include "SnapshotFile.h"
+#include "TopOfBook.h"
 
 class OrderBookBenchmark {
 public:
@@ -20,11 +32,9 @@ public:
             int shares = shares_dist(gen);
             OrderSide orderSide = (i % 2) ? OrderSide::Bid : OrderSide::Ask;
 
-            if(cancel_dist(gen) && !book.getOrderMap().empty()) {
-                // Cancel random existing order
-                auto it = book.getOrderMap().begin();
-                std::advance(it, rand() % book.getOrderMap().size());
-                book.cancelLimitOrder(it->first);
+            if(cancel_dist(gen) && !book.getOrderIndex().empty()) {
+                // Cancel random existing order, sampled in O(1) from the book's order index
+                book.cancelLimitOrder(book.getOrderIndex().sampleOrder(gen)->getOrderId());
             } else {
                 // Add new limit order
                 book.addLimitOrder(i, orderSide, price, shares);
@@ -37,5 +47,652 @@ public:
         double tps = num_orders / (duration / 1000.0);
         std::cout << "Processed " << num_orders << " transactions in " 
                   << duration << "ms (" << tps << " tps)\n";
+
+        OrderBook::MemoryStats stats = book.getMemoryStats();
+        std::cout << "  Live orders: " << stats.liveOrders << " | Live levels: " << stats.liveLevels
+                  << " | High-water marks: " << stats.orderHighWaterMark << " orders, " << stats.levelHighWaterMark << " levels"
+                  << " | Reserved: " << stats.reservedBytes / 1024 << "KB (" << stats.bytesPerRestingOrder << " bytes per resting order)\n";
+    }
+
+    static void run_level_benchmark(int num_levels, int num_operations = 200000) {
+        // Level churn: every operation adds a limit order at a new price (level insertion) and cancels it (level deletion)
+        // With heights stored in the levels, the cost per operation should only grow with log(M)
+        OrderBook book;
+        for (int i = 1; i <= num_levels; ++i)
+            book.addLimitOrder(i, OrderSide::Bid, 2 * i, 1); // Resting levels at even prices
+
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<> price_dist(0, num_levels - 1);
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        for (int i = 1; i <= num_operations; ++i) {
+            int orderId = num_levels + i;
+            book.addLimitOrder(orderId, OrderSide::Bid, 2 * price_dist(gen) + 1, 1); // Odd prices are always new levels
+            book.cancelLimitOrder(orderId);
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+#ifndef NDEBUG
+        book.checkTreeInvariants();
+#endif
+
+        std::cout << "Levels: " << num_levels << " | " << num_operations << " level inserts/deletes in " 
+                  << duration / 1000000 << "ms (" << duration / num_operations << " ns per insert+delete, "
+                  << book.getMemoryStats().bytesPerRestingOrder << " bytes per resting order)\n";
+    }
+
+    // Clustered workload: prices stay within a few hundred ticks of a slowly drifting mid price
+    // 60% limit orders, 25% cancellations of random previous orders, 15% market orders
+    template <typename Book, typename Check>
+    static void run_clustered_workload(Book& book, int num_orders, Check check) {
+        std::mt19937 gen(7);
+        std::uniform_int_distribution<> action_dist(0, 99);
+        std::uniform_int_distribution<> offset_dist(0, 300);
+        std::uniform_int_distribution<> drift_dist(-20, 20);
+        std::uniform_int_distribution<> shares_dist(1, 100);
+        std::vector<int> orderIds;
+        int mid = 100000;
+
+        for (int i = 1; i <= num_orders; ++i) {
+            if (i % 1000 == 0)
+                mid += drift_dist(gen);
+            int action = action_dist(gen);
+            OrderSide orderSide = (i % 2) ? OrderSide::Bid : OrderSide::Ask;
+
+            if (action < 60) {
+                int offset = offset_dist(gen) - 5; // A few orders cross the spread
+                book.addLimitOrder(i, orderSide, (orderSide == OrderSide::Bid) ? mid - offset : mid + offset, shares_dist(gen));
+                orderIds.push_back(i);
+            }
+            else if (action < 85 && !orderIds.empty()) {
+                size_t index = gen() % orderIds.size();
+                book.cancelLimitOrder(orderIds[index]); // No-op if the order was already filled
+                orderIds[index] = orderIds.back();
+                orderIds.pop_back();
+            }
+            else
+                book.addMarketOrder(orderSide, shares_dist(gen));
+            check(i);
+        }
+    }
+
+    static void run_backend_benchmark(int num_orders) {
+        // Both backends timed on the same workload; tests.cpp checks that they stay in the same state
+        OrderBook avlBook;
+        auto start = std::chrono::high_resolution_clock::now();
+        run_clustered_workload(avlBook, num_orders, [](int) {});
+        auto avlDuration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+        PriceLadderBook ladderBook(100000 - 2048, 100000 + 2047);
+        start = std::chrono::high_resolution_clock::now();
+        run_clustered_workload(ladderBook, num_orders, [](int) {});
+        auto ladderDuration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+        std::cout << "AVL book: " << num_orders << " orders in " << avlDuration << "ms (" << num_orders / (avlDuration / 1000.0) << " tps)\n";
+        std::cout << "Ladder book: " << num_orders << " orders in " << ladderDuration << "ms (" << num_orders / (ladderDuration / 1000.0) << " tps, "
+                  << ladderBook.getRecenterCount() << " re-centerings)\n";
+    }
+
+    static void run_depth_benchmark(int num_orders, int num_queries = 1000000) {
+        // Top-N depth queries on a book built by the clustered workload; the ladder book, built the same way, must report the same depth
+        OrderBook avlBook;
+        PriceLadderBook ladderBook(100000 - 2048, 100000 + 2047);
+        run_clustered_workload(avlBook, num_orders, [](int) {});
+        run_clustered_workload(ladderBook, num_orders, [](int) {});
+
+        std::vector<DepthLevel> avlLevels(1000), ladderLevels(1000);
+        bool sameDepth = true;
+        OrderSide sides[2] = { OrderSide::Bid, OrderSide::Ask };
+        for (OrderSide side : sides) {
+            size_t avlCount = avlBook.getDepth(side, avlLevels.size(), avlLevels.data());
+            size_t ladderCount = ladderBook.getDepth(side, ladderLevels.size(), ladderLevels.data());
+            sameDepth = sameDepth && avlCount == ladderCount;
+            for (size_t i = 0; sameDepth && i < avlCount; ++i)
+                sameDepth = avlLevels[i].price == ladderLevels[i].price && avlLevels[i].totalShares == ladderLevels[i].totalShares
+                    && avlLevels[i].numberOfOrders == ladderLevels[i].numberOfOrders
+                    && (i == 0 || (side == OrderSide::Bid ? avlLevels[i].price < avlLevels[i - 1].price : avlLevels[i].price > avlLevels[i - 1].price));
+        }
+        std::cout << "Depth: AVL and ladder books " << (sameDepth ? "match" : "DIFFER") << " on the 1000 best levels of each side\n";
+
+        size_t depths[] = { 5, 10, 100 };
+        for (size_t depth : depths) {
+            volatile int sink = 0; // Keeps the queries from being optimized away
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < num_queries; ++i) {
+                size_t count = avlBook.getDepth(sides[i & 1], depth, avlLevels.data());
+                sink = avlLevels[count - 1].totalShares;
+            }
+            auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+            std::cout << "  Top " << depth << " levels: " << duration / num_queries << " ns per query\n";
+            (void)sink;
+        }
+    }
+
+    static void run_impact_benchmark(int num_levels, int num_queries = 1000000) {
+        // FOK checks & impact estimates on a deep book: O(log(M)) with the subtree aggregates, against walking the levels they span
+        OrderBook book(num_levels * 2, num_levels * 2);
+        std::mt19937 gen(11);
+        std::uniform_int_distribution<> shares_dist(1, 100);
+        for (int level = 1; level <= num_levels; ++level) {
+            book.addLimitOrder(2 * level - 1, OrderSide::Bid, 100000 - level, shares_dist(gen));
+            book.addLimitOrder(2 * level, OrderSide::Ask, 100000 + level, shares_dist(gen));
+        }
+
+        std::uniform_int_distribution<> reach_dist(1, num_levels);
+        bool sameShares = true;
+        for (int i = 0; i < 1000 && sameShares; ++i) {
+            int limitPrice = 100000 + reach_dist(gen);
+            long long walked = 0;
+            for (PriceLevelIterator it = book.getLevelIterator(OrderSide::Ask, OrderCategory::Limit); it != PriceLevelIterator() && it->getLimitPrice() <= limitPrice; ++it)
+                walked += it->getTotalShares();
+            sameShares = walked == book.getSharesAvailable(OrderSide::Bid, limitPrice);
+        }
+        std::cout << "Impact: shares available " << (sameShares ? "match" : "DIFFER") << " the level walk over " << num_levels << " levels per side\n";
+
+        volatile long long sink = 0; // Keeps the queries from being optimized away
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < num_queries; ++i)
+            sink = book.getSharesAvailable((i & 1) ? OrderSide::Bid : OrderSide::Ask, (i & 1) ? 100000 + reach_dist(gen) : 100000 - reach_dist(gen));
+        auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+        std::cout << "  Shares available (FOK check): " << duration / num_queries << " ns per query\n";
+
+        std::uniform_int_distribution<> size_dist(1, num_levels * 50);
+        start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < num_queries; ++i)
+            sink = book.estimateImpact((i & 1) ? OrderSide::Bid : OrderSide::Ask, size_dist(gen)).notional;
+        duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+        std::cout << "  Impact estimate: " << duration / num_queries << " ns per query\n";
+        (void)sink;
+    }
+
+    static int count_resting_stops(const OrderBook& book, OrderSide side) {
+        int stops = 0;
+        for (PriceLevelIterator it = book.getLevelIterator(side, OrderCategory::Stop); it != PriceLevelIterator(); ++it)
+            stops += it->getNumberOfOrders();
+        return stops;
+    }
+
+    static void run_stop_benchmark(int num_stops, int stopsPerLevel = 100) {
+        /* Stop cascades over num_stops resting stop bids of 10 shares, stopsPerLevel per price above the asks. Two shapes:
+            sweep: asks of 5000 shares per level, one market order lifts them past every stop price, which triggers all the stops in one round
+            chain: asks of 1000 shares per level, a stop level takes a whole ask level, so each round triggers the next stop level only */
+        int stopLevels = num_stops / stopsPerLevel;
+        const char* shapes[] = { "sweep", "chain" };
+        for (int shape = 0; shape < 2; ++shape) {
+            int levelShares = (shape == 0) ? 5000 : 1000;
+            int askLevels = stopLevels * 2 + 10;
+            OrderBook book(askLevels * 10 + num_stops + 1000, askLevels + stopLevels + 16);
+            int orderId = 1;
+            for (int level = 1; level <= askLevels; ++level)
+                for (int i = 0; i < 10; ++i)
+                    book.addLimitOrder(orderId++, OrderSide::Ask, 100000 + level, levelShares / 10);
+            for (int level = 0; level < 100; ++level)
+                book.addLimitOrder(orderId++, OrderSide::Bid, 100000 - level, 100);
+            for (int level = 0; level < stopLevels; ++level)
+                for (int i = 0; i < stopsPerLevel; ++i)
+                    book.addStopOrder(orderId++, OrderSide::Bid, 100002 + level, 10);
+
+            int restingStops = count_resting_stops(book, OrderSide::Bid);
+            int marketShares = (shape == 0) ? (stopLevels + 1) * levelShares : levelShares;
+            auto start = std::chrono::high_resolution_clock::now();
+            book.addMarketOrder(OrderSide::Bid, marketShares);
+            auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+            int triggeredStops = restingStops - count_resting_stops(book, OrderSide::Bid);
+
+#ifndef NDEBUG
+            book.checkTreeInvariants();
+#endif
+            std::cout << "Stops (" << shapes[shape] << "): one market order triggered " << triggeredStops << " of " << restingStops << " stops on "
+                      << stopLevels << " levels in " << duration / 1000 << "us (" << (triggeredStops ? duration / triggeredStops : 0) << " ns per stop)\n";
+        }
+    }
+
+    static void run_deep_level_benchmark(int num_levels, int ordersPerLevel) {
+        /* Deep queues: num_levels ask levels of ordersPerLevel orders each, submitted round-robin over the levels (so that a level's orders
+            aren't allocated next to each other), then: a walk of every queue (checksum), cancellations of half the orders at random positions,
+            and market orders sweeping the side, one fill per resting order */
+        int num_orders = num_levels * ordersPerLevel;
+        OrderBook book(num_orders, num_levels);
+        std::mt19937 gen(13);
+        std::uniform_int_distribution<> shares_dist(1, 100);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < num_orders; ++i)
+            book.addLimitOrder(i + 1, OrderSide::Ask, 100000 + i % num_levels, shares_dist(gen));
+        auto addDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+        start = std::chrono::high_resolution_clock::now();
+        volatile uint64_t checksum = book.getChecksum();
+        auto walkDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+        (void)checksum;
+
+        std::vector<int> orderIds(num_orders);
+        for (int i = 0; i < num_orders; ++i)
+            orderIds[i] = i + 1;
+        std::shuffle(orderIds.begin(), orderIds.end(), gen);
+        int num_cancels = num_orders / 2;
+        start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < num_cancels; ++i)
+            book.cancelLimitOrder(orderIds[i]);
+        auto cancelDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+#ifndef NDEBUG
+        book.checkTreeInvariants();
+#endif
+        long long restingShares = book.getSharesAvailable(OrderSide::Bid, INT_MAX);
+        int restingOrders = (int)book.getOrderIndex().size();
+        start = std::chrono::high_resolution_clock::now();
+        for (long long shares = restingShares; shares > 0; shares -= 10000)
+            book.addMarketOrder(OrderSide::Bid, (int)std::min(shares, 10000LL));
+        auto sweepDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+        std::cout << "Deep levels: " << num_levels << " levels of " << ordersPerLevel << " orders | Add: " << addDuration / num_orders
+                  << " ns per order | Queue walk: " << walkDuration / num_orders << " ns per order | Cancel: " << cancelDuration / num_cancels
+                  << " ns per order | Sweep: " << sweepDuration / (restingOrders ? restingOrders : 1) << " ns per fill ("
+                  << (book.getOrderIndex().empty() ? "side emptied" : "ORDERS LEFT") << ")\n";
+    }
+
+    static void run_amend_benchmark(int num_levels, int ordersPerLevel, int num_amends = 1000000) {
+        /* Modifications of resting bids chosen at random, by kind: size decreases at the same price (done in place), size increases at
+            the same price (requeued at the back of their level) and price changes (to another level of the range). With one order per level,
+            the levels stay in their tree for the first two kinds */
+        int num_orders = num_levels * ordersPerLevel;
+        OrderBook book(num_orders, num_levels);
+        std::mt19937 gen(17);
+        std::vector<int> prices(num_orders), shares(num_orders, 1000000), amended(num_amends);
+        for (int i = 0; i < num_orders; ++i) {
+            prices[i] = 100000 - i % num_levels;
+            book.addLimitOrder(i + 1, OrderSide::Bid, prices[i], shares[i]);
+        }
+        for (int& order : amended)
+            order = gen() % num_orders;
+
+        const char* kinds[] = { "size down", "size up", "price change" };
+        std::cout << "Amend: " << num_levels << " levels of " << ordersPerLevel << " orders |";
+        for (int kind = 0; kind < 3; ++kind) {
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int order : amended) {
+                if (kind == 2)
+                    prices[order] = 100000 - (100000 - prices[order] + 1 + gen() % (num_levels - 1)) % num_levels;
+                else
+                    shares[order] += (kind == 0) ? -1 : 1;
+                book.modifyLimitOrder(order + 1, shares[order], prices[order]);
+            }
+            auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+            std::cout << " " << kinds[kind] << ": " << duration / num_amends << " ns" << (kind < 2 ? "," : " per amend");
+        }
+#ifndef NDEBUG
+        book.checkTreeInvariants();
+#endif
+        std::cout << " (" << book.getOrderIndex().size() << " orders left)\n";
+    }
+
+    static void run_memory_benchmark(int num_orders, int num_levels) {
+        // Large book: num_orders resting bids spread over num_levels, then lookups & cancellations of random orders, out of cache
+        OrderBook book(num_orders, num_levels);
+        std::mt19937 gen(23);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 1; i <= num_orders; ++i)
+            book.addLimitOrder(i, OrderSide::Bid, 100000 - (int)(gen() % num_levels), 1 + i % 100);
+        auto addDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+        OrderBook::MemoryStats stats = book.getMemoryStats();
+
+        std::vector<int> orderIds(num_orders);
+        for (int i = 0; i < num_orders; ++i)
+            orderIds[i] = i + 1;
+        std::shuffle(orderIds.begin(), orderIds.end(), gen);
+
+        long long shares = 0;
+        start = std::chrono::high_resolution_clock::now();
+        for (int orderId : orderIds)
+            shares += book.getOrderIndex().find(orderId)->getOrderShares();
+        auto findDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+        int num_cancels = num_orders / 2;
+        start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < num_cancels; ++i)
+            book.cancelLimitOrder(orderIds[i]);
+        auto cancelDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+        std::cout << "Memory: " << num_orders << " orders on " << num_levels << " levels | " << stats.bytesPerRestingOrder << " bytes per resting order ("
+                  << stats.reservedBytes / (1024 * 1024) << "MB) | Add: " << addDuration / num_orders << " ns | Find: " << findDuration / num_orders
+                  << " ns | Cancel: " << cancelDuration / num_cancels << " ns per order (" << shares << " shares found)\n";
+    }
+
+    static void run_mass_cancel_benchmark(int num_orders, int num_levels) {
+        /* End of session & disconnect: num_orders resting orders on num_levels levels per side, the levels of every other price holding only
+            DAY orders, and each order belonging to one of 4 sessions. The DAY orders are expired (half the levels are emptied), then the orders of one
+            session are cancelled, once one by one and once with a mass cancel; both books must end up the same */
+        OrderBook oneByOne(num_orders, 2 * num_levels), bulk(num_orders, 2 * num_levels);
+        std::mt19937 gen(29);
+        std::vector<int> dayOrders, sessionOrders;
+        for (int i = 1; i <= num_orders; ++i) {
+            OrderSide side = (i % 2) ? OrderSide::Bid : OrderSide::Ask;
+            int offset = 1 + (int)(gen() % num_levels);
+            int price = (side == OrderSide::Bid) ? 100000 - offset : 100000 + offset;
+            TimeInForce tif = (offset % 2) ? TimeInForce::DAY : TimeInForce::GTC;
+            oneByOne.addLimitOrder(i, side, price, 1 + i % 100, tif);
+            bulk.addLimitOrder(i, side, price, 1 + i % 100, tif);
+            if (tif == TimeInForce::DAY)
+                dayOrders.push_back(i);
+            else if (i % 4 == 0)
+                sessionOrders.push_back(i);
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int orderId : dayOrders)
+            oneByOne.cancelLimitOrder(orderId);
+        auto oneByOneExpiry = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+        start = std::chrono::high_resolution_clock::now();
+        std::size_t expired = bulk.expireDayOrders();
+        auto bulkExpiry = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+        start = std::chrono::high_resolution_clock::now();
+        for (int orderId : sessionOrders)
+            oneByOne.cancelLimitOrder(orderId);
+        auto oneByOneSession = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+        start = std::chrono::high_resolution_clock::now();
+        std::size_t cancelled = bulk.cancelOrdersIf([](const Order& order) { return order.getOrderId() % 4 == 0; });
+        auto bulkSession = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+#ifndef NDEBUG
+        bulk.checkTreeInvariants();
+#endif
+        std::cout << "Mass cancel: " << num_orders << " orders on " << 2 * num_levels << " levels | Expire " << expired << " DAY orders: "
+                  << oneByOneExpiry / 1000000 << "ms one by one, " << bulkExpiry / 1000000 << "ms in bulk | Cancel " << cancelled
+                  << " orders of a session: " << oneByOneSession / 1000000 << "ms one by one, " << bulkSession / 1000000 << "ms in bulk ("
+                  << ((oneByOne.getChecksum() == bulk.getChecksum() && expired == dayOrders.size() && cancelled == sessionOrders.size()) ? "same book" : "BOOKS DIFFER")
+                  << ")\n";
+    }
+
+    static void run_snapshot_benchmark(const std::string& path, int num_orders) {
+        /* Warm restart of a book of num_orders resting orders (1% of them stop orders) on 10000 levels per side:
+            rebuilding it through addLimitOrder vs writing a snapshot and loading it. The snapshot is also written in the background
+            while the book keeps trading, and both snapshots must give back the book they were taken from (same checksum) */
+        try {
+            std::mt19937 gen(5);
+            std::uniform_int_distribution<> level_dist(1, 10000);
+            std::uniform_int_distribution<> shares_dist(1, 100);
+            OrderBook book(num_orders + num_orders / 10, 20000 + 1024);
+
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int orderId = 1; orderId <= num_orders; ++orderId) {
+                OrderSide side = (orderId % 2) ? OrderSide::Bid : OrderSide::Ask;
+                if (orderId % 100 == 0) // Stop bids above the asks, stop asks below the bids
+                    book.addStopOrder(orderId, side, (side == OrderSide::Bid) ? 110000 + level_dist(gen) : 90000 - level_dist(gen), shares_dist(gen));
+                else
+                    book.addLimitOrder(orderId, side, (side == OrderSide::Bid) ? 100000 - level_dist(gen) : 100000 + level_dist(gen), shares_dist(gen));
+            }
+            auto buildDuration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count();
+            uint64_t checksum = book.getChecksum();
+
+            start = std::chrono::high_resolution_clock::now();
+            SnapshotFile::write(path, book);
+            auto writeDuration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+            start = std::chrono::high_resolution_clock::now();
+            SnapshotFile file(path);
+            OrderBook loadedBook(file.getOrderCount(), file.getLevelCount() + 1024);
+            loadedBook.loadSnapshot(file);
+            auto loadDuration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count();
+            bool sameBook = loadedBook.getChecksum() == checksum && file.getBookChecksum() == checksum;
+#ifndef NDEBUG
+            loadedBook.checkTreeInvariants();
+#endif
+
+            // In the background: the book only stalls for the fork, then trades while the snapshot is written
+            std::string backgroundPath = path + ".background";
+            start = std::chrono::high_resolution_clock::now();
+            long writerId = SnapshotFile::writeInBackground(backgroundPath, loadedBook);
+            auto stallDuration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+            for (int i = 0; i < 100000; ++i)
+                loadedBook.addMarketOrder((i % 2) ? OrderSide::Bid : OrderSide::Ask, shares_dist(gen));
+            SnapshotFile::waitForWrite(writerId);
+            auto backgroundDuration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count();
+            bool sameBackgroundBook;
+            {
+                SnapshotFile backgroundFile(backgroundPath);
+                OrderBook backgroundBook(backgroundFile.getOrderCount(), backgroundFile.getLevelCount() + 1024);
+                backgroundBook.loadSnapshot(backgroundFile);
+                sameBackgroundBook = backgroundBook.getChecksum() == checksum;
+            }
+            std::remove(backgroundPath.c_str());
+
+            std::cout << "Snapshot: " << num_orders << " orders on " << file.getLevelCount() << " levels | Rebuilt through addLimitOrder in " << buildDuration
+                      << "ms | Written in " << writeDuration << "ms | Loaded in " << loadDuration << "ms (" << (sameBook ? "same book" : "DIFFERENT BOOK") << ")\n"
+                      << "  In the background: " << stallDuration << "us stall, written in " << backgroundDuration << "ms while trading ("
+                      << (sameBackgroundBook ? "same book" : "DIFFERENT BOOK") << ")\n";
+        }
+        catch (const std::exception& error) {
+            std::cerr << error.what() << "\n";
+        }
+    }
+
+    static std::pair<int, int> touchOf(Limit* level) {
+        return level ? std::make_pair(level->getLimitPrice(), level->getTotalShares()) : std::make_pair(0, 0);
+    }
+
+    // Same clustered workload as run_clustered_workload, with acks, fills & cancels reported to listener
+    template <typename Listener>
+    static void run_event_workload(OrderBook& book, int num_orders, Listener& listener, EventRingBuffer* ring) {
+        std::mt19937 gen(7);
+        std::uniform_int_distribution<> action_dist(0, 99);
+        std::uniform_int_distribution<> offset_dist(0, 300);
+        std::uniform_int_distribution<> drift_dist(-20, 20);
+        std::uniform_int_distribution<> shares_dist(1, 100);
+        std::vector<int> orderIds;
+        int mid = 100000;
+
+        for (int i = 1; i <= num_orders; ++i) {
+            if (i % 1000 == 0)
+                mid += drift_dist(gen);
+            int action = action_dist(gen);
+            OrderSide orderSide = (i % 2) ? OrderSide::Bid : OrderSide::Ask;
+
+            if (action < 60) {
+                int offset = offset_dist(gen) - 5;
+                book.addLimitOrder(i, orderSide, (orderSide == OrderSide::Bid) ? mid - offset : mid + offset, shares_dist(gen), listener);
+                orderIds.push_back(i);
+            }
+            else if (action < 85 && !orderIds.empty()) {
+                size_t index = gen() % orderIds.size();
+                book.cancelLimitOrder(orderIds[index], listener);
+                orderIds[index] = orderIds.back();
+                orderIds.pop_back();
+            }
+            else
+                book.addMarketOrder(orderSide, shares_dist(gen), listener);
+
+            if (ring && (i & 255) == 0) // Stands for the consumer thread: the ring is emptied every 256 orders, long before it fills up
+                ring->drain([](const ExecutionEvent&) {});
+        }
+    }
+
+    static void run_event_benchmark(int num_orders) {
+        // Cost of the event path: a null listener against fixed-size records written to a preallocated ring buffer
+        OrderBook nullBook;
+        NullEventListener nullListener;
+        auto start = std::chrono::high_resolution_clock::now();
+        run_event_workload(nullBook, num_orders, nullListener, (EventRingBuffer*)nullptr);
+        auto nullDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+        OrderBook ringBook;
+        EventRingBuffer ring(1 << 16);
+        RingBufferListener ringListener(ring);
+        start = std::chrono::high_resolution_clock::now();
+        run_event_workload(ringBook, num_orders, ringListener, &ring);
+        auto ringDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+        std::cout << "Null listener: " << nullDuration / num_orders << " ns per order | Ring buffer listener: " << ringDuration / num_orders
+                  << " ns per order (" << ringListener.getFullRingWaits() << " waits for the consumer)\n";
+    }
+
+    // The clustered workload as a list of commands, so that it can be submitted one by one or in batches; other seeds give other sessions
+    static std::vector<OrderCommand> generate_clustered_commands(int num_orders, unsigned seed = 7) {
+        std::mt19937 gen(seed);
+        std::uniform_int_distribution<> action_dist(0, 99);
+        std::uniform_int_distribution<> offset_dist(0, 300);
+        std::uniform_int_distribution<> drift_dist(-20, 20);
+        std::uniform_int_distribution<> shares_dist(1, 100);
+        std::vector<int> orderIds;
+        std::vector<OrderCommand> commands;
+        commands.reserve(num_orders);
+        int mid = 100000;
+
+        for (int i = 1; i <= num_orders; ++i) {
+            if (i % 1000 == 0)
+                mid += drift_dist(gen);
+            int action = action_dist(gen);
+            OrderSide orderSide = (i % 2) ? OrderSide::Bid : OrderSide::Ask;
+
+            if (action < 60) {
+                int offset = offset_dist(gen) - 5;
+                commands.push_back(makeCommand(CommandType::AddLimit, orderSide, i, (orderSide == OrderSide::Bid) ? mid - offset : mid + offset, shares_dist(gen)));
+                orderIds.push_back(i);
+            }
+            else if (action < 85 && !orderIds.empty()) {
+                size_t index = gen() % orderIds.size();
+                commands.push_back(makeCommand(CommandType::CancelLimit, orderSide, orderIds[index], 0, 0));
+                orderIds[index] = orderIds.back();
+                orderIds.pop_back();
+            }
+            else
+                commands.push_back(makeCommand(CommandType::Market, orderSide, 0, 0, shares_dist(gen)));
+        }
+        return commands;
+    }
+
+    static void run_batch_benchmark(int num_orders) {
+        // Throughput of processBatch at several batch sizes; events go to a ring buffer drained after each batch (it holds far more than a batch's)
+        std::vector<OrderCommand> commands = generate_clustered_commands(num_orders);
+        std::pair<int, int> referenceTouches[2];
+        size_t referenceEvents = 0;
+        size_t batchSizes[] = { 1, 16, 256, 4096 };
+
+        for (size_t batchSize : batchSizes) {
+            OrderBook book(num_orders / 4, 4096);
+            EventRingBuffer ring(1 << 16);
+            RingBufferListener listener(ring);
+            size_t events = 0;
+
+            auto start = std::chrono::high_resolution_clock::now();
+            for (size_t first = 0; first < commands.size(); first += batchSize) {
+                book.processBatch(&commands[first], std::min(batchSize, commands.size() - first), listener);
+                events += ring.drain([](const ExecutionEvent&) {});
+            }
+            auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+            // Batches must give the same book and events as the one by one submission (a batch size of 1)
+            std::pair<int, int> touches[2] = { touchOf(book.getHighestBid()), touchOf(book.getLowestAsk()) };
+            if (batchSize == 1) {
+                referenceTouches[0] = touches[0];
+                referenceTouches[1] = touches[1];
+                referenceEvents = events;
+            }
+            bool sameState = touches[0] == referenceTouches[0] && touches[1] == referenceTouches[1] && events == referenceEvents;
+
+            std::cout << "Batch size " << batchSize << ": " << num_orders / (duration / 1e9) << " commands/s, " 
+                      << (double)duration / num_orders << " ns per command (" << events << " events, " << (sameState ? "same" : "DIFFERENT") << " final state)\n";
+        }
+    }
+
+    static void run_top_of_book_benchmark(int num_orders, int num_readers, size_t batchSize = 16) {
+        // Batches matched without publishing, then with the top of the book published after each batch: without readers, then while
+        // num_readers threads read it in a loop. tests.cpp checks that readers only ever get whole published snapshots
+        std::vector<OrderCommand> commands = generate_clustered_commands(num_orders);
+        size_t numBatches = (commands.size() + batchSize - 1) / batchSize;
+        long long durations[3];
+        std::atomic<bool> matching(false);
+        std::atomic<uint64_t> reads(0), retries(0);
+
+        for (int mode = 0; mode < 3; ++mode) { // 0: not published, 1: published, 2: published & read
+            OrderBook book(num_orders / 4, 4096);
+            TopOfBook topOfBook;
+            std::vector<std::thread> readers;
+            if (mode > 0)
+                book.setTopOfBook(&topOfBook);
+            if (mode == 2) {
+                matching.store(true);
+                for (int reader = 0; reader < num_readers; ++reader)
+                    readers.emplace_back([&]() {
+                        uint64_t readerReads = 0, readerRetries = 0;
+                        TopOfBookSnapshot snapshot;
+                        while (matching.load(std::memory_order_relaxed)) {
+                            if (topOfBook.tryRead(snapshot))
+                                ++readerReads;
+                            else
+                                ++readerRetries;
+                        }
+                        reads.fetch_add(readerReads);
+                        retries.fetch_add(readerRetries);
+                    });
+            }
+
+            auto start = std::chrono::high_resolution_clock::now();
+            for (size_t first = 0; first < commands.size(); first += batchSize)
+                book.processBatch(&commands[first], std::min(batchSize, commands.size() - first));
+            durations[mode] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+            matching.store(false);
+            for (std::thread& reader : readers)
+                reader.join();
+        }
+
+        std::cout << "Top of book (batches of " << batchSize << ", " << numBatches << " publications): " << (double)durations[0] / num_orders
+                  << " ns per command not published, " << (double)durations[1] / num_orders << " ns published, "
+                  << (double)durations[2] / num_orders << " ns published & read by " << num_readers << " threads\n"
+                  << "  " << reads.load() << " reads, " << retries.load() << " retries\n";
+    }
+
+    // Multi-instrument session: every instrument receives the same clustered workload, interleaved command by command
+    static std::vector<OrderCommand> generate_multi_instrument_commands(int num_instruments, int messages_per_instrument) {
+        std::vector<OrderCommand> instrumentCommands = generate_clustered_commands(messages_per_instrument);
+        std::vector<OrderCommand> commands;
+        commands.reserve((size_t)num_instruments * messages_per_instrument);
+        for (const OrderCommand& command : instrumentCommands)
+            for (int instrumentId = 0; instrumentId < num_instruments; ++instrumentId) {
+                commands.push_back(command);
+                commands.back().instrumentId = (uint16_t)instrumentId;
+            }
+        return commands;
+    }
+
+    static void run_engine_benchmark(int num_instruments, int messages_per_instrument) {
+        // Throughput of MatchingEngine from 1 shard up to one shard per core; every book must end in the single-book reference state
+        std::vector<OrderCommand> commands = generate_multi_instrument_commands(num_instruments, messages_per_instrument);
+        OrderBook reference;
+        std::vector<OrderCommand> instrumentCommands = generate_clustered_commands(messages_per_instrument);
+        reference.processBatch(instrumentCommands.data(), instrumentCommands.size());
+        uint64_t referenceChecksum = reference.getChecksum();
+
+        const size_t submitSize = 1024; // Commands are submitted in chunks, as received from a feed
+        unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned numShards = 1; numShards <= cores; numShards *= 2) {
+            MatchingEngine engine(numShards);
+            engine.start();
+
+            auto start = std::chrono::high_resolution_clock::now();
+            for (size_t first = 0; first < commands.size(); first += submitSize)
+                engine.submit(&commands[first], std::min(submitSize, commands.size() - first));
+            engine.waitUntilIdle();
+            auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+            bool sameState = true;
+            for (int instrumentId = 0; instrumentId < num_instruments; ++instrumentId)
+                sameState = sameState && engine.getChecksum((uint16_t)instrumentId) == referenceChecksum;
+
+            std::cout << "Shards: " << numShards << " | " << num_instruments << " instruments, " << commands.size() << " messages in "
+                      << duration / 1000000 << "ms (" << commands.size() / (duration / 1e9) << " messages/s, "
+                      << (sameState ? "same" : "DIFFERENT") << " final books)\n";
+            for (size_t shard = 0; shard < engine.getShardCount(); ++shard) {
+                MatchingEngine::ShardStats stats = engine.getShardStats(shard);
+                std::cout << "  Shard " << shard << ": " << stats.instruments << " instruments, " << stats.processedMessages << " messages | Max queue depth: "
+                          << stats.maxQueueDepth << " | Latency (ns) mean " << (uint64_t)stats.meanLatencyNs << ", p50 " << (uint64_t)stats.p50LatencyNs
+                          << ", p99 " << (uint64_t)stats.p99LatencyNs << ", p99.9 " << (uint64_t)stats.p999LatencyNs << ", max " << (uint64_t)stats.maxLatencyNs << "\n";
+            }
+            engine.stop();
+        }
     }
-};
\ No newline at end of file
+};
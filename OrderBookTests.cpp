@@ -0,0 +1,632 @@
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <iostream>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+#include "OrderBook.h"
+#include "PriceLadderBook.h"
+#include "TopOfBook.h"
+
+// Fails the running test (see OrderBookTests): prints the check & its line, then returns false
+#define TEST_CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cout << "  " << __FILE__ << ":" << __LINE__ << ": check failed: " #condition "\n"; \
+            return false; \
+        } \
+    } while (0)
+
+// Tests of tests.cpp: each returns true if it passed
+class OrderBookTests {
+private:
+    // Random workload around a drifting mid price: limit & market orders, cancellations, and with withAmends, stop orders & modifications.
+    // Orders to cancel or modify are drawn from book, the reference; each command is passed to apply(book) for every book under test
+    template <typename Apply>
+    static void run_random_workload(const OrderBook& book, int num_commands, unsigned seed, int spread, bool withAmends, Apply apply) {
+        std::mt19937 gen(seed);
+        std::uniform_int_distribution<> action_dist(0, 99);
+        std::uniform_int_distribution<> offset_dist(-spread / 8, spread);
+        std::uniform_int_distribution<> drift_dist(-spread / 4, spread / 4);
+        std::uniform_int_distribution<> shares_dist(1, 100);
+        int mid = 100000;
+        int nextOrderId = 1;
+
+        for (int i = 0; i < num_commands; ++i) {
+            if (i % 500 == 0)
+                mid += drift_dist(gen);
+            OrderSide side = (gen() % 2) ? OrderSide::Bid : OrderSide::Ask;
+            int offset = offset_dist(gen); // Negative offsets cross the spread
+            int price = (side == OrderSide::Bid) ? mid - offset : mid + offset;
+            int stopPrice = (side == OrderSide::Bid) ? mid + offset : mid - offset;
+            int shares = shares_dist(gen);
+            int action = action_dist(gen);
+            const Order* order = (action >= 50 && action < 85) ? book.getOrderIndex().sampleOrder(gen) : nullptr;
+            bool isLimit = order && order->getOrderType() == OrderType::LimitOrder;
+
+            if (action < 50 || (action < 85 && !order))
+                apply(makeCommand(CommandType::AddLimit, side, nextOrderId++, price, shares));
+            else if (action < 70 || (!withAmends && action < 85))
+                apply(makeCommand(isLimit ? CommandType::CancelLimit : CommandType::CancelStop, side, order->getOrderId(), 0, 0));
+            else if (action < 85) {
+                bool keepPrice = gen() % 2; // Size decreases at the same price keep their priority
+                int newPrice = keepPrice ? order->getLimitPrice() : (isLimit ? price : stopPrice);
+                int newShares = keepPrice ? std::max(1, order->getOrderShares() - shares) : shares;
+                apply(makeCommand(isLimit ? CommandType::ModifyLimit : CommandType::ModifyStop, side, order->getOrderId(), newPrice, newShares));
+            }
+            else if (action < 93 && withAmends)
+                apply(makeCommand(CommandType::AddStop, side, nextOrderId++, stopPrice, shares));
+            else
+                apply(makeCommand(CommandType::Market, side, 0, 0, shares));
+        }
+    }
+
+    template <typename Book>
+    static void submit(Book& book, const OrderCommand& command) {
+        switch (command.type) {
+            case CommandType::AddLimit: book.addLimitOrder(command.orderId, command.side, command.price, command.shares); break;
+            case CommandType::CancelLimit: book.cancelLimitOrder(command.orderId); break;
+            case CommandType::ModifyLimit: book.modifyLimitOrder(command.orderId, command.shares, command.price); break;
+            case CommandType::AddStop: book.addStopOrder(command.orderId, command.side, command.price, command.shares); break;
+            case CommandType::CancelStop: book.cancelStopOrder(command.orderId); break;
+            case CommandType::ModifyStop: book.modifyStopOrder(command.orderId, command.shares, command.price); break;
+            case CommandType::Market: book.addMarketOrder(command.side, command.shares); break;
+            default: break;
+        }
+    }
+
+    // Keeps every event, in order
+    struct RecordingListener {
+        std::vector<ExecutionEvent> events;
+
+        void record(EventType type, OrderSide side, int orderId, int restingOrderId, int price, int shares, int remainingShares) {
+            ExecutionEvent event = { type, side, orderId, restingOrderId, price, shares, remainingShares };
+            events.push_back(event);
+        }
+        void onAck(int orderId, OrderSide side, int price, int shares) { record(EventType::Ack, side, orderId, 0, price, shares, 0); }
+        void onFill(int aggressorOrderId, int restingOrderId, OrderSide aggressorSide, int price, int shares, int restingRemainingShares) {
+            record(EventType::Fill, aggressorSide, aggressorOrderId, restingOrderId, price, shares, restingRemainingShares);
+        }
+        void onCancel(int orderId, OrderSide side, int price, int shares) { record(EventType::Cancel, side, orderId, 0, price, shares, 0); }
+        void onBatchBegin() {}
+        void onBatchEnd() {}
+    };
+
+    static bool sameEvent(const ExecutionEvent& a, const ExecutionEvent& b) {
+        return a.type == b.type && a.side == b.side && a.orderId == b.orderId && a.restingOrderId == b.restingOrderId && a.price == b.price
+            && a.shares == b.shares && a.remainingShares == b.remainingShares;
+    }
+
+    static std::pair<int, int> touchOf(const Limit* level) {
+        return level ? std::make_pair(level->getLimitPrice(), level->getTotalShares()) : std::make_pair(0, 0);
+    }
+
+    // Expected content of one tree of a book: order ids & shares of each level, in queue order
+    struct ModelTree {
+        OrderSide side;
+        OrderCategory category;
+        bool descending; // Walk from the book edge: bids & stop asks by descending price
+        std::map<int, std::vector<std::pair<int, int>>> levels;
+    };
+
+    // Cancels the model's orders priced in [minPrice, maxPrice] for which shouldCancel(id) is true, appending the expected cancel events
+    template <typename Predicate>
+    static void cancelModelOrders(ModelTree& tree, int minPrice, int maxPrice, Predicate shouldCancel, std::vector<ExecutionEvent>& events) {
+        std::vector<int> prices;
+        for (const auto& level : tree.levels)
+            if (level.first >= minPrice && level.first <= maxPrice)
+                prices.push_back(level.first);
+        if (tree.descending)
+            std::reverse(prices.begin(), prices.end());
+        for (int price : prices) {
+            std::vector<std::pair<int, int>>& orders = tree.levels[price];
+            std::vector<std::pair<int, int>> kept;
+            for (const std::pair<int, int>& order : orders)
+                if (shouldCancel(order.first)) {
+                    ExecutionEvent event = { EventType::Cancel, tree.side, order.first, 0, price, order.second, 0 };
+                    events.push_back(event);
+                }
+                else
+                    kept.push_back(order);
+            if (kept.empty())
+                tree.levels.erase(price);
+            else
+                orders.swap(kept);
+        }
+    }
+
+    // Walks the book's tree from its edge: same levels, same orders in the same queue order as the model
+    static bool matchesModel(const OrderBook& book, const ModelTree& tree) {
+        std::vector<std::pair<int, const std::vector<std::pair<int, int>>*>> expected;
+        for (const auto& level : tree.levels)
+            expected.push_back(std::make_pair(level.first, &level.second));
+        if (tree.descending)
+            std::reverse(expected.begin(), expected.end());
+
+        std::size_t i = 0;
+        for (PriceLevelIterator it = book.getLevelIterator(tree.side, tree.category); it != PriceLevelIterator(); ++it, ++i) {
+            TEST_CHECK(i < expected.size() && it->getLimitPrice() == expected[i].first);
+            const std::vector<std::pair<int, int>>& orders = *expected[i].second;
+            std::size_t j = 0;
+            for (Order* order = it->getHeadOrder(); order != nullptr; order = order->getNextOrder(), ++j)
+                TEST_CHECK(j < orders.size() && order->getOrderId() == orders[j].first && order->getOrderShares() == orders[j].second);
+            TEST_CHECK(j == orders.size());
+        }
+        TEST_CHECK(i == expected.size());
+
+        if (tree.category == OrderCategory::Limit) { // The depth snapshot too, which reads the level totals
+            std::vector<DepthLevel> depth(expected.size() + 1);
+            TEST_CHECK(book.getDepth(tree.side, depth.size(), depth.data()) == expected.size());
+            for (std::size_t k = 0; k < expected.size(); ++k) {
+                long long shares = 0;
+                for (const std::pair<int, int>& order : *expected[k].second)
+                    shares += order.second;
+                TEST_CHECK(depth[k].price == expected[k].first && depth[k].totalShares == shares && depth[k].numberOfOrders == (int)expected[k].second->size());
+            }
+        }
+        return true;
+    }
+
+    static uint64_t hashTopOfBook(const TopOfBookSnapshot& snapshot) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&snapshot);
+        uint64_t hash = 14695981039346656037ULL; // FNV-1a
+        for (std::size_t i = 0; i < sizeof(snapshot); ++i)
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        return hash;
+    }
+
+    // Both backends must stay in the same state along the random workload: the same touch after every order, the same checksum every 100 orders
+    static bool ladder_matches_avl(int num_commands, unsigned seed, int spread, int ladderTicks, bool withAmends) {
+        OrderBook avlBook;
+        PriceLadderBook ladderBook(100000 - ladderTicks / 2, 100000 + ladderTicks / 2 - 1);
+        bool sameState = true;
+        int commands = 0;
+        run_random_workload(avlBook, num_commands, seed, spread, withAmends, [&](const OrderCommand& command) {
+            if (!sameState)
+                return;
+            submit(avlBook, command);
+            submit(ladderBook, command);
+            ++commands;
+            sameState = (commands % 100 != 0 || avlBook.getChecksum() == ladderBook.getChecksum())
+                && avlBook.getOrderIndex().size() == ladderBook.getOrderIndex().size()
+                && touchOf(avlBook.getHighestBid()) == touchOf(ladderBook.getHighestBid())
+                && touchOf(avlBook.getLowestAsk()) == touchOf(ladderBook.getLowestAsk());
+        });
+        sameState = sameState && avlBook.getChecksum() == ladderBook.getChecksum();
+        if (!sameState)
+            std::cout << "  Seed " << seed << ": the books differ after command " << commands << "\n";
+        return sameState;
+    }
+
+public:
+    static bool test_ladder_matches_avl_on_limit_workload() {
+        // Prices drift out of the ladder's window: re-centerings & overflow levels
+        for (unsigned seed = 1; seed <= 4; ++seed)
+            TEST_CHECK(ladder_matches_avl(20000, seed, 300, 1024, false));
+        return true;
+    }
+
+    static bool test_ladder_matches_avl_with_amends_and_stops() {
+        // Modifications requeue orders without trading, even at crossing prices; stop orders trigger at the same commands in both backends
+        for (unsigned seed = 1; seed <= 4; ++seed)
+            TEST_CHECK(ladder_matches_avl(20000, seed, 40, 256, true));
+        return true;
+    }
+
+    static bool test_modify_requeues_without_matching() {
+        // A bid moved above the ask & a stop moved to a price the ask has already reached are requeued, in both backends
+        OrderBook avlBook;
+        PriceLadderBook ladderBook(0, 1023);
+        const OrderCommand commands[] = {
+            makeCommand(CommandType::AddLimit, OrderSide::Ask, 1, 110, 10),
+            makeCommand(CommandType::AddLimit, OrderSide::Bid, 2, 100, 10),
+            makeCommand(CommandType::AddStop, OrderSide::Bid, 3, 200, 5),
+            makeCommand(CommandType::ModifyLimit, OrderSide::Bid, 2, 120, 10),
+            makeCommand(CommandType::ModifyStop, OrderSide::Bid, 3, 100, 5)
+        };
+        for (const OrderCommand& command : commands) {
+            submit(avlBook, command);
+            submit(ladderBook, command);
+        }
+        TEST_CHECK(avlBook.getOrderIndex().size() == 3);
+        TEST_CHECK(ladderBook.getOrderIndex().size() == 3);
+        TEST_CHECK(touchOf(ladderBook.getHighestBid()) == std::make_pair(120, 10));
+        TEST_CHECK(ladderBook.getLowestStopBid() != nullptr && ladderBook.getLowestStopBid()->getLimitPrice() == 100);
+        TEST_CHECK(avlBook.getChecksum() == ladderBook.getChecksum());
+        return true;
+    }
+
+    static bool test_ring_listener_waits_for_a_slow_consumer() {
+        // A ring much smaller than a batch's events & a consumer slower than the matcher: every event must come through, in order
+        OrderBook reference;
+        RecordingListener recorder;
+        std::vector<OrderCommand> commands;
+        run_random_workload(reference, 20000, 11, 40, true, [&](const OrderCommand& command) {
+            reference.processBatch(&command, 1, recorder);
+            commands.push_back(command);
+        });
+
+        OrderBook book;
+        EventRingBuffer ring(64);
+        RingBufferListener listener(ring);
+        std::atomic<bool> matched(false);
+        std::vector<ExecutionEvent> consumed;
+        std::thread consumer([&]() {
+            ExecutionEvent event;
+            while (!matched.load(std::memory_order_acquire) || ring.size() > 0) {
+                if (ring.tryPop(event))
+                    consumed.push_back(event);
+                std::this_thread::yield();
+            }
+        });
+        const std::size_t batchSize = 256;
+        for (std::size_t first = 0; first < commands.size(); first += batchSize)
+            book.processBatch(&commands[first], std::min(batchSize, commands.size() - first), listener);
+        matched.store(true, std::memory_order_release);
+        consumer.join();
+
+        TEST_CHECK(listener.getFullRingWaits() > 0 && listener.getDroppedEvents() == 0);
+        TEST_CHECK(consumed.size() == recorder.events.size());
+        for (std::size_t i = 0; i < consumed.size(); ++i)
+            TEST_CHECK(sameEvent(consumed[i], recorder.events[i]));
+
+        // Without a consumer, FullRingPolicy::Drop counts what doesn't fit
+        OrderBook droppingBook;
+        EventRingBuffer smallRing(64);
+        RingBufferListener droppingListener(smallRing, FullRingPolicy::Drop);
+        droppingBook.processBatch(commands.data(), commands.size(), droppingListener);
+        TEST_CHECK(smallRing.size() == 64 && droppingListener.getDroppedEvents() == recorder.events.size() - 64);
+        return true;
+    }
+
+    static bool test_order_index_shrinks_only_drained_unreserved_tables() {
+        // Batches that add orders to a drained index & cancel them all don't resize it; reserved capacity is kept; a big drained table is released
+        const int batch_size = 2000;
+        OrderBook batchBook;
+        std::vector<OrderCommand> adds, cancels;
+        for (int orderId = 1; orderId <= batch_size; ++orderId) {
+            adds.push_back(makeCommand(CommandType::AddLimit, OrderSide::Bid, orderId, 1 + orderId % 100, 10));
+            cancels.push_back(makeCommand(CommandType::CancelLimit, OrderSide::Bid, orderId, 0, 0));
+        }
+        batchBook.processBatch(adds.data(), adds.size());
+        std::size_t batchBytes = batchBook.getOrderIndex().getReservedBytes();
+        for (int round = 0; round < 10; ++round) {
+            batchBook.processBatch(cancels.data(), cancels.size());
+            TEST_CHECK(batchBook.getOrderIndex().empty() && batchBook.getOrderIndex().getReservedBytes() == batchBytes);
+            batchBook.processBatch(adds.data(), adds.size());
+            TEST_CHECK(batchBook.getOrderIndex().getReservedBytes() == batchBytes);
+        }
+
+        const int num_orders = 100000;
+        OrderBook reservedBook(num_orders), growingBook;
+        std::size_t reservedBytes = reservedBook.getOrderIndex().getReservedBytes();
+        for (int orderId = 1; orderId <= num_orders; ++orderId) {
+            reservedBook.addLimitOrder(orderId, OrderSide::Bid, 1 + orderId % 100, 10);
+            growingBook.addLimitOrder(orderId, OrderSide::Bid, 1 + orderId % 100, 10);
+        }
+        std::size_t peakBytes = growingBook.getOrderIndex().getReservedBytes();
+        for (int orderId = 1; orderId <= num_orders; ++orderId) {
+            reservedBook.cancelLimitOrder(orderId);
+            growingBook.cancelLimitOrder(orderId);
+        }
+        TEST_CHECK(reservedBook.getOrderIndex().getReservedBytes() == reservedBytes);
+        TEST_CHECK(growingBook.getOrderIndex().getReservedBytes() < peakBytes / 16);
+        return true;
+    }
+
+    static bool test_stop_cascade_runs_after_every_trade() {
+        // A limit order that trades then rests, and a stop triggered on entry, move the touch: the stops they cross must trigger right away
+        const OrderCommand restingAggressor[] = {
+            makeCommand(CommandType::AddLimit, OrderSide::Ask, 1, 100, 5),
+            makeCommand(CommandType::AddLimit, OrderSide::Ask, 2, 101, 5),
+            makeCommand(CommandType::AddStop, OrderSide::Bid, 3, 101, 3),
+            makeCommand(CommandType::AddLimit, OrderSide::Bid, 4, 100, 10)
+        };
+        const OrderCommand stopOnEntry[] = {
+            makeCommand(CommandType::AddLimit, OrderSide::Ask, 1, 100, 5),
+            makeCommand(CommandType::AddLimit, OrderSide::Ask, 2, 101, 5),
+            makeCommand(CommandType::AddStop, OrderSide::Bid, 5, 101, 2),
+            makeCommand(CommandType::AddStop, OrderSide::Bid, 6, 100, 5)
+        };
+
+        OrderBook avlBook;
+        PriceLadderBook ladderBook(0, 1023);
+        for (const OrderCommand& command : restingAggressor) {
+            submit(avlBook, command);
+            submit(ladderBook, command);
+        }
+        TEST_CHECK(!avlBook.getOrderIndex().contains(3) && avlBook.getLowestStopBid() == nullptr);
+        TEST_CHECK(touchOf(avlBook.getLowestAsk()) == std::make_pair(101, 2));
+        TEST_CHECK(touchOf(avlBook.getHighestBid()) == std::make_pair(100, 5));
+        TEST_CHECK(avlBook.getChecksum() == ladderBook.getChecksum());
+
+        OrderBook avlEntryBook;
+        PriceLadderBook ladderEntryBook(0, 1023);
+        for (const OrderCommand& command : stopOnEntry) {
+            submit(avlEntryBook, command);
+            submit(ladderEntryBook, command);
+        }
+        TEST_CHECK(avlEntryBook.getOrderIndex().size() == 1 && avlEntryBook.getLowestStopBid() == nullptr);
+        TEST_CHECK(touchOf(avlEntryBook.getLowestAsk()) == std::make_pair(101, 3));
+        TEST_CHECK(avlEntryBook.getChecksum() == ladderEntryBook.getChecksum());
+        return true;
+    }
+
+    static bool test_duplicate_adds_are_cancelled_untraded() {
+        // An add reusing a live id must neither trade nor rest: it would have no index entry of its own, and could take over the live order's
+        OrderBook avlBook;
+        PriceLadderBook ladderBook(0, 1023);
+        RecordingListener recorder;
+        const OrderCommand commands[] = {
+            makeCommand(CommandType::AddLimit, OrderSide::Ask, 1, 100, 5),
+            makeCommand(CommandType::AddLimit, OrderSide::Bid, 1, 100, 3),
+            makeCommand(CommandType::AddLimit, OrderSide::Bid, 1, 90, 3),
+            makeCommand(CommandType::AddStop, OrderSide::Bid, 1, 100, 2)
+        };
+        avlBook.processBatch(commands, 4, recorder);
+        for (const OrderCommand& command : commands)
+            submit(ladderBook, command);
+
+        TEST_CHECK(recorder.events.size() == 4 && recorder.events[0].type == EventType::Ack);
+        for (std::size_t i = 1; i < 4; ++i)
+            TEST_CHECK(recorder.events[i].type == EventType::Cancel && recorder.events[i].orderId == 1 && recorder.events[i].shares == commands[i].shares);
+        TEST_CHECK(avlBook.getOrderIndex().size() == 1 && avlBook.getOrderIndex().find(1)->getOrderShares() == 5);
+        TEST_CHECK(touchOf(avlBook.getLowestAsk()) == std::make_pair(100, 5));
+        TEST_CHECK(avlBook.getHighestBid() == nullptr && avlBook.getLowestStopBid() == nullptr);
+        TEST_CHECK(avlBook.getChecksum() == ladderBook.getChecksum());
+        return true;
+    }
+
+    static bool test_ioc_and_fok_orders() {
+        // IOC: the shares left after trading are cancelled. FOK: all the shares trade at once, or none does
+        OrderBook book;
+        RecordingListener recorder;
+        book.addLimitOrder(1, OrderSide::Ask, 100, 5);
+        book.addLimitOrder(2, OrderSide::Ask, 101, 5);
+
+        book.addLimitOrder(10, OrderSide::Bid, 100, 8, TimeInForce::IOC, recorder);
+        TEST_CHECK(recorder.events.size() == 2);
+        TEST_CHECK(recorder.events[0].type == EventType::Fill && recorder.events[0].restingOrderId == 1 && recorder.events[0].shares == 5);
+        TEST_CHECK(recorder.events[1].type == EventType::Cancel && recorder.events[1].orderId == 10 && recorder.events[1].shares == 3);
+        TEST_CHECK(!book.getOrderIndex().contains(10) && book.getHighestBid() == nullptr);
+        TEST_CHECK(touchOf(book.getLowestAsk()) == std::make_pair(101, 5));
+
+        recorder.events.clear();
+        book.addLimitOrder(11, OrderSide::Bid, 101, 6, TimeInForce::FOK, recorder); // 5 shares available: killed
+        TEST_CHECK(recorder.events.size() == 1 && recorder.events[0].type == EventType::Cancel && recorder.events[0].shares == 6);
+        TEST_CHECK(touchOf(book.getLowestAsk()) == std::make_pair(101, 5) && book.getOrderIndex().size() == 1);
+
+        recorder.events.clear();
+        book.addLimitOrder(3, OrderSide::Ask, 102, 3);
+        book.addLimitOrder(12, OrderSide::Bid, 102, 8, TimeInForce::FOK, recorder); // Exactly 8 shares available: filled
+        TEST_CHECK(recorder.events.size() == 2);
+        TEST_CHECK(recorder.events[0].type == EventType::Fill && recorder.events[0].restingOrderId == 2 && recorder.events[0].shares == 5);
+        TEST_CHECK(recorder.events[1].type == EventType::Fill && recorder.events[1].restingOrderId == 3 && recorder.events[1].shares == 3);
+        TEST_CHECK(book.getOrderIndex().empty() && book.getLowestAsk() == nullptr && book.getHighestBid() == nullptr);
+
+        recorder.events.clear();
+        book.addLimitOrder(13, OrderSide::Bid, 99, 4, TimeInForce::IOC, recorder); // Nothing to trade against
+        TEST_CHECK(recorder.events.size() == 1 && recorder.events[0].type == EventType::Cancel && recorder.events[0].shares == 4);
+        TEST_CHECK(book.getOrderIndex().empty());
+        return true;
+    }
+
+    static bool test_impact_estimates_match_a_walk_of_the_levels() {
+        // getSharesAvailable & estimateImpact add up subtree aggregates: they must agree with a walk of every level from the touch
+        OrderBook book;
+        run_random_workload(book, 20000, 5, 300, false, [&](const OrderCommand& command) { submit(book, command); });
+        std::vector<DepthLevel> levels(100000);
+        std::mt19937 gen(3);
+
+        const OrderSide sides[] = { OrderSide::Bid, OrderSide::Ask };
+        for (OrderSide aggressorSide : sides) {
+            OrderSide restingSide = (aggressorSide == OrderSide::Bid) ? OrderSide::Ask : OrderSide::Bid;
+            std::size_t count = book.getDepth(restingSide, levels.size(), levels.data());
+            TEST_CHECK(count > 10);
+            long long totalShares = 0;
+            for (std::size_t i = 0; i < count; ++i)
+                totalShares += levels[i].totalShares;
+
+            for (int trial = 0; trial < 200; ++trial) {
+                // Shares available up to a limit price within or beyond the levels
+                int limitPrice = levels[gen() % count].price + (int)(gen() % 3) - 1;
+                long long available = 0;
+                for (std::size_t i = 0; i < count; ++i)
+                    if ((aggressorSide == OrderSide::Bid) ? levels[i].price <= limitPrice : levels[i].price >= limitPrice)
+                        available += levels[i].totalShares;
+                TEST_CHECK(book.getSharesAvailable(aggressorSide, limitPrice) == available);
+
+                // Fills of a market order, sometimes bigger than the whole side
+                long long shares = 1 + (long long)(gen() % (totalShares + totalShares / 8));
+                long long remaining = shares, notional = 0;
+                int worstPrice = 0;
+                for (std::size_t i = 0; i < count && remaining > 0; ++i) {
+                    long long filled = std::min(remaining, (long long)levels[i].totalShares);
+                    notional += filled * levels[i].price;
+                    remaining -= filled;
+                    worstPrice = levels[i].price;
+                }
+                OrderBook::ImpactEstimate estimate = book.estimateImpact(aggressorSide, shares);
+                TEST_CHECK(estimate.filledShares == shares - remaining && estimate.notional == notional);
+                TEST_CHECK(estimate.bestPrice == levels[0].price && estimate.worstPrice == worstPrice);
+                double averagePrice = (double)notional / estimate.filledShares;
+                double impactCost = (aggressorSide == OrderSide::Bid) ? averagePrice - levels[0].price : levels[0].price - averagePrice;
+                TEST_CHECK(estimate.averagePrice == averagePrice && estimate.impactCost == impactCost && impactCost >= 0);
+            }
+        }
+        return true;
+    }
+
+    static bool test_mass_cancels_keep_the_trees_valid() {
+        // Mass cancels split each tree around their price range, cancel level by level, then rebuild & join the levels left:
+        // the trees must hold the same orders as a model, report the cancels from the book edge outward, and stay valid AVL trees
+        OrderBook book;
+        ModelTree trees[] = { { OrderSide::Bid, OrderCategory::Limit, true, {} }, { OrderSide::Ask, OrderCategory::Limit, false, {} },
+                              { OrderSide::Bid, OrderCategory::Stop, false, {} }, { OrderSide::Ask, OrderCategory::Stop, true, {} } };
+        ModelTree& bids = trees[0];
+        ModelTree& asks = trees[1];
+        std::vector<bool> isDayOrder(1);
+        std::mt19937 gen(11);
+        int orderId = 0;
+        for (int level = 0; level < 300; ++level)
+            for (int i = 0; i < 4; ++i) {
+                // Limit levels 701..1000 & 1001..1300, shuffled so that the trees are built by rotations; stops far outside them
+                int offset = (int)(gen() % 300);
+                int shares = 1 + (int)(gen() % 100);
+                bool day = gen() % 3 == 0;
+                ModelTree& tree = trees[i];
+                int price = (i == 0) ? 1000 - offset : (i == 1) ? 1001 + offset : (i == 2) ? 1400 + offset : 600 - offset;
+                ++orderId;
+                if (tree.category == OrderCategory::Limit)
+                    book.addLimitOrder(orderId, tree.side, price, shares, day ? TimeInForce::DAY : TimeInForce::GTC);
+                else
+                    book.addStopOrder(orderId, tree.side, price, shares);
+                tree.levels[price].push_back(std::make_pair(orderId, shares));
+                isDayOrder.push_back(day && tree.category == OrderCategory::Limit);
+            }
+        for (const ModelTree& tree : trees)
+            TEST_CHECK(matchesModel(book, tree));
+
+        auto anyOrder = [](int) { return true; };
+        RecordingListener recorder;
+        std::vector<ExecutionEvent> expected;
+        auto checkBook = [&](std::size_t cancelledOrders) -> bool {
+            TEST_CHECK(cancelledOrders == expected.size() && recorder.events.size() == expected.size());
+            for (std::size_t i = 0; i < expected.size(); ++i)
+                TEST_CHECK(sameEvent(recorder.events[i], expected[i]));
+            for (const ModelTree& tree : trees)
+                TEST_CHECK(matchesModel(book, tree));
+#ifndef NDEBUG
+            book.checkTreeInvariants();
+#endif
+            recorder.events.clear();
+            expected.clear();
+            return true;
+        };
+
+        // Ranges within the trees, whose bounds fall between & on levels; then ranges at the edges & beyond them
+        const int bidRanges[][2] = { { 850, 900 }, { 700, 760 }, { 990, 2000 }, { 0, 699 }, { 901, 901 } };
+        const int askRanges[][2] = { { 1100, 1149 }, { 1290, 1300 }, { 0, 1010 }, { 1301, 5000 }, { 1200, 1200 } };
+        for (int i = 0; i < 5; ++i) {
+            cancelModelOrders(bids, bidRanges[i][0], bidRanges[i][1], anyOrder, expected);
+            TEST_CHECK(checkBook(book.cancelOrdersInRange(OrderSide::Bid, bidRanges[i][0], bidRanges[i][1], recorder)));
+            cancelModelOrders(asks, askRanges[i][0], askRanges[i][1], anyOrder, expected);
+            TEST_CHECK(checkBook(book.cancelOrdersInRange(OrderSide::Ask, askRanges[i][0], askRanges[i][1], recorder)));
+        }
+
+        // DAY orders expire from both limit trees, bids first
+        auto isDay = [&](int id) { return (bool)isDayOrder[id]; };
+        cancelModelOrders(bids, INT_MIN, INT_MAX, isDay, expected);
+        cancelModelOrders(asks, INT_MIN, INT_MAX, isDay, expected);
+        TEST_CHECK(checkBook(book.expireDayOrders(recorder)));
+        TEST_CHECK(!bids.levels.empty() && !asks.levels.empty());
+
+        // Every 5th order of the four trees, in the order bids, asks, stop bids, stop asks
+        auto everyFifth = [](int id) { return id % 5 == 0; };
+        for (ModelTree& tree : trees)
+            cancelModelOrders(tree, INT_MIN, INT_MAX, everyFifth, expected);
+        TEST_CHECK(checkBook(book.cancelOrdersIf([](const Order& order) { return order.getOrderId() % 5 == 0; }, recorder)));
+
+        // The emptied trees are left with no level & no edge
+        for (ModelTree& tree : trees)
+            cancelModelOrders(tree, INT_MIN, INT_MAX, anyOrder, expected);
+        std::size_t cancelledOrders = book.cancelOrdersIf([](const Order&) { return true; }, recorder);
+        TEST_CHECK(checkBook(cancelledOrders));
+        TEST_CHECK(book.getOrderIndex().empty() && !book.getHighestBid() && !book.getLowestAsk() && !book.getLowestStopBid() && !book.getHighestStopAsk());
+        return true;
+    }
+
+    static bool test_commands_of_the_other_category_are_ignored() {
+        // A limit order's cancellation or modification of a stop order's id (or the other way around) must leave both orders in their trees
+        OrderBook avlBook;
+        PriceLadderBook ladderBook(0, 1023);
+        const OrderCommand commands[] = {
+            makeCommand(CommandType::AddStop, OrderSide::Bid, 2, 150, 5),
+            makeCommand(CommandType::AddLimit, OrderSide::Ask, 3, 160, 7),
+            makeCommand(CommandType::CancelLimit, OrderSide::Bid, 2, 0, 0),
+            makeCommand(CommandType::ModifyLimit, OrderSide::Bid, 2, 140, 3),
+            makeCommand(CommandType::CancelStop, OrderSide::Ask, 3, 0, 0),
+            makeCommand(CommandType::ModifyStop, OrderSide::Ask, 3, 170, 1)
+        };
+        for (const OrderCommand& command : commands) {
+            submit(avlBook, command);
+            submit(ladderBook, command);
+        }
+        TEST_CHECK(avlBook.getOrderIndex().size() == 2);
+        TEST_CHECK(avlBook.getLowestStopBid() != nullptr && avlBook.getLowestStopBid()->getLimitPrice() == 150);
+        TEST_CHECK(touchOf(avlBook.getLowestStopBid()) == std::make_pair(150, 5));
+        TEST_CHECK(touchOf(avlBook.getLowestAsk()) == std::make_pair(160, 7));
+        TEST_CHECK(avlBook.getHighestBid() == nullptr && avlBook.getHighestStopAsk() == nullptr);
+        TEST_CHECK(avlBook.getChecksum() == ladderBook.getChecksum());
+
+        avlBook.cancelStopOrder(2);
+        avlBook.cancelLimitOrder(3);
+        TEST_CHECK(avlBook.getOrderIndex().empty());
+        TEST_CHECK(avlBook.getLowestStopBid() == nullptr && avlBook.getLowestAsk() == nullptr);
+        return true;
+    }
+
+    static bool test_top_of_book_reads_are_never_torn() {
+        /* A matching thread publishes the top of the book after each batch while reader threads read it in a loop. The matching thread records
+            the hash of every publication; every snapshot a reader got must be one of them, under its sequence number, and a reader's sequence numbers never go back */
+        const int num_commands = 200000, num_readers = 2;
+        const std::size_t batchSize = 16;
+        std::vector<OrderCommand> commands;
+        OrderBook reference;
+        run_random_workload(reference, num_commands, 7, 300, false, [&](const OrderCommand& command) {
+            submit(reference, command);
+            commands.push_back(command);
+        });
+
+        OrderBook book;
+        TopOfBook topOfBook;
+        book.setTopOfBook(&topOfBook);
+        std::size_t numBatches = (commands.size() + batchSize - 1) / batchSize;
+        std::vector<uint64_t> publishedHashes(numBatches + 1);
+        std::atomic<bool> matching(true);
+        std::atomic<uint64_t> backwardReads(0);
+        std::vector<std::vector<std::pair<uint64_t, uint64_t>>> readHashes(num_readers); // (sequence, hash), per reader
+
+        std::vector<std::thread> readers;
+        for (int reader = 0; reader < num_readers; ++reader)
+            readers.emplace_back([&, reader]() {
+                std::vector<std::pair<uint64_t, uint64_t>>& hashes = readHashes[reader];
+                hashes.reserve(1 << 20);
+                uint64_t lastSequence = 0;
+                TopOfBookSnapshot snapshot;
+                while (matching.load(std::memory_order_relaxed)) {
+                    if (!topOfBook.tryRead(snapshot))
+                        continue;
+                    if (snapshot.sequence < lastSequence)
+                        backwardReads.fetch_add(1);
+                    lastSequence = snapshot.sequence;
+                    if (snapshot.sequence != 0 && hashes.size() < hashes.capacity())
+                        hashes.push_back(std::make_pair(snapshot.sequence, hashTopOfBook(snapshot)));
+                }
+            });
+
+        for (std::size_t first = 0; first < commands.size(); first += batchSize) {
+            book.processBatch(&commands[first], std::min(batchSize, commands.size() - first));
+            // The matching thread is the only writer, its own read never overlaps a publication
+            TopOfBookSnapshot published = topOfBook.read();
+            publishedHashes[published.sequence] = hashTopOfBook(published);
+        }
+        matching.store(false);
+        for (std::thread& reader : readers)
+            reader.join();
+
+        uint64_t checkedReads = 0, tornReads = 0;
+        for (const std::vector<std::pair<uint64_t, uint64_t>>& hashes : readHashes)
+            for (const std::pair<uint64_t, uint64_t>& read : hashes) {
+                ++checkedReads;
+                tornReads += (read.first > numBatches || publishedHashes[read.first] != read.second);
+            }
+        TEST_CHECK(book.getChecksum() == reference.getChecksum());
+        TEST_CHECK(tornReads == 0);
+        TEST_CHECK(backwardReads.load() == 0);
+        std::cout << "  " << checkedReads << " snapshots checked\n";
+        return true;
+    }
+};
@@ -0,0 +1,48 @@
+#ifndef ORDERCOMMAND_H
+#define ORDERCOMMAND_H
+
+#include <cstdint>
+
+#include "enums.h"
+
+// Type of a command submitted to an order book
+enum class CommandType : uint8_t {
+    AddLimit,
+    CancelLimit,
+    ModifyLimit,
+    AddStop,
+    CancelStop,
+    ModifyStop,
+    Market,
+    AddLimitIOC, // Limit orders whose remaining shares are cancelled instead of rested
+    AddLimitFOK, // Limit orders cancelled unless all their shares trade right away
+    Checkpoint   // No order: the book's checksum at this point of a journal (see makeCheckpoint), ignored by the book
+};
+
+// Compact (16 bytes) command, as submitted in batches to OrderBook::processBatch. Unused fields are ignored (e.g: side for a cancel)
+struct OrderCommand {
+    CommandType type;
+    OrderSide side;
+    uint16_t instrumentId; // Routes the command to its book in a MatchingEngine, ignored by OrderBook
+    int orderId; // Unused for market orders
+    int price;   // Limit or stop price; the new price for modifications
+    int shares;  // The new number of shares for modifications
+};
+
+static_assert(sizeof(OrderCommand) == 16, "OrderCommand must stay 16 bytes");
+
+inline OrderCommand makeCommand(CommandType type, OrderSide side, int orderId, int price, int shares, uint16_t instrumentId = 0) {
+    OrderCommand command = { type, side, instrumentId, orderId, price, shares };
+    return command;
+}
+
+// The 64-bit checksum is split over price (low half) & shares (high half)
+inline OrderCommand makeCheckpoint(uint64_t bookChecksum) {
+    return makeCommand(CommandType::Checkpoint, OrderSide::Bid, 0, (int)(uint32_t)bookChecksum, (int)(uint32_t)(bookChecksum >> 32));
+}
+
+inline uint64_t checkpointChecksum(const OrderCommand& command) {
+    return (uint64_t)(uint32_t)command.price | ((uint64_t)(uint32_t)command.shares << 32);
+}
+
+#endif
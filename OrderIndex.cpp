@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <cassert>
+#include "Order.h"
+#include "OrderIndex.h"
+
+
+OrderIndex::OrderIndex(const ObjectPool<OrderChunk>& _chunks, std::size_t capacity) : chunks(_chunks), liveOrders(0), minSlots(0), mask(0), hashShift(64) {
+    rehash(16);
+    reserve(capacity);
+}
+
+std::size_t OrderIndex::findSlot(int orderId) const {
+    std::size_t slot = homeSlot(orderId);
+    while (slots[slot].handle != emptySlot && slots[slot].orderId != orderId)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+void OrderIndex::rehash(std::size_t newSlotCount){
+    std::vector<Slot> oldSlots(newSlotCount, Slot{ 0, emptySlot });
+    oldSlots.swap(slots);
+    mask = newSlotCount - 1;
+    hashShift = 64;
+    for (std::size_t count = newSlotCount; count > 1; count >>= 1)
+        --hashShift;
+
+    for (const Slot& oldSlot : oldSlots)
+        if (oldSlot.handle != emptySlot)
+            slots[findSlot(oldSlot.orderId)] = oldSlot;
+}
+
+std::size_t OrderIndex::slotsFor(std::size_t capacity) const {
+    // Keep the table at most 3/4 full: with 8-byte slots, probe sequences stay within a cache line or two
+    std::size_t slotCount = slots.size();
+    while (3 * slotCount < 4 * capacity)
+        slotCount <<= 1;
+    return slotCount;
+}
+
+void OrderIndex::reserve(std::size_t capacity){
+    std::size_t slotCount = slotsFor(capacity);
+    if (slotCount != slots.size())
+        rehash(slotCount);
+    minSlots = std::max(minSlots, slotCount);
+}
+
+void OrderIndex::growFor(std::size_t newOrders){
+    std::size_t slotCount = slotsFor(liveOrders + newOrders);
+    if (slotCount != slots.size())
+        rehash(slotCount);
+}
+
+Order* OrderIndex::find(int orderId) const {
+    const Slot& slot = slots[findSlot(orderId)];
+    return (slot.handle == emptySlot) ? nullptr : resolve(slot.handle);
+}
+
+bool OrderIndex::insert(int orderId, Order* order){
+    if (4 * (liveOrders + 1) > 3 * slots.size())
+        rehash(2 * slots.size());
+
+    Slot& slot = slots[findSlot(orderId)];
+    if (slot.handle != emptySlot)
+        return false;
+
+    slot.orderId = orderId;
+    slot.handle = order->getHandle();
+    ++liveOrders;
+    return true;
+}
+
+void OrderIndex::relocate(int orderId, Order* order){
+    Slot& slot = slots[findSlot(orderId)];
+    assert(slot.handle != emptySlot && "Error: This order Id isn't in the index");
+    slot.handle = order->getHandle();
+}
+
+bool OrderIndex::erase(int orderId){
+    std::size_t hole = findSlot(orderId);
+    if (slots[hole].handle == emptySlot)
+        return false;
+    --liveOrders;
+
+    // Backward-shift deletion: move up the following entries of the probe sequence that can't be reached through the hole anymore
+    std::size_t next = (hole + 1) & mask;
+    while (slots[next].handle != emptySlot){
+        std::size_t home = homeSlot(slots[next].orderId);
+        if (((next - home) & mask) >= ((next - hole) & mask)){
+            slots[hole] = slots[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    slots[hole].handle = emptySlot;
+
+    // A drained table is shrunk: sampling stays O(1) and the memory is released (to a quarter, hence at most 1/8 full)
+    std::size_t shrinkFloor = std::max(minSlots, (std::size_t)minShrinkSlots);
+    if (32 * liveOrders < slots.size() && slots.size() > shrinkFloor)
+        rehash(std::max(slots.size() / 4, shrinkFloor));
+    return true;
+}
@@ -0,0 +1,83 @@
+#ifndef ORDERINDEX_H
+#define ORDERINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <xmmintrin.h>
+#endif
+
+#include "ObjectPool.h"
+#include "Order.h"
+
+/* Order id -> Order* index of a book (the address of the order in its level's queue), replacing std::unordered_map<int, Order*> (one heap node per order):
+    an open-addressing table (linear probing, backward-shift deletion) of 8-byte slots, each holding an id and the 32-bit handle of its order
+    (see Order::getHandle), resolved through the book's chunk pool. Lookup, insertion & erasure are O(1) amortized, and live orders can be sampled
+    uniformly at random in O(1) expected time: the table grows once 3/4 full, and erasures shrink it to a quarter once under 1/32 full.
+    A shrunk table is at most 1/8 full, far from the next growth, and the table never shrinks below its reserved capacity (see reserve) or
+    minShrinkSlots: a batch that adds orders to a drained table doesn't regrow what the previous batch's cancellations released. */
+class OrderIndex {
+private:
+    static const uint32_t emptySlot = UINT32_MAX;
+    static const std::size_t minShrinkSlots = 4096; // 32 KB: smaller tables aren't worth shrinking
+
+    struct Slot {
+        int orderId;
+        uint32_t handle; // emptySlot if the slot is free
+    };
+
+    const ObjectPool<OrderChunk>& chunks; // The book's, where the handles point to
+    std::vector<Slot> slots; // Power of two size, at most 3/4 full
+    std::size_t liveOrders;
+    std::size_t minSlots; // Floor of the shrinks: the slots of the largest reserved capacity
+    std::size_t mask;
+    unsigned hashShift;
+
+    // Fibonacci hashing spreads sequential ids over the whole table
+    inline std::size_t homeSlot(int orderId) const { return (std::size_t)(((uint64_t)(uint32_t)orderId * 11400714819323198485ULL) >> hashShift); }
+    inline Order* resolve(uint32_t handle) const { return chunks.at(handle >> Order::slotBits)->orders + (handle & ((1u << Order::slotBits) - 1)); }
+    std::size_t findSlot(int orderId) const; // Slot of orderId, or the free slot where it would be inserted
+    void rehash(std::size_t newSlotCount);
+    std::size_t slotsFor(std::size_t capacity) const; // Slots holding capacity orders at most 3/4 full, at least the current ones
+
+public:
+    explicit OrderIndex(const ObjectPool<OrderChunk>& chunks, std::size_t capacity = 0);
+
+    Order* find(int orderId) const; // nullptr if the order isn't in the index
+    bool insert(int orderId, Order* order); // false if orderId is already in the index
+    bool erase(int orderId); // false if ...
+    void relocate(int orderId, Order* order); // orderId (which must be in the index) now maps to order, e.g: after its level is compacted
+    void reserve(std::size_t capacity); // Room for capacity orders, kept by the shrinks
+    void growFor(std::size_t newOrders); // Room for newOrders more orders, e.g: a batch's, which the shrinks may release once they're gone
+
+    // Getters
+    inline std::size_t size() const { return liveOrders; }
+    inline bool empty() const { return liveOrders == 0; }
+    inline bool contains(int orderId) const { return find(orderId) != nullptr; }
+    inline void prefetch(int orderId) const { // Start loading the home slot of orderId, ahead of its lookup
+#if defined(_MSC_VER)
+        _mm_prefetch((const char*)&slots[homeSlot(orderId)], _MM_HINT_T0);
+#else
+        __builtin_prefetch(&slots[homeSlot(orderId)]);
+#endif
+    }
+    inline std::size_t getReservedBytes() const { return slots.capacity() * sizeof(Slot); }
+
+    // Uniformly random live order, nullptr if the index is empty: slots are drawn until an occupied one is found
+    template <typename RandomGenerator>
+    Order* sampleOrder(RandomGenerator& gen) const {
+        if (liveOrders == 0)
+            return nullptr;
+        std::uniform_int_distribution<std::size_t> slotDist(0, mask);
+        while (true) {
+            const Slot& slot = slots[slotDist(gen)];
+            if (slot.handle != emptySlot)
+                return resolve(slot.handle);
+        }
+    }
+};
+
+#endif
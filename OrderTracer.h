@@ -0,0 +1,51 @@
+#ifndef ORDERTRACER_H
+#define ORDERTRACER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "enums.h"
+
+// Timestamps (book clock, nanoseconds) of an order through addLimitOrder or addMarketOrder
+struct OrderTrace {
+    int orderId;        // 0 for market orders
+    OrderType orderType;
+    uint64_t ingressTime; // Entry in the book, also the order's submission time
+    uint64_t matchedTime; // End of matching against the opposite side
+    uint64_t ackTime;     // Remaining shares rested & acked (limit orders), or triggered stop orders executed
+};
+
+/* Optional per-order tracing of a book (see OrderBook::setTracer): traces are written to a buffer preallocated at construction.
+    Once the buffer is full, further orders aren't traced (and are counted); clear() makes room again */
+class OrderTracer {
+private:
+    std::vector<OrderTrace> traces;
+    std::size_t count;
+    uint64_t droppedTraces;
+
+public:
+    explicit OrderTracer(std::size_t capacity) : traces(capacity), count(0), droppedTraces(0) {}
+
+    // The trace to fill for a new order, nullptr if the buffer is full
+    inline OrderTrace* beginTrace(int orderId, OrderType orderType, uint64_t ingressTime) {
+        if (count == traces.size()) {
+            ++droppedTraces;
+            return nullptr;
+        }
+        OrderTrace& trace = traces[count++];
+        trace.orderId = orderId;
+        trace.orderType = orderType;
+        trace.ingressTime = trace.matchedTime = trace.ackTime = ingressTime;
+        return &trace;
+    }
+
+    inline void clear() { count = 0; droppedTraces = 0; }
+
+    // Getters
+    inline std::size_t size() const { return count; }
+    inline const OrderTrace& at(std::size_t position) const { return traces[position]; }
+    inline uint64_t getDroppedTraces() const { return droppedTraces; }
+};
+
+#endif
@@ -0,0 +1,157 @@
+#include <cstring>
+
+#include "CycleCounter.h"
+#include "PerfCounters.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+PerfCounters::PerfCounters(bool allowHardware) : counterCount(0), backend(Backend::Timer) {
+    for (std::size_t counter = 0; counter < maxCounters; ++counter) {
+        fds[counter] = -1;
+        names[counter] = nullptr;
+    }
+    if ((allowHardware && openGroup(Backend::Hardware)) || openGroup(Backend::Software))
+        return;
+    names[0] = "tsc_cycles";
+    counterCount = 1;
+}
+
+PerfCounters::~PerfCounters() {
+#if defined(__linux__)
+    for (std::size_t counter = 0; counter < maxCounters; ++counter)
+        if (fds[counter] >= 0)
+            close(fds[counter]);
+#endif
+}
+
+bool PerfCounters::openGroup(Backend groupBackend) {
+#if defined(__linux__)
+    static const uint64_t hardwareEvents[maxCounters] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+    static const char* hardwareNames[maxCounters] = { "cycles", "instructions", "cache_misses", "branch_misses" };
+    static const uint64_t softwareEvents[maxCounters] = { PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_SW_PAGE_FAULTS, PERF_COUNT_SW_CONTEXT_SWITCHES, PERF_COUNT_SW_CPU_MIGRATIONS };
+    static const char* softwareNames[maxCounters] = { "task_clock_ns", "page_faults", "context_switches", "cpu_migrations" };
+
+    bool isHardware = groupBackend == Backend::Hardware;
+    for (std::size_t event = 0; event < maxCounters; ++event) {
+        perf_event_attr attributes;
+        std::memset(&attributes, 0, sizeof(attributes));
+        attributes.size = sizeof(attributes);
+        attributes.type = isHardware ? PERF_TYPE_HARDWARE : PERF_TYPE_SOFTWARE;
+        attributes.config = isHardware ? hardwareEvents[event] : softwareEvents[event];
+        attributes.read_format = PERF_FORMAT_GROUP;
+        attributes.exclude_kernel = 1; // The book runs in user space: the reads' system calls aren't counted
+        attributes.exclude_hv = 1;
+        attributes.disabled = (counterCount == 0); // The group is enabled at once, by its leader
+
+        // This thread, any CPU; the other counters of the group are scheduled with the leader
+        int fd = (int)syscall(SYS_perf_event_open, &attributes, 0, -1, (counterCount == 0) ? -1 : fds[0], 0);
+        if (fd < 0) {
+            if (counterCount == 0)
+                return false; // No group: next backend
+            continue;         // e.g. cache misses aren't exposed by a VM's PMU
+        }
+        fds[counterCount] = fd;
+        names[counterCount] = isHardware ? hardwareNames[event] : softwareNames[event];
+        ++counterCount;
+    }
+
+    ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    backend = groupBackend;
+    return true;
+#else
+    (void)groupBackend;
+    return false;
+#endif
+}
+
+void PerfCounters::read(uint64_t* values) const {
+#if defined(__linux__)
+    if (backend != Backend::Timer) {
+        uint64_t group[1 + maxCounters]; // Number of counters, then their values in the order they were opened
+        if (::read(fds[0], group, sizeof(group)) > 0) {
+            std::memcpy(values, group + 1, counterCount * sizeof(uint64_t));
+            return;
+        }
+        std::memset(values, 0, counterCount * sizeof(uint64_t));
+        return;
+    }
+#endif
+    values[0] = readCyclesStart();
+}
+
+const char* PerfCounters::backendName(Backend backend) {
+    switch (backend) {
+        case Backend::Hardware: return "hardware";
+        case Backend::Software: return "software";
+        default: return "timer";
+    }
+}
+
+OperationProfiler::OperationProfiler(bool allowHardware) : counters(allowHardware) {
+    clear();
+}
+
+void OperationProfiler::clear() {
+    std::memset(totals, 0, sizeof(totals));
+    std::memset(&overhead, 0, sizeof(overhead));
+}
+
+void OperationProfiler::calibrate(int samples) {
+    std::memset(&overhead, 0, sizeof(overhead));
+    Sample sample;
+    uint64_t values[PerfCounters::maxCounters];
+    for (int i = 0; i < samples; ++i) {
+        begin(sample, 0, 0);
+        counters.read(values);
+        ++overhead.operations;
+        for (std::size_t counter = 0; counter < counters.getCounterCount(); ++counter)
+            overhead.counters[counter] += values[counter] - sample.counters[counter];
+    }
+}
+
+const char* OperationProfiler::operationName(BookOperation operation) {
+    static const char* names[(int)BookOperation::Count] = { "add_limit", "add_stop", "cancel", "modify", "market", "stop_trigger", "mass_cancel" };
+    return names[(int)operation];
+}
+
+const char* OperationProfiler::levelChangeName(LevelChange change) {
+    static const char* names[(int)LevelChange::Count] = { "none", "created", "deleted", "created_deleted" };
+    return names[(int)change];
+}
+
+void OperationProfiler::report(std::ostream& out, const char* workload, bool withHeader) const {
+    // IPC, the most telling ratio, is only derived from hardware counters (instructions & cycles, the first two)
+    bool withIpc = counters.getBackend() == PerfCounters::Backend::Hardware && counters.getCounterCount() >= 2
+                   && std::strcmp(counters.getCounterName(1), "instructions") == 0;
+
+    if (withHeader) {
+        out << "workload,counters,operation,levels,count";
+        for (std::size_t counter = 0; counter < counters.getCounterCount(); ++counter)
+            out << ',' << counters.getCounterName(counter);
+        if (withIpc)
+            out << ",ipc";
+        out << '\n';
+    }
+
+    auto writeRow = [&](const char* operation, const char* levels, const Totals& row) {
+        out << workload << ',' << PerfCounters::backendName(counters.getBackend()) << ',' << operation << ',' << levels << ',' << row.operations;
+        for (std::size_t counter = 0; counter < counters.getCounterCount(); ++counter)
+            out << ',' << (double)row.counters[counter] / row.operations;
+        if (withIpc)
+            out << ',' << (row.counters[0] ? (double)row.counters[1] / row.counters[0] : 0.0);
+        out << '\n';
+    };
+
+    if (overhead.operations)
+        writeRow("calibration", "none", overhead);
+    for (int operation = 0; operation < (int)BookOperation::Count; ++operation)
+        for (int change = 0; change < (int)LevelChange::Count; ++change)
+            if (totals[operation][change].operations)
+                writeRow(operationName((BookOperation)operation), levelChangeName((LevelChange)change), totals[operation][change]);
+}
@@ -0,0 +1,115 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+/* Counters of the calling thread, read together (one read per sample), with Linux perf_event_open. In order of preference:
+    Hardware: cycles, instructions, cache misses & branch misses, from the PMU (user space only)
+    Software: task clock (ns), page faults, context switches & CPU migrations, from the kernel, when the PMU isn't available (VMs,
+        containers, perf_event_paranoid) or not exposed
+    Timer: time-stamp counter cycles only (see CycleCounter.h), when perf_event_open isn't available at all (other systems, seccomp)
+    Counters that can't be opened within a group are left out (see getCounterCount). Not copyable: it owns the counters' file descriptors */
+class PerfCounters {
+public:
+    enum class Backend : uint8_t { Hardware, Software, Timer };
+    static const std::size_t maxCounters = 4;
+
+private:
+    int fds[maxCounters]; // Group leader first, -1 if not opened
+    const char* names[maxCounters];
+    std::size_t counterCount;
+    Backend backend;
+
+    bool openGroup(Backend groupBackend); // false if the group leader can't be opened
+
+public:
+    explicit PerfCounters(bool allowHardware = true);
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // Current values of the counters, getCounterCount() of them; cumulative since construction
+    void read(uint64_t* values) const;
+
+    // Getters
+    inline Backend getBackend() const { return backend; }
+    inline std::size_t getCounterCount() const { return counterCount; }
+    inline const char* getCounterName(std::size_t counter) const { return names[counter]; }
+    static const char* backendName(Backend backend);
+};
+
+// Public operations of a book, as profiled by OperationProfiler
+enum class BookOperation : uint8_t {
+    AddLimit,    // Limit order, any time-in-force (matching included)
+    AddStop,     // Stop order (matching included if it's triggered on arrival)
+    Cancel,      // Limit or stop order
+    Modify,      // Limit or stop order
+    Market,      // Market order
+    StopTrigger, // One triggered stop, executed against the touch; also counted in the operation that triggered it
+    MassCancel,  // Any number of orders & levels (see OrderBook::cancelOrdersIf)
+    Count
+};
+
+// Levels created & deleted by an operation, any tree
+enum class LevelChange : uint8_t { None, Created, Deleted, CreatedAndDeleted, Count };
+
+/* Performance counters of a book's operations (see OrderBook::setProfiler), grouped by operation and by level change.
+    Each operation costs two reads of the counters (a system call each, outside of the counted user-space events in Hardware mode):
+    calibrate() measures that cost, to be told apart from the operations' own. Counters are opened for the thread constructing the
+    profiler, which must be the thread running the book */
+class OperationProfiler {
+public:
+    struct Totals {
+        uint64_t operations;
+        uint64_t counters[PerfCounters::maxCounters];
+    };
+
+    // Counter values at the start of an operation, kept by the operation (operations nest: stop triggers within a market order)
+    struct Sample {
+        uint64_t counters[PerfCounters::maxCounters];
+        std::size_t levelsCreated;
+        std::size_t levelsDeleted;
+    };
+
+private:
+    PerfCounters counters;
+    Totals totals[(int)BookOperation::Count][(int)LevelChange::Count];
+    Totals overhead; // Empty samples, see calibrate
+
+public:
+    explicit OperationProfiler(bool allowHardware = true);
+
+    inline void begin(Sample& sample, std::size_t levelsCreated, std::size_t levelsDeleted) const {
+        sample.levelsCreated = levelsCreated;
+        sample.levelsDeleted = levelsDeleted;
+        counters.read(sample.counters);
+    }
+
+    inline void end(const Sample& sample, BookOperation operation, std::size_t levelsCreated, std::size_t levelsDeleted) {
+        uint64_t values[PerfCounters::maxCounters];
+        counters.read(values);
+        int change = (levelsCreated != sample.levelsCreated) + 2 * (levelsDeleted != sample.levelsDeleted);
+        Totals& operationTotals = totals[(int)operation][change];
+        ++operationTotals.operations;
+        for (std::size_t counter = 0; counter < counters.getCounterCount(); ++counter)
+            operationTotals.counters[counter] += values[counter] - sample.counters[counter];
+    }
+
+    void calibrate(int samples = 10000); // Counts of a begin directly followed by its end
+    void clear(); // Calibration included
+
+    /* One CSV row per (operation, level change) with operations, written on demand: workload,counters,operation,levels,count, then the mean
+        of each counter per operation, plus ipc with hardware counters; counters is the backend. The first row is the calibration's, if any */
+    void report(std::ostream& out, const char* workload, bool withHeader = true) const;
+
+    // Getters
+    inline const PerfCounters& getCounters() const { return counters; }
+    inline const Totals& getTotals(BookOperation operation, LevelChange change) const { return totals[(int)operation][(int)change]; }
+    static const char* operationName(BookOperation operation);
+    static const char* levelChangeName(LevelChange change);
+};
+
+#endif
@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "Limit.h"
+#include "PriceLadder.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+static inline int highestBit(uint64_t word) { unsigned long index; _BitScanReverse64(&index, word); return (int)index; }
+static inline int lowestBit(uint64_t word) { unsigned long index; _BitScanForward64(&index, word); return (int)index; }
+#else
+static inline int highestBit(uint64_t word) { return 63 - __builtin_clzll(word); }
+static inline int lowestBit(uint64_t word) { return __builtin_ctzll(word); }
+#endif
+
+
+PriceLadder::PriceLadder(int minPrice, int maxPrice):
+    basePrice(minPrice), numTicks(0), levelCount(0), recenterCount(0)
+{
+    if (maxPrice < minPrice)
+        throw std::invalid_argument("The price ladder's max price must be above its min price");
+
+    long long range = (long long)maxPrice - minPrice + 1;
+    numTicks = (int)((range + 63) / 64 * 64);
+
+    levels.assign(numTicks, nullptr);
+    occupancy.assign(numTicks / 64, 0);
+    summary.assign((occupancy.size() + 63) / 64, 0);
+}
+
+void PriceLadder::setBit(int slot){
+    occupancy[slot >> 6] |= 1ULL << (slot & 63);
+    summary[slot >> 12] |= 1ULL << ((slot >> 6) & 63);
+}
+
+void PriceLadder::clearBit(int slot){
+    int word = slot >> 6;
+    occupancy[word] &= ~(1ULL << (slot & 63));
+    if (!occupancy[word]) // The whole word is empty, hence it's no longer occupied in the summary
+        summary[word >> 6] &= ~(1ULL << (word & 63));
+}
+
+int PriceLadder::highestSlotAtOrBelow(int slot) const {
+    if (slot < 0)
+        return -1;
+
+    // First, look in the word of the slot itself (the closest prices)
+    int word = slot >> 6;
+    uint64_t bits = occupancy[word] & (~0ULL >> (63 - (slot & 63)));
+    if (bits)
+        return (word << 6) + highestBit(bits);
+
+    // Then, find the closest occupied word below it through the summary
+    int summaryWord = word >> 6;
+    uint64_t summaryBits = summary[summaryWord] & ((1ULL << (word & 63)) - 1);
+    while (!summaryBits){
+        if (--summaryWord < 0)
+            return -1;
+        summaryBits = summary[summaryWord];
+    }
+    word = (summaryWord << 6) + highestBit(summaryBits);
+    return (word << 6) + highestBit(occupancy[word]);
+}
+
+int PriceLadder::lowestSlotAtOrAbove(int slot) const {
+    if (slot >= numTicks)
+        return -1;
+
+    int word = slot >> 6;
+    uint64_t bits = occupancy[word] & (~0ULL << (slot & 63));
+    if (bits)
+        return (word << 6) + lowestBit(bits);
+
+    int summaryWord = word >> 6;
+    uint64_t summaryBits = ((word & 63) == 63) ? 0 : summary[summaryWord] & (~0ULL << ((word & 63) + 1));
+    while (!summaryBits){
+        if (++summaryWord >= (int)summary.size())
+            return -1;
+        summaryBits = summary[summaryWord];
+    }
+    word = (summaryWord << 6) + lowestBit(summaryBits);
+    return (word << 6) + lowestBit(occupancy[word]);
+}
+
+void PriceLadder::recenter(int newBasePrice){
+    // Move the window, levels that don't fit in it anymore go to the overflow map and those that now fit leave it. O(window size)
+    std::vector<Limit*> allLevels;
+    allLevels.reserve(levelCount);
+    forEachLevel([&allLevels](Limit* level){ allLevels.push_back(level); });
+
+    std::fill(levels.begin(), levels.end(), nullptr);
+    std::fill(occupancy.begin(), occupancy.end(), 0);
+    std::fill(summary.begin(), summary.end(), 0);
+    overflowLevels.clear();
+    basePrice = newBasePrice;
+
+    for (Limit* level : allLevels){
+        int price = level->getLimitPrice();
+        if (inWindow(price)){
+            levels[price - basePrice] = level;
+            setBit(price - basePrice);
+        }
+        else
+            overflowLevels.emplace(price, level);
+    }
+    ++recenterCount;
+}
+
+void PriceLadder::insert(Limit* level){
+    int price = level->getLimitPrice();
+
+    if (!inWindow(price)){
+        // Re-center the window around its levels and the new price if they all fit in it, otherwise fall back to the overflow map
+        int lowestSlot = lowestSlotAtOrAbove(0);
+        long long lowPrice = price, highPrice = price;
+        if (lowestSlot != -1){
+            lowPrice = std::min(lowPrice, (long long)basePrice + lowestSlot);
+            highPrice = std::max(highPrice, (long long)basePrice + highestSlotAtOrBelow(numTicks - 1));
+        }
+        if (highPrice - lowPrice < numTicks)
+            recenter((int)std::max((long long)INT32_MIN, lowPrice - (numTicks - 1 - (highPrice - lowPrice)) / 2));
+    }
+
+    if (inWindow(price)){
+        levels[price - basePrice] = level;
+        setBit(price - basePrice);
+    }
+    else
+        overflowLevels.emplace(price, level);
+    ++levelCount;
+}
+
+void PriceLadder::erase(int price){
+    if (inWindow(price)){
+        if (!levels[price - basePrice])
+            return;
+        levels[price - basePrice] = nullptr;
+        clearBit(price - basePrice);
+    }
+    else if (!overflowLevels.erase(price))
+        return;
+    --levelCount;
+}
+
+Limit* PriceLadder::highestBelow(int price) const {
+    Limit* best = nullptr;
+
+    long long slot = std::min((long long)price - basePrice - 1, (long long)numTicks - 1);
+    if (slot >= 0){
+        int found = highestSlotAtOrBelow((int)slot);
+        if (found != -1)
+            best = levels[found];
+    }
+
+    if (!overflowLevels.empty()){
+        auto it = overflowLevels.lower_bound(price);
+        if (it != overflowLevels.begin()){
+            --it;
+            if (!best || it->first > best->getLimitPrice())
+                best = it->second;
+        }
+    }
+    return best;
+}
+
+Limit* PriceLadder::lowestAbove(int price) const {
+    Limit* best = nullptr;
+
+    long long slot = std::max((long long)price - basePrice + 1, 0LL);
+    if (slot < numTicks){
+        int found = lowestSlotAtOrAbove((int)slot);
+        if (found != -1)
+            best = levels[found];
+    }
+
+    if (!overflowLevels.empty()){
+        auto it = overflowLevels.upper_bound(price);
+        if (it != overflowLevels.end() && (!best || it->first < best->getLimitPrice()))
+            best = it->second;
+    }
+    return best;
+}
+
+Limit* PriceLadder::highest() const {
+    int found = highestSlotAtOrBelow(numTicks - 1);
+    Limit* best = (found != -1) ? levels[found] : nullptr;
+    if (!overflowLevels.empty() && (!best || overflowLevels.rbegin()->first > best->getLimitPrice()))
+        best = overflowLevels.rbegin()->second;
+    return best;
+}
+
+Limit* PriceLadder::lowest() const {
+    int found = lowestSlotAtOrAbove(0);
+    Limit* best = (found != -1) ? levels[found] : nullptr;
+    if (!overflowLevels.empty() && (!best || overflowLevels.begin()->first < best->getLimitPrice()))
+        best = overflowLevels.begin()->second;
+    return best;
+}
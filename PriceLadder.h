@@ -0,0 +1,73 @@
+#ifndef PRICELADDER_H
+#define PRICELADDER_H
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+class Limit;
+
+/* A price ladder indexes the levels of one side of a book in a flat array by tick offset from a base price.
+    A two-level occupancy bitmap (1 bit per tick, then 1 bit per occupancy word) finds the next occupied price with word scans.
+    Prices outside the window either re-center it (if all the levels still fit) or fall back to an ordered overflow map. */
+class PriceLadder {
+private:
+    int basePrice; // Price of the first slot of the window
+    int numTicks;  // Window size, a multiple of 64
+
+    std::vector<Limit*> levels;          // levels[price - basePrice]
+    std::vector<uint64_t> occupancy;     // Bit i is set if levels[i] is occupied
+    std::vector<uint64_t> summary;       // Bit w is set if occupancy[w] is not 0
+    std::map<int, Limit*> overflowLevels; // Levels whose price is outside of the window
+
+    int levelCount;
+    int recenterCount;
+
+    void setBit(int slot);
+    void clearBit(int slot);
+    int highestSlotAtOrBelow(int slot) const; // -1 if no slot is occupied
+    int lowestSlotAtOrAbove(int slot) const;  // -1 if ...
+    void recenter(int newBasePrice);
+
+public:
+    PriceLadder(int minPrice, int maxPrice);
+
+    // Getters
+    inline bool inWindow(int price) const { return price >= basePrice && price - basePrice < numTicks; }
+    inline Limit* find(int price) const {
+        if (inWindow(price))
+            return levels[price - basePrice];
+        auto it = overflowLevels.find(price);
+        return (it == overflowLevels.end()) ? nullptr : it->second;
+    }
+    inline bool empty() const { return levelCount == 0; }
+    inline int getLevelCount() const { return levelCount; }
+    inline int getOverflowCount() const { return (int)overflowLevels.size(); }
+    inline int getRecenterCount() const { return recenterCount; }
+    inline int getBasePrice() const { return basePrice; }
+    inline int getNumTicks() const { return numTicks; }
+
+    void insert(Limit* level); // The level's price must not be in the ladder yet
+    void erase(int price);
+
+    Limit* highestBelow(int price) const; // Highest level strictly below price, nullptr if none
+    Limit* lowestAbove(int price) const;  // Lowest level strictly above price, ...
+    Limit* highest() const;
+    Limit* lowest() const;
+
+    template <typename F> void forEachLevel(F visit) const; // Ascending prices
+};
+
+template <typename F>
+void PriceLadder::forEachLevel(F visit) const {
+    for (auto& pair : overflowLevels)
+        if (pair.first < basePrice)
+            visit(pair.second);
+    for (int slot = lowestSlotAtOrAbove(0); slot != -1; slot = (slot + 1 < numTicks) ? lowestSlotAtOrAbove(slot + 1) : -1)
+        visit(levels[slot]);
+    for (auto& pair : overflowLevels)
+        if (pair.first >= basePrice)
+            visit(pair.second);
+}
+
+#endif
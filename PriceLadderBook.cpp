@@ -0,0 +1,288 @@
+#include <iostream>
+#include <assert.h>
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+
+#include "Order.h"
+#include "Limit.h"
+#include "PriceLadderBook.h"
+
+
+PriceLadderBook::PriceLadderBook(int minPrice, int maxPrice, std::size_t orderCapacity):
+    bidLadder(minPrice, maxPrice), highestBid(nullptr), askLadder(minPrice, maxPrice), lowestAsk(nullptr),
+    stopBidLadder(minPrice, maxPrice), lowestStopBid(nullptr), stopAskLadder(minPrice, maxPrice), highestStopAsk(nullptr),
+    chunkPool(orderCapacity / OrderChunk::capacity), limitPool(maxPrice - minPrice + 1), orderIndex(chunkPool, orderCapacity), clock(&defaultClock())
+{}
+
+PriceLadderBook::~PriceLadderBook(){
+    // Order chunks and levels live in the book's pools, which release their slabs once destroyed
+}
+
+std::size_t PriceLadderBook::getDepth(OrderSide orderSide, std::size_t maxLevels, DepthLevel* levels) const {
+    // Next levels are found with the ladders' occupancy bitmaps
+    const PriceLadder& ladder = (orderSide == OrderSide::Bid) ? bidLadder : askLadder;
+    Limit* level = (orderSide == OrderSide::Bid) ? highestBid : lowestAsk;
+    std::size_t count = 0;
+    for (; count < maxLevels && level != nullptr; ++count){
+        levels[count].price = level->getLimitPrice();
+        levels[count].totalShares = level->getTotalShares();
+        levels[count].numberOfOrders = level->getNumberOfOrders();
+        level = (orderSide == OrderSide::Bid) ? ladder.highestBelow(level->getLimitPrice()) : ladder.lowestAbove(level->getLimitPrice());
+    }
+    return count;
+}
+
+uint64_t PriceLadderBook::getChecksum() const {
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a offset basis
+    const PriceLadder* ladders[4] = { &bidLadder, &askLadder, &stopBidLadder, &stopAskLadder };
+    for (const PriceLadder* ladder : ladders){
+        ladder->forEachLevel([&](Limit* level){
+            for (Order* order = level->getHeadOrder(); order != nullptr; order = order->getNextOrder()){
+                int fields[3] = { order->getOrderId(), order->getLimitPrice(), order->getOrderShares() };
+                for (int field : fields)
+                    for (int byte = 0; byte < 4; ++byte){
+                        hash ^= (uint64_t)(((uint32_t)field >> (8 * byte)) & 0xFF);
+                        hash *= 1099511628211ULL;
+                    }
+            }
+        });
+        hash = (hash ^ 0xFF) * 1099511628211ULL; // Ladder separator
+    }
+    return hash;
+}
+
+Limit* PriceLadderBook::addLevel(int price, OrderSide orderSide, OrderCategory orderCategory){
+    // Add a new level to its ladder, then check if it's its book's new edge
+    auto& ladder = (orderCategory == OrderCategory::Limit) ? ((orderSide == OrderSide::Bid) ? bidLadder : askLadder)
+        : ((orderSide == OrderSide::Bid) ? stopBidLadder : stopAskLadder);
+    auto& bookEdge = (orderCategory == OrderCategory::Limit) ? ((orderSide == OrderSide::Bid) ? highestBid : lowestAsk)
+        : ((orderSide == OrderSide::Bid) ? lowestStopBid : highestStopAsk);
+    bool isMaxEdge = (orderSide == OrderSide::Bid) == (orderCategory == OrderCategory::Limit);
+
+    Limit* newLevel = limitPool.create(price, orderSide, orderCategory);
+    ladder.insert(newLevel);
+
+    if (!bookEdge || (isMaxEdge ? price > bookEdge->getLimitPrice() : price < bookEdge->getLimitPrice()))
+        bookEdge = newLevel;
+    return newLevel;
+}
+
+void PriceLadderBook::deleteLevel(Limit* level, OrderCategory orderCategory){
+    // Remove an empty level from its ladder; if it was the book edge, the next one is found with a scan of the occupancy bitmap
+    OrderSide orderSide = level->getOrderSide();
+    auto& ladder = (orderCategory == OrderCategory::Limit) ? ((orderSide == OrderSide::Bid) ? bidLadder : askLadder)
+        : ((orderSide == OrderSide::Bid) ? stopBidLadder : stopAskLadder);
+    auto& bookEdge = (orderCategory == OrderCategory::Limit) ? ((orderSide == OrderSide::Bid) ? highestBid : lowestAsk)
+        : ((orderSide == OrderSide::Bid) ? lowestStopBid : highestStopAsk);
+    bool isMaxEdge = (orderSide == OrderSide::Bid) == (orderCategory == OrderCategory::Limit);
+
+    int price = level->getLimitPrice();
+    ladder.erase(price);
+    if (level == bookEdge)
+        bookEdge = isMaxEdge ? ladder.highestBelow(price) : ladder.lowestAbove(price);
+    limitPool.destroy(level);
+}
+
+void PriceLadderBook::removeOrder(Order* order, OrderCategory orderCategory){
+    orderIndex.erase(order->getOrderId());
+    leaveLevel(order, orderCategory);
+}
+
+void PriceLadderBook::leaveLevel(Order* order, OrderCategory orderCategory){
+    // Remove the order from its level, then delete the level if it's empty (or compact it, see Limit::needsCompaction)
+    Limit* parentLimit = order->getParentLimit();
+    parentLimit->removeOrder(order, chunkPool);
+
+    if (parentLimit->getNumberOfOrders() == 0)
+        deleteLevel(parentLimit, orderCategory);
+    else if (parentLimit->needsCompaction())
+        parentLimit->compact(chunkPool, orderIndex);
+}
+
+void PriceLadderBook::requeueOrder(Order* order, int newShares, int newPrice, OrderCategory orderCategory){
+    // Same as OrderBook::amendRestingOrder: the order loses its time priority but never trades nor triggers stops, even at a crossing price
+    int orderId = order->getOrderId();
+    Limit* level = order->getParentLimit();
+    Order amendedOrder = *order;
+    amendedOrder.amendOrder(newShares, clock->now());
+    if (newPrice == level->getLimitPrice()){
+        level->removeOrder(order, chunkPool);
+        orderIndex.relocate(orderId, level->addOrder(amendedOrder, chunkPool));
+        if (level->needsCompaction())
+            level->compact(chunkPool, orderIndex);
+        return;
+    }
+
+    OrderSide orderSide = level->getOrderSide();
+    auto& ladder = (orderCategory == OrderCategory::Limit) ? ((orderSide == OrderSide::Bid) ? bidLadder : askLadder)
+        : ((orderSide == OrderSide::Bid) ? stopBidLadder : stopAskLadder);
+    Limit* newLevel = ladder.find(newPrice);
+    if (!newLevel)
+        newLevel = addLevel(newPrice, orderSide, orderCategory);
+    orderIndex.relocate(orderId, newLevel->addOrder(amendedOrder, chunkPool));
+    leaveLevel(order, orderCategory);
+}
+
+void PriceLadderBook::restLimitOrder(int orderId, OrderSide orderSide, int limitPrice, int shares){
+    auto& ladder = (orderSide == OrderSide::Bid) ? bidLadder : askLadder;
+    Limit* level = ladder.find(limitPrice);
+    if (!level)
+        level = addLevel(limitPrice, orderSide, OrderCategory::Limit);
+
+    Order* newOrder = level->addOrder(Order(orderId, shares), chunkPool);
+    newOrder->setSubmissionTime(clock->now());
+    orderIndex.insert(orderId, newOrder);
+}
+
+void PriceLadderBook::executeStopOrders(OrderSide orderSide){
+    /* Same triggering rules as OrderBook: a stop Bid is triggered once the lowest ask is at or above its stop price,
+        a stop Ask once the highest bid is at or below it. A triggered stop trades against the touch level, and its remaining shares rest as a limit order */
+    while (true){
+        Limit* stopEdge = (orderSide == OrderSide::Bid) ? lowestStopBid : highestStopAsk;
+        Limit*& bookEdge = (orderSide == OrderSide::Bid) ? lowestAsk : highestBid;
+        if (!stopEdge || !bookEdge)
+            return;
+        if ((orderSide == OrderSide::Bid) ? stopEdge->getLimitPrice() > bookEdge->getLimitPrice()
+                : stopEdge->getLimitPrice() < bookEdge->getLimitPrice())
+            return;
+
+        Order* stopOrder = stopEdge->getHeadOrder();
+        int shares = std::min(stopOrder->getOrderShares(), bookEdge->getTotalShares());
+        int remainingShares = stopOrder->getOrderShares() - shares;
+
+        Limit* touch = bookEdge;
+        while (shares > 0){
+            Order* headOrder = touch->getHeadOrder();
+            int tradedShares = std::min(headOrder->getOrderShares(), shares);
+            headOrder->executeOrder(tradedShares);
+            shares -= tradedShares;
+
+            if (headOrder->getOrderShares() == 0)
+                removeOrder(headOrder, OrderCategory::Limit); // Deletes the touch level once it's empty
+        }
+
+        int stopOrderId = stopOrder->getOrderId();
+        int stopPrice = stopOrder->getLimitPrice();
+        removeOrder(stopOrder, OrderCategory::Stop);
+
+        if (remainingShares > 0)
+            restLimitOrder(stopOrderId, orderSide, stopPrice, remainingShares);
+    }
+}
+
+
+// Limit order methods
+void PriceLadderBook::addLimitOrder(int orderId, OrderSide orderSide, int limitPrice, int shares){
+    // Trade the biggest possible number of shares, then make a limit order from the remaining shares
+    if (orderIndex.contains(orderId)) // The id of a live order: dropped (see OrderBook)
+        return;
+    int submittedShares = shares;
+    matchOrder(orderSide, shares, limitPrice);
+
+    if (shares != 0)
+        restLimitOrder(orderId, orderSide, limitPrice, shares);
+    if (shares != submittedShares) // Some shares were traded, hence we check if some stop orders can be executed now that the order book was updated
+        executeStopOrders(orderSide);
+}
+
+void PriceLadderBook::cancelLimitOrder(int orderId){
+    Order* order = orderIndex.find(orderId);
+    if (!order || order->getOrderType() != OrderType::LimitOrder) // Not found, or an order of the other category (see OrderBook)
+        return;
+    removeOrder(order, OrderCategory::Limit);
+}
+
+void PriceLadderBook::modifyLimitOrder(int orderId, int newShares, int newLimitPrice){
+    // A size decrease at the same price keeps the order's time priority, otherwise the order is requeued (see OrderBook::modifyLimitOrder)
+    Order* order = orderIndex.find(orderId);
+    assert(order != nullptr && "Error: This order Id doesn't exist");
+    if (order->getOrderType() != OrderType::LimitOrder)
+        return;
+    if (newShares <= 0)
+        throw std::invalid_argument("Order shares must be positive");
+
+    if (newLimitPrice == order->getLimitPrice() && newShares <= order->getOrderShares()){
+        order->reduceShares(newShares);
+        return;
+    }
+
+    requeueOrder(order, newShares, newLimitPrice, OrderCategory::Limit);
+}
+
+
+// Stop order methods
+void PriceLadderBook::addStopOrder(int orderId, OrderSide orderSide, int stopPrice, int shares){
+    // First, we execute the stop order if possible, and then we make a new stop order from the remaining shares
+    if (orderIndex.contains(orderId)) // The id of a live order: dropped (see OrderBook)
+        return;
+    bool triggered = (orderSide == OrderSide::Bid) ? (lowestAsk != nullptr && stopPrice <= lowestAsk->getLimitPrice())
+        : (highestBid != nullptr && stopPrice >= highestBid->getLimitPrice());
+    if (triggered)
+        executeMarketOrder(orderSide, shares);
+
+    if (shares != 0){
+        auto& ladder = (orderSide == OrderSide::Bid) ? stopBidLadder : stopAskLadder;
+        Limit* level = ladder.find(stopPrice);
+        if (!level)
+            level = addLevel(stopPrice, orderSide, OrderCategory::Stop);
+
+        Order* newOrder = level->addOrder(Order(orderId, shares), chunkPool);
+        newOrder->setSubmissionTime(clock->now());
+        orderIndex.insert(orderId, newOrder);
+    }
+
+    if (triggered) // Its trades moved the touch, like a market order's
+        executeStopOrders(orderSide);
+}
+
+void PriceLadderBook::cancelStopOrder(int orderId){
+    Order* order = orderIndex.find(orderId);
+    if (!order || order->getOrderType() != OrderType::StopOrder) // Not found, or an order of the other category (see OrderBook)
+        return;
+    removeOrder(order, OrderCategory::Stop);
+}
+
+void PriceLadderBook::modifyStopOrder(int orderId, int newShares, int newStopPrice){
+    Order* order = orderIndex.find(orderId);
+    assert(order != nullptr && "Error: This order Id doesn't exist");
+    if (order->getOrderType() != OrderType::StopOrder)
+        return;
+    if (newShares <= 0)
+        throw std::invalid_argument("Order shares must be positive");
+
+    if (newStopPrice == order->getLimitPrice() && newShares <= order->getOrderShares()){
+        order->reduceShares(newShares);
+        return;
+    }
+
+    requeueOrder(order, newShares, newStopPrice, OrderCategory::Stop);
+}
+
+
+// Market order methods
+void PriceLadderBook::executeMarketOrder(OrderSide orderSide, int& shares){
+    // The max possible number of shares is traded, at any price. At the end, shares takes as a value the number of remaining shares
+    matchOrder(orderSide, shares, (orderSide == OrderSide::Bid) ? INT_MAX : INT_MIN);
+}
+
+void PriceLadderBook::matchOrder(OrderSide orderSide, int& shares, int limitPrice){
+    auto& bookEdge = (orderSide == OrderSide::Bid) ? lowestAsk : highestBid;
+
+    while (shares > 0 && bookEdge != nullptr
+            && ((orderSide == OrderSide::Bid) ? bookEdge->getLimitPrice() <= limitPrice : bookEdge->getLimitPrice() >= limitPrice)){
+        Order* headOrder = bookEdge->getHeadOrder();
+        int tradedShares = std::min(headOrder->getOrderShares(), shares);
+
+        headOrder->executeOrder(tradedShares);
+        shares -= tradedShares;
+
+        if (headOrder->getOrderShares() == 0)
+            removeOrder(headOrder, OrderCategory::Limit); // Moves bookEdge to the next level once it's empty
+    }
+}
+
+void PriceLadderBook::addMarketOrder(OrderSide orderSide, int shares){
+    executeMarketOrder(orderSide, shares);
+    executeStopOrders(orderSide);
+}
@@ -0,0 +1,84 @@
+#ifndef PRICELADDERBOOK_H
+#define PRICELADDERBOOK_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "enums.h"
+#include "Clock.h"
+#include "Limit.h"
+#include "Order.h"
+#include "ObjectPool.h"
+#include "OrderIndex.h"
+#include "PriceLadder.h"
+#include "PriceLevelIterator.h"
+
+/* Alternative backend to OrderBook for instruments trading within a bounded tick range:
+    the four AVL trees and the level maps are replaced by four price ladders sized to [minPrice, maxPrice] at construction.
+    It implements a subset of OrderBook, with the same matching rules & checksum: GTC limit orders, stop & market orders, their cancellations
+    and modifications, getDepth. It has no listeners (hence no execution reports), no IOC, FOK or DAY orders, no processBatch, no mass cancels,
+    and no journal, top of book or market data publishing. */
+class PriceLadderBook {
+private:
+    // Limit Orders
+    PriceLadder bidLadder;
+    Limit* highestBid;
+    PriceLadder askLadder;
+    Limit* lowestAsk;
+
+    // Stop Orders; Bid and Ask stops have their own ladders, hence stop levels of both sides can share a price
+    PriceLadder stopBidLadder;
+    Limit* lowestStopBid;
+    PriceLadder stopAskLadder;
+    Limit* highestStopAsk;
+
+    ObjectPool<OrderChunk> chunkPool;
+    ObjectPool<Limit> limitPool;
+
+    OrderIndex orderIndex; // Resolves its handles through chunkPool, hence declared after it
+
+    Clock* clock; // Stamps orders in nanoseconds
+
+    Limit* addLevel(int price, OrderSide orderSide, OrderCategory orderCategory);
+    void deleteLevel(Limit* level, OrderCategory orderCategory);
+    void restLimitOrder(int orderId, OrderSide orderSide, int limitPrice, int shares);
+    void executeStopOrders(OrderSide orderSide);
+    void matchOrder(OrderSide orderSide, int& shares, int limitPrice); // Trade against the opposite side at limitPrice or better
+    void removeOrder(Order* order, OrderCategory orderCategory);
+    void leaveLevel(Order* order, OrderCategory orderCategory); // The order leaves its level, but not the index
+    void requeueOrder(Order* order, int newShares, int newPrice, OrderCategory orderCategory); // At the back of the level at newPrice, without trading
+
+public:
+    // The tick range of the ladders; prices outside of it are still accepted. The level pool is preallocated for the whole range
+    PriceLadderBook(int minPrice, int maxPrice, std::size_t orderCapacity = 0);
+    ~PriceLadderBook();
+
+    // Getters
+    inline Limit* getLowestAsk() const { return lowestAsk; }
+    inline Limit* getHighestBid() const { return highestBid; }
+    inline Limit* getLowestStopBid() const { return lowestStopBid; }
+    inline Limit* getHighestStopAsk() const { return highestStopAsk; }
+    inline const OrderIndex& getOrderIndex() const { return orderIndex; }
+    inline int getRecenterCount() const { return bidLadder.getRecenterCount() + askLadder.getRecenterCount(); }
+    std::size_t getDepth(OrderSide orderSide, std::size_t maxLevels, DepthLevel* levels) const; // Same as OrderBook::getDepth
+    uint64_t getChecksum() const; // Same as OrderBook::getChecksum: both backends in the same state have the same checksum
+
+    // Setters
+    inline void setClock(Clock* newClock) { clock = newClock ? newClock : &defaultClock(); } // nullptr for the default TSC clock
+
+    // Limit order methods
+    void addLimitOrder(int orderId, OrderSide orderSide, int limitPrice, int shares);
+    void cancelLimitOrder(int orderId);
+    void modifyLimitOrder(int orderId, int newShares, int newLimitPrice);
+
+    // Stop order methods
+    void addStopOrder(int orderId, OrderSide orderSide, int stopPrice, int shares);
+    void cancelStopOrder(int orderId);
+    void modifyStopOrder(int orderId, int newShares, int newStopPrice);
+
+    // Market order methods
+    void executeMarketOrder(OrderSide orderSide, int& shares);
+    void addMarketOrder(OrderSide orderSide, int shares);
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef PRICELEVELITERATOR_H
+#define PRICELEVELITERATOR_H
+
+#include <cstddef>
+#include <iterator>
+
+#include "Limit.h"
+
+// One level of a depth snapshot (see OrderBook::getDepth)
+struct DepthLevel {
+    int price;
+    int totalShares;
+    int numberOfOrders;
+};
+
+/* Walks the levels of an AVL tree by price, from a book edge outward, following child & parent pointers:
+    no stack and no allocation, O(1) amortized per step, hence O(N + log(M)) for the N best levels of a tree of M levels.
+    Levels must not be added or deleted while iterating. */
+class PriceLevelIterator {
+private:
+    Limit* level;
+    bool descending; // From the highest price down, e.g: bids from the highest bid
+
+public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef Limit value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef Limit* pointer;
+    typedef Limit& reference;
+
+    PriceLevelIterator() : level(nullptr), descending(false) {} // End of any walk
+    PriceLevelIterator(Limit* start, bool _descending) : level(start), descending(_descending) {}
+
+    // In-order predecessor (descending) or successor of level in its tree, nullptr if level is the last one
+    static Limit* nextLevel(Limit* level, bool descending) {
+        Limit* child = descending ? level->getLeftChildLimit() : level->getRightChildLimit();
+        if (child) { // The closest level of the child's subtree
+            while (Limit* next = descending ? child->getRightChildLimit() : child->getLeftChildLimit())
+                child = next;
+            return child;
+        }
+        // Otherwise the first ancestor reached from its other side
+        Limit* parent = level->getParentLimit();
+        while (parent && level == (descending ? parent->getLeftChildLimit() : parent->getRightChildLimit())) {
+            level = parent;
+            parent = parent->getParentLimit();
+        }
+        return parent;
+    }
+
+    inline Limit& operator*() const { return *level; }
+    inline Limit* operator->() const { return level; }
+    inline Limit* get() const { return level; }
+
+    inline PriceLevelIterator& operator++() {
+        level = nextLevel(level, descending);
+        return *this;
+    }
+    inline PriceLevelIterator operator++(int) {
+        PriceLevelIterator previous = *this;
+        ++*this;
+        return previous;
+    }
+
+    inline bool operator==(const PriceLevelIterator& other) const { return level == other.level; }
+    inline bool operator!=(const PriceLevelIterator& other) const { return level != other.level; }
+};
+
+#endif
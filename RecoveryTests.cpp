@@ -0,0 +1,266 @@
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Journal.h"
+#include "MarketData.h"
+#include "OrderBook.h"
+#include "OrderCommand.h"
+#include "ReplayFile.h"
+#include "SnapshotFile.h"
+
+#if defined(__linux__)
+#include <sys/resource.h>
+#endif
+
+// Round trips of tests.cpp (see TEST_CHECK in OrderBookTests.cpp): snapshots, journals & market data; files are written to the working directory, then removed
+class RecoveryTests {
+private:
+    // Adds & stops around 1000, with crossing orders & cancellations of earlier ids
+    static std::vector<OrderCommand> generate_commands(int num_commands, int firstOrderId, unsigned seed) {
+        std::mt19937 gen(seed);
+        std::uniform_int_distribution<> action_dist(0, 99);
+        std::uniform_int_distribution<> price_dist(950, 1050);
+        std::uniform_int_distribution<> shares_dist(1, 100);
+        std::vector<OrderCommand> commands;
+        for (int i = 0; i < num_commands; ++i) {
+            int orderId = firstOrderId + i;
+            OrderSide side = (gen() % 2) ? OrderSide::Bid : OrderSide::Ask;
+            int action = action_dist(gen);
+            if (action < 70)
+                commands.push_back(makeCommand(CommandType::AddLimit, side, orderId, price_dist(gen), shares_dist(gen)));
+            else if (action < 85)
+                commands.push_back(makeCommand(CommandType::AddStop, side, orderId, price_dist(gen), shares_dist(gen)));
+            else if (action < 95 && i > 0)
+                commands.push_back(makeCommand(CommandType::CancelLimit, side, firstOrderId + (int)(gen() % i), 0, 0));
+            else
+                commands.push_back(makeCommand(CommandType::Market, side, 0, 0, shares_dist(gen)));
+        }
+        return commands;
+    }
+
+    // Same levels on both sides, best first
+    static bool sameDepth(const OrderBook& book, const MarketDataDecoder& decoder) {
+        std::vector<DepthLevel> bookLevels(4096), decodedLevels(4096);
+        const OrderSide sides[] = { OrderSide::Bid, OrderSide::Ask };
+        for (OrderSide side : sides) {
+            std::size_t count = book.getDepth(side, bookLevels.size(), bookLevels.data());
+            TEST_CHECK(decoder.getDepth(side, decodedLevels.size(), decodedLevels.data()) == count && decoder.getLevelCount(side) == count);
+            for (std::size_t i = 0; i < count; ++i)
+                TEST_CHECK(decodedLevels[i].price == bookLevels[i].price && decodedLevels[i].totalShares == bookLevels[i].totalShares
+                    && decodedLevels[i].numberOfOrders == bookLevels[i].numberOfOrders);
+        }
+        return true;
+    }
+
+public:
+    static bool test_snapshot_load_keeps_the_book() {
+        // A loaded snapshot must be the same book: same checksum & valid trees, then the same trades as the saved book, time priority included
+        const std::string path = "lob_tests_snapshot.bin";
+        OrderBook book;
+        std::vector<OrderCommand> commands = generate_commands(50000, 1, 21);
+        book.processBatch(commands.data(), commands.size());
+        for (int i = 0; i < 200; ++i)
+            book.addLimitOrder(100001 + i, (i % 2) ? OrderSide::Bid : OrderSide::Ask, (i % 2) ? 900 + i / 4 : 1100 - i / 4, 1 + i % 50, TimeInForce::DAY);
+        uint64_t checksum = book.getChecksum();
+        SnapshotFile::write(path, book);
+
+        bool sameBook = false, sameTrades = false;
+        {
+            SnapshotFile file(path);
+            OrderBook loadedBook(file.getOrderCount(), file.getLevelCount() + 1024);
+            loadedBook.loadSnapshot(file);
+            sameBook = file.getBookChecksum() == checksum && loadedBook.getChecksum() == checksum
+                && file.getOrderCount() == book.getOrderIndex().size() && loadedBook.getOrderIndex().size() == book.getOrderIndex().size();
+#ifndef NDEBUG
+            loadedBook.checkTreeInvariants();
+#endif
+
+            // Trading on from both books: the orders of each level must be filled in the same order, and the DAY orders must still be DAY orders
+            std::vector<OrderCommand> nextCommands = generate_commands(20000, 200001, 22);
+            book.processBatch(nextCommands.data(), nextCommands.size());
+            loadedBook.processBatch(nextCommands.data(), nextCommands.size());
+            sameTrades = loadedBook.getChecksum() == book.getChecksum() && loadedBook.expireDayOrders() == book.expireDayOrders()
+                && loadedBook.getChecksum() == book.getChecksum();
+        }
+        std::remove(path.c_str());
+        TEST_CHECK(sameBook);
+        TEST_CHECK(sameTrades);
+        return true;
+    }
+
+    static bool test_snapshot_keeps_queues_across_chunks() {
+        // Levels of several chunks, with tombstones, a partly filled head & orders amended in place: the loaded levels must hold the same orders in the same order
+        const std::string path = "lob_tests_chunks.bin";
+        OrderBook book;
+        int orderId = 0;
+        for (int i = 0; i < 200; ++i)
+            for (int price = 100; price < 104; ++price)
+                book.addLimitOrder(++orderId, OrderSide::Ask, price, 10 + i % 7);
+        for (int id = 3; id <= orderId; id += 3)
+            book.cancelLimitOrder(id);
+        for (int id = 4; id <= orderId; id += 60)
+            book.modifyLimitOrder(id, 4, 100 + (id - 1) % 4); // Fewer shares at the same price: keeps its priority
+        book.addMarketOrder(OrderSide::Bid, 25);
+
+        bool sameQueues = true, sameTrades = false;
+        {
+            SnapshotFile::write(path, book);
+            SnapshotFile file(path);
+            OrderBook loadedBook(file.getOrderCount(), file.getLevelCount() + 16);
+            loadedBook.loadSnapshot(file);
+            PriceLevelIterator it = book.getLevelIterator(OrderSide::Ask), loadedIt = loadedBook.getLevelIterator(OrderSide::Ask);
+            for (; sameQueues && it != PriceLevelIterator() && loadedIt != PriceLevelIterator(); ++it, ++loadedIt) {
+                Order* order = it->getHeadOrder();
+                Order* loadedOrder = loadedIt->getHeadOrder();
+                sameQueues = it->getLimitPrice() == loadedIt->getLimitPrice() && it->getNumberOfOrders() == loadedIt->getNumberOfOrders();
+                for (; sameQueues && order && loadedOrder; order = order->getNextOrder(), loadedOrder = loadedOrder->getNextOrder())
+                    sameQueues = order->getOrderId() == loadedOrder->getOrderId() && order->getOrderShares() == loadedOrder->getOrderShares();
+                sameQueues = sameQueues && !order && !loadedOrder;
+            }
+            sameQueues = sameQueues && it == PriceLevelIterator() && loadedIt == PriceLevelIterator() && loadedBook.getChecksum() == book.getChecksum();
+
+            book.addMarketOrder(OrderSide::Bid, 3000);
+            loadedBook.addMarketOrder(OrderSide::Bid, 3000);
+            sameTrades = loadedBook.getChecksum() == book.getChecksum();
+        }
+        std::remove(path.c_str());
+        TEST_CHECK(sameQueues);
+        TEST_CHECK(sameTrades);
+        return true;
+    }
+
+    static bool test_journal_replays_to_the_live_book() {
+        // With each flush policy, the journal must hold every command of processBatch in order once flushed, and replay to the live book's checksum
+        const std::string path = "lob_tests_journal.bin";
+        const FlushPolicy policies[] = { FlushPolicy::None, FlushPolicy::GroupCommit, FlushPolicy::EachRecord };
+        for (FlushPolicy policy : policies) {
+            std::vector<OrderCommand> commands = generate_commands(policy == FlushPolicy::EachRecord ? 1000 : 20000, 1, 31);
+            uint64_t checksum = 0, durableRecords = 0;
+            bool flushed = false;
+            {
+                Journal journal(path, policy, 512, 100);
+                OrderBook book;
+                book.setJournal(&journal);
+                for (std::size_t first = 0, size = 1; first < commands.size(); first += size, size = size * 3 % 601) // Batches of 1 to 600 commands
+                    book.processBatch(commands.data() + first, std::min(size, commands.size() - first));
+                flushed = journal.flush();
+                durableRecords = journal.getDurableRecords();
+                checksum = book.getChecksum();
+                book.setJournal(nullptr);
+            }
+
+            bool sameCommands = false;
+            uint64_t recoveredChecksum = 0;
+            {
+                ReplayFile file(path);
+                sameCommands = file.getMessageCount() == commands.size()
+                    && std::memcmp(file.getCommands(), commands.data(), commands.size() * sizeof(OrderCommand)) == 0;
+                OrderBook recoveredBook;
+                recoveredBook.processBatch(file.getCommands(), file.getMessageCount());
+                recoveredChecksum = recoveredBook.getChecksum();
+            }
+            std::remove(path.c_str());
+            TEST_CHECK(flushed && durableRecords == commands.size());
+            TEST_CHECK(sameCommands);
+            TEST_CHECK(recoveredChecksum == checksum);
+        }
+        return true;
+    }
+
+    static bool test_journal_recovers_mass_cancels() {
+        // Mass cancels change the book outside processBatch: recovery must still reach every checkpoint of the live book
+        const std::string path = "lob_tests_journal.bin";
+        {
+            Journal journal(path);
+            OrderBook book;
+            book.setJournal(&journal);
+            for (int round = 0; round < 4; ++round) {
+                std::vector<OrderCommand> commands = generate_commands(5000, 1 + round * 5000, round);
+                book.processBatch(commands.data(), commands.size());
+                journal.appendCheckpoint(book.getChecksum());
+
+                book.cancelOrdersIf([](const Order& order) { return order.getOrderId() % 3 == 0; });
+                book.cancelOrdersInRange(OrderSide::Bid, 980, 1000);
+                if (round % 2)
+                    book.cancelAllOrders(OrderSide::Ask);
+                journal.appendCheckpoint(book.getChecksum());
+            }
+            book.setJournal(nullptr);
+        }
+        int recovery = ReplayDriver::run_recovery(path);
+        std::remove(path.c_str());
+        TEST_CHECK(recovery == 0);
+        return true;
+    }
+
+    static bool test_journal_reports_failed_writes() {
+        // Writes past a file size limit fail: the journal must report the error, and stop counting records as durable before the failed one
+#if defined(__linux__)
+        const std::string path = "lob_tests_full_journal.bin";
+        const uint64_t fittingRecords = 100;
+        rlimit previousLimit, limit;
+        ::getrlimit(RLIMIT_FSIZE, &previousLimit);
+        limit = previousLimit;
+        limit.rlim_cur = sizeof(ReplayHeader) + fittingRecords * sizeof(OrderCommand);
+        void (*previousHandler)(int) = std::signal(SIGXFSZ, SIG_IGN); // Writes fail with EFBIG instead
+        ::setrlimit(RLIMIT_FSIZE, &limit);
+
+        std::vector<OrderCommand> commands = generate_commands(1000, 1, 7);
+        bool flushed = true, appendedAfterFailure = true;
+        uint64_t durableRecords = 0;
+        int error = 0;
+        {
+            Journal journal(path, FlushPolicy::EachRecord);
+            journal.append(commands.data(), commands.size());
+            flushed = journal.flush();
+            appendedAfterFailure = journal.append(commands.data(), 1);
+            durableRecords = journal.getDurableRecords();
+            error = journal.getError();
+        }
+        ::setrlimit(RLIMIT_FSIZE, &previousLimit);
+        std::signal(SIGXFSZ, previousHandler);
+        std::remove(path.c_str());
+
+        TEST_CHECK(!flushed && !appendedAfterFailure && error == EFBIG);
+        TEST_CHECK(durableRecords <= fittingRecords);
+#endif
+        return true;
+    }
+
+    static bool test_market_data_decodes_to_the_book_depth() {
+        /* After each batch, the decoders of the stream must have the book's depth: one from the start, a late joiner synchronized by the
+            next refresh, and one that missed a batch's messages, resynchronized by the next refresh. Mass cancels are published too */
+        OrderBook book;
+        MarketDataEncoder encoder(1000);
+        book.setMarketData(&encoder);
+        encoder.encodeRefresh(book); // Of the empty book, which synchronizes the first decoder
+        MarketDataDecoder decoders[3];
+        const int lateRound = 7, missedRound = 3;
+        for (int round = 0; round < 20; ++round) {
+            std::vector<OrderCommand> commands = generate_commands(2000, 1 + round * 2000, 40 + round);
+            book.processBatch(commands.data(), commands.size());
+            if (round % 5 == 4) {
+                book.cancelOrdersInRange(OrderSide::Bid, 990, 1010);
+                book.publishMarketData();
+            }
+
+            const std::vector<uint8_t>& stream = encoder.getBuffer();
+            const bool received[] = { true, round >= lateRound, round != missedRound };
+            for (int i = 0; i < 3; ++i)
+                if (received[i]) {
+                    decoders[i].applyAll(stream.data(), stream.size());
+                    if (decoders[i].isSynchronized())
+                        TEST_CHECK(sameDepth(book, decoders[i]));
+                }
+            encoder.clear();
+            TEST_CHECK(decoders[0].isSynchronized() && decoders[0].getSequence() == encoder.getSequence());
+        }
+        TEST_CHECK(encoder.getRefreshes() > 2 && decoders[1].isSynchronized() && decoders[2].isSynchronized());
+        return true;
+    }
+};
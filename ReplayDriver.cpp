@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Journal.h"
+#include "MarketData.h"
+#include "MatchingEngine.h"
+#include "OrderBook.h"
+#include "ReplayFile.h"
+
+/* Replays a session file through an OrderBook, as fast as the book allows: records are read in place from the mapped file
+    and submitted in batches (see OrderBook::processBatch). The final state, hence the checksum, only depends on the file */
+class ReplayDriver {
+public:
+    template <typename Listener = NullEventListener>
+    static void replay(const ReplayFile& file, OrderBook& book, std::size_t batchSize = 4096, Listener&& listener = Listener()) {
+        const OrderCommand* commands = file.getCommands();
+        std::size_t count = file.getMessageCount();
+        for (std::size_t first = 0; first < count; first += batchSize)
+            book.processBatch(commands + first, std::min(batchSize, count - first), listener);
+    }
+
+    static int run_replay(const std::string& path) {
+        try {
+            ReplayFile file(path);
+            OrderBook book(file.getMessageCount() / 4, 4096);
+            ReplayClock clock; // Orders are stamped 0, 1, 2... ns: the same file gives the same timestamps too
+            book.setClock(&clock);
+
+            auto start = std::chrono::high_resolution_clock::now();
+            replay(file, book);
+            auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+            double seconds = duration / 1e9;
+            std::cout << "Replayed " << file.getMessageCount() << " messages in " << duration / 1000000 << "ms ("
+                      << (seconds > 0 ? file.getMessageCount() / seconds : 0.0) << " messages/s)\n"
+                      << "  Resting orders: " << book.getOrderIndex().size()
+                      << " | Checksum: 0x" << std::hex << book.getChecksum() << std::dec << "\n";
+            return 0;
+        }
+        catch (const std::exception& error) {
+            std::cerr << error.what() << "\n";
+            return 1;
+        }
+    }
+
+    // Replays a session file with an OperationProfiler set on the book, then writes its counters (see OperationProfiler::report)
+    static int run_profiled_replay(const std::string& path, std::ostream& out) {
+        try {
+            ReplayFile file(path);
+            OrderBook book(file.getMessageCount() / 4, 4096);
+            ReplayClock clock;
+            book.setClock(&clock);
+            OperationProfiler profiler;
+            profiler.calibrate();
+            book.setProfiler(&profiler);
+
+            replay(file, book);
+            profiler.report(out, "replay");
+            std::cerr << "Replayed " << file.getMessageCount() << " messages with " << PerfCounters::backendName(profiler.getCounters().getBackend())
+                      << " counters | Checksum: 0x" << std::hex << book.getChecksum() << std::dec << "\n";
+            return 0;
+        }
+        catch (const std::exception& error) {
+            std::cerr << error.what() << "\n";
+            return 1;
+        }
+    }
+
+    /* Replays a session file with a MarketDataEncoder set on the book (a refresh every refreshInterval incremental messages), after a replay
+        without market data: throughput in commands, messages & bytes per second. The stream is then decoded from its start and by a late
+        joiner from the first refresh after its middle; both must end up with the book's levels */
+    static int run_market_data_replay(const std::string& path, uint64_t refreshInterval) {
+        try {
+            ReplayFile file(path);
+            const std::size_t batchSize = 4096;
+            double withoutSeconds;
+            {
+                OrderBook book(file.getMessageCount() / 4, 4096);
+                ReplayClock clock;
+                book.setClock(&clock);
+                auto start = std::chrono::high_resolution_clock::now();
+                replay(file, book, batchSize);
+                withoutSeconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count() / 1e9;
+            }
+
+            OrderBook book(file.getMessageCount() / 4, 4096);
+            ReplayClock clock;
+            book.setClock(&clock);
+            MarketDataEncoder encoder(refreshInterval);
+            book.setMarketData(&encoder);
+            std::vector<uint8_t> stream; // What subscribers would receive, taken from the encoder after each batch
+            stream.reserve(file.getMessageCount() * 16); // Over the ~13 bytes of an incremental message
+
+            const OrderCommand* commands = file.getCommands();
+            std::size_t count = file.getMessageCount();
+            auto start = std::chrono::high_resolution_clock::now();
+            for (std::size_t first = 0; first < count; first += batchSize) {
+                book.processBatch(commands + first, std::min(batchSize, count - first));
+                stream.insert(stream.end(), encoder.getBuffer().begin(), encoder.getBuffer().end());
+                encoder.clear();
+            }
+            double seconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count() / 1e9;
+
+            uint64_t messages = encoder.getSequence() + encoder.getRefreshes();
+            std::cout << "Market data: " << count << " commands -> " << encoder.getSequence() << " incremental messages ("
+                      << (double)encoder.getEntries() / std::max<uint64_t>(encoder.getSequence(), 1) << " levels per message) & " << encoder.getRefreshes()
+                      << " refreshes, " << stream.size() << " bytes (" << (double)stream.size() / std::max<uint64_t>(messages, 1) << " per message)\n"
+                      << "  Replay: " << count / withoutSeconds << " commands/s without market data, " << count / seconds << " commands/s with it | "
+                      << messages / seconds << " messages/s, " << stream.size() / seconds / (1024 * 1024) << " MB/s\n";
+
+            // A decoder from the start, and a late joiner that skips the first half of the stream up to a refresh
+            MarketDataDecoder decoder, lateJoiner;
+            start = std::chrono::high_resolution_clock::now();
+            decoder.applyAll(stream.data(), stream.size());
+            double decodeSeconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count() / 1e9;
+            const uint8_t* message = stream.data();
+            const uint8_t* end = stream.data() + stream.size();
+            MarketDataDecoder skipped;
+            while (message != end && (message < stream.data() + stream.size() / 2 || *message != (uint8_t)MarketDataMessageType::Refresh))
+                message = skipped.apply(message, end); // Parsed only to find the message boundaries
+            while (message != end)
+                message = lateJoiner.apply(message, end);
+
+            auto sameLevels = [&book](const MarketDataDecoder& side) {
+                for (OrderSide orderSide : { OrderSide::Bid, OrderSide::Ask }) {
+                    std::vector<DepthLevel> bookLevels(side.getLevelCount(orderSide) + 1), decodedLevels(side.getLevelCount(orderSide) + 1);
+                    std::size_t bookCount = book.getDepth(orderSide, bookLevels.size(), bookLevels.data());
+                    std::size_t decodedCount = side.getDepth(orderSide, decodedLevels.size(), decodedLevels.data());
+                    if (bookCount != decodedCount)
+                        return false;
+                    for (std::size_t i = 0; i < bookCount; ++i)
+                        if (bookLevels[i].price != decodedLevels[i].price || bookLevels[i].totalShares != decodedLevels[i].totalShares
+                            || bookLevels[i].numberOfOrders != decodedLevels[i].numberOfOrders)
+                            return false;
+                }
+                return side.isSynchronized();
+            };
+            std::cout << "  Decode: " << decoder.getAppliedMessages() / decodeSeconds << " messages/s | Decoded levels: "
+                      << (sameLevels(decoder) ? "same as the book" : "DIFFER FROM THE BOOK") << ", late joiner ("
+                      << lateJoiner.getAppliedMessages() << " messages): " << (sameLevels(lateJoiner) ? "same as the book" : "DIFFER FROM THE BOOK") << "\n";
+            return 0;
+        }
+        catch (const std::exception& error) {
+            std::cerr << error.what() << "\n";
+            return 1;
+        }
+    }
+
+    /* Recovery from a journal (see Journal.h): its commands are replayed into a fresh book, and at every checkpoint the book must have the
+        checksum that the live book had when the checkpoint was journaled. A record torn by a crash at the end of the journal is left out */
+    static int run_recovery(const std::string& path) {
+        try {
+            ReplayFile file(path);
+            OrderBook book(file.getMessageCount() / 4, 4096);
+            ReplayClock clock;
+            book.setClock(&clock);
+
+            const OrderCommand* commands = file.getCommands();
+            std::size_t count = file.getMessageCount(), first = 0, checkpoints = 0;
+            auto start = std::chrono::high_resolution_clock::now();
+            for (std::size_t i = 0; i < count; ++i) {
+                if (commands[i].type != CommandType::Checkpoint)
+                    continue;
+                book.processBatch(commands + first, i - first);
+                first = i + 1;
+                if (book.getChecksum() != checkpointChecksum(commands[i])) {
+                    std::cerr << "Recovered book differs from the live book at checkpoint " << checkpoints + 1 << " (command " << i << ")\n";
+                    return 1;
+                }
+                ++checkpoints;
+            }
+            book.processBatch(commands + first, count - first); // Journaled after the last checkpoint
+            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+            std::cout << "Recovered " << count << " journaled commands in " << duration << "ms: " << checkpoints << " checkpoints match the live book\n"
+                      << "  Resting orders: " << book.getOrderIndex().size() << " | Checksum: 0x" << std::hex << book.getChecksum() << std::dec << "\n";
+            return 0;
+        }
+        catch (const std::exception& error) {
+            std::cerr << error.what() << "\n";
+            return 1;
+        }
+    }
+
+    // Multi-instrument sessions: records are routed by instrumentId to a MatchingEngine's shards. The checksum doesn't depend on the number of shards
+    static int run_engine_replay(const std::string& path, int num_shards) {
+        try {
+            ReplayFile file(path);
+            MatchingEngine engine(num_shards > 0 ? num_shards : 1);
+            engine.start();
+
+            const std::size_t submitSize = 1024;
+            auto start = std::chrono::high_resolution_clock::now();
+            for (std::size_t first = 0; first < file.getMessageCount(); first += submitSize)
+                engine.submit(file.getCommands() + first, std::min(submitSize, file.getMessageCount() - first));
+            engine.waitUntilIdle();
+            auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+            double seconds = duration / 1e9;
+            std::cout << "Replayed " << file.getMessageCount() << " messages on " << engine.getShardCount() << " shards in " << duration / 1000000 << "ms ("
+                      << (seconds > 0 ? file.getMessageCount() / seconds : 0.0) << " messages/s)\n"
+                      << "  Checksum: 0x" << std::hex << engine.getChecksum() << std::dec << "\n";
+            for (std::size_t shard = 0; shard < engine.getShardCount(); ++shard) {
+                MatchingEngine::ShardStats stats = engine.getShardStats(shard);
+                std::cout << "  Shard " << shard << ": " << stats.instruments << " instruments, " << stats.processedMessages << " messages | Max queue depth: "
+                          << stats.maxQueueDepth << " | Latency (ns) p50 " << (uint64_t)stats.p50LatencyNs << ", p99 " << (uint64_t)stats.p99LatencyNs << "\n";
+            }
+            return 0;
+        }
+        catch (const std::exception& error) {
+            std::cerr << error.what() << "\n";
+            return 1;
+        }
+    }
+
+    static void run_journal_benchmark(const std::string& path, int num_orders) {
+        /* Matching throughput (batches of 256 commands) without a journal, then journaling with each flush policy: the matching thread only
+            hands its commands over, durable shows when the last one was synced. Per-record syncs are measured over fewer commands.
+            The group commit journal, left at path, gets a checkpoint of the live book at the end and is recovered into a fresh book */
+        std::vector<OrderCommand> commands = OrderBookBenchmark::generate_clustered_commands(num_orders);
+        const char* modes[] = { "off", "none", "each_record", "group_commit" };
+        FlushPolicy policies[] = { FlushPolicy::None, FlushPolicy::None, FlushPolicy::EachRecord, FlushPolicy::GroupCommit };
+        const std::size_t batchSize = 256;
+
+        try {
+            for (int mode = 0; mode < 4; ++mode) {
+                std::size_t count = (mode == 2) ? std::min<std::size_t>(commands.size(), 5000) : commands.size();
+                OrderBook book(count / 4, 4096);
+                std::unique_ptr<Journal> journal(mode > 0 ? new Journal(path, policies[mode]) : nullptr);
+                book.setJournal(journal.get());
+
+                auto start = std::chrono::high_resolution_clock::now();
+                for (std::size_t first = 0; first < count; first += batchSize)
+                    book.processBatch(&commands[first], std::min(batchSize, count - first));
+                auto matchDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+                std::cout << "Journal " << modes[mode] << ": " << count << " commands matched at " << count / (matchDuration / 1e9) << " commands/s";
+
+                if (journal) {
+                    if (mode == 3)
+                        journal->appendCheckpoint(book.getChecksum());
+                    if (!journal->flush()) {
+                        std::cerr << "\nJournal " << modes[mode] << " failed: " << std::strerror(journal->getError()) << "\n";
+                        return;
+                    }
+                    auto durableDuration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+                    std::cout << ", durable after " << durableDuration / 1000 << "ms (" << journal->getCommits() << " commits, "
+                              << journal->getDurableRecords() / std::max<uint64_t>(journal->getCommits(), 1) << " records per commit)";
+                }
+                std::cout << "\n";
+
+                if (mode == 3) {
+                    journal.reset(); // Closes the file
+                    std::cout << "  ";
+                    run_recovery(path);
+                }
+            }
+        }
+        catch (const std::exception& error) {
+            std::cerr << error.what() << "\n";
+        }
+    }
+
+    // Writes the clustered benchmark workload as a session file, e.g: to replay it on several builds
+    // With several instruments, each one receives num_messages / num_instruments messages
+    static int record_session(const std::string& path, int num_messages, int num_instruments = 1) {
+        try {
+            if (num_instruments > 1)
+                ReplayFile::write(path, OrderBookBenchmark::generate_multi_instrument_commands(num_instruments, num_messages / num_instruments));
+            else
+                ReplayFile::write(path, OrderBookBenchmark::generate_clustered_commands(num_messages));
+            std::cout << "Wrote " << (num_instruments > 1 ? num_messages / num_instruments * num_instruments : num_messages) << " messages to " << path << "\n";
+            return 0;
+        }
+        catch (const std::exception& error) {
+            std::cerr << error.what() << "\n";
+            return 1;
+        }
+    }
+};
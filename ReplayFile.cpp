@@ -0,0 +1,101 @@
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "ReplayFile.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LOB_HAS_MMAP 1
+#endif
+
+// Open-ended files hold as many whole records as their size allows: a record torn by a crash is left out
+static std::size_t recordCount(const ReplayHeader& header, std::size_t fileBytes) {
+    return (header.messageCount == ReplayFile::openEnded) ? (fileBytes - sizeof(ReplayHeader)) / sizeof(OrderCommand) : (std::size_t)header.messageCount;
+}
+
+static void checkReplayHeader(const ReplayHeader& header, std::size_t fileBytes, const std::string& path) {
+    if (std::memcmp(header.magic, "LOBR", 4) != 0 || header.version != ReplayFile::currentVersion || header.recordSize != sizeof(OrderCommand))
+        throw std::runtime_error("Not a session file (or unsupported version): " + path);
+    if (header.messageCount != ReplayFile::openEnded && header.messageCount > (fileBytes - sizeof(ReplayHeader)) / sizeof(OrderCommand))
+        throw std::runtime_error("Truncated session file: " + path);
+}
+
+ReplayFile::ReplayFile(const std::string& path) : mappedData(nullptr), mappedBytes(0), commands(nullptr), messageCount(0) {
+#if defined(LOB_HAS_MMAP)
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open " + path);
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || (std::size_t)fileStat.st_size < sizeof(ReplayHeader)) {
+        close(fd);
+        throw std::runtime_error("Not a session file: " + path);
+    }
+
+    int flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+    flags |= MAP_POPULATE; // Fault the pages in now rather than during the replay
+#endif
+    void* data = mmap(nullptr, (std::size_t)fileStat.st_size, PROT_READ, flags, fd, 0);
+    close(fd); // The mapping stays valid
+    if (data == MAP_FAILED)
+        throw std::runtime_error("Cannot map " + path);
+    madvise(data, (std::size_t)fileStat.st_size, MADV_SEQUENTIAL);
+    mappedData = data;
+    mappedBytes = (std::size_t)fileStat.st_size;
+
+    const ReplayHeader& header = *static_cast<const ReplayHeader*>(data);
+    try {
+        checkReplayHeader(header, mappedBytes, path);
+    }
+    catch (...) {
+        munmap(data, mappedBytes);
+        throw;
+    }
+    commands = reinterpret_cast<const OrderCommand*>(static_cast<const char*>(data) + sizeof(ReplayHeader));
+    messageCount = recordCount(header, mappedBytes);
+#else
+    std::ifstream in(path.c_str(), std::ios::binary | std::ios::ate);
+    if (!in)
+        throw std::runtime_error("Cannot open " + path);
+    std::size_t fileBytes = (std::size_t)in.tellg();
+    ReplayHeader header;
+    in.seekg(0);
+    if (fileBytes < sizeof(ReplayHeader) || !in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+        throw std::runtime_error("Not a session file: " + path);
+    checkReplayHeader(header, fileBytes, path);
+
+    readCommands.resize(recordCount(header, fileBytes));
+    if (!readCommands.empty() && !in.read(reinterpret_cast<char*>(&readCommands[0]), readCommands.size() * sizeof(OrderCommand)))
+        throw std::runtime_error("Cannot read " + path);
+    commands = readCommands.empty() ? nullptr : &readCommands[0];
+    messageCount = readCommands.size();
+#endif
+}
+
+ReplayFile::~ReplayFile() {
+#if defined(LOB_HAS_MMAP)
+    if (mappedData)
+        munmap(const_cast<void*>(mappedData), mappedBytes);
+#endif
+}
+
+void ReplayFile::write(const std::string& path, const std::vector<OrderCommand>& commands) {
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("Cannot create " + path);
+
+    ReplayHeader header;
+    std::memcpy(header.magic, "LOBR", 4);
+    header.version = currentVersion;
+    header.recordSize = sizeof(OrderCommand);
+    header.messageCount = commands.size();
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!commands.empty())
+        out.write(reinterpret_cast<const char*>(&commands[0]), commands.size() * sizeof(OrderCommand));
+    if (!out)
+        throw std::runtime_error("Cannot write " + path);
+}
@@ -0,0 +1,48 @@
+#ifndef REPLAYFILE_H
+#define REPLAYFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "OrderCommand.h"
+
+/* Binary session file: a 16-byte header followed by fixed-width 16-byte records, each one an OrderCommand as laid out in memory
+    (little-endian), hence records are used in place from the mapped file: no decoding, no allocation per message.
+    Message types: add/cancel/modify of limit & stop orders and market orders (see CommandType). */
+struct ReplayHeader {
+    char magic[4];          // "LOBR"
+    uint16_t version;
+    uint16_t recordSize;    // sizeof(OrderCommand)
+    uint64_t messageCount;  // ReplayFile::openEnded: as many records as the file holds (e.g: a journal, see Journal.h)
+};
+
+static_assert(sizeof(ReplayHeader) == 16, "ReplayHeader must stay 16 bytes, records stay aligned after it");
+
+// Read-only view of a session file, memory-mapped where available (POSIX), read into memory otherwise
+class ReplayFile {
+private:
+    const void* mappedData;
+    std::size_t mappedBytes;
+    std::vector<OrderCommand> readCommands; // Without mmap
+    const OrderCommand* commands;
+    std::size_t messageCount;
+
+public:
+    static const uint16_t currentVersion = 1;
+    static const uint64_t openEnded = UINT64_MAX;
+
+    explicit ReplayFile(const std::string& path); // Throws std::runtime_error if the file can't be opened or isn't a valid session file
+    ~ReplayFile();
+    ReplayFile(const ReplayFile&) = delete;
+    ReplayFile& operator=(const ReplayFile&) = delete;
+
+    // Getters
+    inline const OrderCommand* getCommands() const { return commands; }
+    inline std::size_t getMessageCount() const { return messageCount; }
+
+    static void write(const std::string& path, const std::vector<OrderCommand>& commands); // Throws std::runtime_error on failure
+};
+
+#endif
@@ -0,0 +1,216 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "OrderBook.h"
+#include "PriceLevelIterator.h"
+#include "SnapshotFile.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define LOB_HAS_MMAP 1
+#endif
+
+static void checkSnapshot(const SnapshotHeader& header, const SnapshotLevel* levels, std::size_t fileBytes, const std::string& path) {
+    if (std::memcmp(header.magic, "LOBS", 4) != 0 || header.version != SnapshotFile::currentVersion
+            || header.levelRecordSize != sizeof(SnapshotLevel) || header.orderRecordSize != sizeof(SnapshotOrder))
+        throw std::runtime_error("Not a snapshot file (or unsupported version): " + path);
+
+    uint64_t levelCount = (uint64_t)header.levelCounts[0] + header.levelCounts[1] + header.levelCounts[2] + header.levelCounts[3];
+    uint64_t recordBytes = fileBytes - sizeof(SnapshotHeader);
+    if (levelCount > recordBytes / sizeof(SnapshotLevel) || header.orderCount > (recordBytes - levelCount * sizeof(SnapshotLevel)) / sizeof(SnapshotOrder))
+        throw std::runtime_error("Truncated snapshot file: " + path);
+
+    // Levels must be strictly increasing within each tree and own all the order records: the book can then be built without checks
+    uint64_t orderCount = 0;
+    for (int tree = 0; tree < 4; ++tree) {
+        for (uint32_t i = 0; i < header.levelCounts[tree]; ++i, ++levels) {
+            if (levels->numberOfOrders == 0 || (i > 0 && levels->price <= levels[-1].price))
+                throw std::runtime_error("Corrupt snapshot file: " + path);
+            orderCount += levels->numberOfOrders;
+        }
+    }
+    if (orderCount != header.orderCount)
+        throw std::runtime_error("Corrupt snapshot file: " + path);
+}
+
+SnapshotFile::SnapshotFile(const std::string& path) : mappedData(nullptr), mappedBytes(0), header(nullptr), levels(nullptr), orders(nullptr) {
+    const char* data;
+    std::size_t fileBytes;
+#if defined(LOB_HAS_MMAP)
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open " + path);
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || (std::size_t)fileStat.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        throw std::runtime_error("Not a snapshot file: " + path);
+    }
+
+    int flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+    flags |= MAP_POPULATE; // Fault the pages in now, the whole file is read once
+#endif
+    void* mapping = mmap(nullptr, (std::size_t)fileStat.st_size, PROT_READ, flags, fd, 0);
+    close(fd); // The mapping stays valid
+    if (mapping == MAP_FAILED)
+        throw std::runtime_error("Cannot map " + path);
+    madvise(mapping, (std::size_t)fileStat.st_size, MADV_SEQUENTIAL);
+    mappedData = mapping;
+    mappedBytes = fileBytes = (std::size_t)fileStat.st_size;
+    data = static_cast<const char*>(mapping);
+#else
+    std::ifstream in(path.c_str(), std::ios::binary | std::ios::ate);
+    if (!in)
+        throw std::runtime_error("Cannot open " + path);
+    fileBytes = (std::size_t)in.tellg();
+    if (fileBytes < sizeof(SnapshotHeader))
+        throw std::runtime_error("Not a snapshot file: " + path);
+
+    readData.resize((fileBytes + sizeof(uint64_t) - 1) / sizeof(uint64_t)); // 8-byte aligned records
+    in.seekg(0);
+    if (!in.read(reinterpret_cast<char*>(&readData[0]), fileBytes))
+        throw std::runtime_error("Cannot read " + path);
+    data = reinterpret_cast<const char*>(&readData[0]);
+#endif
+
+    header = reinterpret_cast<const SnapshotHeader*>(data);
+    levels = reinterpret_cast<const SnapshotLevel*>(data + sizeof(SnapshotHeader));
+    try {
+        checkSnapshot(*header, levels, fileBytes, path);
+    }
+    catch (...) {
+#if defined(LOB_HAS_MMAP)
+        munmap(const_cast<void*>(mappedData), mappedBytes);
+#endif
+        throw;
+    }
+    orders = reinterpret_cast<const SnapshotOrder*>(levels + getLevelCount());
+}
+
+SnapshotFile::~SnapshotFile() {
+#if defined(LOB_HAS_MMAP)
+    if (mappedData)
+        munmap(const_cast<void*>(mappedData), mappedBytes);
+#endif
+}
+
+// Records are gathered in a buffer and written by chunks of 1MB
+class SnapshotWriter {
+private:
+    std::ofstream out;
+    std::vector<char> buffer;
+    std::size_t used;
+
+public:
+    explicit SnapshotWriter(const std::string& path) : out(path.c_str(), std::ios::binary | std::ios::trunc), buffer(1 << 20), used(0) {
+        if (!out)
+            throw std::runtime_error("Cannot create " + path);
+    }
+
+    void append(const void* record, std::size_t bytes) {
+        if (used + bytes > buffer.size())
+            flush();
+        std::memcpy(&buffer[used], record, bytes);
+        used += bytes;
+    }
+
+    void flush() {
+        out.write(&buffer[0], used);
+        used = 0;
+    }
+
+    bool close() {
+        flush();
+        out.close();
+        return !out.fail();
+    }
+};
+
+void SnapshotFile::write(const std::string& path, const OrderBook& book) {
+    Limit* trees[4] = { book.getBidTree(), book.getAskTree(), book.getStopBidTree(), book.getStopAskTree() };
+    Limit* lowestLevels[4];
+
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "LOBS", 4);
+    header.version = currentVersion;
+    header.levelRecordSize = sizeof(SnapshotLevel);
+    header.orderRecordSize = sizeof(SnapshotOrder);
+    header.orderCount = book.getOrderIndex().size();
+    header.bookChecksum = book.getChecksum();
+    for (int tree = 0; tree < 4; ++tree) {
+        Limit* level = trees[tree];
+        while (level && level->getLeftChildLimit())
+            level = level->getLeftChildLimit();
+        lowestLevels[tree] = level;
+        for (PriceLevelIterator it(level, false); it != PriceLevelIterator(); ++it)
+            ++header.levelCounts[tree];
+    }
+
+    std::string temporaryPath = path + ".tmp";
+    SnapshotWriter writer(temporaryPath);
+    writer.append(&header, sizeof(header));
+
+    for (int tree = 0; tree < 4; ++tree)
+        for (PriceLevelIterator it(lowestLevels[tree], false); it != PriceLevelIterator(); ++it) {
+            SnapshotLevel record = { it->getLimitPrice(), (uint32_t)it->getNumberOfOrders() };
+            writer.append(&record, sizeof(record));
+        }
+
+    for (int tree = 0; tree < 4; ++tree)
+        for (PriceLevelIterator it(lowestLevels[tree], false); it != PriceLevelIterator(); ++it)
+            for (Order* order = it->getHeadOrder(); order != nullptr; order = order->getNextOrder()) {
+                SnapshotOrder record;
+                std::memset(&record, 0, sizeof(record));
+                record.orderId = order->getOrderId();
+                record.shares = order->getOrderShares();
+                record.submissionTime = order->getSubmissionTime();
+                record.tif = (uint8_t)order->getTIF();
+                writer.append(&record, sizeof(record));
+            }
+
+    if (!writer.close() || std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        std::remove(temporaryPath.c_str());
+        throw std::runtime_error("Cannot write " + path);
+    }
+}
+
+long SnapshotFile::writeInBackground(const std::string& path, const OrderBook& book) {
+#if defined(LOB_HAS_MMAP)
+    pid_t writerId = fork(); // The child process has a copy-on-write image of the book, frozen at this point
+    if (writerId < 0)
+        throw std::runtime_error("Cannot fork to write " + path);
+    if (writerId == 0) {
+        int status = 0;
+        try {
+            write(path, book);
+        }
+        catch (...) {
+            status = 1;
+        }
+        _exit(status);
+    }
+    return (long)writerId;
+#else
+    write(path, book);
+    return 0;
+#endif
+}
+
+void SnapshotFile::waitForWrite(long writerId) {
+#if defined(LOB_HAS_MMAP)
+    if (writerId <= 0)
+        return;
+    int status = 0;
+    if (waitpid((pid_t)writerId, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        throw std::runtime_error("Snapshot write failed");
+#else
+    (void)writerId;
+#endif
+}
@@ -0,0 +1,79 @@
+#ifndef SNAPSHOTFILE_H
+#define SNAPSHOTFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class OrderBook;
+
+/* Binary snapshot of a book: a 48-byte header, the level records of the four trees (bid, ask, stop bid, stop ask trees,
+    each one by ascending price), then the order records of every level in the same order, each level's orders by time priority.
+    Records are fixed-width and little-endian, read in place from the mapped file (see OrderBook::loadSnapshot) */
+struct SnapshotHeader {
+    char magic[4];              // "LOBS"
+    uint16_t version;
+    uint16_t levelRecordSize;   // sizeof(SnapshotLevel)
+    uint16_t orderRecordSize;   // sizeof(SnapshotOrder)
+    uint16_t reserved;
+    uint32_t levelCounts[4];    // Bid, ask, stop bid & stop ask levels
+    uint32_t reservedWord;
+    uint64_t orderCount;
+    uint64_t bookChecksum;      // OrderBook::getChecksum() of the saved book
+};
+
+struct SnapshotLevel {
+    int32_t price;
+    uint32_t numberOfOrders;    // Its orders are the next numberOfOrders order records
+};
+
+struct SnapshotOrder {
+    int32_t orderId;
+    int32_t shares;
+    uint64_t submissionTime;
+    uint8_t tif;                // TimeInForce
+    uint8_t reserved[7];
+};
+
+static_assert(sizeof(SnapshotHeader) == 48, "SnapshotHeader must stay 48 bytes, records stay aligned after it");
+static_assert(sizeof(SnapshotLevel) == 8 && sizeof(SnapshotOrder) == 24, "Snapshot records are fixed-width");
+
+// Read-only view of a snapshot file, memory-mapped where available (POSIX), read into memory otherwise
+class SnapshotFile {
+private:
+    const void* mappedData;
+    std::size_t mappedBytes;
+    std::vector<uint64_t> readData; // Without mmap
+    const SnapshotHeader* header;
+    const SnapshotLevel* levels;
+    const SnapshotOrder* orders;
+
+public:
+    static const uint16_t currentVersion = 1;
+
+    // Throws std::runtime_error if the file can't be opened or isn't a valid snapshot (levels out of order, order counts not adding up...)
+    explicit SnapshotFile(const std::string& path);
+    ~SnapshotFile();
+    SnapshotFile(const SnapshotFile&) = delete;
+    SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+    // Getters
+    inline const SnapshotLevel* getLevels() const { return levels; }
+    inline const SnapshotOrder* getOrders() const { return orders; }
+    inline std::size_t getLevelCount(int tree) const { return header->levelCounts[tree]; } // tree: 0 bid, 1 ask, 2 stop bid, 3 stop ask
+    inline std::size_t getLevelCount() const { return getLevelCount(0) + getLevelCount(1) + getLevelCount(2) + getLevelCount(3); }
+    inline std::size_t getOrderCount() const { return (std::size_t)header->orderCount; }
+    inline uint64_t getBookChecksum() const { return header->bookChecksum; }
+
+    // Writes to path.tmp, then renames it to path: an existing snapshot is replaced only by a complete one. Throws std::runtime_error on failure
+    static void write(const std::string& path, const OrderBook& book);
+
+    /* Writes the snapshot from a forked copy of the process (POSIX), so the book only stalls for the fork itself and can be modified
+        as soon as it returns; it must not be modified by another thread meanwhile. Returns the id to wait for with waitForWrite.
+        Without fork, the snapshot is written before returning */
+    static long writeInBackground(const std::string& path, const OrderBook& book);
+    static void waitForWrite(long writerId); // Throws std::runtime_error if the background write failed
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// Single-producer single-consumer ring: one thread pushes, one other thread pops. Never allocates after construction
+template <typename T>
+class SpscQueue {
+private:
+    // Consumer & producer positions are kept on different cache lines by padding (rather than alignas, so that queues can be allocated with new in C++11)
+    std::vector<T> items; // Power of two size
+    std::size_t mask;
+    char padding0[64];
+    std::atomic<uint64_t> head; // Next item to pop, written by the consumer
+    char padding1[64];
+    std::atomic<uint64_t> tail; // Next item to push, written by the producer
+    char padding2[64];
+    uint64_t cachedHead;        // Producer's copy of head, refreshed only when the ring looks full
+    uint64_t pendingTail;       // Producer's next position, ahead of tail while items are written but not yet published
+    char padding3[64];
+
+public:
+    explicit SpscQueue(std::size_t capacity) : mask(0), head(0), tail(0), cachedHead(0), pendingTail(0) {
+        if (capacity == 0 || (capacity & (capacity - 1)))
+            throw std::invalid_argument("Ring buffer capacity must be a power of two");
+        items.resize(capacity);
+        mask = capacity - 1;
+    }
+
+    // Write an item, visible to the consumer once published (right away if publishNow)
+    inline bool tryPush(const T& item, bool publishNow = true) {
+        if (pendingTail - cachedHead > mask) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (pendingTail - cachedHead > mask)
+                return false; // Full
+        }
+        items[pendingTail & mask] = item;
+        ++pendingTail;
+        if (publishNow)
+            tail.store(pendingTail, std::memory_order_release);
+        return true;
+    }
+
+    inline void publish() { tail.store(pendingTail, std::memory_order_release); }
+
+    inline bool tryPop(T& item) {
+        uint64_t position = head.load(std::memory_order_relaxed);
+        if (position == tail.load(std::memory_order_acquire))
+            return false; // Empty
+        item = items[position & mask];
+        head.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Pop up to maxCount items at once (a single release of head); returns the number of items popped
+    inline std::size_t tryPopBatch(T* out, std::size_t maxCount) {
+        uint64_t position = head.load(std::memory_order_relaxed);
+        std::size_t count = (std::size_t)(tail.load(std::memory_order_acquire) - position);
+        if (count > maxCount)
+            count = maxCount;
+        for (std::size_t i = 0; i < count; ++i)
+            out[i] = items[(position + i) & mask];
+        if (count)
+            head.store(position + count, std::memory_order_release);
+        return count;
+    }
+
+    // Pop every available item; returns the number of items handled
+    template <typename Handler>
+    std::size_t drain(Handler handle) {
+        std::size_t count = 0;
+        T item;
+        while (tryPop(item)) {
+            handle(item);
+            ++count;
+        }
+        return count;
+    }
+
+    inline std::size_t size() const { return (std::size_t)(tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire)); }
+    inline std::size_t capacity() const { return items.size(); }
+};
+
+#endif
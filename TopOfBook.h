@@ -0,0 +1,85 @@
+#ifndef TOPOFBOOK_H
+#define TOPOFBOOK_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "PriceLevelIterator.h"
+
+// Fixed-size view of the top of a book, 256 bytes: the best bid & ask (price & size) are bids[0] & asks[0]
+struct TopOfBookSnapshot {
+    static const std::size_t maxLevels = 10;
+
+    uint64_t sequence;   // Number of the publication, from 1 (0 until the first one)
+    uint32_t bidLevels;  // Valid levels of bids, best first; 0 if the side is empty
+    uint32_t askLevels;  // ... of asks
+    DepthLevel bids[maxLevels];
+    DepthLevel asks[maxLevels];
+};
+
+/* Seqlock publication of a book's top (see OrderBook::setTopOfBook): the matching thread publishes a snapshot after each batch,
+    any number of other threads read the latest one without locking. The matching thread never waits for readers; a reader retries
+    while a publication is in progress. The snapshot is stored in atomic words, stored with release & loaded with acquire (plain moves
+    on x86): a reader that sees a word of a publication in progress sees its odd version too, hence an overlapping read is a retry, not a data race */
+class TopOfBook {
+private:
+    static const std::size_t words = sizeof(TopOfBookSnapshot) / sizeof(uint64_t);
+    static_assert(sizeof(TopOfBookSnapshot) % sizeof(uint64_t) == 0, "TopOfBookSnapshot must be made of whole words");
+
+    // The version & snapshot are kept away from their neighbours' cache lines by padding (see SpscQueue.h)
+    char padding0[64];
+    std::atomic<uint64_t> version;       // Odd while a publication is in progress
+    std::atomic<uint64_t> data[words];
+    char padding1[64];
+    uint64_t publications;               // Matching thread only
+
+public:
+    TopOfBook() : version(0), publications(0) {
+        for (std::size_t i = 0; i < words; ++i)
+            data[i].store(0, std::memory_order_relaxed);
+    }
+    TopOfBook(const TopOfBook&) = delete;
+    TopOfBook& operator=(const TopOfBook&) = delete;
+
+    // Matching thread only: snapshot's sequence is set to the number of this publication
+    inline void publish(TopOfBookSnapshot& snapshot) {
+        snapshot.sequence = ++publications;
+        uint64_t source[words];
+        std::memcpy(source, &snapshot, sizeof(snapshot));
+
+        uint64_t current = version.load(std::memory_order_relaxed);
+        version.store(current + 1, std::memory_order_relaxed);
+        for (std::size_t i = 0; i < words; ++i)
+            data[i].store(source[i], std::memory_order_release); // Visible after the odd version
+        version.store(current + 2, std::memory_order_release);
+    }
+
+    // Any thread: false if a publication overlapped the read, snapshot is then left unchanged
+    inline bool tryRead(TopOfBookSnapshot& snapshot) const {
+        uint64_t before = version.load(std::memory_order_acquire);
+        if (before & 1)
+            return false;
+
+        uint64_t copy[words];
+        for (std::size_t i = 0; i < words; ++i)
+            copy[i] = data[i].load(std::memory_order_acquire); // Read before the version is checked again
+        if (version.load(std::memory_order_relaxed) != before)
+            return false;
+
+        std::memcpy(&snapshot, copy, sizeof(snapshot));
+        return true;
+    }
+
+    // Any thread: the latest snapshot, retrying until a read doesn't overlap a publication
+    inline TopOfBookSnapshot read() const {
+        TopOfBookSnapshot snapshot;
+        while (!tryRead(snapshot)) {}
+        return snapshot;
+    }
+
+    inline uint64_t getPublications() const { return publications; } // Matching thread only
+};
+
+#endif
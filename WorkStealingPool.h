@@ -0,0 +1,122 @@
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+/* Runs a fixed list of tasks (indices 0 to count - 1) on a number of threads, for coarse tasks of uneven lengths (e.g: whole sessions).
+    Every worker starts with a contiguous range of the indices and takes its tasks from the front of its range; once its range is empty,
+    it steals the back half of another worker's range. A range is a single atomic word (begin & end), hence taking and stealing are
+    one compare-and-swap each, without locks. Stolen tasks are in no range between the steal and the thief's store: another idle worker
+    may then find nothing to steal and stop early, the thief still runs them */
+class WorkStealingPool {
+public:
+    struct WorkerStats {
+        uint64_t executedTasks;
+        uint64_t steals;        // Successful steals
+        uint64_t stolenTasks;
+    };
+
+private:
+    // A worker's range is kept away from the other workers' by padding (see SpscQueue.h)
+    struct Worker {
+        char padding0[64];
+        std::atomic<uint64_t> range; // begin << 32 | end: tasks [begin, end) left to this worker
+        WorkerStats stats;           // Written by the worker, read once the run is over
+        char padding1[64];
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    static inline uint64_t packRange(uint32_t begin, uint32_t end) { return (uint64_t)begin << 32 | end; }
+    static inline uint32_t rangeBegin(uint64_t range) { return (uint32_t)(range >> 32); }
+    static inline uint32_t rangeEnd(uint64_t range) { return (uint32_t)range; }
+
+    // Takes the front task of worker's own range; false once it's empty
+    inline bool takeTask(Worker& worker, uint32_t& task) {
+        uint64_t range = worker.range.load(std::memory_order_acquire);
+        while (rangeBegin(range) < rangeEnd(range))
+            if (worker.range.compare_exchange_weak(range, packRange(rangeBegin(range) + 1, rangeEnd(range)), std::memory_order_acq_rel)) {
+                task = rangeBegin(range);
+                return true;
+            }
+        return false;
+    }
+
+    /* Moves the back half of another worker's range (at least one task) into thief's range, which must be empty: nobody else changes an
+        empty range, and ranges are only ever split, never merged: a range seen before a change never comes back, a stale compare-and-swap fails */
+    bool steal(std::size_t thiefIndex) {
+        Worker& thief = *workers[thiefIndex];
+        for (std::size_t offset = 1; offset < workers.size(); ++offset) {
+            Worker& victim = *workers[(thiefIndex + offset) % workers.size()];
+            uint64_t range = victim.range.load(std::memory_order_acquire);
+            while (rangeBegin(range) < rangeEnd(range)) {
+                uint32_t middle = rangeBegin(range) + (rangeEnd(range) - rangeBegin(range)) / 2;
+                if (victim.range.compare_exchange_weak(range, packRange(rangeBegin(range), middle), std::memory_order_acq_rel)) {
+                    thief.range.store(packRange(middle, rangeEnd(range)), std::memory_order_release);
+                    ++thief.stats.steals;
+                    thief.stats.stolenTasks += rangeEnd(range) - middle;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    template <typename Task>
+    void runWorker(std::size_t workerIndex, Task& task) {
+        Worker& worker = *workers[workerIndex];
+        uint32_t index;
+        do {
+            while (takeTask(worker, index)) {
+                task((std::size_t)index, workerIndex);
+                ++worker.stats.executedTasks;
+            }
+        } while (steal(workerIndex));
+    }
+
+public:
+    explicit WorkStealingPool(std::size_t numberOfThreads) {
+        if (numberOfThreads == 0)
+            throw std::invalid_argument("A pool needs at least one thread");
+        for (std::size_t i = 0; i < numberOfThreads; ++i)
+            workers.emplace_back(new Worker());
+    }
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    /* Calls task(index, workerIndex) once for every index in [0, count), from the calling thread (worker 0) and getThreadCount() - 1
+        threads started for the run; returns once every task returned. Worker w starts with the w-th of getThreadCount() equal ranges of indices,
+        the first count % getThreadCount() ranges being one task longer.
+        task must not throw */
+    template <typename Task>
+    void run(std::size_t count, Task&& task) {
+        if (count > UINT32_MAX)
+            throw std::invalid_argument("Too many tasks for a run");
+        std::size_t numberOfWorkers = workers.size(), share = count / numberOfWorkers, longerShares = count % numberOfWorkers;
+        for (std::size_t i = 0, begin = 0; i < numberOfWorkers; ++i) {
+            std::size_t end = begin + share + (i < longerShares);
+            workers[i]->range.store(packRange((uint32_t)begin, (uint32_t)end), std::memory_order_relaxed);
+            workers[i]->stats = WorkerStats();
+            begin = end;
+        }
+
+        std::vector<std::thread> threads; // Started after every range is set (the thread start is a release)
+        for (std::size_t i = 1; i < numberOfWorkers; ++i)
+            threads.emplace_back([this, i, &task]() { runWorker(i, task); });
+        runWorker(0, task);
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+    // Getters; stats are those of the last run
+    inline std::size_t getThreadCount() const { return workers.size(); }
+    inline const WorkerStats& getWorkerStats(std::size_t workerIndex) const { return workers[workerIndex]->stats; }
+};
+
+#endif
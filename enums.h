@@ -3,20 +3,20 @@
 #include <cstdint> // For fixed-width integer types
 
 // Represents the side of an order (Bid or Ask)
-enum class OrderSide {
+enum class OrderSide : uint8_t {
     Bid = 0, // Buy order
     Ask = 1  // Sell order
 };
 
 // Represents the type of an order
-enum class OrderType {
+enum class OrderType : uint8_t {
     LimitOrder,  // Buy/Sell at a specific price or better
     MarketOrder, // Buy/Sell immediately at the best available price
     StopOrder    // Buy/Sell when the price reaches a specified stop price
 };
 
 // Represents the time-in-force for an order
-enum class TimeInForce {
+enum class TimeInForce : uint8_t {
     GTC, // Good Till Cancel: Order remains active until explicitly canceled
     DAY, // Day: Order expires at the end of the trading day
     IOC, // Immediate or Cancel: Order must be filled immediately or canceled
@@ -24,7 +24,7 @@ enum class TimeInForce {
 };
 
 // Represents the category of an order (Limit or Stop)
-enum class OrderCategory {
+enum class OrderCategory : uint8_t {
     Limit, // Order is a limit order
     Stop   // Order is a stop order
 };
\ No newline at end of file
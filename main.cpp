@@ -1,12 +1,95 @@
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 
 #include "Order.cpp"
 #include "Limit.cpp"
+#include "OrderIndex.cpp"
 #include "AvlTree.cpp"
 #include "OrderBook.cpp"
+#include "PriceLadder.cpp"
+#include "PriceLadderBook.cpp"
+#include "MatchingEngine.cpp"
 #include "OrderBookBenchmark.cpp"
+#include "LatencyBenchmark.cpp"
+#include "ReplayFile.cpp"
+#include "Journal.cpp"
+#include "PerfCounters.cpp"
+#include "MarketData.cpp"
+#include "ReplayDriver.cpp"
+#include "SnapshotFile.cpp"
+#include "Gateway.cpp"
+#include "GatewayDriver.cpp"
+#include "Backtester.cpp"
+#include "BacktestDriver.cpp"
+
+int main(int argc, char* argv[]){
+    // Per-operation latency percentiles, as CSV: ./lob latency [output.csv]
+    if (argc > 1 && std::strcmp(argv[1], "latency") == 0){
+        if (argc > 2){
+            std::ofstream out(argv[2]);
+            if (!out){
+                std::cerr << "Cannot open " << argv[2] << "\n";
+                return 1;
+            }
+            LatencyBenchmark::run_latency_benchmark(out);
+        }
+        else
+            LatencyBenchmark::run_latency_benchmark(std::cout);
+        return 0;
+    }
+
+    // Performance counters per operation & level change, as CSV: ./lob counters runs the latency profiles, ./lob counters <file> replays a session file
+    if (argc > 1 && std::strcmp(argv[1], "counters") == 0){
+        if (argc > 2)
+            return ReplayDriver::run_profiled_replay(argv[2], std::cout);
+        LatencyBenchmark::run_counter_benchmark(std::cout);
+        return 0;
+    }
+
+    // Session files: ./lob record <file> [messages] [instruments] writes the clustered workload,
+    // ./lob replay <file> [shards] replays a file (on a sharded MatchingEngine if shards is given) and prints its checksum
+    if (argc > 2 && std::strcmp(argv[1], "record") == 0)
+        return ReplayDriver::record_session(argv[2], argc > 3 ? std::atoi(argv[3]) : 10000000, argc > 4 ? std::atoi(argv[4]) : 1);
+    if (argc > 2 && std::strcmp(argv[1], "replay") == 0)
+        return (argc > 3) ? ReplayDriver::run_engine_replay(argv[2], std::atoi(argv[3])) : ReplayDriver::run_replay(argv[2]);
+
+    // Incremental L2 market data of a replayed session file: ./lob marketdata <file> [refresh interval, in messages]
+    if (argc > 2 && std::strcmp(argv[1], "marketdata") == 0)
+        return ReplayDriver::run_market_data_replay(argv[2], argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 10000);
+
+    // Write-ahead journal: ./lob journal <file> [messages] measures matching with & without journaling, ./lob recover <file> replays a journal
+    if (argc > 2 && std::strcmp(argv[1], "journal") == 0){
+        ReplayDriver::run_journal_benchmark(argv[2], argc > 3 ? std::atoi(argv[3]) : 1000000);
+        return 0;
+    }
+    if (argc > 2 && std::strcmp(argv[1], "recover") == 0)
+        return ReplayDriver::run_recovery(argv[2]);
+
+    // Warm restart from a snapshot file: ./lob snapshot <file> [orders]
+    if (argc > 2 && std::strcmp(argv[1], "snapshot") == 0){
+        OrderBookBenchmark::run_snapshot_benchmark(argv[2], argc > 3 ? std::atoi(argv[3]) : 5000000);
+        return 0;
+    }
+
+    // Order-entry gateway over loopback TCP: ./lob gateway [port] serves until interrupted,
+    // ./lob loadgen [port [connections messages/s messages]] measures its round trips (without a port, against a gateway started in-process)
+    if (argc > 1 && std::strcmp(argv[1], "gateway") == 0)
+        return GatewayDriver::run_gateway((uint16_t)(argc > 2 ? std::atoi(argv[2]) : 9000));
+    if (argc > 1 && std::strcmp(argv[1], "loadgen") == 0){
+        if (argc > 5)
+            return GatewayDriver::run_load_once((uint16_t)std::atoi(argv[2]), std::atoi(argv[3]), std::atoi(argv[4]), std::atoi(argv[5]));
+        return GatewayDriver::run_load_sweep((uint16_t)(argc > 2 ? std::atoi(argv[2]) : 0));
+    }
+
+    // Parallel backtests: ./lob sessions <directory> [sessions] [messages] writes sessions to replay,
+    // ./lob backtest <directory> [threads] replays every session of a directory against the example strategy (from 1 thread up to one per core without threads)
+    if (argc > 2 && std::strcmp(argv[1], "sessions") == 0)
+        return BacktestDriver::write_sessions(argv[2], argc > 3 ? std::atoi(argv[3]) : 64, argc > 4 ? std::atoi(argv[4]) : 200000);
+    if (argc > 2 && std::strcmp(argv[1], "backtest") == 0)
+        return BacktestDriver::run_backtest(argv[2], argc > 3 ? std::atoi(argv[3]) : 0);
 
-int main(){
     /*
     OrderBook myOrderBook = OrderBook();
     myOrderBook.addLimitOrder(1, OrderSide::Bid, 100, 1);
@@ -21,5 +104,45 @@ int main(){
     // Actual measurement
     OrderBookBenchmark::run_benchmark(1000000);
 
+    // Level insertion/deletion cost from 1k to 1M levels
+    for (int levels = 1000; levels <= 1000000; levels *= 10)
+        OrderBookBenchmark::run_level_benchmark(levels);
+
+    // AVL book vs price ladder book on prices clustered near the touch
+    OrderBookBenchmark::run_backend_benchmark(1000000);
+
+    // Top-N depth snapshots
+    OrderBookBenchmark::run_depth_benchmark(1000000);
+    OrderBookBenchmark::run_impact_benchmark(100000);
+
+    // Stop cascades over 100k resting stops
+    OrderBookBenchmark::run_stop_benchmark(100000);
+
+    // Deep levels: 1k & 10k orders per level
+    OrderBookBenchmark::run_deep_level_benchmark(100, 1000);
+    OrderBookBenchmark::run_deep_level_benchmark(20, 10000);
+
+    // Modifications in place & requeued, on single-order & deep levels
+    OrderBookBenchmark::run_amend_benchmark(100000, 1);
+    OrderBookBenchmark::run_amend_benchmark(1000, 100);
+
+    // Memory footprint & out-of-cache latency of a 10M order book
+    OrderBookBenchmark::run_memory_benchmark(10000000, 10000);
+
+    // End of session & disconnect: mass cancels vs one by one cancels, over 1M orders
+    OrderBookBenchmark::run_mass_cancel_benchmark(1000000, 100000);
+
+    // Execution reports: null listener vs ring buffer listener
+    OrderBookBenchmark::run_event_benchmark(1000000);
+
+    // Batched submission at batch sizes 1, 16, 256 & 4096
+    OrderBookBenchmark::run_batch_benchmark(1000000);
+
+    // Top of book published after each batch, read by 2 concurrent threads
+    OrderBookBenchmark::run_top_of_book_benchmark(1000000, 2);
+
+    // Multi-instrument engine, from 1 shard up to one shard per core
+    OrderBookBenchmark::run_engine_benchmark(1000, 4000);
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include <cstring>
+#include <iostream>
+
+#include "Order.cpp"
+#include "Limit.cpp"
+#include "OrderIndex.cpp"
+#include "AvlTree.cpp"
+#include "OrderBook.cpp"
+#include "PriceLadder.cpp"
+#include "PriceLadderBook.cpp"
+#include "Journal.cpp"
+#include "PerfCounters.cpp"
+#include "MarketData.cpp"
+#include "ReplayFile.cpp"
+#include "MatchingEngine.cpp"
+#include "OrderBookBenchmark.cpp"
+#include "ReplayDriver.cpp"
+#include "SnapshotFile.cpp"
+#include "Gateway.cpp"
+#include "OrderBookTests.cpp"
+#include "GatewayTests.cpp"
+#include "RecoveryTests.cpp"
+
+struct TestCase {
+    const char* name;
+    bool (*run)();
+};
+
+static const TestCase testCases[] = {
+    { "ladder_matches_avl_on_limit_workload", OrderBookTests::test_ladder_matches_avl_on_limit_workload },
+    { "ladder_matches_avl_with_amends_and_stops", OrderBookTests::test_ladder_matches_avl_with_amends_and_stops },
+    { "modify_requeues_without_matching", OrderBookTests::test_modify_requeues_without_matching },
+    { "ring_listener_waits_for_a_slow_consumer", OrderBookTests::test_ring_listener_waits_for_a_slow_consumer },
+    { "order_index_shrinks_only_drained_unreserved_tables", OrderBookTests::test_order_index_shrinks_only_drained_unreserved_tables },
+    { "stop_cascade_runs_after_every_trade", OrderBookTests::test_stop_cascade_runs_after_every_trade },
+    { "duplicate_adds_are_cancelled_untraded", OrderBookTests::test_duplicate_adds_are_cancelled_untraded },
+    { "ioc_and_fok_orders", OrderBookTests::test_ioc_and_fok_orders },
+    { "impact_estimates_match_a_walk_of_the_levels", OrderBookTests::test_impact_estimates_match_a_walk_of_the_levels },
+    { "mass_cancels_keep_the_trees_valid", OrderBookTests::test_mass_cancels_keep_the_trees_valid },
+    { "commands_of_the_other_category_are_ignored", OrderBookTests::test_commands_of_the_other_category_are_ignored },
+    { "top_of_book_reads_are_never_torn", OrderBookTests::test_top_of_book_reads_are_never_torn },
+    { "gateway_flood_is_not_stalled", GatewayTests::test_gateway_flood_is_not_stalled },
+    { "gateway_refuses_the_other_order_type", GatewayTests::test_gateway_refuses_the_other_order_type },
+    { "gateway_rejects_refused_commands", GatewayTests::test_gateway_rejects_refused_commands },
+    { "gateway_frees_the_ids_of_filled_stops", GatewayTests::test_gateway_frees_the_ids_of_filled_stops },
+    { "snapshot_load_keeps_the_book", RecoveryTests::test_snapshot_load_keeps_the_book },
+    { "snapshot_keeps_queues_across_chunks", RecoveryTests::test_snapshot_keeps_queues_across_chunks },
+    { "journal_replays_to_the_live_book", RecoveryTests::test_journal_replays_to_the_live_book },
+    { "journal_recovers_mass_cancels", RecoveryTests::test_journal_recovers_mass_cancels },
+    { "journal_reports_failed_writes", RecoveryTests::test_journal_reports_failed_writes },
+    { "market_data_decodes_to_the_book_depth", RecoveryTests::test_market_data_decodes_to_the_book_depth },
+};
+
+// ./lob_tests [name]: runs every test, or the ones whose name contains name; exits with 1 if any failed
+int main(int argc, char* argv[]){
+    int run = 0, failed = 0;
+    for (const TestCase& testCase : testCases){
+        if (argc > 1 && std::strstr(testCase.name, argv[1]) == nullptr)
+            continue;
+        bool passed = testCase.run();
+        std::cout << (passed ? "PASS " : "FAIL ") << testCase.name << std::endl;
+        ++run;
+        failed += !passed;
+    }
+    std::cout << run - failed << " of " << run << " tests passed" << std::endl;
+    return failed ? 1 : 0;
+}